@@ -78,8 +78,79 @@
         MPE is running if enabled, and to allow MPE to access caller's line no. V3.1 (BG)
 [2-Feb-17] Fix problem of long names failing MPE_Log_pack, causing Jumpshot to crash
         when object is rt-clicked. V3.1 (BG)
+[17-Oct-26] Split ParseFormatString into compile and bind steps, and cache compiled
+        formats per process so that repeated reads/writes with the same format only
+        bind their args. Level 2 signatures are also cached when they don't depend on
+        the args. Fix reduce op parsing that looked for '/' beyond the current term.
+        V3.3 (JC)
+[17-Oct-26] Add -pimsg=c option to coalesce the items of a point-to-point read/write
+        into one packed message. V3.3 (JC)
+[17-Oct-26] Level 2 signature rides with the first item's message instead of being
+        sent by itself; PI_Broadcast folds it into its first MPI_Bcast, and the other
+        collectives overlap it with the data using MPI_Ibcast. V3.3 (JC)
+[17-Oct-26] On channels, ^ and %s no longer send a separate length message: PI_Read
+        sizes the array from the data message with MPI_Mprobe/MPI_Get_count and
+        receives it with MPI_Mrecv. V3.3 (JC)
+[17-Oct-26] Add PI_ReleaseBuffer to recycle ^ and %s read arrays through a small pool,
+        and the ~ flag to read into a caller-supplied buffer that only grows. V3.3 (JC)
+[17-Oct-26] Add strided arrays "%N:S:Bt" (e.g., matrix columns and tiles), compiled
+        once into an MPI vector type owned by the cached format. V3.3 (JC)
+[17-Oct-26] Support arrays of more than INT_MAX elements: counts are long long in the
+        format layer, "z" prefix for size_t lengths, and big counts are wrapped
+        into derived types (reductions are chunked instead). V3.3 (JC)
+[17-Oct-26] Add "%{...}" record specifier for C structs, compiled into a shared MPI
+        struct datatype with C layout, and included in the signature. V3.3 (JC)
+[17-Oct-26] Add PI_WriteItems/PI_ReadItems taking pre-parsed PI_ITEMs, the entry point
+        for the C++17 binding in pilot.hpp; write/read bodies moved into WriteArgs
+        and ReadArgs, shared by both. V3.3 (JC)
+[17-Oct-26] Add PI_SetChannelFormat for typed channels: format compiled at config time
+        and owned by the channel, checked across processes once by PI_StartAll,
+        so point-to-point reads/writes skip the lookup and the signature. V3.3 (JC)
+[17-Oct-26] Add PI_IWrite with PI_Wait/PI_Test/PI_WaitAll: items copied into a PI_REQUEST
+        handle and sent with MPI_Isend (MPI_Issend under deadlock detection). V3.3 (JC)
+[17-Oct-26] Add PI_IRead: receives posted up to the first ^ item, the rest deferred to
+        PI_Wait/PI_Test via ReadArgs' new start index, queued per channel. PI_Wait
+        now logs each item, so the deadlock detector pairs them. V3.3 (JC)
+[17-Oct-26] Add PI_BindWrite/PI_BindRead/PI_Start/PI_Unbind: persistent MPI requests
+        (MPI_Send_init/MPI_Recv_init) on fixed-shape items, reused by each PI_Start.
+        V3.3 (JC)
+[17-Oct-26] Add PI_SetChannelMode: senders are tables indexed by the channel's send mode
+        (standard/sync/ready/buffered); buffered is WriteBehind, Isend of a packed copy
+        from a bounded pool drained at PI_StopMain. V3.3 (JC)
+[17-Oct-26] Add PI_SEND_AGGREGATE mode and PI_Flush: writes packed onto the channel's
+        buffer, sent in batches, and unpacked one by one by ReadArgs. V3.3 (JC)
+[17-Oct-26] Add PI_SEND_SHARED mode: co-located ends share an SPSC ring in an MPI
+        shared-memory window set up by PI_StartAll; otherwise plain MPI. V3.3 (JC)
+[17-Oct-26] Items of PI_PULL_BYTES or more on a ring are pulled by the reader with
+        process_vm_readv, falling back to copying them through the ring. V3.3 (JC)
+[17-Oct-26] Add PI_SEND_RMA mode: writes are put into a ring in the consumer's part
+        of an MPI window, with head and tail updated by RMA atomics. V3.3 (JC)
+[17-Oct-26] Add PI_WriteStream/PI_ReadStream: an array as a header then segments,
+        with PI_STREAM_DEPTH Isends/Irecvs in flight. V3.3 (JC)
+[17-Oct-26] Add PI_WriteMulti/PI_ReadMulti: one item list for many channels, every
+        channel's write or read started (StartWrite/StartRead) before any is
+        waited for, and reads finished in arrival order by MPI_Waitsome. V3.3 (JC)
+[17-Oct-26] Selector bundles map a probed message's source to its channel with a
+        rank=>index table. Add PI_SetSelectPolicy for round-robin or least
+        recently selected choice among ready channels (FairSelect). V3.3 (JC)
+[17-Oct-26] Add PI_SelectAll/PI_TrySelectAll, which list every channel of a
+        selector with data in one pass (ReadySet), and PI_ReadReady to read
+        from the listed channels in one call. V3.3 (JC)
+[17-Oct-26] Add PI_SelectRead, which matches a selector's next message with
+        MPI_Mprobe and receives that very message. ReadArgs takes a channel's
+        next message via MatchNext/RecvNext. V3.3 (JC)
+[17-Oct-26] Add PI_SetSelectFormat: a selector's channels carry one packed message
+        of a fixed-size format per write, and the reader keeps an MPI_Irecv
+        posted for each channel, selecting with MPI_Waitany/MPI_Testany. V3.3 (JC)
+[17-Oct-26] Add PI_SelectTimeout and PI_ReadTimeout, which poll with spin-then-
+        sleep backoff, and -piwait=S,M to make blocking reads and selects
+        wait that way too. V3.3 (JC)
 *******************************************************************************/
 
+#ifdef __linux__
+#define _GNU_SOURCE		// for process_vm_readv
+#endif
+
 #include "pilot_private.h"	// include these typedefs first
 
 #define PI_NO_OPAQUE		// suppress typedefs in public pilot.h
@@ -98,7 +169,14 @@
 #include <stdarg.h>
 #include <ctype.h>
 #include <stdint.h>
+#include <limits.h>
+#include <stddef.h>	// for offsetof
 #include <unistd.h>  //for usleep()
+#include <sched.h>	// for sched_yield()
+#ifdef __linux__
+#include <sys/uio.h>	// for process_vm_readv()
+#include <sys/stat.h>	// for stat() of the PID namespace
+#endif
 
 #ifdef PILOT_WITH_MPE
 #include <mpe.h>
@@ -118,6 +196,7 @@
  * Make a typedef to the new signature so we can cast the old one.
  */
 typedef int (MPI_Send_func)(const void*, int, MPI_Datatype, int, int, MPI_Comm);
+typedef int (MPI_Isend_func)(const void*, int, MPI_Datatype, int, int, MPI_Comm, MPI_Request*);
 
 /*** Pilot global variables ***/
 
@@ -154,7 +233,101 @@ static char *ParseArgs( int *argc, char ***argv );
 static int OnlineProcessFunc( int a1, void *a2 );
 static const char *interpArg( char *dest, int maxlen, const char *code, const PI_MPI_RTTI *arg );
 static uint32_t FormatSignature( PI_MPI_RTTI meta[], int items );
-static int ParseFormatString( IO_CONTEXT valsOrLocs, PI_MPI_RTTI meta[], const char *fmt, va_list ap );
+static uint32_t GetSignature( PI_FORMAT *f, PI_MPI_RTTI meta[], int items );
+static int ParseFormatString( IO_CONTEXT valsOrLocs, PI_MPI_RTTI meta[], PI_FORMAT **compiled,
+                              const char *fmt, va_list ap );
+static int ItemSpec( PI_ITEMTYPE type, PI_FORMAT_TERM *t );
+static int BindItems( IO_CONTEXT valsOrLocs, PI_MPI_RTTI meta[], const PI_ITEM items[], int n );
+static int BindMulti( PI_MPI_RTTI mpiArgs[], PI_FORMAT **compiled, MPI_Aint stride[],
+                      const char *format, va_list ap );
+static int CheckMulti( PI_CHANNEL *const c[], int n, int reading, const char *format );
+static void LogMulti( const char *code, PI_CHANNEL *const c[], int n, const char *format,
+                      const PI_MPI_RTTI mpiArgs[], int mpiArgCount, const MPI_Aint stride[] );
+static void WriteArgs( PI_CHANNEL *c, const char *format, PI_FORMAT *compiled,
+                       PI_MPI_RTTI mpiArgs[], int mpiArgCount );
+static void ReadArgs( PI_CHANNEL *c, const char *format, PI_FORMAT *compiled,
+                      PI_MPI_RTTI mpiArgs[], int mpiArgCount, int start );
+static void FreeFormatCache( void );
+static void CompileFormat( const char *fmt, PI_FORMAT *f );
+static int SameFormat( const PI_FORMAT *f, const char *format );
+static void FreeChannelFormat( PI_CHANNEL *c );
+static int CheckChannelFormats( void );
+static void FreeRecords( void );
+static void *StageBuffer( int size );
+static MPI_Datatype SigDatatype( PI_SIGTYPE *cache, int *sig, const PI_MPI_RTTI *arg );
+static void FreeSigDatatype( PI_SIGTYPE *cache, MPI_Datatype *type );
+static PI_SIGTYPE *SigCache( PI_FORMAT *f );
+static int RecvSignedItem( PI_SIGTYPE *cache, PI_MPI_RTTI *arg, int sig, PI_CHANNEL *c,
+                           PI_BUNDLE *b );
+static void MatchNext( PI_CHANNEL *c, PI_PROBED *msg, MPI_Status *status );
+static void RecvNext( PI_CHANNEL *c, void *buf, int count, MPI_Datatype type, PI_PROBED *msg );
+static void StartSigBcast( int *sig, MPI_Comm comm, MPI_Request *req );
+static long long ProbeArrayLen( PI_CHANNEL *c, const PI_MPI_RTTI *arg, int signFirst, PI_PROBED *msg );
+static void *PoolAlloc( size_t size );
+static void FreePool( void );
+static int RecvProbed( PI_CHANNEL *c, const PI_MPI_RTTI *arg, void *buf, int count,
+                       const int *sig, PI_SIGTYPE *cache, PI_PROBED *msg );
+static void WrapCount( PI_MPI_RTTI *arg, long long n, int force );
+static void FreeBigTypes( void );
+static int StoreLength( const PI_MPI_RTTI *arg, long long len );
+static PI_REQUEST *NewRequest( PI_CHANNEL *c, int reading, const PI_MPI_RTTI mpiArgs[],
+                               int mpiArgCount );
+static PI_REQUEST *StartWrite( PI_CHANNEL *c, const char *format, PI_FORMAT *compiled,
+                               PI_MPI_RTTI mpiArgs[], int mpiArgCount, const char *code );
+static PI_REQUEST *StartRead( PI_CHANNEL *c, const char *format, PI_FORMAT *compiled,
+                              PI_MPI_RTTI mpiArgs[], int mpiArgCount, const char *code );
+static int PackedSize( const PI_MPI_RTTI mpiArgs[], int mpiArgCount, int signFirst );
+static PI_REQUEST *BindChannel( PI_CHANNEL *c, int reading, const char *format, va_list ap );
+static int PackArgs( PI_REQUEST *r );
+static int CompleteRequest( PI_REQUEST *r, int block );
+static int WaitPosted( PI_REQUEST *r );
+static int FinishDeferred( PI_REQUEST *r, int block );
+static void FreeRequest( PI_REQUEST **req );
+static void ReduceItem( void *sendbuf, void *recvbuf, const PI_MPI_RTTI *arg, MPI_Comm comm );
+static int WriteBehind( const void *buf, int count, MPI_Datatype type, int dest, int tag,
+                        MPI_Comm comm );
+static int RetireWriteBehind( int block );
+static void *AggBuffer( PI_CHANNEL *c, int size );
+static void FlushChannel( PI_CHANNEL *c );
+static void FlushAggregated( void );
+static int ChannelReady( PI_CHANNEL *c );
+static int FairSelect( PI_BUNDLE *b, int block );
+static int ReadySet( PI_BUNDLE *b, int ready[], int block );
+static void AwaitSelect( PI_BUNDLE *b, int rings, PI_WAITER *w );
+static int SelectReady( PI_BUNDLE *b );
+static void WaitBegin( PI_WAITER *w, double timeout );
+static int WaitPause( PI_WAITER *w );
+static int PollChannel( PI_CHANNEL *c, double timeout );
+static int PollSelect( PI_BUNDLE *b, double timeout );
+static void SetupPosted( void );
+static void FreePosted( void );
+static int PostedLanded( PI_BUNDLE *b, int i, int block );
+static int PostedAny( PI_BUNDLE *b, int block );
+static int PostedSelect( PI_BUNDLE *b, int block );
+static void Repost( PI_BUNDLE *b, int i );
+static int TypeChannel( PI_CHANNEL *c, const char *format );
+static int UnprobedData( PI_BUNDLE *b, int *rings );
+static int RingHasData( PI_CHANNEL *c );
+static void SetupRma( void );
+static uint64_t RmaLoad( int rank, MPI_Aint disp );
+static void RmaStore( int rank, MPI_Aint disp, uint64_t value );
+static void RmaCopyIn( PI_CHANNEL *c, const char *src, size_t n );
+static void RmaCopyOut( PI_CHANNEL *c, char *dest, size_t n );
+static void FreeRma( void );
+static void RmaPublish( PI_CHANNEL *c );
+static void HandleWinErrors( MPI_Win win );
+static void RmaPut( PI_CHANNEL *c, const void *buf, int len );
+static int RmaGet( PI_CHANNEL *c );
+static void SetupRings( void );
+static void FreeRings( void );
+static void RingWait( int *spins );
+static void RingCopyIn( PI_RING *r, const char *src, size_t n );
+static void RingCopyOut( PI_RING *r, char *dest, size_t n );
+static void RingPut( PI_RING *r, const void *buf, int len );
+static int RingGet( PI_RING *r );
+static size_t PullBytes( int count, MPI_Datatype type );
+static void RingPush( PI_RING *r, int pull, const void *buf, size_t bytes );
+static void RingPull( PI_RING *r, void *dest, char *packBuf, int packedLen, int *packed );
 
 /*** Pointer validation function ***/
 static int CheckPointer( void *ptr );
@@ -182,7 +355,30 @@ static PI_PROCENVT thisproc = { .phase=PREINIT };
 static int MPICallLine;	/*!< line number of last MPI library call (PI_CALLMPI macro) */
 static int MPIMaxTag;	/*!< max tag number allowed by this MPI implementation */
 static int MPIPreInit;	/*!< non-0 if MPI already initialized when Pilot invoked */
-static MPI_Send_func *MPISender;	/*!< function used for PI_Write */
+static MPI_Send_func *MPISender[PI_SEND_MODES];	/*!< function used for PI_Write, by send mode */
+static MPI_Isend_func *MPIISender[PI_SEND_MODES];	/*!< function used for PI_IWrite, by send mode */
+static MPI_Isend_func *MPIPSender[PI_SEND_MODES];	/*!< function used for PI_BindWrite, by send mode */
+static PI_WBMSG WBMsgs[PI_WB_MESSAGES];	/*!< write-behind sends in flight, ring */
+static int WBFirst;		/*!< oldest entry in WBMsgs */
+static int WBCount;		/*!< number of entries in WBMsgs */
+static int WBBytes;		/*!< bytes held by entries in WBMsgs */
+static int AggPending;		/*!< aggregating channels with writes not yet sent */
+static int AggUnread;		/*!< aggregating channels with writes left in their batch */
+static MPI_Comm NodeComm = MPI_COMM_NULL;	/*!< processes on this node, if rings are used */
+static MPI_Win RingWin = MPI_WIN_NULL;	/*!< shared memory holding the rings */
+static MPI_Win RmaWin = MPI_WIN_NULL;	/*!< buffers of PI_SEND_RMA channels */
+static int RingsActive;		/*!< true if any channel this process reads has a ring or RMA buffer */
+static char *StageBuf;		/*!< staging buffer for packed messages */
+static int StageLen;		/*!< current size of StageBuf */
+static PI_POOLBUF PoolFree[PI_POOL_FREE];	/*!< released buffers for ^ and %s reads */
+static int PoolFreeCount;	/*!< number of buffers in PoolFree */
+static PI_POOLBUF PoolLent[PI_POOL_LENT];	/*!< recent buffers handed out, ring */
+static int PoolLentNext;	/*!< next slot to use in PoolLent */
+static struct {
+    MPI_Datatype base, type;
+    long long n;
+} BigTypes[PI_MAX_FORMATLEN];	/*!< recent types built by WrapCount, ring */
+static int BigTypesNext;	/*!< next slot to use in BigTypes */
 
 /* Command-line options:
 These variables are only meaningful on node 0 (and we assume that only
@@ -192,8 +388,10 @@ during PI_ API calls.  These variables are not used after PI_Configure.
 */
 static char *LogFilename;	/*!< Path to log file. NULL = no log file needed. */
 static enum {OLP_NONE, OLP_PILOT} OnlineProcess;
-enum {OPT_CALLS=0, OPT_DEADLOCK, OPT_JUMPSHOT, OPT_STATS, OPT_TOPO, OPT_TRACE, OPT_END};
+enum {OPT_CALLS=0, OPT_DEADLOCK, OPT_JUMPSHOT, OPT_STATS, OPT_TOPO, OPT_TRACE,
+      OPT_COALESCE, OPT_WAIT, OPT_END};
 static Flag_t Option[OPT_END];	/*!< List of command-line options. 1/0 = flag set/clear */
+static int WaitParams[2] = { PI_WAIT_SPIN, PI_WAIT_SLEEP };	/*!< -piwait spin, max. sleep (usec.) */
 
 
 /*** Public API; each PI_Foo_ is called via PI_Foo wrapper macro ***/
@@ -302,6 +500,10 @@ int PI_Configure_( int *argc, char ***argv )
         /* services needing an online process/thread */
         thisproc.svc_flag[OLP_DEADLOCK] = Option[OPT_DEADLOCK];
 
+        /* message transport options */
+        thisproc.svc_flag[MSG_COALESCE] = Option[OPT_COALESCE];
+        thisproc.svc_flag[WAIT_POLL] = Option[OPT_WAIT];
+
         /* Here's the overall explanation on logging logic:
            - Logging is disabled by default.  The user may want to put PI_Log() calls in their
              code but have them essentially be no-ops unless logging is enabled at run time.
@@ -343,10 +545,7 @@ int PI_Configure_( int *argc, char ***argv )
             OnlineProcess = OLP_PILOT;
             thisproc.svc_flag[OLP_RANK] = 1;
         }
-        /*else {
-            OnlineProcess = OLP_NONE;
-            thisproc.svc_flag[OLP_RANK] = 0;
-        }*/
+        else thisproc.svc_flag[OLP_RANK] = 0;	// may be left from an earlier configuration
 
         /* TESTING: print summary of args
                 for ( i=0; i<OPT_END; i++) printf( " %d", Option[i] );
@@ -372,6 +571,8 @@ int PI_Configure_( int *argc, char ***argv )
             if ( Option[OPT_TOPO] ) printf( " Topology_log" );      // future
             if ( Option[OPT_TRACE] ) printf( " CSP_traces_log" );  // future
             if ( Option[OPT_DEADLOCK] ) printf( " Deadlock_detection" );
+            if ( Option[OPT_COALESCE] ) printf( " Coalesced_messages" );
+            if ( Option[OPT_WAIT] ) printf( " Polled_waits(%d,%d)", WaitParams[0], WaitParams[1] );
             printf( "\n" );
             if ( LogFilename )
                 printf( PI_BORDER "*** Logging to file: %s\n", LogFilename );
@@ -393,6 +594,7 @@ int PI_Configure_( int *argc, char ***argv )
 
     PI_CALLMPI( MPI_Bcast( thisproc.svc_flag, SVC_END, MPI_UNSIGNED_CHAR, PI_MAIN,
                            PI_CommWorld ) )
+    PI_CALLMPI( MPI_Bcast( WaitParams, 2, MPI_INT, PI_MAIN, PI_CommWorld ) )
 
     /* initialize table of processes */
     thisproc.processes =
@@ -427,13 +629,47 @@ int PI_Configure_( int *argc, char ***argv )
     /* create a place holder for rank 0 and set name */
     PI_SetName( PI_CreateProcess_( NULL, 0, NULL, 0 ), "main" );
 
-    /* Determine which MPI function will do PI_Write; default is MPI_Send,
-       which is often buffered, but could be unbuffered in some circumstances.
-       Deadlock detection can't live with that uncertainty, so use MPI_Ssend
-       if it's enabled, which will act unbuffered and unf'ly add overhead.
+    /* Determine which MPI function will do PI_Write for each channel send
+       mode; default is MPI_Send, which is often buffered, but could be
+       unbuffered in some circumstances.  Deadlock detection can't live with
+       that uncertainty, so use MPI_Ssend for every mode if it's enabled, which
+       will act unbuffered and unf'ly add overhead.
     */
-    if ( Option[OPT_DEADLOCK] ) MPISender = (MPI_Send_func *)MPI_Ssend;
-    else MPISender = (MPI_Send_func *)MPI_Send;
+    if ( Option[OPT_DEADLOCK] ) {
+        for ( i = 0; i < PI_SEND_MODES; i++ ) {
+            MPISender[i] = (MPI_Send_func *)MPI_Ssend;
+            MPIISender[i] = (MPI_Isend_func *)MPI_Issend;
+            MPIPSender[i] = (MPI_Isend_func *)MPI_Ssend_init;
+        }
+    }
+    else {
+        MPISender[PI_SEND_STANDARD] = (MPI_Send_func *)MPI_Send;
+        MPISender[PI_SEND_SYNC] = (MPI_Send_func *)MPI_Ssend;
+        MPISender[PI_SEND_READY] = (MPI_Send_func *)MPI_Rsend;
+        MPISender[PI_SEND_BUFFERED] = WriteBehind;
+        MPISender[PI_SEND_AGGREGATE] = (MPI_Send_func *)MPI_Send;	// once per batch
+        MPISender[PI_SEND_SHARED] = (MPI_Send_func *)MPI_Send;	// if not on one node
+        MPISender[PI_SEND_RMA] = (MPI_Send_func *)MPI_Send;	// not used
+
+        /* already nonblocking, so buffering would only add a copy */
+        MPIISender[PI_SEND_STANDARD] = (MPI_Isend_func *)MPI_Isend;
+        MPIISender[PI_SEND_SYNC] = (MPI_Isend_func *)MPI_Issend;
+        MPIISender[PI_SEND_READY] = (MPI_Isend_func *)MPI_Irsend;
+        MPIISender[PI_SEND_BUFFERED] = (MPI_Isend_func *)MPI_Isend;
+        MPIISender[PI_SEND_AGGREGATE] = (MPI_Isend_func *)MPI_Isend;	// not used
+        MPIISender[PI_SEND_SHARED] = (MPI_Isend_func *)MPI_Isend;	// not used
+        MPIISender[PI_SEND_RMA] = (MPI_Isend_func *)MPI_Isend;	// not used
+
+        MPIPSender[PI_SEND_STANDARD] = (MPI_Isend_func *)MPI_Send_init;
+        MPIPSender[PI_SEND_SYNC] = (MPI_Isend_func *)MPI_Ssend_init;
+        MPIPSender[PI_SEND_READY] = (MPI_Isend_func *)MPI_Rsend_init;
+        MPIPSender[PI_SEND_BUFFERED] = (MPI_Isend_func *)MPI_Send_init;
+        MPIPSender[PI_SEND_AGGREGATE] = (MPI_Isend_func *)MPI_Send_init;	// not used
+        MPIPSender[PI_SEND_SHARED] = (MPI_Isend_func *)MPI_Send_init;	// not used
+        MPIPSender[PI_SEND_RMA] = (MPI_Isend_func *)MPI_Send_init;	// not used
+    }
+    WBFirst = WBCount = WBBytes = 0;
+    AggPending = AggUnread = 0;
 
     /* If we need to start an online process, create it now, so it gets
        rank 1; this will abort if there aren't at least 2 MPI processes
@@ -731,6 +967,17 @@ PI_CHANNEL *PI_CreateChannel_( PI_PROCESS *from, PI_PROCESS *to )
               "C%d", pc->chan_id ); 	// default name "Cn"
 
     pc->bundle = NULL;		/* initially not part of bundle */
+    pc->format = NULL;		/* and not typed */
+    pc->deferHead = pc->deferTail = NULL;
+    pc->postSel = NULL;
+    pc->matched = 0;
+    pc->sendmode = PI_SEND_STANDARD;
+    pc->aggBuf = NULL;
+    pc->aggSize = pc->aggPos = pc->aggLen = 0;
+    pc->ring = NULL;		/* until PI_StartAll */
+    pc->rma = NULL;
+    pc->rmaDisp = -1;
+    pc->rmaHead = pc->rmaTail = 0;
     pc->magic = PI_CHAN;
 
     return pc;
@@ -809,9 +1056,24 @@ PI_BUNDLE *PI_CreateBundle_( enum PI_BUNUSE usage, PI_CHANNEL *const array[], in
     }
 
     b->narrow_end = (usage==PI_BROADCAST || usage==PI_SCATTER) ? FROM : TO;
+    b->index = b->order = NULL;
+    b->policy = PI_SELECT_ANY;
+    b->next = 0;
+    b->postSize = b->landed = 0;
+    b->postBuf = NULL;
+    b->postReqs = NULL;
+    b->postLen = NULL;
 
     if ( usage == PI_SELECT ) {
         b->comm = PI_CommWorld;
+
+        /* so a probed message's source leads straight to its channel */
+        b->index = malloc( sizeof( int ) * thisproc.worldsize );
+        PI_ASSERT( , b->index, PI_MALLOC_ERROR )
+        for ( i = 0; i < thisproc.worldsize; i++ )
+            b->index[i] = -1;
+        for ( i = 0; i < size; i++ )
+            b->index[ array[i]->producer ] = i;
     } else {
         /* create the communicator */
         MPI_Group world, group;
@@ -937,6 +1199,121 @@ void PI_SetName_( void *object, const char *name )
         strcpy( nameField, "" );	// use empty string if NULL
 }
 
+void PI_SetChannelFormat_( PI_CHANNEL *c, const char *format )
+{
+    /* Like SetName, this is only allowed in the Config phase, so that every
+       process binds the same format to the channel.
+    */
+    PI_ON_ERROR_RETURN()
+    PI_ASSERT( , thisproc.phase==CONFIG, PI_WRONG_PHASE )
+    PI_ASSERT( , c, PI_NULL_CHANNEL )
+    PI_ASSERT( LEVEL(1), ISVALID(PI_CHAN,c), PI_INVALID_OBJ )
+    PI_ASSERT( , c->postSel==NULL, PI_BUNDLE_USAGE )	// has its selector's format
+
+    TypeChannel( c, format );
+}
+
+/*!
+********************************************************************************
+Gives a channel its format, for PI_SetChannelFormat and PI_SetSelectFormat.
+
+\param c Channel.
+\param format Format string, or NULL to make the channel untyped.
+\return 1 if successful, 0 if not (only with PI_OnErrorReturn).
+*******************************************************************************/
+static int TypeChannel( PI_CHANNEL *c, const char *format )
+{
+    PI_ON_ERROR_RETURN( 0 )
+
+    FreeChannelFormat( c );
+    if ( format == NULL ) return 1;	// channel is untyped again
+
+    PI_FORMAT *f = malloc( sizeof( PI_FORMAT ) );
+    PI_ASSERT( , f, PI_MALLOC_ERROR )
+    CompileFormat( format, f );
+    f->key = format;
+    f->text = strdup( format );
+    c->format = f;		// so FreeChannelFormat can clean up after an error
+    PI_ASSERT( , f->text, PI_MALLOC_ERROR )
+
+    /* report a malformed format now, rather than at every read/write */
+    PI_ASSERT( , f->error == PI_NO_ERROR, f->error )
+    PI_ASSERT( , f->term[ f->terms-1 ].error == PI_NO_ERROR, f->term[ f->terms-1 ].error )
+    return 1;
+}
+
+void PI_SetChannelMode_( PI_CHANNEL *c, enum PI_SENDMODE mode )
+{
+    /* Like PI_SetChannelFormat, only allowed in the Config phase, so that
+       both ends agree, which PI_SEND_READY depends on.
+    */
+    PI_ON_ERROR_RETURN()
+    PI_ASSERT( , thisproc.phase==CONFIG, PI_WRONG_PHASE )
+    PI_ASSERT( , c, PI_NULL_CHANNEL )
+    PI_ASSERT( LEVEL(1), ISVALID(PI_CHAN,c), PI_INVALID_OBJ )
+    PI_ASSERT( , mode >= PI_SEND_STANDARD && mode < PI_SEND_MODES, PI_SEND_MODE )
+    PI_ASSERT( , c->postSel==NULL || mode < PI_SEND_AGGREGATE, PI_SEND_MODE )	// see PI_SetSelectFormat
+
+    c->sendmode = mode;
+}
+
+void PI_SetSelectPolicy_( PI_BUNDLE *b, enum PI_SELECTPOLICY policy )
+{
+    PI_ON_ERROR_RETURN()
+    PI_ASSERT( , thisproc.phase==CONFIG, PI_WRONG_PHASE )
+    PI_ASSERT( , b, PI_NULL_BUNDLE )
+    PI_ASSERT( LEVEL(1), ISVALID(PI_BUND,b), PI_INVALID_OBJ )
+    PI_ASSERT( , b->usage==PI_SELECT, PI_BUNDLE_USAGE )
+    PI_ASSERT( , policy >= PI_SELECT_ANY && policy <= PI_SELECT_LEAST_RECENT, PI_INVALID_ARG )
+
+    int i;
+    if ( policy == PI_SELECT_LEAST_RECENT && b->order == NULL ) {
+        b->order = malloc( sizeof( int ) * b->size );
+        PI_ASSERT( , b->order, PI_MALLOC_ERROR )
+        for ( i = 0; i < b->size; i++ )
+            b->order[i] = i;
+    }
+    b->policy = policy;
+}
+
+void PI_SetSelectFormat_( PI_BUNDLE *b, const char *format )
+{
+    PI_ON_ERROR_RETURN()
+    PI_ASSERT( , thisproc.phase==CONFIG, PI_WRONG_PHASE )
+    PI_ASSERT( , b, PI_NULL_BUNDLE )
+    PI_ASSERT( LEVEL(1), ISVALID(PI_BUND,b), PI_INVALID_OBJ )
+    PI_ASSERT( , b->usage==PI_SELECT, PI_BUNDLE_USAGE )
+    PI_ASSERT( , format, PI_NULL_FORMAT )
+
+    int i, part, size;
+    for ( i = 0; i < b->size; i++ ) {
+        PI_ASSERT( , b->channels[i]->sendmode < PI_SEND_AGGREGATE, PI_SEND_MODE )
+        if ( !TypeChannel( b->channels[i], format ) ) return;	// func. detected error with PI_OnErrorReturn
+    }
+
+    /* A pre-posted receive must hold any message, so every item's size is
+     * fixed by the format alone: no ^ or %s, %* or %m, and nothing to reduce.
+     * The signature is allowed for, though a typed channel sends none.
+     */
+    PI_FORMAT *f = b->channels[0]->format;
+    PI_CALLMPI( MPI_Pack_size( 1, MPI_INT, PI_CommWorld, &size ) )
+    for ( i = 0; i < f->terms; i++ ) {
+        PI_FORMAT_TERM *t = &f->term[i];
+        PI_ASSERT( , t->countKind==COUNT_NONE || t->countKind==COUNT_FIXED, PI_FORMAT_INVALID )
+        PI_ASSERT( , t->type!=MPI_DATATYPE_NULL && !t->callerBuf, PI_FORMAT_INVALID )
+        PI_ASSERT( , t->op==MPI_OP_NULL && !t->opArg, PI_OP_INVALID )
+        PI_ASSERT( , t->count <= INT_MAX, PI_ARRAY_LENGTH )
+        PI_CALLMPI( MPI_Pack_size( t->countKind==COUNT_FIXED ? (int)t->count : 1, t->type,
+                                   PI_CommWorld, &part ) )
+        PI_ASSERT( , part <= INT_MAX - size, PI_ARRAY_LENGTH )
+        size += part;
+    }
+
+    b->postSize = size;
+    for ( i = 0; i < b->size; i++ )
+        b->channels[i]->postSel = b;
+}
+
 int PI_StartAll_( void )
 {
     PI_ON_ERROR_RETURN( 0 )
@@ -944,6 +1321,18 @@ int PI_StartAll_( void )
 
     thisproc.phase = RUNNING;
 
+    /* At level 2, confirm once that all processes gave the same channels the
+       same formats, since typed channels skip the per-call signature */
+    if ( PI_CheckLevel >= 2 )
+        PI_ASSERT( , CheckChannelFormats(), PI_FORMAT_MISMATCH )
+
+    /* Co-located ends of PI_SEND_SHARED channels get their rings */
+    SetupRings();
+    SetupRma();
+
+    /* Readers of PI_SetSelectFormat selectors post their receives */
+    SetupPosted();
+
 #ifdef PILOT_WITH_MPE
     if ( thisproc.svc_flag[LOG_MPE] ) {
         bytebuf_pos = 0;
@@ -1126,10 +1515,10 @@ void PI_Write_( PI_CHANNEL *c, const char *format, ... )
     PI_ASSERT( LEVEL(1), ISVALID(PI_CHAN,c), PI_INVALID_OBJ )
     PI_ASSERT( , c->producer==thisproc.rank, PI_ENDPOINT_WRITER )
 
-    int i;
     va_list argptr;
     int mpiArgCount;
     PI_MPI_RTTI mpiArgs[ PI_MAX_FORMATLEN ];
+    PI_FORMAT *compiled = c->format;	// typed channel's format, else NULL
 
     PI_BUNDLE *b = c->bundle;	// collective bundle associated with channel
     if ( b ) {			// NULL if point-to-point
@@ -1139,11 +1528,43 @@ void PI_Write_( PI_CHANNEL *c, const char *format, ... )
         PI_ASSERT( , b->narrow_end==TO, PI_BUNDLED_CHANNEL )
     }
 
+    /* a typed channel only carries its own format */
+    if ( compiled )
+        PI_ASSERT( , SameFormat( compiled, format ), PI_FORMAT_MISMATCH )
+
     va_start( argptr, format );
-    mpiArgCount = ParseFormatString( IO_CONTEXT_VALS, mpiArgs, format, argptr );
+    mpiArgCount = ParseFormatString( IO_CONTEXT_VALS, mpiArgs, &compiled, format, argptr );
     va_end( argptr );
     if ( mpiArgCount < 0 ) return;	// func. detected error with PI_OnErrorReturn
 
+    WriteArgs( c, format, compiled, mpiArgs, mpiArgCount );
+}
+
+/*!
+********************************************************************************
+Sends the bound items of a PI_Write or PI_WriteItems.  The caller has checked
+the channel, so errors here are reported as if by the API function.
+
+\param c Channel to write to.
+\param format Format string, or a label for the log if there is none.
+\param compiled Compiled format, or NULL if the items were not parsed from one.
+\param mpiArgs Items bound by ParseFormatString or BindItems.
+\param mpiArgCount Number of elements in mpiArgs.
+*******************************************************************************/
+static void WriteArgs( PI_CHANNEL *c, const char *format, PI_FORMAT *compiled,
+                       PI_MPI_RTTI mpiArgs[], int mpiArgCount )
+{
+    PI_ON_ERROR_RETURN()
+
+    int i;
+    PI_BUNDLE *b = c->bundle;	// collective bundle associated with channel
+    int agg = b==NULL && c->sendmode==PI_SEND_AGGREGATE;
+    PI_RING *ring = b==NULL ? c->ring : NULL;	// write goes through shared memory
+    int rma = b==NULL && c->rmaDisp >= 0;	// write is put into reader's window
+
+    /* this write may block, so earlier aggregated writes must go first */
+    if ( !agg && AggPending ) FlushAggregated();
+
 #ifdef PILOT_WITH_MPE
     if ( thisproc.svc_flag[LOG_MPE] )
         MPE_Log_event( thisproc.mpe_eventse[LOG_WRITE][0], 0, NULL ); // mark start of PI_Write
@@ -1154,34 +1575,90 @@ void PI_Write_( PI_CHANNEL *c, const char *format, ... )
      */
     LOGCALL( "Wri", c->chan_id, format, 1, mpiArgCount, mpiArgs )
 
-    /* Calculate format signature; if channel write, send to reader for matchup;
-     * if bundle "write" (to Gather or Reduce) receive format from "narrow" end
-     * of bundle and compare. If we're in a reducer bundle AND we're "rank 0"
-     * in the communicator, responsible to collect the result and send it to the
-     * "narrow" end, then we do both operations, since the PI_Reduce process is
-     * not in the communicator and cannot broadcast its format to the writers.
+    /* Calculate format signature; if channel write, it rides along with the
+     * first item to the reader for matchup; if bundle "write" (to Gather or
+     * Reduce) receive format from "narrow" end of bundle and compare. If we're
+     * in a reducer bundle AND we're "rank 0" in the communicator, responsible to
+     * collect the result and send it to the "narrow" end, then we do both
+     * operations, since the PI_Reduce process is not in the communicator and
+     * cannot broadcast its format to the writers.  The rim completes the
+     * bundle broadcast and compares before any data moves, so that a mismatch
+     * can't be received into the wrong buffers; only the reducer's rank 0,
+     * which sends it, overlaps it with the data collectives.
      */
-    if ( PI_CheckLevel >= 2 ) {
-        int buff,
-            sig = (int)FormatSignature( mpiArgs, mpiArgCount );
+    static int rootSig;		// static in case of an early error return
+    int sig = 0, signFirst = 0;	// signFirst: sig goes with first item sent
+    MPI_Request sigReq = MPI_REQUEST_NULL;
+    /* A typed point-to-point channel was checked once by PI_StartAll,
+     * unless its signature depends on the args */
+    int typed = b==NULL && c->format && c->format->sigFixed;
+    if ( PI_CheckLevel >= 2 && !typed ) {
+        sig = (int)GetSignature( compiled, mpiArgs, mpiArgCount );
 
-        if ( b==NULL || (b->usage==PI_REDUCE && c==b->channels[0]) ) {
-            PI_CALLMPI( MPISender( &sig, 1, MPI_INT, c->consumer,
-                                   c->chan_tag, PI_CommWorld ) )
-        }
+        if ( b==NULL || (b->usage==PI_REDUCE && c==b->channels[0]) ) signFirst = 1;
 
         if ( b ) {
-            if ( b->usage==PI_REDUCE && c==b->channels[0] ) {
-                // We're rank 0 in reducer bundle, send signature
-                PI_CALLMPI( MPI_Bcast( &sig, 1, MPI_INT,	// what we're sending
-                                       0, b->comm ) )	// "root" is rank 0 in bundle
+            // If we're rank 0 in reducer bundle, send signature, otherwise
+            // (we're on the rim) get signature from "root" to compare to ours
+            if ( b->usage==PI_REDUCE && c==b->channels[0] ) rootSig = sig;
+            StartSigBcast( &rootSig, b->comm, &sigReq );
+            if ( !signFirst ) {
+                PI_CALLMPI( MPI_Wait( &sigReq, MPI_STATUS_IGNORE ) )
+                PI_ASSERT( LEVEL(2), rootSig==sig, PI_FORMAT_MISMATCH )
             }
-            else {		// all other bundle cases (we're on the rim)
-                // Get signature from "root" and compare to ours
-                PI_CALLMPI( MPI_Bcast( &buff, 1, MPI_INT,	// what we're receiving
-                                       0, b->comm ) )
-                PI_ASSERT( LEVEL(2), buff==sig, PI_FORMAT_MISMATCH )
+        }
+    }
+
+    /* With -pimsg=c, a point-to-point write of several items is packed into
+     * the staging buffer and sent as one message, which PI_Read unpacks.  An
+     * aggregating channel packs every write onto the end of its own buffer,
+     * which is sent once it fills up, or is flushed.  A write through a ring
+     * or RMA buffer is packed the same way.
+     */
+    int packed = -1;		// >= 0 means items are being packed into packBuf
+    char *packBuf = StageBuf;
+    int packLen = StageLen;
+    int pull = 0;		// reader may pull large items from this process
+    if ( agg || ring || rma || ( b==NULL && c->postSel )	// one message for pre-posted reads
+         || ( b==NULL && thisproc.svc_flag[MSG_COALESCE] && mpiArgCount > 1 ) ) {
+        int part, size = 0;
+        if ( signFirst ) {
+            PI_CALLMPI( MPI_Pack_size( 1, MPI_INT, PI_CommWorld, &part ) )
+            size += part;
+        }
+#ifdef __linux__
+        pull = ring && !atomic_load_explicit( &ring->noPull, memory_order_relaxed );
+#endif
+        for ( i = 0; i < mpiArgCount; i++ ) {
+            /* a large item through a ring is packed as a descriptor */
+            if ( ring && PullBytes( mpiArgs[i].count, mpiArgs[i].type ) ) {
+                PI_CALLMPI( MPI_Pack_size( 3, MPI_UINT64_T, PI_CommWorld, &part ) )
+                size += part;
+                continue;
             }
+            /* a packed message's size is an int, so big items can't be packed */
+            PI_ASSERT( , mpiArgs[i].base == MPI_DATATYPE_NULL, PI_ARRAY_LENGTH )
+            PI_CALLMPI( MPI_Pack_size( mpiArgs[i].count, mpiArgs[i].type,
+                                       PI_CommWorld, &part ) )
+            PI_ASSERT( , part <= INT_MAX - size, PI_ARRAY_LENGTH )
+            size += part;
+        }
+        if ( agg ) {
+            PI_ASSERT( , size <= INT_MAX - c->aggPos, PI_ARRAY_LENGTH )
+            PI_ASSERT( , AggBuffer( c, c->aggPos + size ), PI_MALLOC_ERROR )
+            packBuf = c->aggBuf;
+            packLen = c->aggSize;
+            packed = c->aggPos;
+        }
+        else {
+            PI_ASSERT( , StageBuffer( size ), PI_MALLOC_ERROR )
+            packBuf = StageBuf;
+            packLen = StageLen;
+            packed = 0;
+        }
+        if ( signFirst ) {	// signature goes at front of packed items
+            PI_CALLMPI( MPI_Pack( &sig, 1, MPI_INT, packBuf, packLen,
+                                  &packed, PI_CommWorld ) )
         }
     }
 
@@ -1208,8 +1685,29 @@ void PI_Write_( PI_CHANNEL *c, const char *format, ... )
             }
 #endif
 
-            PI_CALLMPI( MPISender( arg->buf, arg->count, arg->type, c->consumer,
-                                   c->chan_tag, PI_CommWorld ) )
+            size_t pullBytes = ring ? PullBytes( arg->count, arg->type ) : 0;
+            if ( pullBytes ) {	// see PI_RING
+                uint64_t desc[3] = { getpid(), pull ? (uintptr_t)arg->buf : 0, pullBytes };
+                PI_CALLMPI( MPI_Pack( desc, 3, MPI_UINT64_T,
+                                      packBuf, packLen, &packed, PI_CommWorld ) )
+            }
+            else if ( packed >= 0 ) {
+                PI_CALLMPI( MPI_Pack( arg->buf, arg->count, arg->type,
+                                      packBuf, packLen, &packed, PI_CommWorld ) )
+            }
+            else if ( arg->sendCount ) {
+                /* no length message: the reader finds it from the data message */
+            }
+            else if ( signFirst ) {	// first message carries signature
+                MPI_Datatype sigtype = SigDatatype( SigCache( compiled ), &sig, arg );
+                PI_CALLMPI( MPISender[ c->sendmode ]( MPI_BOTTOM, 1, sigtype, c->consumer,
+                                                      c->chan_tag, PI_CommWorld ) )
+                FreeSigDatatype( SigCache( compiled ), &sigtype );
+                signFirst = 0;
+            }
+            else PI_CALLMPI( MPISender[ c->sendmode ]( arg->buf, arg->count, arg->type,
+                                                       c->consumer, c->chan_tag,
+                                                       PI_CommWorld ) )
         }
         else if ( b->usage==PI_GATHER ) {
 
@@ -1269,25 +1767,57 @@ void PI_Write_( PI_CHANNEL *c, const char *format, ... )
             }
 #endif
 
-            PI_CALLMPI( MPI_Reduce(
-                            arg->buf,			// our contribution
-                            resultbuf,			// result here if we're "root"
-                            arg->count, arg->type,	// what we're sending
-                            arg->op,			// the reduce operation
-                            0, b->comm ) )	    // "root" is rank 0 in communicator
+            ReduceItem( arg->buf,		// our contribution
+                        resultbuf,		// result here if we're "root"
+                        arg,			// what we're sending, and the operation
+                        b->comm );		// "root" is rank 0 in communicator
 
             /* Next, if our channel is first in the bundle, we have the
                task of sending the result to the process at the bundle's base.
                 */
             if ( resultbuf ) {
 
-                PI_CALLMPI( MPISender( resultbuf, arg->count, arg->type, c->consumer,
-                                       c->chan_tag, PI_CommWorld ) )
+                if ( i==0 && signFirst ) {	// first result carries signature
+                    PI_MPI_RTTI result = *arg;
+                    result.buf = resultbuf;
+                    MPI_Datatype sigtype = SigDatatype( SigCache( compiled ), &sig, &result );
+                    PI_CALLMPI( MPISender[ c->sendmode ]( MPI_BOTTOM, 1, sigtype,
+                                                          c->consumer, c->chan_tag,
+                                                          PI_CommWorld ) )
+                    FreeSigDatatype( SigCache( compiled ), &sigtype );
+                }
+                else PI_CALLMPI( MPISender[ c->sendmode ]( resultbuf, arg->count, arg->type,
+                                                           c->consumer, c->chan_tag,
+                                                           PI_CommWorld ) )
                 free( resultbuf );
             }
         }
     }
 
+    /* send the coalesced items, or leave them with the channel's earlier
+       writes; with deadlock detection, every write is sent as it's made */
+    if ( agg ) {
+        if ( c->aggPos == 0 ) AggPending++;
+        c->aggPos = packed;
+        if ( c->aggPos >= PI_AGG_BYTES || thisproc.svc_flag[OLP_DEADLOCK] ) FlushChannel( c );
+    }
+    else if ( ring ) {
+        RingPut( ring, packBuf, packed );
+        for ( i = 0; i < mpiArgCount; i++ ) {	// large items follow, in order
+            size_t pullBytes = PullBytes( mpiArgs[i].count, mpiArgs[i].type );
+            if ( pullBytes ) RingPush( ring, pull, mpiArgs[i].buf, pullBytes );
+        }
+    }
+    else if ( rma ) RmaPut( c, packBuf, packed );
+    else if ( packed >= 0 ) {
+        PI_CALLMPI( MPISender[ c->sendmode ]( StageBuf, packed, MPI_PACKED, c->consumer,
+                                              c->chan_tag, PI_CommWorld ) )
+    }
+
+    /* complete the reducer's signature broadcast from rank 0 */
+    if ( b && sigReq != MPI_REQUEST_NULL )
+        PI_CALLMPI( MPI_Wait( &sigReq, MPI_STATUS_IGNORE ) )
+
 #ifdef PILOT_WITH_MPE
     if ( thisproc.svc_flag[LOG_MPE] ) {
         bytebuf_pos = 0;
@@ -1309,12 +1839,10 @@ void PI_Read_( PI_CHANNEL *c, const char *format, ... )
     PI_ASSERT( LEVEL(1), ISVALID(PI_CHAN,c), PI_INVALID_OBJ )
     PI_ASSERT( , c->consumer==thisproc.rank, PI_ENDPOINT_READER )
 
-    int i;
-    int arrayLen = -1;		// count received for ^ flag, or -1 if n/a
     va_list argptr;
     int mpiArgCount;
     PI_MPI_RTTI mpiArgs[ PI_MAX_FORMATLEN ];
-    MPI_Status status;
+    PI_FORMAT *compiled = c->format;	// typed channel's format, else NULL
 
     PI_BUNDLE *b = c->bundle;	// collective bundle associated with channel
     if ( b ) {			// NULL if point-to-point
@@ -1324,11 +1852,93 @@ void PI_Read_( PI_CHANNEL *c, const char *format, ... )
         PI_ASSERT( , b->narrow_end==FROM, PI_BUNDLED_CHANNEL )
     }
 
+    /* a typed channel only carries its own format */
+    if ( compiled )
+        PI_ASSERT( , SameFormat( compiled, format ), PI_FORMAT_MISMATCH )
+
     va_start( argptr, format );
-    mpiArgCount = ParseFormatString( IO_CONTEXT_LOCS, mpiArgs, format, argptr );
+    mpiArgCount = ParseFormatString( IO_CONTEXT_LOCS, mpiArgs, &compiled, format, argptr );
     va_end( argptr );
     if ( mpiArgCount < 0 ) return;	// func. detected error with PI_OnErrorReturn
 
+    /* earlier PI_IReads with deferred items get their data first */
+    if ( c->deferTail && !FinishDeferred( c->deferTail, 1 ) ) return;
+
+    ReadArgs( c, format, compiled, mpiArgs, mpiArgCount, 0 );
+}
+
+int PI_ReadTimeout_( PI_CHANNEL *c, double timeout, const char *format, ... )
+{
+    PI_ON_ERROR_RETURN( 0 )
+    PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
+    PI_ASSERT( , c, PI_NULL_CHANNEL )
+    PI_ASSERT( , format, PI_NULL_FORMAT )
+    PI_ASSERT( LEVEL(1), ISVALID(PI_CHAN,c), PI_INVALID_OBJ )
+    PI_ASSERT( , c->consumer==thisproc.rank, PI_ENDPOINT_READER )
+    PI_ASSERT( , c->bundle==NULL, PI_BUNDLED_CHANNEL )	// collectives can't be polled
+
+    va_list argptr;
+    int mpiArgCount;
+    PI_MPI_RTTI mpiArgs[ PI_MAX_FORMATLEN ];
+    PI_FORMAT *compiled = c->format;	// typed channel's format, else NULL
+
+    /* a typed channel only carries its own format */
+    if ( compiled )
+        PI_ASSERT( , SameFormat( compiled, format ), PI_FORMAT_MISMATCH )
+
+    va_start( argptr, format );
+    mpiArgCount = ParseFormatString( IO_CONTEXT_LOCS, mpiArgs, &compiled, format, argptr );
+    va_end( argptr );
+    if ( mpiArgCount < 0 ) return 0;	// func. detected error with PI_OnErrorReturn
+
+    /* earlier PI_IReads with deferred items get their data first */
+    if ( c->deferTail && !FinishDeferred( c->deferTail, 1 ) ) return 0;
+
+    /* the write we wait for may depend on our aggregated writes; not logged
+       as a read until it has come, so a timeout leaves no trace.  Without a
+       timeout, it's logged before waiting, as by PI_Read, so the deadlock
+       detector sees the blocked read */
+    if ( timeout >= 0 ) {
+        if ( AggPending ) FlushAggregated();
+        if ( !PollChannel( c, timeout ) ) return 0;
+    }
+
+    ReadArgs( c, format, compiled, mpiArgs, mpiArgCount, 0 );
+    return 1;
+}
+
+/*!
+********************************************************************************
+Receives the bound items of a PI_Read or PI_ReadItems.  The caller has checked
+the channel, so errors here are reported as if by the API function.
+
+\param c Channel to read from.
+\param format Format string, or a label for the log if there is none.
+\param compiled Compiled format, or NULL if the items were not parsed from one.
+\param mpiArgs Items bound by ParseFormatString or BindItems.
+\param mpiArgCount Number of elements in mpiArgs.
+\param start Index of the first item to receive, normally 0.  PI_IRead's
+deferred items start later: the earlier ones, and the signature, were received
+by posted receives, and the call has been logged by PI_Wait.
+*******************************************************************************/
+static void ReadArgs( PI_CHANNEL *c, const char *format, PI_FORMAT *compiled,
+                      PI_MPI_RTTI mpiArgs[], int mpiArgCount, int start )
+{
+    PI_ON_ERROR_RETURN()
+
+    int i;
+    long long arrayLen = -1;	// count received for ^ flag, or -1 if n/a
+    MPI_Status status;
+    PI_BUNDLE *b = c->bundle;	// collective bundle associated with channel
+    int agg = b==NULL && c->sendmode==PI_SEND_AGGREGATE;
+    PI_RING *ring = b==NULL ? c->ring : NULL;	// write comes through shared memory
+    int rma = b==NULL && c->rmaDisp >= 0;	// write was put into our window
+    PI_BUNDLE *sel = b==NULL ? c->postSel : NULL;	// write lands in a pre-posted receive
+    int slot = sel ? sel->index[ c->producer ] : -1;
+
+    /* the reply we wait for may depend on our aggregated writes */
+    if ( AggPending ) FlushAggregated();
+
     /* Log the first item, so that if the format message causes a deadlock (which it
      * likely will if the subsequent I/O would cause one), it will get diagnosed.
      */
@@ -1337,35 +1947,101 @@ void PI_Read_( PI_CHANNEL *c, const char *format, ... )
         MPE_Log_event( thisproc.mpe_eventse[LOG_READ][0], 0, NULL );    // mark start of PI_Read
 #endif
 
-    LOGCALL( "Rea", c->chan_id, format, 1, mpiArgCount, mpiArgs )
+    LOGCALL( "Rea", c->chan_id, format, start+1, mpiArgCount, &mpiArgs[start] )
+
+    /* with -piwait, poll for the write rather than block in MPI */
+    if ( thisproc.svc_flag[WAIT_POLL] && b==NULL && start == 0 ) PollChannel( c, -1.0 );
 
-    /* Calculate format signature; if channel read, received writer's format and
-     * compare; if bundle "read" (from Broadcast or Reduce), send format from our
-     * "narrow" end of bundle for matchup.
+    /* Calculate format signature; if channel read or bundle "read" from
+     * Broadcast, the writer's format arrives with the first item and we
+     * compare; if bundle "read" from Scatter, get format from "narrow" end of
+     * bundle and compare before any data is received.
      */
-    if ( PI_CheckLevel >= 2 ) {
-        int buff,
-            sig = (int)FormatSignature( mpiArgs, mpiArgCount );
+    int rootSig;
+    int sig = 0, signFirst = 0;	// signFirst: sig comes with first item
+    MPI_Request sigReq = MPI_REQUEST_NULL;
+    PI_PROBED probed;		// data message of ^ or %s item on a channel
+    /* A typed point-to-point channel was checked once by PI_StartAll,
+     * unless its signature depends on the args */
+    int typed = b==NULL && c->format && c->format->sigFixed;
+    if ( PI_CheckLevel >= 2 && !typed && start == 0 ) {
+        sig = (int)GetSignature( compiled, mpiArgs, mpiArgCount );
+
+        if ( b==NULL || b->usage==PI_BROADCAST ) signFirst = 1;
+        else {
+            StartSigBcast( &rootSig, b->comm, &sigReq );
+            PI_CALLMPI( MPI_Wait( &sigReq, MPI_STATUS_IGNORE ) )
+            PI_ASSERT( LEVEL(2), rootSig==sig, PI_FORMAT_MISMATCH )
+        }
+    }
 
-        if ( b==NULL ) {
-            PI_CALLMPI( MPI_Recv( &buff, 1, MPI_INT, c->producer,
-                                  c->chan_tag, PI_CommWorld, &status ) )
-            PI_ASSERT( LEVEL(2), buff==sig, PI_FORMAT_MISMATCH )
+    /* A point-to-point read of several items with -pimsg=c receives them all
+     * in one packed message (see PI_Write), then unpacks them one by one.  An
+     * aggregating channel unpacks the next write from the batch it last
+     * received, and only receives another when that is used up.  A ring or
+     * RMA buffer delivers each write packed, to the staging buffer.
+     */
+    int packed = -1, packedLen;	// packed >= 0 means unpacking from packBuf
+    char *packBuf = StageBuf;
+    int unread = 0;		// aggregating channel had writes left in its batch
+    if ( agg ) {
+        unread = c->aggPos < c->aggLen;
+        if ( !unread ) {
+            MatchNext( c, &probed, &status );
+            PI_CALLMPI( MPI_Get_count( &status, MPI_PACKED, &packedLen ) )
+            PI_ASSERT( , AggBuffer( c, packedLen ), PI_MALLOC_ERROR )
+            RecvNext( c, c->aggBuf, packedLen, MPI_PACKED, &probed );
+            c->aggLen = packedLen;
+            c->aggPos = 0;
         }
-        else {
-            PI_CALLMPI( MPI_Bcast( &sig, 1, MPI_INT,	// what we're sending
-                                   0, b->comm ) )	// "root" is rank 0 in bundle
+        packBuf = c->aggBuf;
+        packedLen = c->aggLen;
+        packed = c->aggPos;
+    }
+    else if ( ring ) {
+        packedLen = RingGet( ring );
+        PI_ASSERT( , packedLen >= 0, PI_MALLOC_ERROR )
+        packBuf = StageBuf;
+        packed = 0;
+    }
+    else if ( rma ) {
+        packedLen = RmaGet( c );
+        PI_ASSERT( , packedLen >= 0, PI_MALLOC_ERROR )
+        packBuf = StageBuf;
+        packed = 0;
+    }
+    else if ( sel ) {
+        PostedLanded( sel, slot, 1 );
+        packBuf = sel->postBuf + (size_t)slot * sel->postSize;
+        packedLen = sel->postLen[ slot ];
+        packed = 0;
+    }
+    else if ( b==NULL && thisproc.svc_flag[MSG_COALESCE] && mpiArgCount > 1 && start == 0 ) {
+        MatchNext( c, &probed, &status );
+        PI_CALLMPI( MPI_Get_count( &status, MPI_PACKED, &packedLen ) )
+        PI_ASSERT( , StageBuffer( packedLen ), PI_MALLOC_ERROR )
+        RecvNext( c, StageBuf, packedLen, MPI_PACKED, &probed );
+        packBuf = StageBuf;
+        packed = 0;
+    }
+    if ( packed >= 0 ) {
+        if ( signFirst ) {	// signature is at front of packed items
+            int buff;
+            PI_CALLMPI( MPI_Unpack( packBuf, packedLen, &packed,
+                                    &buff, 1, MPI_INT, PI_CommWorld ) )
+            PI_ASSERT( LEVEL(2), buff==sig, PI_FORMAT_MISMATCH )
+            signFirst = 0;
         }
     }
 
-    for ( i = 0; i < mpiArgCount; i++ ) {
+    for ( i = start; i < mpiArgCount; i++ ) {
         PI_MPI_RTTI* arg = &mpiArgs[ i ];
 
         /* Reduce operation is never valid for PI_Read */
         PI_ASSERT( , arg->op==MPI_OP_NULL, PI_OP_INVALID )
 
         /* Log each item */
-        if ( i>0 ) LOGCALL( "Rea", c->chan_id, format, i+1, mpiArgCount, arg );
+        if ( i>start ) LOGCALL( "Rea", c->chan_id, format, i+1, mpiArgCount, arg );
 
         /* First case handles ordinary receive and broadcast receive.
                MPI_Bcast here receives data from producer process within comm
@@ -1374,18 +2050,40 @@ void PI_Read_( PI_CHANNEL *c, const char *format, ... )
 
         if ( b==NULL || b->usage==PI_BROADCAST ) {
 
-            /* Handling ^ flag or %s string step 1: expecting to receive array length first */
-            if ( arg->sendCount ) {
-                if ( b==NULL ) {
-                    PI_CALLMPI( MPI_Recv( arg->buf, arg->count, arg->type, c->producer,
-                                          c->chan_tag, PI_CommWorld, &status ) )
+            /* Handling ^ flag or %s string step 1 on a channel: the writer
+               doesn't send the array length, so find it from the data message */
+            if ( arg->sendCount && b==NULL && packed < 0 ) {
+                arrayLen = ProbeArrayLen( c, &mpiArgs[i+1], signFirst, &probed );
+                if ( arrayLen < 0 || !StoreLength( arg, arrayLen ) )
+                    return;	// func. detected error with PI_OnErrorReturn
+            }
+
+            /* The first item brings the writer's signature with it */
+            else if ( i==0 && signFirst ) {
+                if ( !RecvSignedItem( SigCache( compiled ), arg, sig, c, b ) )
+                    return;	// func. detected error with PI_OnErrorReturn
+                signFirst = 0;
+                if ( arg->sendCount ) {
+                    arrayLen = arg->data.lld;
+                    if ( !StoreLength( arg, arrayLen ) )
+                        return;	// func. detected error with PI_OnErrorReturn
+                }
+            }
+
+            /* Otherwise, expecting to receive array length first */
+            else if ( arg->sendCount ) {
+                if ( packed >= 0 ) {
+                    PI_CALLMPI( MPI_Unpack( packBuf, packedLen, &packed,
+                                            arg->buf, arg->count, arg->type, PI_CommWorld ) )
                 }
                 else {
                     PI_CALLMPI( MPI_Bcast(
                                     arg->buf, arg->count, arg->type,	// what we're getting
                                     0, b->comm ) )		// "root" is rank 0 in bundle
                 }
-                arrayLen = *(int *)arg->buf;
+                arrayLen = arg->data.lld;
+                if ( !StoreLength( arg, arrayLen ) )
+                    return;	// func. detected error with PI_OnErrorReturn
             }
 
             /* Step 2: malloc based on received array len, then get data  */
@@ -1394,19 +2092,49 @@ void PI_Read_( PI_CHANNEL *c, const char *format, ... )
                 int size;
                 PI_CALLMPI( MPI_Type_size( arg->type, &size ) )
 
-                /* Put array addr into user's pointer variable */
-                *(void **)arg->buf = (void *)malloc( arrayLen * size );
-                PI_ASSERT( , arg->buf != NULL, PI_MALLOC_ERROR );
+                /* '~' flag: reuse caller's buffer, only growing it if needed */
+                if ( arg->capacity ) {
+                    long long capacity = arg->wideLen ? (long long)*(size_t *)arg->capacity
+                                                      : *(int *)arg->capacity;
+                    if ( *(void **)arg->buf == NULL || capacity < arrayLen ) {
+                        PI_ASSERT( , arg->wideLen || arrayLen <= INT_MAX, PI_ARRAY_LENGTH )
+                        void *grown = realloc( *(void **)arg->buf, (size_t)arrayLen * size );
+                        PI_ASSERT( , grown != NULL, PI_MALLOC_ERROR );
+                        *(void **)arg->buf = grown;
+                        if ( arg->wideLen ) *(size_t *)arg->capacity = arrayLen;
+                        else *(int *)arg->capacity = arrayLen;
+                    }
+                }
+
+                /* PI_ReadItems: the caller's callback supplies the array */
+                else if ( arg->resize ) {
+                    *(void **)arg->buf = arg->resize( arg->resizeCtx, (size_t)arrayLen );
+                    PI_ASSERT( , *(void **)arg->buf != NULL, PI_MALLOC_ERROR );
+                }
 
-                /* Now we're ready to receive the data */
-                if ( b==NULL ) {
-                    PI_CALLMPI( MPI_Recv( *(void **)arg->buf, arrayLen, arg->type, c->producer,
-                                          c->chan_tag, PI_CommWorld, &status ) )
+                /* Otherwise put array addr from pool into user's pointer variable */
+                else {
+                    *(void **)arg->buf = PoolAlloc( (size_t)arrayLen * size );
+                    PI_ASSERT( , *(void **)arg->buf != NULL, PI_MALLOC_ERROR );
+                }
 
+                /* Now we're ready to receive the data */
+                WrapCount( arg, arrayLen, 0 );
+                if ( ring && PullBytes( arg->count, arg->type ) )
+                    RingPull( ring, *(void **)arg->buf, packBuf, packedLen, &packed );
+                else if ( packed >= 0 ) {
+                    PI_CALLMPI( MPI_Unpack( packBuf, packedLen, &packed,
+                                            *(void **)arg->buf, arg->count, arg->type, PI_CommWorld ) )
+                }
+                else if ( b==NULL ) {	// message already matched in step 1
+                    if ( !RecvProbed( c, arg, *(void **)arg->buf, arg->count,
+                                      signFirst ? &sig : NULL, SigCache( compiled ), &probed ) )
+                        return;	// func. detected error with PI_OnErrorReturn
+                    signFirst = 0;
                 }
                 else {
                     PI_CALLMPI( MPI_Bcast(
-                                    *(void **)arg->buf, arrayLen, arg->type,	// array we're getting
+                                    *(void **)arg->buf, arg->count, arg->type,	// array we're getting
                                     0, b->comm ) )		// "root" is rank 0 in bundle
                 }
                 arrayLen = -1;		// done with arrayLen for this arg
@@ -1414,7 +2142,17 @@ void PI_Read_( PI_CHANNEL *c, const char *format, ... )
 
             /* Plain case: just receive the data */
             else {
-                if ( b==NULL ) {
+                if ( ring && PullBytes( arg->count, arg->type ) )
+                    RingPull( ring, arg->buf, packBuf, packedLen, &packed );
+                else if ( packed >= 0 ) {
+                    PI_CALLMPI( MPI_Unpack( packBuf, packedLen, &packed,
+                                            arg->buf, arg->count, arg->type, PI_CommWorld ) )
+                }
+                else if ( b==NULL && c->matched ) {	// PI_SelectRead matched it
+                    MatchNext( c, &probed, &status );
+                    RecvNext( c, arg->buf, arg->count, arg->type, &probed );
+                }
+                else if ( b==NULL ) {
                     PI_CALLMPI( MPI_Recv( arg->buf, arg->count, arg->type, c->producer,
                                           c->chan_tag, PI_CommWorld, &status ) )
                 }
@@ -1437,6 +2175,15 @@ void PI_Read_( PI_CHANNEL *c, const char *format, ... )
         }
     }
 
+    /* the next read on an aggregating channel carries on from here */
+    if ( agg ) {
+        c->aggPos = packed;
+        AggUnread += ( c->aggPos < c->aggLen ) - unread;
+    }
+
+    /* the buffer is free for the channel's next write */
+    if ( sel ) Repost( sel, slot );
+
 #ifdef PILOT_WITH_MPE
     if ( thisproc.svc_flag[LOG_MPE] ) {
         MPE_Log_receive( c->producer, c->chan_tag, arrayLen );  // receiver's end of message arrow
@@ -1456,722 +2203,3646 @@ void PI_Read_( PI_CHANNEL *c, const char *format, ... )
 #endif
 }
 
-int PI_Select_( PI_BUNDLE *b )
+void PI_WriteItems_( PI_CHANNEL *c, const PI_ITEM items[], int n )
 {
-    PI_ON_ERROR_RETURN( 0 )
+    PI_ON_ERROR_RETURN()
     PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
-    PI_ASSERT( , b, PI_NULL_BUNDLE )
-    PI_ASSERT( LEVEL(1), ISVALID(PI_BUND,b), PI_INVALID_OBJ )
-    PI_ASSERT( , b->usage==PI_SELECT, PI_BUNDLE_USAGE )
-    PI_ASSERT( , b->narrow_end==TO, PI_ENDPOINT_READER )
-
-    MPI_Status status;
-    int i;
-
-#ifdef PILOT_WITH_MPE
-    if ( thisproc.svc_flag[LOG_MPE] )
-        MPE_Log_event( thisproc.mpe_eventse[LOG_SELECT][0], 0, NULL ); // mark start of PI_Select
-#endif
-
-    LOGCALL( "Sel", b->bund_id, "", 0, 0, NULL )
+    PI_ASSERT( , c, PI_NULL_CHANNEL )
+    PI_ASSERT( LEVEL(1), ISVALID(PI_CHAN,c), PI_INVALID_OBJ )
+    PI_ASSERT( , c->producer==thisproc.rank, PI_ENDPOINT_WRITER )
+    PI_ASSERT( , c->format==NULL, PI_FORMAT_MISMATCH )	// typed channel needs its format
 
-    PI_CALLMPI( MPI_Probe( MPI_ANY_SOURCE, b->channels[0]->chan_tag,
-                           PI_CommWorld, &status ) )
+    int mpiArgCount;
+    PI_MPI_RTTI mpiArgs[ PI_MAX_FORMATLEN ];
 
-    /* note: this is a sequential search! suppose bundle is large?
-       May want to build (on the fly) lookup table (hash?) for rank=>index.
-       Another alt (since each rank will likely participate in few bundles) is
-       to make small lookup table in rank's PI_PROCENVT: [rank].table:tag=>index.
-       The table could be PI_MAX_BUNDLES long, and CreateBundle fills in the next entry
-       for each producer process.
-    */
+    PI_BUNDLE *b = c->bundle;	// collective bundle associated with channel
+    if ( b ) {			// NULL if point-to-point
 
-    for ( i = 0; i < b->size; i++ ) {
-        if ( b->channels[i]->producer == status.MPI_SOURCE ) {
-#ifdef PILOT_WITH_MPE
-            if ( thisproc.svc_flag[LOG_MPE] ) {
-                bytebuf_pos = 0;
-                MPE_Log_pack( bytebuf, &bytebuf_pos, 'd', 1, &PI_CallerLine );
-                int namelen = strlen(thisproc.processes[thisproc.rank].name);
-                MPE_Log_pack( bytebuf, &bytebuf_pos, 's', MIN(LOG_SELECT_S1MAX,namelen), thisproc.processes[thisproc.rank].name );
-                MPE_Log_pack( bytebuf, &bytebuf_pos, 'd', 1, &thisproc.processes[thisproc.rank].argument );
-                namelen = strlen(b->name);
-                MPE_Log_pack( bytebuf, &bytebuf_pos, 's', MIN(LOG_SELECT_S2MAX,namelen), b->name );
-                MPE_Log_pack( bytebuf, &bytebuf_pos, 'd', 1, &i );
-                MPE_Log_event( thisproc.mpe_eventse[LOG_SELECT][1], 0, bytebuf );   // mark end of PI_Select
-            }
-#endif
-            return i;
-        }
+        /* make sure we're on the rim of the bundled channel */
+        PI_ASSERT( LEVEL(1), ISVALID(PI_BUND,b), PI_SYSTEM_ERROR )
+        PI_ASSERT( , b->narrow_end==TO, PI_BUNDLED_CHANNEL )
     }
 
-    /* If the message source does not match the producer of any of the bundle's
-       channels, that's a problem.  PI_ASSERT(, 0, ...) will always abort. */
-    PI_ASSERT( , 0, PI_SYSTEM_ERROR )
-    return 0;	// never reached, but satisfies compiler
+    mpiArgCount = BindItems( IO_CONTEXT_VALS, mpiArgs, items, n );
+    if ( mpiArgCount < 0 ) return;	// func. detected error with PI_OnErrorReturn
+
+    WriteArgs( c, "(items)", NULL, mpiArgs, mpiArgCount );
 }
 
-int PI_ChannelHasData_( PI_CHANNEL *c )
+void PI_ReadItems_( PI_CHANNEL *c, const PI_ITEM items[], int n )
 {
-    PI_ON_ERROR_RETURN( 0 )
+    PI_ON_ERROR_RETURN()
     PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
     PI_ASSERT( , c, PI_NULL_CHANNEL )
     PI_ASSERT( LEVEL(1), ISVALID(PI_CHAN,c), PI_INVALID_OBJ )
+    PI_ASSERT( , c->consumer==thisproc.rank, PI_ENDPOINT_READER )
+    PI_ASSERT( , c->format==NULL, PI_FORMAT_MISMATCH )	// typed channel needs its format
 
-    int flag;
-    MPI_Status s;
-
-    LOGCALL( "Has", c->chan_id, "", 0, 0, NULL )
+    int mpiArgCount;
+    PI_MPI_RTTI mpiArgs[ PI_MAX_FORMATLEN ];
 
-    PI_CALLMPI( MPI_Iprobe( c->producer, c->chan_tag, PI_CommWorld, &flag, &s ) )
+    PI_BUNDLE *b = c->bundle;	// collective bundle associated with channel
+    if ( b ) {			// NULL if point-to-point
 
-#ifdef PILOT_WITH_MPE
-    if ( thisproc.svc_flag[LOG_MPE] ) {
-        bytebuf_pos = 0;
-        MPE_Log_pack( bytebuf, &bytebuf_pos, 'd', 1, &PI_CallerLine );
-        int namelen = strlen(c->name);
-        MPE_Log_pack( bytebuf, &bytebuf_pos, 's', MIN(LOG_CHANNELHASDATA,namelen), c->name );
-        MPE_Log_pack( bytebuf, &bytebuf_pos, 'd', 1, &flag );
-        MPE_Log_event( thisproc.mpe_event[LOG_CHANNELHASDATA], 0, bytebuf );    // event bubble for PI_ChannelHasData result
+        /* make sure we're on the rim of the bundled channel */
+        PI_ASSERT( LEVEL(1), ISVALID(PI_BUND,b), PI_SYSTEM_ERROR )
+        PI_ASSERT( , b->narrow_end==FROM, PI_BUNDLED_CHANNEL )
     }
-#endif
 
-    return flag;
+    mpiArgCount = BindItems( IO_CONTEXT_LOCS, mpiArgs, items, n );
+    if ( mpiArgCount < 0 ) return;	// func. detected error with PI_OnErrorReturn
+
+    /* earlier PI_IReads with deferred items get their data first */
+    if ( c->deferTail && !FinishDeferred( c->deferTail, 1 ) ) return;
+
+    ReadArgs( c, "(items)", NULL, mpiArgs, mpiArgCount, 0 );
 }
 
-int PI_TrySelect_( PI_BUNDLE *b )
+void PI_WriteStream_( PI_CHANNEL *c, PI_ITEMTYPE type, const void *buf, size_t count,
+                      size_t segment )
 {
-    PI_ON_ERROR_RETURN( -1 )
+    PI_ON_ERROR_RETURN()
     PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
-    PI_ASSERT( , b, PI_NULL_BUNDLE )
-    PI_ASSERT( LEVEL(1), ISVALID(PI_BUND,b), PI_INVALID_OBJ )
-    PI_ASSERT( , b->usage==PI_SELECT, PI_BUNDLE_USAGE )
-    PI_ASSERT( , b->narrow_end==TO, PI_ENDPOINT_READER )
-
-    int flag, i;
-    MPI_Status status;
-
-    LOGCALL( "Try", b->bund_id, "", 0, 0, NULL )
-
-    PI_CALLMPI( MPI_Iprobe( MPI_ANY_SOURCE, b->channels[0]->chan_tag,
-                            PI_CommWorld, &flag, &status ) )
-
-#ifdef PILOT_WITH_MPE
-    if ( thisproc.svc_flag[LOG_MPE] ) {
-        bytebuf_pos = 0;
-        MPE_Log_pack( bytebuf, &bytebuf_pos, 'd', 1, &PI_CallerLine );
-        int namelen = strlen(b->name);
-        MPE_Log_pack( bytebuf, &bytebuf_pos, 's', MIN(LOG_TRYSELECT_SMAX,namelen), b->name );
+    PI_ASSERT( , c, PI_NULL_CHANNEL )
+    PI_ASSERT( LEVEL(1), ISVALID(PI_CHAN,c), PI_INVALID_OBJ )
+    PI_ASSERT( , c->producer==thisproc.rank, PI_ENDPOINT_WRITER )
+    PI_ASSERT( , c->bundle==NULL, PI_BUNDLED_CHANNEL )
+    PI_ASSERT( , c->format==NULL, PI_FORMAT_MISMATCH )	// typed channel needs its format
+    PI_ASSERT( , c->sendmode < PI_SEND_AGGREGATE, PI_SEND_MODE )	// batches and rings aren't MPI messages
+    PI_ASSERT( , c->sendmode != PI_SEND_READY, PI_SEND_MODE )	// segments are posted after the header
+    PI_ASSERT( , c->postSel==NULL, PI_SEND_MODE )	// its reads are pre-posted
+    PI_ASSERT( , buf || count==0, PI_FORMAT_ARGS )
+    PI_ASSERT( , count <= LLONG_MAX, PI_ARRAY_LENGTH )
+
+    int size;
+    size_t k, segments;
+    PI_FORMAT_TERM element;
+    MPI_Request req[ PI_STREAM_DEPTH ];
+
+    PI_ASSERT( , ItemSpec( type, &element ), PI_FORMAT_INVALID )
+    PI_CALLMPI( MPI_Type_size( element.type, &size ) )
+    if ( segment == 0 ) segment = PI_STREAM_BYTES / size;
+    PI_ASSERT( , segment <= INT_MAX, PI_ARRAY_LENGTH )	// each is one message
+    if ( AggPending ) FlushAggregated();	// this write may block
+
+    LOGCALL( "Wri", c->chan_id, "(stream)", 1, 1, NULL )
+
+    /* the header tells the reader what to expect */
+    long long header[3] = { (long long)count, (long long)segment, type };
+    PI_CALLMPI( MPISender[ c->sendmode ]( header, 3, MPI_LONG_LONG, c->consumer,
+                                          c->chan_tag, PI_CommWorld ) )
+
+    /* keep up to PI_STREAM_DEPTH segments in flight */
+    segments = ( count + segment - 1 ) / segment;
+    for ( k = 0; k < PI_STREAM_DEPTH; k++ ) req[k] = MPI_REQUEST_NULL;
+    for ( k = 0; k < segments; k++ ) {
+        MPI_Request *slot = &req[ k % PI_STREAM_DEPTH ];
+        size_t n = count - k * segment;		// last one may be short
+        if ( n > segment ) n = segment;
+        PI_CALLMPI( MPI_Wait( slot, MPI_STATUS_IGNORE ) )
+        PI_CALLMPI( MPIISender[ c->sendmode ]( (char *)buf + k * segment * size,
+                                               (int)n, element.type, c->consumer,
+                                               c->chan_tag, PI_CommWorld, slot ) )
     }
-#endif
-
-    if ( flag == 0 ) {
-#ifdef PILOT_WITH_MPE
-        if ( thisproc.svc_flag[LOG_MPE] ) {
-            int return_val = -1;
-            MPE_Log_pack( bytebuf, &bytebuf_pos, 'd', 1, &return_val );
-            MPE_Log_event( thisproc.mpe_event[LOG_TRYSELECT], 0, bytebuf );     // event bubble for PI_TrySelect result
-        }
-#endif
+    PI_CALLMPI( MPI_Waitall( PI_STREAM_DEPTH, req, MPI_STATUSES_IGNORE ) )
+}
 
-        return -1;		// no channel has data
+size_t PI_ReadStream_( PI_CHANNEL *c, PI_ITEMTYPE type, void *buf, size_t capacity,
+                       PI_STREAM_FUNC consume, void *ctx )
+{
+    PI_ON_ERROR_RETURN( 0 )
+    PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
+    PI_ASSERT( , c, PI_NULL_CHANNEL )
+    PI_ASSERT( LEVEL(1), ISVALID(PI_CHAN,c), PI_INVALID_OBJ )
+    PI_ASSERT( , c->consumer==thisproc.rank, PI_ENDPOINT_READER )
+    PI_ASSERT( , c->bundle==NULL, PI_BUNDLED_CHANNEL )
+    PI_ASSERT( , c->format==NULL, PI_FORMAT_MISMATCH )	// typed channel needs its format
+    PI_ASSERT( , c->sendmode < PI_SEND_AGGREGATE, PI_SEND_MODE )	// batches and rings aren't MPI messages
+    PI_ASSERT( , c->sendmode != PI_SEND_READY, PI_SEND_MODE )	// segments are posted after the header
+    PI_ASSERT( , c->postSel==NULL, PI_SEND_MODE )	// its reads are pre-posted
+    PI_ASSERT( , buf || consume, PI_FORMAT_ARGS )
+
+    int size;
+    size_t k, count, segment, segments;
+    char *slots = NULL;		// reused segment buffers if buf is NULL
+    PI_FORMAT_TERM element;
+    MPI_Request req[ PI_STREAM_DEPTH ];
+    long long header[3];	// count, segment, type
+
+    PI_ASSERT( , ItemSpec( type, &element ), PI_FORMAT_INVALID )
+    PI_CALLMPI( MPI_Type_size( element.type, &size ) )
+    if ( AggPending ) FlushAggregated();	// the writer may depend on them
+
+    /* earlier PI_IReads with deferred items get their data first */
+    if ( c->deferTail && !FinishDeferred( c->deferTail, 1 ) ) return 0;
+
+    LOGCALL( "Rea", c->chan_id, "(stream)", 1, 1, NULL )
+
+    /* with -piwait, poll for the header rather than block in MPI */
+    if ( thisproc.svc_flag[WAIT_POLL] ) PollChannel( c, -1.0 );
+
+    PI_CALLMPI( MPI_Recv( header, 3, MPI_LONG_LONG, c->producer, c->chan_tag,
+                          PI_CommWorld, MPI_STATUS_IGNORE ) )
+    PI_ASSERT( , header[2] == type, PI_FORMAT_MISMATCH )
+    count = header[0];
+    segment = header[1];
+    PI_ASSERT( , buf == NULL || count <= capacity, PI_ARRAY_LENGTH )
+    if ( buf == NULL && count > 0 ) {
+        slots = malloc( PI_STREAM_DEPTH * segment * size );
+        PI_ASSERT( , slots, PI_MALLOC_ERROR )
     }
 
-    /* lookup message source's corresponding channel index in bundle
-       (see comment in PI_Select_ re sequential search) */
-    for ( i = 0; i < b->size; i++ ) {
-        if ( b->channels[i]->producer == status.MPI_SOURCE ) {
-#ifdef PILOT_WITH_MPE
-            if ( thisproc.svc_flag[LOG_MPE] ) {
-                MPE_Log_pack( bytebuf, &bytebuf_pos, 'd', 1, &i );
-                MPE_Log_event( thisproc.mpe_event[LOG_TRYSELECT], 0, bytebuf ); // event bubble for PI_TrySelect result
-            }
-#endif
-            return i;           // channel index with data
-        }
+#define DEST(k) ( buf ? (char *)buf + (k) * segment * size \
+                      : slots + (k) % PI_STREAM_DEPTH * segment * size )
+#define LENGTH(k) ( (int)( count - (k) * segment < segment ? count - (k) * segment : segment ) )
+
+    /* keep up to PI_STREAM_DEPTH segments posted, and hand each one over as
+       it arrives, before reusing its slot */
+    segments = count ? ( count + segment - 1 ) / segment : 0;
+    for ( k = 0; k < PI_STREAM_DEPTH; k++ ) {
+        req[k] = MPI_REQUEST_NULL;
+        if ( k < segments )
+            PI_CALLMPI( MPI_Irecv( DEST(k), LENGTH(k), element.type, c->producer,
+                                   c->chan_tag, PI_CommWorld, &req[k] ) )
+    }
+    for ( k = 0; k < segments; k++ ) {
+        MPI_Request *slot = &req[ k % PI_STREAM_DEPTH ];
+        PI_CALLMPI( MPI_Wait( slot, MPI_STATUS_IGNORE ) )
+        if ( consume ) consume( ctx, DEST(k), k * segment, LENGTH(k) );
+        if ( k + PI_STREAM_DEPTH < segments )
+            PI_CALLMPI( MPI_Irecv( DEST(k + PI_STREAM_DEPTH), LENGTH(k + PI_STREAM_DEPTH),
+                                   element.type, c->producer, c->chan_tag,
+                                   PI_CommWorld, slot ) )
     }
+#undef DEST
+#undef LENGTH
 
-    /* If the message source does not match the producer of any of the bundle's
-       channels, that's a problem.  PI_ASSERT(, 0, ...) will always abort. */
-    PI_ASSERT( , 0, PI_SYSTEM_ERROR )
-    return 0;	// never reached, but satisfies compiler
+    free( slots );
+    return count;
 }
 
-PI_CHANNEL *PI_GetBundleChannel_( const PI_BUNDLE *b, int index )
+/*!
+********************************************************************************
+Binds the items of PI_WriteMulti or PI_ReadMulti, which must be of fixed shape,
+and finds how far apart successive channels' items are in each arg's array.
+
+\param mpiArgs Filled in with the items.
+\param compiled Set to the compiled format.
+\param stride Filled in with the bytes per channel of each item.
+\param format Format string.
+\param ap Args (locations).
+\return Number of items, or -1 on error (only with PI_OnErrorReturn).
+*******************************************************************************/
+static int BindMulti( PI_MPI_RTTI mpiArgs[], PI_FORMAT **compiled, MPI_Aint stride[],
+                      const char *format, va_list ap )
 {
-    PI_ON_ERROR_RETURN( NULL )
-    PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
-    PI_ASSERT( , b, PI_NULL_BUNDLE )
-    PI_ASSERT( LEVEL(1), ISVALID(PI_BUND,b), PI_INVALID_OBJ )
-    PI_ASSERT( , index >= 0 && index < b->size, PI_BUNDLE_INDEX )
+    PI_ON_ERROR_RETURN( -1 )
 
-    return b->channels[index];
+    int i, mpiArgCount;
+    MPI_Aint lb, extent;
+
+    mpiArgCount = ParseFormatString( IO_CONTEXT_LOCS, mpiArgs, compiled, format, ap );
+    if ( mpiArgCount < 0 ) return -1;	// func. detected error with PI_OnErrorReturn
+
+    /* as for PI_Scatter and PI_Gather, each channel's items follow the last's */
+    for ( i = 0; i < mpiArgCount; i++ ) {
+        PI_ASSERT( , !mpiArgs[i].sendCount && mpiArgs[i].capacity==NULL, PI_FORMAT_INVALID )
+        PI_ASSERT( , mpiArgs[i].op==MPI_OP_NULL, PI_OP_INVALID )
+        PI_CALLMPI( MPI_Type_get_extent( mpiArgs[i].type, &lb, &extent ) )
+        stride[i] = extent * mpiArgs[i].count;
+    }
+    return mpiArgCount;
 }
 
-int PI_GetBundleSize_( const PI_BUNDLE *b )
+/*!
+********************************************************************************
+Checks the channels of PI_WriteMulti or PI_ReadMulti.
+
+\param c Channels.
+\param n Number of channels.
+\param reading True for PI_ReadMulti.
+\param format Format string, which a typed channel must have.
+\return 1 if OK, or 0 on error (only with PI_OnErrorReturn).
+*******************************************************************************/
+static int CheckMulti( PI_CHANNEL *const c[], int n, int reading, const char *format )
 {
     PI_ON_ERROR_RETURN( 0 )
-    PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
-    PI_ASSERT( , b, PI_NULL_BUNDLE )
-    PI_ASSERT( LEVEL(1), ISVALID(PI_BUND,b), PI_INVALID_OBJ )
 
-    return b->size;
+    int i;
+    for ( i = 0; i < n; i++ ) {
+        PI_ASSERT( , c[i], PI_NULL_CHANNEL )
+        PI_ASSERT( LEVEL(1), ISVALID(PI_CHAN,c[i]), PI_INVALID_OBJ )
+        if ( reading ) {
+            PI_ASSERT( , c[i]->consumer==thisproc.rank, PI_ENDPOINT_READER )
+        }
+        else PI_ASSERT( , c[i]->producer==thisproc.rank, PI_ENDPOINT_WRITER )
+        PI_ASSERT( , c[i]->bundle==NULL, PI_BUNDLED_CHANNEL )	// use the collective
+        PI_ASSERT( , c[i]->sendmode < PI_SEND_AGGREGATE, PI_SEND_MODE )	// batches and rings aren't MPI messages
+        PI_ASSERT( , c[i]->postSel==NULL, PI_SEND_MODE )	// its reads are pre-posted
+        if ( c[i]->format )
+            PI_ASSERT( , SameFormat( c[i]->format, format ), PI_FORMAT_MISMATCH )
+    }
+    return 1;
 }
 
+/*!
+********************************************************************************
+Logs the items of PI_WriteMulti or PI_ReadMulti.  They are logged item by item,
+and each item for every channel, as part i of n, so that the deadlock detector
+can take each item's channels together, as for a collective.
+
+\param code Code to log with.
+\param c Channels.
+\param n Number of channels.
+\param format Format string.
+\param mpiArgs Bound items.
+\param mpiArgCount Number of elements in mpiArgs.
+\param stride Bytes per channel of each item.
+*******************************************************************************/
+static void LogMulti( const char *code, PI_CHANNEL *const c[], int n, const char *format,
+                      const PI_MPI_RTTI mpiArgs[], int mpiArgCount, const MPI_Aint stride[] )
+{
+    int i, j;
+    PI_MPI_RTTI arg;
+
+    for ( j = 0; j < mpiArgCount; j++ ) {
+        for ( i = 0; i < n; i++ ) {
+            arg = mpiArgs[j];
+            arg.buf = arg.data.address = (char *)mpiArgs[j].buf + i * stride[j];
+            LOGCALL( code, c[i]->chan_id, format, i+1, n, &arg )
+        }
+    }
+}
 
-void PI_Broadcast_( PI_BUNDLE *b, const char *format, ... )
+void PI_WriteMulti_( PI_CHANNEL *const c[], int n, const char *format, ... )
 {
     PI_ON_ERROR_RETURN()
     PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
-    PI_ASSERT( , b, PI_NULL_BUNDLE )
+    PI_ASSERT( , c || n==0, PI_NULL_CHANNEL )
+    PI_ASSERT( , n >= 0, PI_ARRAY_LENGTH )
     PI_ASSERT( , format, PI_NULL_FORMAT )
-    PI_ASSERT( LEVEL(1), ISVALID(PI_BUND,b), PI_INVALID_OBJ )
-    PI_ASSERT( , b->usage==PI_BROADCAST, PI_BUNDLE_USAGE )
-    PI_ASSERT( , thisproc.rank==b->channels[0]->producer, PI_ENDPOINT_WRITER )
+    if ( !CheckMulti( c, n, 0, format ) ) return;	// func. detected error with PI_OnErrorReturn
 
-    int i;
+    int i, j;
     va_list argptr;
     int mpiArgCount;
-    PI_MPI_RTTI mpiArgs[ PI_MAX_FORMATLEN ];
+    PI_MPI_RTTI mpiArgs[ PI_MAX_FORMATLEN ], chanArgs[ PI_MAX_FORMATLEN ];
+    MPI_Aint stride[ PI_MAX_FORMATLEN ];
+    PI_FORMAT *compiled = NULL;
 
     va_start( argptr, format );
-    mpiArgCount = ParseFormatString( IO_CONTEXT_VALS, mpiArgs, format, argptr );
+    mpiArgCount = BindMulti( mpiArgs, &compiled, stride, format, argptr );
     va_end( argptr );
     if ( mpiArgCount < 0 ) return;	// func. detected error with PI_OnErrorReturn
-
-#ifdef PILOT_WITH_MPE
-    if ( thisproc.svc_flag[LOG_MPE] )
-        MPE_Log_event( thisproc.mpe_eventse[LOG_BROADCAST][0], 0, NULL );       // mark start of PI_Broadcast
-#endif
-
-    /* Log the first item, so that if the format message causes a deadlock (which it
-     * likely will if the subsequent I/O would cause one), it will get diagnosed.
-     */
-    LOGCALL( "Bro", b->bund_id, format, 1, mpiArgCount, mpiArgs )
-
-    /* Calculate format signature; send from our "narrow" end of bundle to readers
-     * for matchup.
-     */
-    if ( PI_CheckLevel >= 2 ) {
-        int sig = (int)FormatSignature( mpiArgs, mpiArgCount );
-
-        PI_CALLMPI( MPI_Bcast( &sig, 1, MPI_INT,	// what we're sending
-                               0, b->comm ) )	// "root" is rank 0 in bundle
-    }
-
-    for ( i = 0; i < mpiArgCount; i++ ) {
-        PI_MPI_RTTI* arg = &mpiArgs[ i ];
-
-        /* Reduce operation is never valid for PI_Broadcast */
-        PI_ASSERT( , arg->op==MPI_OP_NULL, PI_OP_INVALID )
-
-        /* Log each item */
-        if ( i>0 ) LOGCALL( "Bro", b->bund_id, format, i+1, mpiArgCount, arg );
-
-#ifdef PILOT_WITH_MPE
-        if ( thisproc.svc_flag[LOG_MPE] ) {
-            int j;
-            for ( j = b->size-1; j >= 0; j-- ) {          // fan out message arrows to PI_Readers
-                mybuff[0] = '\0';
-                bytebuf_pos = 0;
-                // skip leading PI_LOGSEP char output by interpArg
-                int namelen = strlen( interpArg(mybuff, LOG_BROADCAST_MSG_SMAX, "Bro", &mpiArgs[i]) ) - 1;
-                MPE_Log_pack( bytebuf, &bytebuf_pos, 's', MIN(LOG_BROADCAST_MSG_SMAX,namelen), mybuff+1 );
-                MPE_Log_event( thisproc.mpe_event[LOG_BROADCAST_MSG], 0, bytebuf );     // event bubble in PI_Broadcast
-                MPE_Log_send( b->channels[j]->consumer, b->channels[j]->chan_tag, arg->count ); // sender's end of message arrow
-                usleep(1000);   // pause 1 msec. so message arrows don't get superimposed in logfile
-            }
+    if ( n == 0 ) return;
+
+    PI_REQUEST **reqs = malloc( n * sizeof(PI_REQUEST *) );
+    PI_ASSERT( , reqs, PI_MALLOC_ERROR )
+    if ( AggPending ) FlushAggregated();	// the writes may block
+
+    /* Start every channel's write before waiting for any */
+    LogMulti( "WrM", c, n, format, mpiArgs, mpiArgCount, stride );
+    for ( i = 0; i < n; i++ ) {
+        for ( j = 0; j < mpiArgCount; j++ ) {
+            chanArgs[j] = mpiArgs[j];
+            chanArgs[j].buf = (char *)mpiArgs[j].buf + i * stride[j];
         }
-#endif
-
-        PI_CALLMPI( MPI_Bcast(
-                        arg->buf, arg->count, arg->type,	// what we're sending
-                        0, b->comm ) )		// "root" is rank 0 in bundle
+        reqs[i] = StartWrite( c[i], format, compiled, chanArgs, mpiArgCount, NULL );
+        if ( reqs[i] == NULL ) break;	// func. detected error with PI_OnErrorReturn
+        reqs[i]->multi = 1;
     }
-#ifdef PILOT_WITH_MPE
-    if ( thisproc.svc_flag[LOG_MPE] ) {
-        bytebuf_pos = 0;
-        MPE_Log_pack( bytebuf, &bytebuf_pos, 'd', 1, &PI_CallerLine );
-        int namelen = strlen(thisproc.processes[thisproc.rank].name);
-        MPE_Log_pack( bytebuf, &bytebuf_pos, 's', MIN(LOG_BROADCAST_S1MAX,namelen), thisproc.processes[thisproc.rank].name );
-        MPE_Log_pack( bytebuf, &bytebuf_pos, 'd', 1, &thisproc.processes[thisproc.rank].argument );
-        namelen = strlen(b->name);
-        MPE_Log_pack( bytebuf, &bytebuf_pos, 's', MIN(LOG_BROADCAST_S2MAX,namelen), b->name );
-        MPE_Log_event( thisproc.mpe_eventse[LOG_BROADCAST][1], 0, bytebuf );    // mark end of PI_Broadcast
+
+    for ( j = 0; j < i; j++ ) {
+        if ( i == n ) WaitPosted( reqs[j] );
+        FreeRequest( &reqs[j] );
     }
-#endif
+    free( reqs );
 }
 
-
-void PI_Scatter_( PI_BUNDLE *b, const char *format, ... )
+void PI_ReadMulti_( PI_CHANNEL *const c[], int n, int order[], const char *format, ... )
 {
     PI_ON_ERROR_RETURN()
     PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
-    PI_ASSERT( , b, PI_NULL_BUNDLE )
+    PI_ASSERT( , c || n==0, PI_NULL_CHANNEL )
+    PI_ASSERT( , n >= 0, PI_ARRAY_LENGTH )
     PI_ASSERT( , format, PI_NULL_FORMAT )
-    PI_ASSERT( LEVEL(1), ISVALID(PI_BUND,b), PI_INVALID_OBJ )
-    PI_ASSERT( , b->usage==PI_SCATTER, PI_BUNDLE_USAGE )
-    PI_ASSERT( , thisproc.rank==b->channels[0]->producer, PI_ENDPOINT_WRITER )
+    if ( !CheckMulti( c, n, 1, format ) ) return;	// func. detected error with PI_OnErrorReturn
 
-    int i, chan;
+    int i, j, k;
     va_list argptr;
     int mpiArgCount;
-    PI_MPI_RTTI mpiArgs[ PI_MAX_FORMATLEN ];
+    PI_MPI_RTTI mpiArgs[ PI_MAX_FORMATLEN ], chanArgs[ PI_MAX_FORMATLEN ];
+    MPI_Aint stride[ PI_MAX_FORMATLEN ];
+    PI_FORMAT *compiled = NULL;
 
     va_start( argptr, format );
-    mpiArgCount = ParseFormatString( IO_CONTEXT_LOCS, mpiArgs, format, argptr );
+    mpiArgCount = BindMulti( mpiArgs, &compiled, stride, format, argptr );
     va_end( argptr );
     if ( mpiArgCount < 0 ) return;	// func. detected error with PI_OnErrorReturn
-#ifdef PILOT_WITH_MPE
-    if ( thisproc.svc_flag[LOG_MPE] )
-        MPE_Log_event( thisproc.mpe_eventse[LOG_SCATTER][0], 0, NULL ); // mark start of PI_Scatter
-#endif
+    if ( n == 0 ) return;
 
-    /* Log the first item, so that if the format message causes a deadlock (which it
-     * likely will if the subsequent I/O would cause one), it will get diagnosed.
-     */
-    LOGCALL( "Sca", b->bund_id, format, 1, mpiArgCount, mpiArgs )
+    /* Earlier nonblocking reads come first (see PI_IRead) */
+    for ( i = 0; i < n; i++ )
+        if ( c[i]->deferTail && !FinishDeferred( c[i]->deferTail, 1 ) ) return;
 
-    /* Calculate format signature; send from our "narrow" end of bundle to readers
-     * for matchup.
+    /* One block for the requests, all their MPI requests, which are waited for
+     * together, the count of each one's messages still to come, and the
+     * indices of those that complete
      */
-    if ( PI_CheckLevel >= 2 ) {
-        int sig = (int)FormatSignature( mpiArgs, mpiArgCount );
-
-        PI_CALLMPI( MPI_Bcast( &sig, 1, MPI_INT,	// what we're sending
-                               0, b->comm ) )	// "root" is rank 0 in bundle
+    int total = n * mpiArgCount;
+    PI_REQUEST **reqs = malloc( n * sizeof(PI_REQUEST *) + total * sizeof(MPI_Request)
+                                + ( n + total ) * sizeof(int) );
+    PI_ASSERT( , reqs, PI_MALLOC_ERROR )
+    MPI_Request *all = (MPI_Request *)( reqs + n );
+    int *left = (int *)( all + total );
+    int *index = left + n;
+    for ( k = 0; k < total; k++ ) all[k] = MPI_REQUEST_NULL;
+    if ( AggPending ) FlushAggregated();	// the writers may depend on them
+
+    /* Post every channel's read before waiting for any */
+    LogMulti( "ReM", c, n, format, mpiArgs, mpiArgCount, stride );
+    for ( i = 0; i < n; i++ ) {
+        for ( j = 0; j < mpiArgCount; j++ ) {
+            chanArgs[j] = mpiArgs[j];
+            chanArgs[j].buf = (char *)mpiArgs[j].buf + i * stride[j];
+        }
+        reqs[i] = StartRead( c[i], format, compiled, chanArgs, mpiArgCount, NULL );
+        if ( reqs[i] == NULL ) break;	// func. detected error with PI_OnErrorReturn
+        reqs[i]->multi = 1;
+
+        /* take over its MPI requests; a packed read has just one */
+        left[i] = 0;
+        for ( j = 0; j < mpiArgCount; j++ ) {
+            all[ i * mpiArgCount + j ] = reqs[i]->mpireq[j];
+            reqs[i]->mpireq[j] = MPI_REQUEST_NULL;
+            if ( all[ i * mpiArgCount + j ] != MPI_REQUEST_NULL ) left[i]++;
+        }
     }
 
-    for ( i = 0; i < mpiArgCount; i++ ) {
-        PI_MPI_RTTI* arg = &mpiArgs[ i ];
-
-        /* Reduce operation is never valid for PI_Scatter */
-        PI_ASSERT( , arg->op==MPI_OP_NULL, PI_OP_INVALID )
-
-        /* set up args for MPI_Scatter (sending side) */
-        int sendcounts[b->size+1];	// count sent to each process
-        int displs[b->size+1];		// displacements in userbuf for send
-
-        /* Log each item */
-        if ( i>0 ) LOGCALL( "Sca", b->bund_id, format, i+1, mpiArgCount, arg );
-
-#ifdef PILOT_WITH_MPE
-        if ( thisproc.svc_flag[LOG_MPE] ) {                     // fan out message arrows to PI_Readers
-            int j;
-            for ( j = b->size - 1; j >= 0; j-- ) {
-                mybuff[0] = '\0';
-                bytebuf_pos = 0;
-                // skip leading PI_LOGSEP char output by interpArg
-                int namelen = strlen( interpArg(mybuff, LOG_SCATTER_MSG_SMAX, "Sca", &mpiArgs[i]) ) - 1;
-                MPE_Log_pack( bytebuf, &bytebuf_pos, 's', MIN(LOG_SCATTER_MSG_SMAX,namelen), mybuff+1 );
-                MPE_Log_event( thisproc.mpe_event[LOG_SCATTER_MSG], 0, bytebuf );       // event bubble in PI_Scatter
-                MPE_Log_send( b->channels[j]->consumer, b->channels[j]->chan_tag, arg->count ); // sender's end of message arrow
-                usleep(1000);   // pause 1 msec. so message arrows don't get superimposed in logfile
+    /* Finish each channel's read as soon as all its messages are in, so that
+     * they complete in the order they arrive */
+    int done = 0, outcount;
+    while ( i == n && done < n ) {
+        PI_CALLMPI( MPI_Waitsome( total, all, &outcount, index, MPI_STATUSES_IGNORE ) )
+        if ( outcount == MPI_UNDEFINED ) break;		// nothing left
+        for ( k = 0; k < outcount; k++ ) {
+            j = index[k] / mpiArgCount;
+            if ( --left[j] > 0 ) continue;
+            if ( !WaitPosted( reqs[j] ) ) {	// func. detected error with PI_OnErrorReturn
+                done = n;
+                break;
             }
+            if ( order ) order[ done ] = j;
+            done++;
         }
-#endif
+    }
 
-        /* prepare sendcounts and displs arrays so that root receives nothing,
-           and all the rest receive 'count' items */
-        sendcounts[0] = displs[0] = 0;
-        for ( chan=1; chan<=b->size; chan++ ) {
-            sendcounts[chan] = arg->count;
-            displs[chan] = (chan-1) * arg->count;	// fits buffer of size*count items
-        }
+    for ( k = 0; k < total; k++ )	// left after an error
+        if ( all[k] != MPI_REQUEST_NULL ) PI_CALLMPI( MPI_Request_free( &all[k] ) )
+    for ( j = 0; j < i; j++ )
+        FreeRequest( &reqs[j] );
+    free( reqs );
+}
 
-#ifdef MPI_IN_PLACE
-        PI_CALLMPI( MPI_Scatterv(
-                        arg->buf, sendcounts, displs, arg->type,	// sends all data
-                        MPI_IN_PLACE, 0, 0,	// receive 0 data from "root"
-                        0, b->comm ) )		// "root" is P0 in bundle communicator
-#else
-        char recvbuf[1];	// root receives 0-length data, so make dummy
-        PI_CALLMPI( MPI_Scatterv(
-                        arg->buf, sendcounts, displs, arg->type,	// sends all data
-                        recvbuf, 0, arg->type,	// receive 0 data from "root"
-                        0, b->comm ) )		// "root" is P0 in bundle communicator
-#endif
-    }
-#ifdef PILOT_WITH_MPE
-    if ( thisproc.svc_flag[LOG_MPE] ) {
-        bytebuf_pos = 0;
-        MPE_Log_pack( bytebuf, &bytebuf_pos, 'd', 1, &PI_CallerLine );
-        int namelen = strlen(thisproc.processes[thisproc.rank].name);
-        MPE_Log_pack( bytebuf, &bytebuf_pos, 's', MIN(LOG_SCATTER_S1MAX,namelen), thisproc.processes[thisproc.rank].name );
-        MPE_Log_pack( bytebuf, &bytebuf_pos, 'd', 1, &thisproc.processes[thisproc.rank].argument );
-        namelen = strlen(b->name);
-        MPE_Log_pack( bytebuf, &bytebuf_pos, 's', MIN(LOG_SCATTER_S2MAX,namelen), b->name );
-        MPE_Log_event( thisproc.mpe_eventse[LOG_SCATTER][1], 0, bytebuf );      // mark end of PI_Scatter
+void PI_Flush_( PI_CHANNEL *c )
+{
+    PI_ON_ERROR_RETURN()
+    PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
+
+    if ( c == NULL ) {		// all of them
+        if ( AggPending ) FlushAggregated();
+        return;
     }
-#endif
-}
+    PI_ASSERT( LEVEL(1), ISVALID(PI_CHAN,c), PI_INVALID_OBJ )
+    PI_ASSERT( , c->producer==thisproc.rank, PI_ENDPOINT_WRITER )
 
+    if ( c->sendmode == PI_SEND_AGGREGATE ) FlushChannel( c );
+}
 
-void PI_Reduce_( PI_BUNDLE *b, const char *format, ... )
+PI_REQUEST *PI_IWrite_( PI_CHANNEL *c, const char *format, ... )
 {
-    PI_ON_ERROR_RETURN()
+    PI_ON_ERROR_RETURN( NULL )
     PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
-    PI_ASSERT( , b, PI_NULL_BUNDLE )
+    PI_ASSERT( , c, PI_NULL_CHANNEL )
     PI_ASSERT( , format, PI_NULL_FORMAT )
-    PI_ASSERT( LEVEL(1), ISVALID(PI_BUND,b), PI_INVALID_OBJ )
-    PI_ASSERT( , b->usage==PI_REDUCE, PI_BUNDLE_USAGE )
-    PI_ASSERT( , thisproc.rank==b->channels[0]->consumer, PI_ENDPOINT_READER )
+    PI_ASSERT( LEVEL(1), ISVALID(PI_CHAN,c), PI_INVALID_OBJ )
+    PI_ASSERT( , c->producer==thisproc.rank, PI_ENDPOINT_WRITER )
+    PI_ASSERT( , c->bundle==NULL, PI_BUNDLED_CHANNEL )	// collectives are blocking
+    PI_ASSERT( , c->sendmode < PI_SEND_AGGREGATE, PI_SEND_MODE )	// batches and rings aren't MPI messages
+    PI_ASSERT( , c->postSel==NULL, PI_SEND_MODE )	// its reads are pre-posted
 
-    int i;
     va_list argptr;
     int mpiArgCount;
     PI_MPI_RTTI mpiArgs[ PI_MAX_FORMATLEN ];
-    MPI_Status status;
+    PI_FORMAT *compiled = c->format;	// typed channel's format, else NULL
+
+    /* a typed channel only carries its own format */
+    if ( compiled )
+        PI_ASSERT( , SameFormat( compiled, format ), PI_FORMAT_MISMATCH )
 
     va_start( argptr, format );
-    mpiArgCount = ParseFormatString( IO_CONTEXT_LOCS, mpiArgs, format, argptr );
+    mpiArgCount = ParseFormatString( IO_CONTEXT_VALS, mpiArgs, &compiled, format, argptr );
     va_end( argptr );
-    if ( mpiArgCount < 0 ) return;	// func. detected error with PI_OnErrorReturn
-#ifdef PILOT_WITH_MPE
-    if ( thisproc.svc_flag[LOG_MPE] )
-        MPE_Log_event( thisproc.mpe_eventse[LOG_REDUCE][0], 0, NULL );  // mark start of PI_Reduce
-#endif
+    if ( mpiArgCount < 0 ) return NULL;	// func. detected error with PI_OnErrorReturn
 
-    /* Log the first item, so that if the format message causes a deadlock (which it
-     * likely will if the subsequent I/O would cause one), it will get diagnosed.
-     */
-    LOGCALL( "Rdu", b->bund_id, format, 1, mpiArgCount, mpiArgs )
+    return StartWrite( c, format, compiled, mpiArgs, mpiArgCount, "IWr" );
+}
 
-    /* The reduction topology is complex: The writers are in a communicator, and
-     * the "rank 0" member (=the root) is nominated to get the reduced result and
-     * send it to the PI_Reduce process. So as the latter, we obey the "reader
-     * validates the format" rule: we receive the writer's format and compare.
-     */
-    if ( PI_CheckLevel >= 2 ) {
-        int buff,
-            sig = (int)FormatSignature( mpiArgs, mpiArgCount );
+PI_REQUEST *PI_IRead_( PI_CHANNEL *c, const char *format, ... )
+{
+    PI_ON_ERROR_RETURN( NULL )
+    PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
+    PI_ASSERT( , c, PI_NULL_CHANNEL )
+    PI_ASSERT( , format, PI_NULL_FORMAT )
+    PI_ASSERT( LEVEL(1), ISVALID(PI_CHAN,c), PI_INVALID_OBJ )
+    PI_ASSERT( , c->consumer==thisproc.rank, PI_ENDPOINT_READER )
+    PI_ASSERT( , c->bundle==NULL, PI_BUNDLED_CHANNEL )	// collectives are blocking
+    PI_ASSERT( , c->sendmode < PI_SEND_AGGREGATE, PI_SEND_MODE )	// batches and rings aren't MPI messages
+    PI_ASSERT( , c->postSel==NULL, PI_SEND_MODE )	// its reads are pre-posted
 
-        PI_CALLMPI( MPI_Recv( &buff, 1, MPI_INT,
-                              b->channels[0]->producer, b->channels[0]->chan_tag,
-                              PI_CommWorld, &status ) )
-        PI_ASSERT( LEVEL(2), buff==sig, PI_FORMAT_MISMATCH )
+    va_list argptr;
+    int mpiArgCount;
+    PI_MPI_RTTI mpiArgs[ PI_MAX_FORMATLEN ];
+    PI_FORMAT *compiled = c->format;	// typed channel's format, else NULL
+
+    /* a typed channel only carries its own format */
+    if ( compiled )
+        PI_ASSERT( , SameFormat( compiled, format ), PI_FORMAT_MISMATCH )
+
+    va_start( argptr, format );
+    mpiArgCount = ParseFormatString( IO_CONTEXT_LOCS, mpiArgs, &compiled, format, argptr );
+    va_end( argptr );
+    if ( mpiArgCount < 0 ) return NULL;	// func. detected error with PI_OnErrorReturn
+
+    return StartRead( c, format, compiled, mpiArgs, mpiArgCount, "IRe" );
+}
+
+void PI_Wait_( PI_REQUEST **req )
+{
+    PI_ON_ERROR_RETURN()
+    PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
+    PI_ASSERT( , req, PI_INVALID_OBJ )
+
+    PI_REQUEST *r = *req;
+    if ( r == NULL ) return;		// already completed
+    PI_ASSERT( LEVEL(1), ISVALID(PI_REQ,r), PI_INVALID_OBJ )
+
+    CompleteRequest( r, 1 );
+    if ( !r->persistent ) FreeRequest( req );
+}
+
+int PI_Test_( PI_REQUEST **req )
+{
+    PI_ON_ERROR_RETURN( 0 )
+    PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
+    PI_ASSERT( , req, PI_INVALID_OBJ )
+
+    PI_REQUEST *r = *req;
+    if ( r == NULL ) return 1;		// already completed
+    PI_ASSERT( LEVEL(1), ISVALID(PI_REQ,r), PI_INVALID_OBJ )
+
+    if ( !CompleteRequest( r, 0 ) ) return 0;
+    if ( !r->persistent ) FreeRequest( req );
+    return 1;
+}
+
+void PI_WaitAll_( PI_REQUEST *reqs[], int n )
+{
+    PI_ON_ERROR_RETURN()
+    PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
+    PI_ASSERT( , reqs || n==0, PI_INVALID_OBJ )
+
+    int i;
+    for ( i = 0; i < n; i++ )
+        PI_Wait_( &reqs[i] );
+}
+
+PI_REQUEST *PI_BindWrite_( PI_CHANNEL *c, const char *format, ... )
+{
+    PI_ON_ERROR_RETURN( NULL )
+    PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
+    PI_ASSERT( , c, PI_NULL_CHANNEL )
+    PI_ASSERT( , format, PI_NULL_FORMAT )
+    PI_ASSERT( LEVEL(1), ISVALID(PI_CHAN,c), PI_INVALID_OBJ )
+    PI_ASSERT( , c->producer==thisproc.rank, PI_ENDPOINT_WRITER )
+    PI_ASSERT( , c->sendmode < PI_SEND_AGGREGATE, PI_SEND_MODE )	// batches and rings aren't MPI messages
+    PI_ASSERT( , c->postSel==NULL, PI_SEND_MODE )	// its reads are pre-posted
+
+    va_list argptr;
+    va_start( argptr, format );
+    PI_REQUEST *r = BindChannel( c, 0, format, argptr );
+    va_end( argptr );
+    return r;
+}
+
+PI_REQUEST *PI_BindRead_( PI_CHANNEL *c, const char *format, ... )
+{
+    PI_ON_ERROR_RETURN( NULL )
+    PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
+    PI_ASSERT( , c, PI_NULL_CHANNEL )
+    PI_ASSERT( , format, PI_NULL_FORMAT )
+    PI_ASSERT( LEVEL(1), ISVALID(PI_CHAN,c), PI_INVALID_OBJ )
+    PI_ASSERT( , c->consumer==thisproc.rank, PI_ENDPOINT_READER )
+    PI_ASSERT( , c->sendmode < PI_SEND_AGGREGATE, PI_SEND_MODE )	// batches and rings aren't MPI messages
+    PI_ASSERT( , c->postSel==NULL, PI_SEND_MODE )	// its reads are pre-posted
+
+    va_list argptr;
+    va_start( argptr, format );
+    PI_REQUEST *r = BindChannel( c, 1, format, argptr );
+    va_end( argptr );
+    return r;
+}
+
+void PI_Start_( PI_REQUEST *r )
+{
+    PI_ON_ERROR_RETURN()
+    PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
+    PI_ASSERT( , r, PI_INVALID_OBJ )
+    PI_ASSERT( LEVEL(1), ISVALID(PI_REQ,r), PI_INVALID_OBJ )
+    PI_ASSERT( , r->persistent && r->done, PI_INVALID_OBJ )	// bound, and not started
+
+    int i;
+    PI_CHANNEL *c = r->chan;
+
+    /* earlier PI_IReads with deferred items get their data first */
+    if ( r->reading && c->deferTail && !FinishDeferred( c->deferTail, 1 ) ) return;
+
+    /* Log each item; their values are only taken when sent */
+    for ( i = 0; i < r->nargs; i++ )
+        LOGCALL( r->reading ? "IRe" : "IWr", c->chan_id, r->format ? r->format : "",
+                 i+1, r->nargs, NULL );
+
+    if ( r->packed && !r->reading ) PackArgs( r );
+    r->done = 0;
+    PI_CALLMPI( MPI_Startall( r->packed ? 1 : r->posted, r->mpireq ) )
+}
+
+void PI_Unbind_( PI_REQUEST **req )
+{
+    PI_ON_ERROR_RETURN()
+    PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
+    PI_ASSERT( , req, PI_INVALID_OBJ )
+
+    PI_REQUEST *r = *req;
+    if ( r == NULL ) return;		// already unbound
+    PI_ASSERT( LEVEL(1), ISVALID(PI_REQ,r), PI_INVALID_OBJ )
+    PI_ASSERT( , r->persistent, PI_INVALID_OBJ )
+
+    CompleteRequest( r, 1 );		// in case it was started
+    FreeRequest( req );
+}
+
+void PI_ReleaseBuffer_( void *buf )
+{
+    PI_ON_ERROR_RETURN()
+    PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
+
+    int i, slot;
+    PI_POOLBUF rel;
+
+    if ( buf == NULL ) return;
+
+    /* find it among the recent buffers handed out, newest first */
+    for ( i = 1; i <= PI_POOL_LENT; i++ ) {
+        slot = ( PoolLentNext - i + PI_POOL_LENT ) % PI_POOL_LENT;
+        if ( PoolLent[slot].buf == buf ) break;
     }
+    if ( i > PI_POOL_LENT ) {	// size unknown, so can't reuse it
+        free( buf );
+        return;
+    }
+    rel = PoolLent[slot];
+    PoolLent[slot].buf = NULL;
 
-    for ( i = 0; i < mpiArgCount; i++ ) {
-        PI_MPI_RTTI* arg = &mpiArgs[ i ];
+    /* keep it, or if the pool is full, keep the larger of it and the smallest */
+    if ( PoolFreeCount < PI_POOL_FREE ) {
+        PoolFree[PoolFreeCount++] = rel;
+        return;
+    }
+    slot = 0;
+    for ( i = 1; i < PI_POOL_FREE; i++ )
+        if ( PoolFree[i].size < PoolFree[slot].size ) slot = i;
+    if ( PoolFree[slot].size < rel.size ) {
+        free( PoolFree[slot].buf );
+        PoolFree[slot] = rel;
+    }
+    else free( rel.buf );
+}
 
-        /* PI_Reduce doesn't actually use the operator, but we insist on it
-           for consistency. */
-        PI_ASSERT( , arg->op!=MPI_OP_NULL, PI_OP_MISSING )
+int PI_Select_( PI_BUNDLE *b )
+{
+    PI_ON_ERROR_RETURN( 0 )
+    PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
+    PI_ASSERT( , b, PI_NULL_BUNDLE )
+    PI_ASSERT( LEVEL(1), ISVALID(PI_BUND,b), PI_INVALID_OBJ )
+    PI_ASSERT( , b->usage==PI_SELECT, PI_BUNDLE_USAGE )
+    PI_ASSERT( , b->narrow_end==TO, PI_ENDPOINT_READER )
 
-        /* Log each item */
-        if ( i>0 ) LOGCALL( "Rdu", b->bund_id, format, i+1, mpiArgCount, arg );
+    MPI_Status status;
+    int i;
 
-        /* The actual reduction is done within the communicator, i.e., by the
-           processes on the bundle's rim.  The 1st channel's producer process
-           will send the result back here. */
-        PI_CALLMPI( MPI_Recv( arg->buf, arg->count, arg->type,
-                              b->channels[0]->producer, b->channels[0]->chan_tag,
-                              PI_CommWorld, &status ) )
 #ifdef PILOT_WITH_MPE
-        if ( thisproc.svc_flag[LOG_MPE] ) {                     // fan in message arrows from PI_Writers
-            int j;
-            for ( j = 0; j < b->size; j++ ) {
-                MPE_Log_receive( b->channels[j]->producer, b->channels[j]->chan_tag, arg->count );  // receiver's end of message arrow
-                bytebuf_pos = 0;
-                MPE_Log_pack( bytebuf, &bytebuf_pos, 's', strlen( b->channels[j]->name ), b->channels[j]->name );
-                MPE_Log_event( thisproc.mpe_event[LOG_CHANNEL], 0, bytebuf );   // event bubble in PI_Reduce
-                usleep(1000);   // pause 1 msec. so message arrows don't get superimposed in logfile
-            }
-        }
+    if ( thisproc.svc_flag[LOG_MPE] )
+        MPE_Log_event( thisproc.mpe_eventse[LOG_SELECT][0], 0, NULL ); // mark start of PI_Select
 #endif
+
+    LOGCALL( "Sel", b->bund_id, "", 0, 0, NULL )
+
+    if ( AggPending ) FlushAggregated();
+
+    if ( thisproc.svc_flag[WAIT_POLL] ) {
+        i = PollSelect( b, -1.0 );
+        goto selected;
     }
+    if ( b->policy != PI_SELECT_ANY ) {
+        i = FairSelect( b, 1 );
+        goto selected;
+    }
+    if ( b->postReqs ) {
+        i = PostedSelect( b, 1 );
+        goto selected;
+    }
+
+    /* a channel with data outside MPI (aggregated writes left over, or in
+       a ring) needs no probe; rings can't be probed at all, so if there are
+       any, poll them and MPI by turns */
+    int rings = 0, flag = 0, spins = 0;
+    if ( ( AggUnread || RingsActive ) && ( i = UnprobedData( b, &rings ) ) >= 0 )
+        goto selected;
+    while ( rings && !flag ) {
+        PI_CALLMPI( MPI_Iprobe( MPI_ANY_SOURCE, b->channels[0]->chan_tag,
+                                PI_CommWorld, &flag, &status ) )
+        if ( !flag ) {
+            if ( ( i = UnprobedData( b, &rings ) ) >= 0 ) goto selected;
+            RingWait( &spins );
+        }
+    }
+    if ( !flag ) {
+        PI_CALLMPI( MPI_Probe( MPI_ANY_SOURCE, b->channels[0]->chan_tag,
+                               PI_CommWorld, &status ) )
+    }
+
+    /* If the message source does not match the producer of any of the bundle's
+       channels, that's a problem. */
+    i = b->index[ status.MPI_SOURCE ];
+    PI_ASSERT( , i >= 0, PI_SYSTEM_ERROR )
+
+selected:
 #ifdef PILOT_WITH_MPE
     if ( thisproc.svc_flag[LOG_MPE] ) {
         bytebuf_pos = 0;
         MPE_Log_pack( bytebuf, &bytebuf_pos, 'd', 1, &PI_CallerLine );
         int namelen = strlen(thisproc.processes[thisproc.rank].name);
-        MPE_Log_pack( bytebuf, &bytebuf_pos, 's', MIN(LOG_REDUCE_S1MAX,namelen), thisproc.processes[thisproc.rank].name );
+        MPE_Log_pack( bytebuf, &bytebuf_pos, 's', MIN(LOG_SELECT_S1MAX,namelen), thisproc.processes[thisproc.rank].name );
         MPE_Log_pack( bytebuf, &bytebuf_pos, 'd', 1, &thisproc.processes[thisproc.rank].argument );
         namelen = strlen(b->name);
-        MPE_Log_pack( bytebuf, &bytebuf_pos, 's', MIN(LOG_REDUCE_S2MAX,namelen), b->name );
-        MPE_Log_event( thisproc.mpe_eventse[LOG_REDUCE][1], 0, bytebuf );       // mark end of PI_Reduce
+        MPE_Log_pack( bytebuf, &bytebuf_pos, 's', MIN(LOG_SELECT_S2MAX,namelen), b->name );
+        MPE_Log_pack( bytebuf, &bytebuf_pos, 'd', 1, &i );
+        MPE_Log_event( thisproc.mpe_eventse[LOG_SELECT][1], 0, bytebuf );   // mark end of PI_Select
     }
 #endif
+    return i;
 }
 
-
-void PI_Gather_( PI_BUNDLE *b, const char *format, ... )
+int PI_ChannelHasData_( PI_CHANNEL *c )
 {
-    PI_ON_ERROR_RETURN()
+    PI_ON_ERROR_RETURN( 0 )
     PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
-    PI_ASSERT( , b, PI_NULL_BUNDLE )
-    PI_ASSERT( , format, PI_NULL_FORMAT )
-    PI_ASSERT( LEVEL(1), ISVALID(PI_BUND,b), PI_INVALID_OBJ )
-    PI_ASSERT( , b->usage==PI_GATHER, PI_BUNDLE_USAGE )
-    PI_ASSERT( , thisproc.rank==b->channels[0]->consumer, PI_ENDPOINT_READER )
+    PI_ASSERT( , c, PI_NULL_CHANNEL )
+    PI_ASSERT( LEVEL(1), ISVALID(PI_CHAN,c), PI_INVALID_OBJ )
 
-    int i, chan;
-    va_list argptr;
-    int mpiArgCount;
-    PI_MPI_RTTI mpiArgs[ PI_MAX_FORMATLEN ];
+    int flag;
+
+    LOGCALL( "Has", c->chan_id, "", 0, 0, NULL )
+
+    if ( AggPending ) FlushAggregated();
+    flag = ChannelReady( c );
 
-    va_start( argptr, format );
-    mpiArgCount = ParseFormatString( IO_CONTEXT_LOCS, mpiArgs, format, argptr );
-    va_end( argptr );
-    if ( mpiArgCount < 0 ) return;	// func. detected error with PI_OnErrorReturn
 #ifdef PILOT_WITH_MPE
-    if ( thisproc.svc_flag[LOG_MPE] )
-        MPE_Log_event( thisproc.mpe_eventse[LOG_GATHER][0], 0, NULL );  // mark start of PI_Gather
+    if ( thisproc.svc_flag[LOG_MPE] ) {
+        bytebuf_pos = 0;
+        MPE_Log_pack( bytebuf, &bytebuf_pos, 'd', 1, &PI_CallerLine );
+        int namelen = strlen(c->name);
+        MPE_Log_pack( bytebuf, &bytebuf_pos, 's', MIN(LOG_CHANNELHASDATA,namelen), c->name );
+        MPE_Log_pack( bytebuf, &bytebuf_pos, 'd', 1, &flag );
+        MPE_Log_event( thisproc.mpe_event[LOG_CHANNELHASDATA], 0, bytebuf );    // event bubble for PI_ChannelHasData result
+    }
 #endif
 
-    /* Log the first item, so that if the format message causes a deadlock (which it
-     * likely will if the subsequent I/O would cause one), it will get diagnosed.
-     */
-    LOGCALL( "Gat", b->bund_id, format, 1, mpiArgCount, mpiArgs )
+    return flag;
+}
 
-    /* Calculate format signature; send from our "narrow" end of bundle to writers
-     * for matchup.
-     */
-    if ( PI_CheckLevel >= 2 ) {
-        int sig = (int)FormatSignature( mpiArgs, mpiArgCount );
+int PI_TrySelect_( PI_BUNDLE *b )
+{
+    PI_ON_ERROR_RETURN( -1 )
+    PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
+    PI_ASSERT( , b, PI_NULL_BUNDLE )
+    PI_ASSERT( LEVEL(1), ISVALID(PI_BUND,b), PI_INVALID_OBJ )
+    PI_ASSERT( , b->usage==PI_SELECT, PI_BUNDLE_USAGE )
+    PI_ASSERT( , b->narrow_end==TO, PI_ENDPOINT_READER )
 
-        PI_CALLMPI( MPI_Bcast( &sig, 1, MPI_INT,	// what we're sending
-                               0, b->comm ) )	// "root" is rank 0 in bundle
-    }
+    int i;
 
-    for ( i = 0; i < mpiArgCount; i++ ) {
-        PI_MPI_RTTI* arg = &mpiArgs[ i ];
+    LOGCALL( "Try", b->bund_id, "", 0, 0, NULL )
 
-        /* Reduce operation is never valid for PI_Gather */
-        PI_ASSERT( , arg->op==MPI_OP_NULL, PI_OP_INVALID )
+    if ( AggPending ) FlushAggregated();
+    i = SelectReady( b );	// -1 if no channel has data
 
-        /* set up args for MPI_Gather (receiving side) */
-        int recvcounts[b->size+1];	// count that each process sends
-        int displs[b->size+1];		// displacements in userbuf for recv
+#ifdef PILOT_WITH_MPE
+    if ( thisproc.svc_flag[LOG_MPE] ) {
+        bytebuf_pos = 0;
+        MPE_Log_pack( bytebuf, &bytebuf_pos, 'd', 1, &PI_CallerLine );
+        int namelen = strlen(b->name);
+        MPE_Log_pack( bytebuf, &bytebuf_pos, 's', MIN(LOG_TRYSELECT_SMAX,namelen), b->name );
+        MPE_Log_pack( bytebuf, &bytebuf_pos, 'd', 1, &i );
+        MPE_Log_event( thisproc.mpe_event[LOG_TRYSELECT], 0, bytebuf ); // event bubble for PI_TrySelect result
+    }
+#endif
+    return i;           // channel index with data
+}
 
-        /* Log each item */
-        if ( i>0 ) LOGCALL( "Gat", b->bund_id, format, i+1, mpiArgCount, arg );
+int PI_SelectTimeout_( PI_BUNDLE *b, double timeout )
+{
+    PI_ON_ERROR_RETURN( -1 )
+    PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
+    PI_ASSERT( , b, PI_NULL_BUNDLE )
+    PI_ASSERT( LEVEL(1), ISVALID(PI_BUND,b), PI_INVALID_OBJ )
+    PI_ASSERT( , b->usage==PI_SELECT, PI_BUNDLE_USAGE )
+    PI_ASSERT( , b->narrow_end==TO, PI_ENDPOINT_READER )
 
-        /* prepare recvcounts and displs arrays so that root sends nothing,
-           and all the rest send 'count' items */
-        recvcounts[0] = displs[0] = 0;
-        for ( chan=1; chan<=b->size; chan++ ) {
-            recvcounts[chan] = arg->count;
-            displs[chan] = (chan-1) * arg->count;	// fits buffer of size*count items
-        }
+    int i;
 
-#ifdef MPI_IN_PLACE
-        PI_CALLMPI( MPI_Gatherv(
-                        MPI_IN_PLACE, 0, 0,	// send no data from "root"
-                        arg->buf, recvcounts, displs, arg->type,	// receives all data
-                        0, b->comm ) )		// "root" is P0 in bundle communicator
-#else
-        char sendbuf[1];	// root sends 0-length data, so make dummy
-        PI_CALLMPI( MPI_Gatherv(
-                        sendbuf, 0, arg->type,	// send 0 data from "root"
-                        arg->buf, recvcounts, displs, arg->type,	// receives all data
-                        0, b->comm ) )		// "root" is P0 in bundle communicator
-#endif
+    if ( timeout < 0 ) return PI_Select_( b );	// logged as blocking
+
+    /* logged as a try, since the wait may end without a channel */
+    LOGCALL( "Try", b->bund_id, "", 0, 0, NULL )
+
+    if ( AggPending ) FlushAggregated();
+    i = PollSelect( b, timeout );
 
-#ifdef PILOT_WITH_MPE
-        if ( thisproc.svc_flag[LOG_MPE] ) {                     // fan in message arrows from PI_Writers
-            int j;
-            for ( j = 0; j < b->size; j++ ) {
-                MPE_Log_receive( b->channels[j]->producer, b->channels[j]->chan_tag, arg->count );
-                bytebuf_pos = 0;
-                MPE_Log_pack( bytebuf, &bytebuf_pos, 's', strlen( b->channels[j]->name ), b->channels[j]->name );
-                MPE_Log_event( thisproc.mpe_event[LOG_CHANNEL], 0, bytebuf );   // event bubble in PI_Gather
-                usleep(1000);   // pause 1 msec. so message arrows don't get superimposed in logfile
-            }
-        }
-#endif
-    }
 #ifdef PILOT_WITH_MPE
     if ( thisproc.svc_flag[LOG_MPE] ) {
         bytebuf_pos = 0;
         MPE_Log_pack( bytebuf, &bytebuf_pos, 'd', 1, &PI_CallerLine );
-        int namelen = strlen(thisproc.processes[thisproc.rank].name);
-        MPE_Log_pack( bytebuf, &bytebuf_pos, 's', MIN(LOG_GATHER_S1MAX,namelen), thisproc.processes[thisproc.rank].name );
-        MPE_Log_pack( bytebuf, &bytebuf_pos, 'd', 1, &thisproc.processes[thisproc.rank].argument );
-        namelen = strlen(b->name);
-        MPE_Log_pack( bytebuf, &bytebuf_pos, 's', MIN(LOG_GATHER_S2MAX,namelen), b->name );
-        MPE_Log_event( thisproc.mpe_eventse[LOG_GATHER][1], 0, bytebuf );       // mark end of PI_Gather
+        int namelen = strlen(b->name);
+        MPE_Log_pack( bytebuf, &bytebuf_pos, 's', MIN(LOG_TRYSELECT_SMAX,namelen), b->name );
+        MPE_Log_pack( bytebuf, &bytebuf_pos, 'd', 1, &i );
+        MPE_Log_event( thisproc.mpe_event[LOG_TRYSELECT], 0, bytebuf ); // event bubble for PI_SelectTimeout result
+    }
+#endif
+    return i;
+}
+
+int PI_SelectRead_( PI_BUNDLE *b, const char *format, ... )
+{
+    PI_ON_ERROR_RETURN( -1 )
+    PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
+    PI_ASSERT( , b, PI_NULL_BUNDLE )
+    PI_ASSERT( LEVEL(1), ISVALID(PI_BUND,b), PI_INVALID_OBJ )
+    PI_ASSERT( , b->usage==PI_SELECT, PI_BUNDLE_USAGE )
+    PI_ASSERT( , b->narrow_end==TO, PI_ENDPOINT_READER )
+    PI_ASSERT( , format, PI_NULL_FORMAT )
+
+    int i = -1, flag = 0, rings = 0, spins = 0;
+    va_list argptr;
+    int mpiArgCount;
+    PI_MPI_RTTI mpiArgs[ PI_MAX_FORMATLEN ];
+    PI_FORMAT *compiled = NULL;
+    MPI_Status status;
+    PI_CHANNEL *c;
+#if MPI_VERSION >= 3
+    PI_PROBED msg;
+#endif
+
+    LOGCALL( "Sel", b->bund_id, "", 0, 0, NULL )
+
+    /* parse first, so that a bad format doesn't leave a message matched */
+    va_start( argptr, format );
+    mpiArgCount = ParseFormatString( IO_CONTEXT_LOCS, mpiArgs, &compiled, format, argptr );
+    va_end( argptr );
+    if ( mpiArgCount < 0 ) return -1;	// func. detected error with PI_OnErrorReturn
+
+    if ( AggPending ) FlushAggregated();
+
+    /* As in PI_Select, but the message found is matched, and the channel's
+     * read (see MatchNext) receives that very message instead of matching it
+     * again.  Data outside MPI, or a bundle with a select policy, is read as
+     * by PI_Read.
+     */
+    if ( thisproc.svc_flag[WAIT_POLL] ) i = PollSelect( b, -1.0 );
+    else if ( b->policy != PI_SELECT_ANY ) i = FairSelect( b, 1 );
+    else if ( b->postReqs ) i = PostedSelect( b, 1 );
+    else if ( AggUnread || RingsActive ) i = UnprobedData( b, &rings );
+    while ( i < 0 ) {
+#if MPI_VERSION >= 3
+        if ( rings ) {
+            PI_CALLMPI( MPI_Improbe( MPI_ANY_SOURCE, b->channels[0]->chan_tag,
+                                     PI_CommWorld, &flag, &msg, &status ) )
+        }
+        else {
+            PI_CALLMPI( MPI_Mprobe( MPI_ANY_SOURCE, b->channels[0]->chan_tag,
+                                    PI_CommWorld, &msg, &status ) )
+            flag = 1;
+        }
+#else
+        if ( rings ) {
+            PI_CALLMPI( MPI_Iprobe( MPI_ANY_SOURCE, b->channels[0]->chan_tag,
+                                    PI_CommWorld, &flag, &status ) )
+        }
+        else {
+            PI_CALLMPI( MPI_Probe( MPI_ANY_SOURCE, b->channels[0]->chan_tag,
+                                   PI_CommWorld, &status ) )
+            flag = 1;
+        }
+#endif
+        if ( flag ) {
+            i = b->index[ status.MPI_SOURCE ];
+            PI_ASSERT( , i >= 0, PI_SYSTEM_ERROR )
+#if MPI_VERSION >= 3
+            c = b->channels[i];
+            c->probed = msg;
+            c->probedStatus = status;
+            c->matched = 1;
+#endif
+        }
+        else if ( ( i = UnprobedData( b, &rings ) ) < 0 ) RingWait( &spins );
+    }
+
+    c = b->channels[i];
+    if ( c->format )
+        PI_ASSERT( , SameFormat( c->format, format ), PI_FORMAT_MISMATCH )
+
+    /* earlier PI_IReads with deferred items get their data first */
+    if ( c->deferTail && !FinishDeferred( c->deferTail, 1 ) ) return -1;
+
+    ReadArgs( c, format, compiled, mpiArgs, mpiArgCount, 0 );
+    return i;
+}
+
+int PI_SelectAll_( PI_BUNDLE *b, int ready[] )
+{
+    PI_ON_ERROR_RETURN( 0 )
+    PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
+    PI_ASSERT( , b, PI_NULL_BUNDLE )
+    PI_ASSERT( LEVEL(1), ISVALID(PI_BUND,b), PI_INVALID_OBJ )
+    PI_ASSERT( , b->usage==PI_SELECT, PI_BUNDLE_USAGE )
+    PI_ASSERT( , b->narrow_end==TO, PI_ENDPOINT_READER )
+    PI_ASSERT( , ready, PI_BOGUS_POINTER_ARG )
+
+    LOGCALL( "Sel", b->bund_id, "", 0, 0, NULL )
+
+    if ( AggPending ) FlushAggregated();
+    return ReadySet( b, ready, 1 );
+}
+
+int PI_TrySelectAll_( PI_BUNDLE *b, int ready[] )
+{
+    PI_ON_ERROR_RETURN( 0 )
+    PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
+    PI_ASSERT( , b, PI_NULL_BUNDLE )
+    PI_ASSERT( LEVEL(1), ISVALID(PI_BUND,b), PI_INVALID_OBJ )
+    PI_ASSERT( , b->usage==PI_SELECT, PI_BUNDLE_USAGE )
+    PI_ASSERT( , b->narrow_end==TO, PI_ENDPOINT_READER )
+    PI_ASSERT( , ready, PI_BOGUS_POINTER_ARG )
+
+    LOGCALL( "Try", b->bund_id, "", 0, 0, NULL )
+
+    if ( AggPending ) FlushAggregated();
+    return ReadySet( b, ready, 0 );
+}
+
+void PI_ReadReady_( PI_BUNDLE *b, const int ready[], int n, const char *format, ... )
+{
+    PI_ON_ERROR_RETURN()
+    PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
+    PI_ASSERT( , b, PI_NULL_BUNDLE )
+    PI_ASSERT( LEVEL(1), ISVALID(PI_BUND,b), PI_INVALID_OBJ )
+    PI_ASSERT( , b->usage==PI_SELECT, PI_BUNDLE_USAGE )
+    PI_ASSERT( , b->narrow_end==TO, PI_ENDPOINT_READER )
+    PI_ASSERT( , ready || n==0, PI_BOGUS_POINTER_ARG )
+    PI_ASSERT( , n >= 0 && n <= b->size, PI_ARRAY_LENGTH )
+    PI_ASSERT( , format, PI_NULL_FORMAT )
+
+    int i, j;
+    va_list argptr;
+    int mpiArgCount;
+    PI_MPI_RTTI mpiArgs[ PI_MAX_FORMATLEN ], chanArgs[ PI_MAX_FORMATLEN ];
+    MPI_Aint stride[ PI_MAX_FORMATLEN ];
+    PI_FORMAT *compiled = NULL;
+    PI_CHANNEL *c;
+
+    for ( i = 0; i < n; i++ ) {
+        PI_ASSERT( , ready[i] >= 0 && ready[i] < b->size, PI_BUNDLE_INDEX )
+        c = b->channels[ ready[i] ];
+        if ( c->format )
+            PI_ASSERT( , SameFormat( c->format, format ), PI_FORMAT_MISMATCH )
+    }
+
+    /* the format is parsed once for all the reads */
+    va_start( argptr, format );
+    mpiArgCount = BindMulti( mpiArgs, &compiled, stride, format, argptr );
+    va_end( argptr );
+    if ( mpiArgCount < 0 ) return;	// func. detected error with PI_OnErrorReturn
+
+    for ( i = 0; i < n; i++ ) {
+        c = b->channels[ ready[i] ];
+        for ( j = 0; j < mpiArgCount; j++ ) {
+            chanArgs[j] = mpiArgs[j];
+            chanArgs[j].buf = (char *)mpiArgs[j].buf + i * stride[j];
+        }
+
+        /* earlier PI_IReads with deferred items get their data first */
+        if ( c->deferTail && !FinishDeferred( c->deferTail, 1 ) ) return;
+
+        ReadArgs( c, format, compiled, chanArgs, mpiArgCount, 0 );
+    }
+}
+
+PI_CHANNEL *PI_GetBundleChannel_( const PI_BUNDLE *b, int index )
+{
+    PI_ON_ERROR_RETURN( NULL )
+    PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
+    PI_ASSERT( , b, PI_NULL_BUNDLE )
+    PI_ASSERT( LEVEL(1), ISVALID(PI_BUND,b), PI_INVALID_OBJ )
+    PI_ASSERT( , index >= 0 && index < b->size, PI_BUNDLE_INDEX )
+
+    return b->channels[index];
+}
+
+int PI_GetBundleSize_( const PI_BUNDLE *b )
+{
+    PI_ON_ERROR_RETURN( 0 )
+    PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
+    PI_ASSERT( , b, PI_NULL_BUNDLE )
+    PI_ASSERT( LEVEL(1), ISVALID(PI_BUND,b), PI_INVALID_OBJ )
+
+    return b->size;
+}
+
+
+void PI_Broadcast_( PI_BUNDLE *b, const char *format, ... )
+{
+    PI_ON_ERROR_RETURN()
+    PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
+    PI_ASSERT( , b, PI_NULL_BUNDLE )
+    PI_ASSERT( , format, PI_NULL_FORMAT )
+    PI_ASSERT( LEVEL(1), ISVALID(PI_BUND,b), PI_INVALID_OBJ )
+    PI_ASSERT( , b->usage==PI_BROADCAST, PI_BUNDLE_USAGE )
+    PI_ASSERT( , thisproc.rank==b->channels[0]->producer, PI_ENDPOINT_WRITER )
+
+    int i;
+    va_list argptr;
+    int mpiArgCount;
+    PI_MPI_RTTI mpiArgs[ PI_MAX_FORMATLEN ];
+    PI_FORMAT *compiled = NULL;
+
+    va_start( argptr, format );
+    mpiArgCount = ParseFormatString( IO_CONTEXT_VALS, mpiArgs, &compiled, format, argptr );
+    va_end( argptr );
+    if ( mpiArgCount < 0 ) return;	// func. detected error with PI_OnErrorReturn
+    if ( AggPending ) FlushAggregated();	// the collective may block
+
+#ifdef PILOT_WITH_MPE
+    if ( thisproc.svc_flag[LOG_MPE] )
+        MPE_Log_event( thisproc.mpe_eventse[LOG_BROADCAST][0], 0, NULL );       // mark start of PI_Broadcast
+#endif
+
+    /* Log the first item, so that if the format message causes a deadlock (which it
+     * likely will if the subsequent I/O would cause one), it will get diagnosed.
+     */
+    LOGCALL( "Bro", b->bund_id, format, 1, mpiArgCount, mpiArgs )
+
+    /* Calculate format signature; send from our "narrow" end of bundle to readers
+     * for matchup, along with the first item.
+     */
+    int sig = 0;
+    if ( PI_CheckLevel >= 2 )
+        sig = (int)GetSignature( compiled, mpiArgs, mpiArgCount );
+
+    for ( i = 0; i < mpiArgCount; i++ ) {
+        PI_MPI_RTTI* arg = &mpiArgs[ i ];
+
+        /* Reduce operation is never valid for PI_Broadcast */
+        PI_ASSERT( , arg->op==MPI_OP_NULL, PI_OP_INVALID )
+
+        /* Log each item */
+        if ( i>0 ) LOGCALL( "Bro", b->bund_id, format, i+1, mpiArgCount, arg );
+
+#ifdef PILOT_WITH_MPE
+        if ( thisproc.svc_flag[LOG_MPE] ) {
+            int j;
+            for ( j = b->size-1; j >= 0; j-- ) {          // fan out message arrows to PI_Readers
+                mybuff[0] = '\0';
+                bytebuf_pos = 0;
+                // skip leading PI_LOGSEP char output by interpArg
+                int namelen = strlen( interpArg(mybuff, LOG_BROADCAST_MSG_SMAX, "Bro", &mpiArgs[i]) ) - 1;
+                MPE_Log_pack( bytebuf, &bytebuf_pos, 's', MIN(LOG_BROADCAST_MSG_SMAX,namelen), mybuff+1 );
+                MPE_Log_event( thisproc.mpe_event[LOG_BROADCAST_MSG], 0, bytebuf );     // event bubble in PI_Broadcast
+                MPE_Log_send( b->channels[j]->consumer, b->channels[j]->chan_tag, arg->count ); // sender's end of message arrow
+                usleep(1000);   // pause 1 msec. so message arrows don't get superimposed in logfile
+            }
+        }
+#endif
+
+        if ( i==0 && PI_CheckLevel >= 2 ) {	// first item carries signature
+            MPI_Datatype sigtype = SigDatatype( SigCache( compiled ), &sig, arg );
+            PI_CALLMPI( MPI_Bcast( MPI_BOTTOM, 1, sigtype, 0, b->comm ) )
+            FreeSigDatatype( SigCache( compiled ), &sigtype );
+        }
+        else PI_CALLMPI( MPI_Bcast(
+                             arg->buf, arg->count, arg->type,	// what we're sending
+                             0, b->comm ) )		// "root" is rank 0 in bundle
+    }
+#ifdef PILOT_WITH_MPE
+    if ( thisproc.svc_flag[LOG_MPE] ) {
+        bytebuf_pos = 0;
+        MPE_Log_pack( bytebuf, &bytebuf_pos, 'd', 1, &PI_CallerLine );
+        int namelen = strlen(thisproc.processes[thisproc.rank].name);
+        MPE_Log_pack( bytebuf, &bytebuf_pos, 's', MIN(LOG_BROADCAST_S1MAX,namelen), thisproc.processes[thisproc.rank].name );
+        MPE_Log_pack( bytebuf, &bytebuf_pos, 'd', 1, &thisproc.processes[thisproc.rank].argument );
+        namelen = strlen(b->name);
+        MPE_Log_pack( bytebuf, &bytebuf_pos, 's', MIN(LOG_BROADCAST_S2MAX,namelen), b->name );
+        MPE_Log_event( thisproc.mpe_eventse[LOG_BROADCAST][1], 0, bytebuf );    // mark end of PI_Broadcast
+    }
+#endif
+}
+
+
+void PI_Scatter_( PI_BUNDLE *b, const char *format, ... )
+{
+    PI_ON_ERROR_RETURN()
+    PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
+    PI_ASSERT( , b, PI_NULL_BUNDLE )
+    PI_ASSERT( , format, PI_NULL_FORMAT )
+    PI_ASSERT( LEVEL(1), ISVALID(PI_BUND,b), PI_INVALID_OBJ )
+    PI_ASSERT( , b->usage==PI_SCATTER, PI_BUNDLE_USAGE )
+    PI_ASSERT( , thisproc.rank==b->channels[0]->producer, PI_ENDPOINT_WRITER )
+
+    int i, chan;
+    va_list argptr;
+    int mpiArgCount;
+    PI_MPI_RTTI mpiArgs[ PI_MAX_FORMATLEN ];
+    PI_FORMAT *compiled = NULL;
+
+    va_start( argptr, format );
+    mpiArgCount = ParseFormatString( IO_CONTEXT_LOCS, mpiArgs, &compiled, format, argptr );
+    va_end( argptr );
+    if ( mpiArgCount < 0 ) return;	// func. detected error with PI_OnErrorReturn
+    if ( AggPending ) FlushAggregated();	// the collective may block
+#ifdef PILOT_WITH_MPE
+    if ( thisproc.svc_flag[LOG_MPE] )
+        MPE_Log_event( thisproc.mpe_eventse[LOG_SCATTER][0], 0, NULL ); // mark start of PI_Scatter
+#endif
+
+    /* Log the first item, so that if the format message causes a deadlock (which it
+     * likely will if the subsequent I/O would cause one), it will get diagnosed.
+     */
+    LOGCALL( "Sca", b->bund_id, format, 1, mpiArgCount, mpiArgs )
+
+    /* Calculate format signature; send from our "narrow" end of bundle to readers
+     * for matchup, overlapped with the data.
+     */
+    static int sig;		// static in case of an early error return
+    MPI_Request sigReq = MPI_REQUEST_NULL;
+    if ( PI_CheckLevel >= 2 ) {
+        sig = (int)GetSignature( compiled, mpiArgs, mpiArgCount );
+        StartSigBcast( &sig, b->comm, &sigReq );
+    }
+
+    for ( i = 0; i < mpiArgCount; i++ ) {
+        PI_MPI_RTTI* arg = &mpiArgs[ i ];
+
+        /* Reduce operation is never valid for PI_Scatter */
+        PI_ASSERT( , arg->op==MPI_OP_NULL, PI_OP_INVALID )
+
+        /* set up args for MPI_Scatter (sending side) */
+        int sendcounts[b->size+1];	// count sent to each process
+        int displs[b->size+1];		// displacements in userbuf for send
+
+        /* Log each item */
+        if ( i>0 ) LOGCALL( "Sca", b->bund_id, format, i+1, mpiArgCount, arg );
+
+#ifdef PILOT_WITH_MPE
+        if ( thisproc.svc_flag[LOG_MPE] ) {                     // fan out message arrows to PI_Readers
+            int j;
+            for ( j = b->size - 1; j >= 0; j-- ) {
+                mybuff[0] = '\0';
+                bytebuf_pos = 0;
+                // skip leading PI_LOGSEP char output by interpArg
+                int namelen = strlen( interpArg(mybuff, LOG_SCATTER_MSG_SMAX, "Sca", &mpiArgs[i]) ) - 1;
+                MPE_Log_pack( bytebuf, &bytebuf_pos, 's', MIN(LOG_SCATTER_MSG_SMAX,namelen), mybuff+1 );
+                MPE_Log_event( thisproc.mpe_event[LOG_SCATTER_MSG], 0, bytebuf );       // event bubble in PI_Scatter
+                MPE_Log_send( b->channels[j]->consumer, b->channels[j]->chan_tag, arg->count ); // sender's end of message arrow
+                usleep(1000);   // pause 1 msec. so message arrows don't get superimposed in logfile
+            }
+        }
+#endif
+
+        /* prepare sendcounts and displs arrays so that root receives nothing,
+           and all the rest receive 'count' items; displs are in units of the
+           datatype, so if they would overflow an int, wrap the items into one */
+        if ( (long long)(b->size-1) * arg->count > INT_MAX )
+            WrapCount( arg, arg->count, 1 );
+        sendcounts[0] = displs[0] = 0;
+        for ( chan=1; chan<=b->size; chan++ ) {
+            sendcounts[chan] = arg->count;
+            displs[chan] = (chan-1) * arg->count;	// fits buffer of size*count items
+        }
+
+#ifdef MPI_IN_PLACE
+        PI_CALLMPI( MPI_Scatterv(
+                        arg->buf, sendcounts, displs, arg->type,	// sends all data
+                        MPI_IN_PLACE, 0, 0,	// receive 0 data from "root"
+                        0, b->comm ) )		// "root" is P0 in bundle communicator
+#else
+        char recvbuf[1];	// root receives 0-length data, so make dummy
+        PI_CALLMPI( MPI_Scatterv(
+                        arg->buf, sendcounts, displs, arg->type,	// sends all data
+                        recvbuf, 0, arg->type,	// receive 0 data from "root"
+                        0, b->comm ) )		// "root" is P0 in bundle communicator
+#endif
+    }
+    PI_CALLMPI( MPI_Wait( &sigReq, MPI_STATUS_IGNORE ) )
+#ifdef PILOT_WITH_MPE
+    if ( thisproc.svc_flag[LOG_MPE] ) {
+        bytebuf_pos = 0;
+        MPE_Log_pack( bytebuf, &bytebuf_pos, 'd', 1, &PI_CallerLine );
+        int namelen = strlen(thisproc.processes[thisproc.rank].name);
+        MPE_Log_pack( bytebuf, &bytebuf_pos, 's', MIN(LOG_SCATTER_S1MAX,namelen), thisproc.processes[thisproc.rank].name );
+        MPE_Log_pack( bytebuf, &bytebuf_pos, 'd', 1, &thisproc.processes[thisproc.rank].argument );
+        namelen = strlen(b->name);
+        MPE_Log_pack( bytebuf, &bytebuf_pos, 's', MIN(LOG_SCATTER_S2MAX,namelen), b->name );
+        MPE_Log_event( thisproc.mpe_eventse[LOG_SCATTER][1], 0, bytebuf );      // mark end of PI_Scatter
+    }
+#endif
+}
+
+
+void PI_Reduce_( PI_BUNDLE *b, const char *format, ... )
+{
+    PI_ON_ERROR_RETURN()
+    PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
+    PI_ASSERT( , b, PI_NULL_BUNDLE )
+    PI_ASSERT( , format, PI_NULL_FORMAT )
+    PI_ASSERT( LEVEL(1), ISVALID(PI_BUND,b), PI_INVALID_OBJ )
+    PI_ASSERT( , b->usage==PI_REDUCE, PI_BUNDLE_USAGE )
+    PI_ASSERT( , thisproc.rank==b->channels[0]->consumer, PI_ENDPOINT_READER )
+
+    int i;
+    va_list argptr;
+    int mpiArgCount;
+    PI_MPI_RTTI mpiArgs[ PI_MAX_FORMATLEN ];
+    PI_FORMAT *compiled = NULL;
+    MPI_Status status;
+
+    va_start( argptr, format );
+    mpiArgCount = ParseFormatString( IO_CONTEXT_LOCS, mpiArgs, &compiled, format, argptr );
+    va_end( argptr );
+    if ( mpiArgCount < 0 ) return;	// func. detected error with PI_OnErrorReturn
+    if ( AggPending ) FlushAggregated();	// the collective may block
+#ifdef PILOT_WITH_MPE
+    if ( thisproc.svc_flag[LOG_MPE] )
+        MPE_Log_event( thisproc.mpe_eventse[LOG_REDUCE][0], 0, NULL );  // mark start of PI_Reduce
+#endif
+
+    /* Log the first item, so that if the format message causes a deadlock (which it
+     * likely will if the subsequent I/O would cause one), it will get diagnosed.
+     */
+    LOGCALL( "Rdu", b->bund_id, format, 1, mpiArgCount, mpiArgs )
+
+    /* The reduction topology is complex: The writers are in a communicator, and
+     * the "rank 0" member (=the root) is nominated to get the reduced result and
+     * send it to the PI_Reduce process. So as the latter, we obey the "reader
+     * validates the format" rule: we receive the writer's format and compare.
+     */
+    int sig = 0;
+    if ( PI_CheckLevel >= 2 )	// writer's format comes with the first result
+        sig = (int)GetSignature( compiled, mpiArgs, mpiArgCount );
+
+    for ( i = 0; i < mpiArgCount; i++ ) {
+        PI_MPI_RTTI* arg = &mpiArgs[ i ];
+
+        /* PI_Reduce doesn't actually use the operator, but we insist on it
+           for consistency. */
+        PI_ASSERT( , arg->op!=MPI_OP_NULL, PI_OP_MISSING )
+
+        /* Log each item */
+        if ( i>0 ) LOGCALL( "Rdu", b->bund_id, format, i+1, mpiArgCount, arg );
+
+        /* The actual reduction is done within the communicator, i.e., by the
+           processes on the bundle's rim.  The 1st channel's producer process
+           will send the result back here. */
+        if ( i==0 && PI_CheckLevel >= 2 ) {
+            if ( !RecvSignedItem( SigCache( compiled ), arg, sig, b->channels[0], NULL ) )
+                return;	// func. detected error with PI_OnErrorReturn
+        }
+        else PI_CALLMPI( MPI_Recv( arg->buf, arg->count, arg->type,
+                                   b->channels[0]->producer, b->channels[0]->chan_tag,
+                                   PI_CommWorld, &status ) )
+#ifdef PILOT_WITH_MPE
+        if ( thisproc.svc_flag[LOG_MPE] ) {                     // fan in message arrows from PI_Writers
+            int j;
+            for ( j = 0; j < b->size; j++ ) {
+                MPE_Log_receive( b->channels[j]->producer, b->channels[j]->chan_tag, arg->count );  // receiver's end of message arrow
+                bytebuf_pos = 0;
+                MPE_Log_pack( bytebuf, &bytebuf_pos, 's', strlen( b->channels[j]->name ), b->channels[j]->name );
+                MPE_Log_event( thisproc.mpe_event[LOG_CHANNEL], 0, bytebuf );   // event bubble in PI_Reduce
+                usleep(1000);   // pause 1 msec. so message arrows don't get superimposed in logfile
+            }
+        }
+#endif
+    }
+#ifdef PILOT_WITH_MPE
+    if ( thisproc.svc_flag[LOG_MPE] ) {
+        bytebuf_pos = 0;
+        MPE_Log_pack( bytebuf, &bytebuf_pos, 'd', 1, &PI_CallerLine );
+        int namelen = strlen(thisproc.processes[thisproc.rank].name);
+        MPE_Log_pack( bytebuf, &bytebuf_pos, 's', MIN(LOG_REDUCE_S1MAX,namelen), thisproc.processes[thisproc.rank].name );
+        MPE_Log_pack( bytebuf, &bytebuf_pos, 'd', 1, &thisproc.processes[thisproc.rank].argument );
+        namelen = strlen(b->name);
+        MPE_Log_pack( bytebuf, &bytebuf_pos, 's', MIN(LOG_REDUCE_S2MAX,namelen), b->name );
+        MPE_Log_event( thisproc.mpe_eventse[LOG_REDUCE][1], 0, bytebuf );       // mark end of PI_Reduce
+    }
+#endif
+}
+
+
+void PI_Gather_( PI_BUNDLE *b, const char *format, ... )
+{
+    PI_ON_ERROR_RETURN()
+    PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
+    PI_ASSERT( , b, PI_NULL_BUNDLE )
+    PI_ASSERT( , format, PI_NULL_FORMAT )
+    PI_ASSERT( LEVEL(1), ISVALID(PI_BUND,b), PI_INVALID_OBJ )
+    PI_ASSERT( , b->usage==PI_GATHER, PI_BUNDLE_USAGE )
+    PI_ASSERT( , thisproc.rank==b->channels[0]->consumer, PI_ENDPOINT_READER )
+
+    int i, chan;
+    va_list argptr;
+    int mpiArgCount;
+    PI_MPI_RTTI mpiArgs[ PI_MAX_FORMATLEN ];
+    PI_FORMAT *compiled = NULL;
+
+    va_start( argptr, format );
+    mpiArgCount = ParseFormatString( IO_CONTEXT_LOCS, mpiArgs, &compiled, format, argptr );
+    va_end( argptr );
+    if ( mpiArgCount < 0 ) return;	// func. detected error with PI_OnErrorReturn
+    if ( AggPending ) FlushAggregated();	// the collective may block
+#ifdef PILOT_WITH_MPE
+    if ( thisproc.svc_flag[LOG_MPE] )
+        MPE_Log_event( thisproc.mpe_eventse[LOG_GATHER][0], 0, NULL );  // mark start of PI_Gather
+#endif
+
+    /* Log the first item, so that if the format message causes a deadlock (which it
+     * likely will if the subsequent I/O would cause one), it will get diagnosed.
+     */
+    LOGCALL( "Gat", b->bund_id, format, 1, mpiArgCount, mpiArgs )
+
+    /* Calculate format signature; send from our "narrow" end of bundle to writers
+     * for matchup, overlapped with the data.
+     */
+    static int sig;		// static in case of an early error return
+    MPI_Request sigReq = MPI_REQUEST_NULL;
+    if ( PI_CheckLevel >= 2 ) {
+        sig = (int)GetSignature( compiled, mpiArgs, mpiArgCount );
+        StartSigBcast( &sig, b->comm, &sigReq );
+    }
+
+    for ( i = 0; i < mpiArgCount; i++ ) {
+        PI_MPI_RTTI* arg = &mpiArgs[ i ];
+
+        /* Reduce operation is never valid for PI_Gather */
+        PI_ASSERT( , arg->op==MPI_OP_NULL, PI_OP_INVALID )
+
+        /* set up args for MPI_Gather (receiving side) */
+        int recvcounts[b->size+1];	// count that each process sends
+        int displs[b->size+1];		// displacements in userbuf for recv
+
+        /* Log each item */
+        if ( i>0 ) LOGCALL( "Gat", b->bund_id, format, i+1, mpiArgCount, arg );
+
+        /* prepare recvcounts and displs arrays so that root sends nothing,
+           and all the rest send 'count' items; displs are in units of the
+           datatype, so if they would overflow an int, wrap the items into one */
+        if ( (long long)(b->size-1) * arg->count > INT_MAX )
+            WrapCount( arg, arg->count, 1 );
+        recvcounts[0] = displs[0] = 0;
+        for ( chan=1; chan<=b->size; chan++ ) {
+            recvcounts[chan] = arg->count;
+            displs[chan] = (chan-1) * arg->count;	// fits buffer of size*count items
+        }
+
+#ifdef MPI_IN_PLACE
+        PI_CALLMPI( MPI_Gatherv(
+                        MPI_IN_PLACE, 0, 0,	// send no data from "root"
+                        arg->buf, recvcounts, displs, arg->type,	// receives all data
+                        0, b->comm ) )		// "root" is P0 in bundle communicator
+#else
+        char sendbuf[1];	// root sends 0-length data, so make dummy
+        PI_CALLMPI( MPI_Gatherv(
+                        sendbuf, 0, arg->type,	// send 0 data from "root"
+                        arg->buf, recvcounts, displs, arg->type,	// receives all data
+                        0, b->comm ) )		// "root" is P0 in bundle communicator
+#endif
+
+#ifdef PILOT_WITH_MPE
+        if ( thisproc.svc_flag[LOG_MPE] ) {                     // fan in message arrows from PI_Writers
+            int j;
+            for ( j = 0; j < b->size; j++ ) {
+                MPE_Log_receive( b->channels[j]->producer, b->channels[j]->chan_tag, arg->count );
+                bytebuf_pos = 0;
+                MPE_Log_pack( bytebuf, &bytebuf_pos, 's', strlen( b->channels[j]->name ), b->channels[j]->name );
+                MPE_Log_event( thisproc.mpe_event[LOG_CHANNEL], 0, bytebuf );   // event bubble in PI_Gather
+                usleep(1000);   // pause 1 msec. so message arrows don't get superimposed in logfile
+            }
+        }
+#endif
+    }
+    PI_CALLMPI( MPI_Wait( &sigReq, MPI_STATUS_IGNORE ) )
+#ifdef PILOT_WITH_MPE
+    if ( thisproc.svc_flag[LOG_MPE] ) {
+        bytebuf_pos = 0;
+        MPE_Log_pack( bytebuf, &bytebuf_pos, 'd', 1, &PI_CallerLine );
+        int namelen = strlen(thisproc.processes[thisproc.rank].name);
+        MPE_Log_pack( bytebuf, &bytebuf_pos, 's', MIN(LOG_GATHER_S1MAX,namelen), thisproc.processes[thisproc.rank].name );
+        MPE_Log_pack( bytebuf, &bytebuf_pos, 'd', 1, &thisproc.processes[thisproc.rank].argument );
+        namelen = strlen(b->name);
+        MPE_Log_pack( bytebuf, &bytebuf_pos, 's', MIN(LOG_GATHER_S2MAX,namelen), b->name );
+        MPE_Log_event( thisproc.mpe_eventse[LOG_GATHER][1], 0, bytebuf );       // mark end of PI_Gather
+    }
+#endif
+}
+
+void PI_Log_( const char *text )
+{
+    PI_ON_ERROR_RETURN()
+    PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
+
+    /* if logging to file enabled, forward to LogEvent as USER type event */
+    if ( thisproc.svc_flag[OLP_LOGFILE] ) LogEvent( USER, text );
+
+#ifdef PILOT_WITH_MPE
+    if ( thisproc.svc_flag[LOG_MPE] ) {
+        bytebuf_pos = 0;
+        MPE_Log_pack( bytebuf, &bytebuf_pos, 'd', 1, &PI_CallerLine );
+        int textlen = strlen( text );
+        MPE_Log_pack( bytebuf, &bytebuf_pos, 's', MIN(LOG_LOG_SMAX,textlen), text );
+        MPE_Log_event( thisproc.mpe_event[LOG_LOG], 0, bytebuf );       // event bubble for PI_Log
+    }
+#endif
+}
+
+/* This function might be called before Pilot's tables are all set up, so be
+   sure we don't deref. any NULL pointers.  It can be called in any phase of
+   the program by any process.  If MPI is not even running yet, it will call
+   abort() and get out that way.  If Pilot is in the configuration phase (where
+   the same code is running on all nodes), only rank 0 will print, to avoid
+   cluttering the display with many duplicate messages.
+*/
+void PI_Abort( const int errcode, const char *text, const char *file, const int line )
+{
+    if ( thisproc.phase != CONFIG || thisproc.rank == 0 ) {
+        char *procname = "";
+        int procarg = 0;
+        if ( thisproc.processes ) {
+            procname = thisproc.processes[thisproc.rank].name;
+            procarg = thisproc.processes[thisproc.rank].argument;
+        }
+        fprintf( stderr, "\n" PI_BORDER
+                 "*** PI_Abort *** Called from MPI process #%d = Pilot process:\n"
+                 PI_BORDER "***   %s(%d) @ %s:%d:\n"
+                 PI_BORDER "***   %s%s\n" PI_BORDER
+                 "The above should pinpoint the problem.\n" PI_BORDER
+                 "Subsequent messages from MPI can likely be disregarded.\n",
+                 thisproc.rank, procname, procarg, file, line,
+                 ( errcode >= PI_MIN_ERROR && errcode <= PI_MAX_ERROR ) ?
+                 ErrorText[errcode] : "",
+                 text ? text : "" );
+    }
+
+    /* TODO: Shut down MPE logging gracefully so file isn't lost or
+       corrupted (MPI errors are intercepted and end up here, too).
+       Unfortunately, we only have control over one process -- this one --
+       indeed, others could be exited or deadlocked, so we can't arrange for
+       them to call MPE functions.  We know that MPI_Abort, at least with
+       OpenMPI, sends SIGTERM to all processes, and we *can* trap that, but
+       MPE calls in the handler don't seem to work or even return, probably
+       because they in turn use MPI and MPI is shutting down.  So we have
+       to give up on this :-(
+       Another approach would be to find a Pilot way to stop all the processes
+       without calling MPI_Abort (at least not till everything is tidied up). */
+
+    /* MPI should shut down the application and may call exit/abort(errcode) */
+    int MPI_up;
+    MPI_Initialized( &MPI_up );
+    if ( MPI_up )
+        MPI_Abort( MPI_COMM_WORLD, errcode );	// kill everyone, not just PI_CommWorld subset
+    else
+        abort();
+    /******** does not return *********/
+}
+
+void PI_StopMain_( int status )
+{
+    int i;
+
+    PI_ON_ERROR_RETURN()
+    PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
+
+    /* First job is to shutdown Pilot process logging, if it's active. */
+    if ( thisproc.svc_flag[OLP_RANK] == 1 ) {
+
+        /* Notify log that this process is finished (unless this *is* the log
+           process on rank 1) */
+        if ( thisproc.rank != 1 ) {
+            char buff[PI_MAX_LOGLEN];
+            sprintf( buff, "FIN" PI_LOGSEP "%d", status );
+            LogEvent( PILOT, buff );
+        }
+    }
+
+    /*MPE Shutdown Calls*/
+#ifdef PILOT_WITH_MPE
+    if ( thisproc.svc_flag[LOG_MPE] ) {
+        bytebuf_pos = 0;
+        MPE_Log_event( thisproc.mpe_eventse[LOG_COMPUTE][1], 0, NULL ); // end of execution phase (Compute state)
+        MPE_Log_sync_clocks();
+        MPE_Finish_log( LogFilename );
+    }
+#endif
+
+    /* Aggregated and write-behind writes must be sent before MPI goes away */
+    if ( AggPending ) FlushAggregated();
+    while ( RetireWriteBehind( 1 ) )
+        ;
+
+    MPI_Barrier( PI_CommWorld );	/* synchronize all processes */
+
+    FreeRings();
+    FreeRma();
+    FreePosted();
+
+    /* Compiled formats may hold MPI datatypes, so free them while MPI is up */
+    for ( i = 0; i < thisproc.allocated_channels; i++ )
+        FreeChannelFormat( thisproc.channels[i] );
+    FreeFormatCache();
+    FreeBigTypes();
+    FreeRecords();
+
+    /* If user pre-initialized MPI, then leave it initialized.  This is to
+       allow Pilot to be re-configured and used again in this program, which is
+       needed for running benchmarks, but not in ordinary use.  In this case,
+       since MPI_Finalize is not being called, we take the trouble to free up
+       the communicators created for non-selector bundles, because MPI is liable
+       to run out of that resource given enough repetitions.
+    */
+    if ( MPIPreInit ) {
+        thisproc.phase = PREINIT;
+        if ( thisproc.bundles != NULL )
+            for ( i = 0; i < thisproc.allocated_bundles; i++ ) {
+                if ( thisproc.bundles[i]->usage != PI_SELECT &&
+                        thisproc.bundles[i]->comm != MPI_COMM_NULL )
+                    MPI_Comm_free( &(thisproc.bundles[i]->comm) );
+            }
+    }
+    else {
+        thisproc.phase = POSTRUN;
+        MPI_Finalize( );
+    }
+
+    /* deallocate memory */
+
+    if ( StageBuf ) {
+        free( StageBuf );
+        StageBuf = NULL;
+        StageLen = 0;
+    }
+
+    FreePool();
+
+    for ( i = 0; i < thisproc.allocated_channels; i++ ) {
+        free( thisproc.channels[i]->aggBuf );
+        free( thisproc.channels[i] );
+    }
+
+    if ( thisproc.channels != NULL )
+        free( thisproc.channels );
+
+    if ( thisproc.processes != NULL )
+        free( thisproc.processes );
+
+    if ( thisproc.bundles != NULL ) {
+        for( i = 0; i < thisproc.allocated_bundles; i++ ) {
+            if ( thisproc.bundles[i]->channels != NULL )
+                free( thisproc.bundles[i]->channels );
+            free( thisproc.bundles[i]->index );
+            free( thisproc.bundles[i]->order );
+        }
+        free( thisproc.bundles );
+    }
+
+    if ( LogFilename ) free( LogFilename );
+
+    /* The main process always returns, but other processes normally exit
+       here because otherwise they would return from PI_StartAll and (re)execute
+       main's code.  However, if Pilot is in "bench mode", we do return so
+       that another Pilot application can be configured and executed.
+    */
+    if ( thisproc.rank!=0 && !MPIPreInit ) exit( 0 );
+}
+
+
+/*** Internal Functions ***/
+
+/*!
+********************************************************************************
+Called by MPI to handle error in library function.
+Handle the error reported from MPI by printing message and aborting.
+Could be due to Pilot's misuse of MPI, or MPI detecting a user error (like
+mismatched read/write data types or lengths).
+
+\param comm MPI communicator where error occurred (we don't use this).
+\param code MPI error code
+\param ... additional implementation-specific args (ignore)
+*******************************************************************************/
+static void HandleMPIErrors( MPI_Comm *comm, int *code, ... )
+{
+    char buff[MPI_MAX_ERROR_STRING], text[MPI_MAX_ERROR_STRING+80];
+    int len;
+
+    MPI_Error_string( *code, buff, &len );	// obtain text for error code
+
+    snprintf( text, sizeof(text), " at " __FILE__ ":%d; MPI error code %d:\n%s",
+              MPICallLine, *code, buff );
+
+    PI_Abort( PI_MPI_ERROR, text, PI_CallerFile, PI_CallerLine );
+    /***** does not return *****/
+}
+
+/*!
+********************************************************************************
+Has MPI report errors on a window with HandleMPIErrors, as on PI_CommWorld,
+since a window does not inherit its communicator's error handler.
+
+\param win Window just created.
+*******************************************************************************/
+static void HandleWinErrors( MPI_Win win )
+{
+    MPI_Errhandler errhandler;
+
+    PI_CALLMPI( MPI_Win_create_errhandler( (MPI_Win_errhandler_function*)HandleMPIErrors,
+                                           &errhandler ) )
+    PI_CALLMPI( MPI_Win_set_errhandler( win, errhandler ) )
+    PI_CALLMPI( MPI_Errhandler_free( &errhandler ) )
+}
+
+/*!
+********************************************************************************
+Sends a write on a PI_SEND_BUFFERED channel without waiting for the reader.
+The data is packed into a copy of its own and sent with MPI_Isend, so the
+caller may reuse its variables at once.  At most PI_WB_MESSAGES copies of up
+to PI_WB_BYTES in total are in flight from a process; when there is no room,
+this waits for the oldest to be sent.  A message too big for the pool, or
+one that can't be copied, is sent with MPI_Send instead.
+
+Takes the same arguments as MPI_Send, so it can take its place as the
+channel's sender.
+*******************************************************************************/
+static int WriteBehind( const void *buf, int count, MPI_Datatype type, int dest, int tag,
+                        MPI_Comm comm )
+{
+    int size, pos = 0;
+
+    MPI_Pack_size( count, type, comm, &size );
+    if ( size > PI_WB_BYTES ) return MPI_Send( buf, count, type, dest, tag, comm );
+
+    while ( WBCount > 0 && RetireWriteBehind( 0 ) )
+        ;
+    while ( WBCount == PI_WB_MESSAGES || WBBytes + size > PI_WB_BYTES )
+        RetireWriteBehind( 1 );
+
+    void *copy = malloc( size );
+    if ( copy == NULL ) return MPI_Send( buf, count, type, dest, tag, comm );
+    MPI_Pack( buf, count, type, copy, size, &pos, comm );
+
+    /* a packed message can be received with the types it was packed from */
+    PI_WBMSG *m = &WBMsgs[ ( WBFirst + WBCount ) % PI_WB_MESSAGES ];
+    m->buf = copy;
+    m->size = size;
+    WBCount++;
+    WBBytes += size;
+    return MPI_Isend( copy, pos, MPI_PACKED, dest, tag, comm, &m->req );
+}
+
+/*!
+********************************************************************************
+Frees the oldest write-behind copy once its send is done.
+
+\param block If true, waits for the send, else only tests it.
+\return 1 if a copy was freed, else 0.
+*******************************************************************************/
+static int RetireWriteBehind( int block )
+{
+    int flag = 1;
+    PI_WBMSG *m = &WBMsgs[ WBFirst ];
+
+    if ( WBCount == 0 ) return 0;
+    if ( block ) MPI_Wait( &m->req, MPI_STATUS_IGNORE );
+    else MPI_Test( &m->req, &flag, MPI_STATUS_IGNORE );
+    if ( !flag ) return 0;
+
+    free( m->buf );
+    WBBytes -= m->size;
+    WBFirst = ( WBFirst + 1 ) % PI_WB_MESSAGES;
+    WBCount--;
+    return 1;
+}
+
+/*!
+********************************************************************************
+Makes sure an aggregating channel's buffer can hold \p size bytes.  The writer
+packs its writes into it, and the reader receives each batch into it.
+
+\param c Channel in PI_SEND_AGGREGATE mode.
+\param size Number of bytes needed.
+\return Pointer to the buffer, or NULL if it could not be enlarged.
+*******************************************************************************/
+static void *AggBuffer( PI_CHANNEL *c, int size )
+{
+    if ( size > c->aggSize ) {
+        if ( size < 2 * PI_AGG_BYTES ) size = 2 * PI_AGG_BYTES;	// a batch and one more write
+        char *p = realloc( c->aggBuf, size );
+        if ( p == NULL ) return NULL;
+        c->aggBuf = p;
+        c->aggSize = size;
+    }
+    return c->aggBuf;
+}
+
+/*!
+********************************************************************************
+Sends the writes an aggregating channel has accumulated, as one message.
+*******************************************************************************/
+static void FlushChannel( PI_CHANNEL *c )
+{
+    if ( c->aggPos == 0 ) return;
+    PI_CALLMPI( MPISender[ c->sendmode ]( c->aggBuf, c->aggPos, MPI_PACKED, c->consumer,
+                                          c->chan_tag, PI_CommWorld ) )
+    c->aggPos = 0;
+    AggPending--;
+}
+
+/*!
+********************************************************************************
+Sends the accumulated writes of all this process's aggregating channels.  Done
+before anything that may wait for another process, which might be waiting for
+them.
+*******************************************************************************/
+static void FlushAggregated( void )
+{
+    int i;
+
+    for ( i = 0; i < thisproc.allocated_channels && AggPending > 0; i++ ) {
+        PI_CHANNEL *c = thisproc.channels[i];
+        if ( c->producer == thisproc.rank && c->sendmode == PI_SEND_AGGREGATE )
+            FlushChannel( c );
+    }
+}
+
+/*!
+********************************************************************************
+Tells whether a channel has data to read, wherever it is waiting: left over
+from an aggregated message, in a ring, or in MPI.
+
+\param c Channel, read end.
+\return 1 if it has data, else 0.
+*******************************************************************************/
+static int ChannelReady( PI_CHANNEL *c )
+{
+    int flag;
+    MPI_Status s;
+
+    if ( c->matched ) return 1;	// by PI_SelectRead, so probing won't find it
+    if ( c->postSel ) return PostedLanded( c->postSel, c->postSel->index[ c->producer ], 0 );
+    if ( c->sendmode==PI_SEND_AGGREGATE && c->aggPos < c->aggLen ) return 1;
+    if ( c->ring || c->rma ) return RingHasData( c );
+    PI_CALLMPI( MPI_Iprobe( c->producer, c->chan_tag, PI_CommWorld, &flag, &s ) )
+    return flag;
+}
+
+/*!
+********************************************************************************
+Chooses a channel with data in a selector bundle whose policy isn't
+PI_SELECT_ANY, by looking at its channels one by one in the order the policy
+favours, and updates the policy's state for the one chosen.
+
+\param b Selector bundle.
+\param block If 0, return instead of waiting for data.
+\return Index of the channel in the bundle, or -1 if none is ready and
+\p block is 0.
+*******************************************************************************/
+static int FairSelect( PI_BUNDLE *b, int block )
+{
+    int i, k, rings;
+    PI_WAITER w;
+
+    WaitBegin( &w, -1.0 );
+
+    for ( ;; ) {
+        rings = 0;
+        for ( k = 0; k < b->size; k++ ) {
+            i = b->policy == PI_SELECT_ROUND_ROBIN ? ( b->next + k ) % b->size : b->order[k];
+            if ( b->channels[i]->ring || b->channels[i]->rma ) rings = 1;
+            if ( !ChannelReady( b->channels[i] ) ) continue;
+
+            if ( b->policy == PI_SELECT_ROUND_ROBIN )
+                b->next = ( i + 1 ) % b->size;
+            else {		// to the back of the line
+                memmove( &b->order[k], &b->order[k+1], ( b->size - k - 1 ) * sizeof( int ) );
+                b->order[ b->size - 1 ] = i;
+            }
+            return i;
+        }
+        if ( !block ) return -1;
+        AwaitSelect( b, rings, &w );
+    }
+}
+
+/*!
+********************************************************************************
+Lists every channel in a selector bundle that has data, looking at each one
+once per pass.
+
+\param b Selector bundle.
+\param ready Set to the indices of the channels with data, in ascending order;
+must have room for the whole bundle.
+\param block If 0, return instead of waiting for data.
+\return Number of channels listed, 0 only if \p block is 0.
+*******************************************************************************/
+static int ReadySet( PI_BUNDLE *b, int ready[], int block )
+{
+    int i, n, rings;
+    PI_WAITER w;
+
+    WaitBegin( &w, -1.0 );
+    for ( ;; ) {
+        rings = n = 0;
+        for ( i = 0; i < b->size; i++ ) {
+            if ( b->channels[i]->ring || b->channels[i]->rma ) rings = 1;
+            if ( ChannelReady( b->channels[i] ) ) ready[n++] = i;
+        }
+        if ( n > 0 || !block ) return n;
+        AwaitSelect( b, rings, &w );
+    }
+}
+
+/*!
+********************************************************************************
+Waits for a message that may give a selector bundle's channel data, so that
+its channels are worth looking at again.  Rings can't be probed, so if the
+bundle has any, they are polled instead, as is everything with -piwait.
+
+\param b Selector bundle.
+\param rings True if any of its channels has a ring or RMA buffer.
+\param w The wait so far, begun with no deadline.
+*******************************************************************************/
+static void AwaitSelect( PI_BUNDLE *b, int rings, PI_WAITER *w )
+{
+    MPI_Status status;
+
+    if ( thisproc.svc_flag[WAIT_POLL] ) WaitPause( w );
+    else if ( b->postReqs ) PostedAny( b, 1 );	// probes can't see them
+    else if ( rings ) RingWait( &w->spins );
+    else PI_CALLMPI( MPI_Probe( MPI_ANY_SOURCE, b->channels[0]->chan_tag,
+                                PI_CommWorld, &status ) )
+}
+
+/*!
+********************************************************************************
+Chooses a channel with data in a selector bundle, without waiting, as
+PI_TrySelect does.
+
+\param b Selector bundle, read end.
+\return Index of the channel in the bundle, or -1 if none has data.
+*******************************************************************************/
+static int SelectReady( PI_BUNDLE *b )
+{
+    PI_ON_ERROR_RETURN( -1 )
+    int flag, i;
+    MPI_Status status;
+
+    if ( b->policy != PI_SELECT_ANY ) return FairSelect( b, 0 );
+    if ( b->postReqs ) return PostedSelect( b, 0 );
+    if ( ( AggUnread || RingsActive ) && ( i = UnprobedData( b, &flag ) ) >= 0 ) return i;
+
+    PI_CALLMPI( MPI_Iprobe( MPI_ANY_SOURCE, b->channels[0]->chan_tag,
+                            PI_CommWorld, &flag, &status ) )
+    if ( !flag ) return -1;
+
+    /* lookup message source's corresponding channel index in bundle; if it
+       does not match the producer of any of the bundle's channels, that's a
+       problem */
+    i = b->index[ status.MPI_SOURCE ];
+    PI_ASSERT( , i >= 0, PI_SYSTEM_ERROR )
+    return i;
+}
+
+/*!
+********************************************************************************
+Begins a polled wait.
+
+\param w Wait to begin.
+\param timeout Seconds to wait at most, or negative to wait for ever.
+*******************************************************************************/
+static void WaitBegin( PI_WAITER *w, double timeout )
+{
+    w->start = MPI_Wtime();
+    w->deadline = timeout < 0.0 ? -1.0 : w->start + timeout;
+    w->sleep = 0;
+    w->spins = 0;
+}
+
+/*!
+********************************************************************************
+Pauses between the polls of a polled wait.  For the first -piwait interval it
+only spins, giving up the CPU now and then as RingWait does.  After that it
+yields once, then sleeps 1 usec., doubling each time up to the -piwait maximum
+(0 means it only yields), but never past the deadline.
+
+\param w Wait begun by WaitBegin.
+\return 1 if the caller should poll again, 0 if the deadline has passed.
+*******************************************************************************/
+static int WaitPause( PI_WAITER *w )
+{
+    double now = MPI_Wtime();
+
+    if ( w->deadline >= 0.0 && now >= w->deadline ) return 0;
+
+    if ( now - w->start < WaitParams[0] * 1e-6 ) {
+        RingWait( &w->spins );
+        return 1;
+    }
+
+    if ( w->sleep == 0 ) sched_yield();
+    else {
+        double left = w->deadline < 0.0 ? w->sleep : ( w->deadline - now ) * 1e6 + 1;
+        usleep( left < w->sleep ? (useconds_t)left : (useconds_t)w->sleep );
+    }
+    if ( w->sleep < WaitParams[1] )
+        w->sleep = w->sleep > WaitParams[1] / 2 ? WaitParams[1] : 2 * w->sleep + ( w->sleep == 0 );
+    return 1;
+}
+
+/*!
+********************************************************************************
+Polls a channel until it has data, pausing between polls by WaitPause.
+
+\param c Channel, read end.
+\param timeout Seconds to wait at most, or negative to wait for ever.
+\return 1 if the channel has data, 0 if the time ran out first.
+*******************************************************************************/
+static int PollChannel( PI_CHANNEL *c, double timeout )
+{
+    PI_WAITER w;
+
+    WaitBegin( &w, timeout );
+    while ( !ChannelReady( c ) )
+        if ( !WaitPause( &w ) ) return 0;
+    return 1;
+}
+
+/*!
+********************************************************************************
+Polls a selector bundle until one of its channels has data, choosing it as
+PI_TrySelect does, and pausing between polls by WaitPause.
+
+\param b Selector bundle, read end.
+\param timeout Seconds to wait at most, or negative to wait for ever.
+\return Index of the channel chosen, or -1 if the time ran out first.
+*******************************************************************************/
+static int PollSelect( PI_BUNDLE *b, double timeout )
+{
+    int i;
+    PI_WAITER w;
+
+    WaitBegin( &w, timeout );
+    while ( ( i = SelectReady( b ) ) < 0 )
+        if ( !WaitPause( &w ) ) return -1;
+    return i;
+}
+
+/*!
+********************************************************************************
+Posts a receive for each channel of each PI_SetSelectFormat selector that this
+process reads, into a buffer of the bundle's.
+*******************************************************************************/
+static void SetupPosted( void )
+{
+    PI_ON_ERROR_RETURN()
+    int i, j;
+
+    for ( i = 0; i < thisproc.allocated_bundles; i++ ) {
+        PI_BUNDLE *b = thisproc.bundles[i];
+        if ( b->postSize == 0 || b->channels[0]->consumer != thisproc.rank ) continue;
+
+        b->postBuf = malloc( (size_t)b->size * b->postSize );
+        b->postReqs = malloc( b->size * sizeof(MPI_Request) );
+        b->postLen = malloc( b->size * sizeof(int) );
+        PI_ASSERT( , b->postBuf && b->postReqs && b->postLen, PI_MALLOC_ERROR )
+        for ( j = 0; j < b->size; j++ ) {
+            b->postLen[j] = -1;
+            Repost( b, j );
+        }
+    }
+}
+
+/*!
+********************************************************************************
+Cancels the pre-posted receives of SetupPosted, and frees their buffers.
+*******************************************************************************/
+static void FreePosted( void )
+{
+    int i, j;
+
+    for ( i = 0; i < thisproc.allocated_bundles; i++ ) {
+        PI_BUNDLE *b = thisproc.bundles[i];
+        if ( b->postReqs == NULL ) continue;
+
+        for ( j = 0; j < b->size; j++ ) {
+            if ( b->postReqs[j] == MPI_REQUEST_NULL ) continue;
+            PI_CALLMPI( MPI_Cancel( &b->postReqs[j] ) )
+            PI_CALLMPI( MPI_Wait( &b->postReqs[j], MPI_STATUS_IGNORE ) )
+        }
+        free( b->postBuf );
+        free( b->postReqs );
+        free( b->postLen );
+        b->postBuf = NULL;
+        b->postReqs = NULL;
+        b->postLen = NULL;
+    }
+}
+
+/*!
+********************************************************************************
+Tells whether a message has landed in a channel's pre-posted receive.
+
+\param b Selector bundle with pre-posted receives.
+\param i Index of the channel in the bundle.
+\param block If true, wait for the message.
+\return 1 if it has landed (and b->postLen[i] is its size), else 0.
+*******************************************************************************/
+static int PostedLanded( PI_BUNDLE *b, int i, int block )
+{
+    int flag = 1;
+    MPI_Status status;
+
+    if ( b->postLen[i] >= 0 ) return 1;
+    if ( block ) PI_CALLMPI( MPI_Wait( &b->postReqs[i], &status ) )
+    else PI_CALLMPI( MPI_Test( &b->postReqs[i], &flag, &status ) )
+    if ( !flag ) return 0;
+
+    PI_CALLMPI( MPI_Get_count( &status, MPI_PACKED, &b->postLen[i] ) )
+    b->landed++;
+    return 1;
+}
+
+/*!
+********************************************************************************
+Finds whether any of a selector bundle's pre-posted receives has a message,
+waiting for the next one to complete if none has landed.  Which one it was is
+left to PostedSelect to find, so that the round-robin turn is untouched.
+
+\param b Selector bundle with pre-posted receives.
+\param block If 0, return instead of waiting for a message.
+\return 1 if any message has landed, else 0.
+*******************************************************************************/
+static int PostedAny( PI_BUNDLE *b, int block )
+{
+    int i, flag = 1;
+    MPI_Status status;
+
+    if ( b->landed ) return 1;
+    if ( block ) PI_CALLMPI( MPI_Waitany( b->size, b->postReqs, &i, &status ) )
+    else PI_CALLMPI( MPI_Testany( b->size, b->postReqs, &i, &flag, &status ) )
+    if ( !flag || i == MPI_UNDEFINED ) return 0;
+
+    PI_CALLMPI( MPI_Get_count( &status, MPI_PACKED, &b->postLen[i] ) )
+    b->landed++;
+    return 1;
+}
+
+/*!
+********************************************************************************
+Selects a channel whose pre-posted receive has a message.  Once one has landed
+(waiting for the next receive to complete if none has), the channels take
+turns, round-robin: the first one with a message, starting after the channel
+last selected, is taken.  MPI_Waitany and MPI_Testany favour low indices, so
+taking what they return would let a busy low-ranked writer starve the rest.
+
+\param b Selector bundle with pre-posted receives.
+\param block If 0, return instead of waiting for a message.
+\return Index of the channel in the bundle, or -1 if none and \p block is 0.
+*******************************************************************************/
+static int PostedSelect( PI_BUNDLE *b, int block )
+{
+    int i, k;
+
+    if ( !PostedAny( b, block ) ) return -1;
+
+    /* one has landed, so this finds one, testing those before it */
+    for ( k = 0; k < b->size; k++ ) {
+        i = ( b->next + k ) % b->size;
+        if ( PostedLanded( b, i, 0 ) ) break;
+    }
+    b->next = ( i + 1 ) % b->size;
+    return i;
+}
+
+/*!
+********************************************************************************
+Posts a channel's receive again, once the message in its buffer has been read.
+
+\param b Selector bundle with pre-posted receives.
+\param i Index of the channel in the bundle.
+*******************************************************************************/
+static void Repost( PI_BUNDLE *b, int i )
+{
+    PI_CHANNEL *c = b->channels[i];
+
+    if ( b->postLen[i] >= 0 ) {
+        b->postLen[i] = -1;
+        b->landed--;
+    }
+    PI_CALLMPI( MPI_Irecv( b->postBuf + (size_t)i * b->postSize, b->postSize, MPI_PACKED,
+                           c->producer, c->chan_tag, PI_CommWorld, &b->postReqs[i] ) )
+}
+
+/*!
+********************************************************************************
+Finds a channel in a selector bundle with data that won't show up in a probe:
+the rest of a batch of aggregated writes, or a write in a ring or RMA buffer.
+
+\param b Selector bundle.
+\param rings Set to true if any of the channels (up to the one found) has a
+ring or RMA buffer.
+\return Index of the channel in the bundle, or -1 if none.
+*******************************************************************************/
+static int UnprobedData( PI_BUNDLE *b, int *rings )
+{
+    int i;
+
+    *rings = 0;
+    for ( i = 0; i < b->size; i++ ) {
+        PI_CHANNEL *c = b->channels[i];
+        if ( c->sendmode == PI_SEND_AGGREGATE && c->aggPos < c->aggLen ) return i;
+        if ( c->ring || c->rma ) {
+            *rings = 1;
+            if ( RingHasData( c ) ) return i;
+        }
+    }
+    return -1;
+}
+
+/*!
+********************************************************************************
+Finds whether a channel with a ring or RMA buffer has a write waiting in it.
+Called by the consumer.
+*******************************************************************************/
+static int RingHasData( PI_CHANNEL *c )
+{
+    if ( c->ring )
+        return atomic_load_explicit( &c->ring->head, memory_order_acquire ) !=
+               atomic_load_explicit( &c->ring->tail, memory_order_relaxed );
+
+    if ( c->rmaHead == c->rmaTail )	// none seen yet, so look again
+        c->rmaHead = RmaLoad( thisproc.rank, c->rmaDisp + offsetof(PI_RING, head) );
+    return c->rmaHead != c->rmaTail;
+}
+
+/*!
+********************************************************************************
+Gives rings to the PI_SEND_SHARED channels whose ends are on the same node.
+Called by every process from PI_StartAll.
+
+The processes on each node share an MPI window, where each one holds the rings
+of the channels it reads, in the order the channels were created, so the writer
+can work out where its ring is.  With deadlock detection, there are none.
+
+A ring whose ends are in different PID namespaces (e.g., containers sharing
+/dev/shm) starts with pulls off, since the writer's pid would name some other
+process to the reader.  A namespace is told by the device and inode of
+/proc/self/ns/pid.
+*******************************************************************************/
+static void SetupRings( void )
+{
+    PI_ON_ERROR_RETURN()
+
+    int i, n = thisproc.allocated_channels, mine = 0, nodeRank, nodeSize;
+    MPI_Group world, node;
+    PI_RING *base;
+
+    RingsActive = 0;
+    if ( thisproc.svc_flag[OLP_DEADLOCK] ) return;	// the detector needs MPI sends
+
+    /* every process has the same channels, so all agree whether to go on */
+    for ( i = 0; i < n; i++ )
+        if ( thisproc.channels[i]->sendmode == PI_SEND_SHARED &&
+                thisproc.channels[i]->bundle == NULL ) break;
+    if ( i == n ) return;
+
+    PI_CALLMPI( MPI_Comm_split_type( PI_CommWorld, MPI_COMM_TYPE_SHARED, 0,
+                                     MPI_INFO_NULL, &NodeComm ) )
+    PI_CALLMPI( MPI_Comm_rank( NodeComm, &nodeRank ) )
+    PI_CALLMPI( MPI_Comm_size( NodeComm, &nodeSize ) )
+
+    /* each channel's producer and consumer as ranks on this node, or
+       MPI_UNDEFINED; a channel is eligible if both are here */
+    int *ends = malloc( 2 * n * sizeof(int) ), *onNode = malloc( 2 * n * sizeof(int) );
+    int *next = calloc( nodeSize, sizeof(int) );
+    PI_ASSERT( , ends && onNode && next, PI_MALLOC_ERROR )	// others would hang
+    for ( i = 0; i < n; i++ ) {
+        ends[2*i] = thisproc.channels[i]->producer;
+        ends[2*i+1] = thisproc.channels[i]->consumer;
+    }
+    PI_CALLMPI( MPI_Comm_group( PI_CommWorld, &world ) )
+    PI_CALLMPI( MPI_Comm_group( NodeComm, &node ) )
+    PI_CALLMPI( MPI_Group_translate_ranks( world, 2 * n, ends, node, onNode ) )
+    PI_CALLMPI( MPI_Group_free( &world ) )
+    PI_CALLMPI( MPI_Group_free( &node ) )
+
+#define ELIGIBLE(i) ( thisproc.channels[i]->sendmode == PI_SEND_SHARED && \
+                      thisproc.channels[i]->bundle == NULL && \
+                      onNode[2*(i)] != MPI_UNDEFINED && onNode[2*(i)+1] != MPI_UNDEFINED )
+
+    for ( i = 0; i < n; i++ )
+        if ( ELIGIBLE(i) && onNode[2*i+1] == nodeRank ) mine++;
+
+    /* PID namespace of each process on this node */
+    uint64_t myNs[2] = { 0, 0 }, *pidNs = malloc( 2 * nodeSize * sizeof(uint64_t) );
+    PI_ASSERT( , pidNs, PI_MALLOC_ERROR )
+#ifdef __linux__
+    struct stat st;
+    if ( stat( "/proc/self/ns/pid", &st ) == 0 ) {
+        myNs[0] = st.st_dev;
+        myNs[1] = st.st_ino;
+    }
+#endif
+    PI_CALLMPI( MPI_Allgather( myNs, 2, MPI_UINT64_T, pidNs, 2, MPI_UINT64_T, NodeComm ) )
+
+    PI_CALLMPI( MPI_Win_allocate_shared( mine * sizeof(PI_RING), sizeof(PI_RING),
+                                         MPI_INFO_NULL, NodeComm, &base, &RingWin ) )
+    HandleWinErrors( RingWin );
+    for ( i = 0, mine = 0; i < n; i++ ) {
+        if ( !ELIGIBLE(i) || onNode[2*i+1] != nodeRank ) continue;
+        uint64_t *ns = &pidNs[ 2 * onNode[2*i] ];	// the writer's
+        atomic_init( &base[mine].head, 0 );
+        atomic_init( &base[mine].tail, 0 );
+        base[mine].pulls = 0;
+        atomic_init( &base[mine].pulled, 0 );
+        atomic_init( &base[mine].noPull, ns[0] != myNs[0] || ns[1] != myNs[1] );
+        mine++;
+    }
+    free( pidNs );
+    PI_CALLMPI( MPI_Win_lock_all( MPI_MODE_NOCHECK, RingWin ) )
+    PI_CALLMPI( MPI_Win_sync( RingWin ) )
+    PI_CALLMPI( MPI_Barrier( NodeComm ) )	// rings are ready before anyone uses them
+
+    for ( i = 0; i < n; i++ ) {
+        PI_CHANNEL *c = thisproc.channels[i];
+        if ( !ELIGIBLE(i) ) continue;
+        int owner = onNode[2*i+1], index = next[owner]++;
+        if ( c->producer == thisproc.rank || c->consumer == thisproc.rank ) {
+            MPI_Aint size;
+            int disp;
+            PI_RING *theirs;
+            PI_CALLMPI( MPI_Win_shared_query( RingWin, owner, &size, &disp, &theirs ) )
+            c->ring = theirs + index;
+            RingsActive = 1;
+        }
+    }
+#undef ELIGIBLE
+
+    free( ends );
+    free( onNode );
+    free( next );
+}
+
+/*!
+********************************************************************************
+Frees the rings' shared memory, if any.  Called by every process from
+PI_StopMain, after the barrier, so no one is still using them.
+*******************************************************************************/
+static void FreeRings( void )
+{
+    int i;
+
+    if ( RingWin == MPI_WIN_NULL ) return;
+    for ( i = 0; i < thisproc.allocated_channels; i++ )
+        thisproc.channels[i]->ring = NULL;
+    MPI_Win_unlock_all( RingWin );
+    MPI_Win_free( &RingWin );
+    MPI_Comm_free( &NodeComm );
+    RingsActive = 0;
+}
+
+/*!
+********************************************************************************
+Pauses while waiting on a ring.  Every so often it gives up the CPU, which
+matters when processes outnumber cores, and lets MPI make progress on any other
+transfers, which the other end may be waiting for.
+
+\param spins Count of calls so far in this wait, starting from 0.
+*******************************************************************************/
+static void RingWait( int *spins )
+{
+    int flag;
+
+    if ( ++*spins % 64 == 0 ) sched_yield();
+    if ( *spins % 1024 == 0 )
+        MPI_Iprobe( MPI_ANY_SOURCE, MPI_ANY_TAG, PI_CommWorld, &flag, MPI_STATUS_IGNORE );
+}
+
+/*!
+********************************************************************************
+Copies n bytes into a ring, waiting for room as needed.  Each piece is
+published as soon as it's in, so a write bigger than the ring streams through.
+*******************************************************************************/
+static void RingCopyIn( PI_RING *r, const char *src, size_t n )
+{
+    uint64_t head = atomic_load_explicit( &r->head, memory_order_relaxed );
+    int spins = 0;
+
+    while ( n > 0 ) {
+        size_t room = PI_RING_BYTES -
+                      ( head - atomic_load_explicit( &r->tail, memory_order_acquire ) );
+        if ( room == 0 ) {
+            RingWait( &spins );
+            continue;
+        }
+        size_t off = head % PI_RING_BYTES, k = PI_RING_BYTES - off;
+        if ( k > room ) k = room;
+        if ( k > n ) k = n;
+        memcpy( r->data + off, src, k );
+        head += k;
+        src += k;
+        n -= k;
+        atomic_store_explicit( &r->head, head, memory_order_release );
+    }
+}
+
+/*!
+********************************************************************************
+Copies n bytes out of a ring, waiting for them as needed.
+*******************************************************************************/
+static void RingCopyOut( PI_RING *r, char *dest, size_t n )
+{
+    uint64_t tail = atomic_load_explicit( &r->tail, memory_order_relaxed );
+    int spins = 0;
+
+    while ( n > 0 ) {
+        size_t avail = atomic_load_explicit( &r->head, memory_order_acquire ) - tail;
+        if ( avail == 0 ) {
+            RingWait( &spins );
+            continue;
+        }
+        size_t off = tail % PI_RING_BYTES, k = PI_RING_BYTES - off;
+        if ( k > avail ) k = avail;
+        if ( k > n ) k = n;
+        memcpy( dest, r->data + off, k );
+        tail += k;
+        dest += k;
+        n -= k;
+        atomic_store_explicit( &r->tail, tail, memory_order_release );
+    }
+}
+
+/*!
+********************************************************************************
+Puts one packed write into a ring, preceded by its length.
+*******************************************************************************/
+static void RingPut( PI_RING *r, const void *buf, int len )
+{
+    RingCopyIn( r, (const char *)&len, sizeof(len) );
+    RingCopyIn( r, buf, len );
+}
+
+/*!
+********************************************************************************
+Gives RMA buffers to the PI_SEND_RMA channels.  Called by every process from
+PI_StartAll.
+
+Each process holds the buffers of the channels it reads in its part of an MPI
+window, in the order the channels were created, so every process can work out
+where each buffer is.  With deadlock detection, there are none.
+*******************************************************************************/
+static void SetupRma( void )
+{
+    PI_ON_ERROR_RETURN()
+
+    int i, n = thisproc.allocated_channels, mine = 0;
+    int *next;			// buffers so far, by consumer
+    PI_RING *base;
+
+#define ELIGIBLE(c) ( (c)->sendmode == PI_SEND_RMA && (c)->bundle == NULL )
+
+    if ( thisproc.svc_flag[OLP_DEADLOCK] ) return;	// the detector needs MPI sends
+
+    /* every process has the same channels, so all agree whether to go on */
+    for ( i = 0; i < n; i++ )
+        if ( ELIGIBLE(thisproc.channels[i]) ) break;
+    if ( i == n ) return;
+
+    next = calloc( thisproc.worldsize, sizeof(int) );
+    PI_ASSERT( , next, PI_MALLOC_ERROR )
+    for ( i = 0; i < n; i++ ) {
+        PI_CHANNEL *c = thisproc.channels[i];
+        if ( !ELIGIBLE(c) ) continue;
+        c->rmaDisp = next[c->consumer]++ * (MPI_Aint)sizeof(PI_RING);
+        if ( c->consumer == thisproc.rank ) mine++;
+    }
+    free( next );
+
+    PI_CALLMPI( MPI_Win_allocate( mine * sizeof(PI_RING), 1, MPI_INFO_NULL,
+                                  PI_CommWorld, &base, &RmaWin ) )
+    HandleWinErrors( RmaWin );
+    PI_CALLMPI( MPI_Win_lock_all( MPI_MODE_NOCHECK, RmaWin ) )
+    for ( i = 0; i < mine; i++ ) {
+        RmaStore( thisproc.rank, i * sizeof(PI_RING) + offsetof(PI_RING, head), 0 );
+        RmaStore( thisproc.rank, i * sizeof(PI_RING) + offsetof(PI_RING, tail), 0 );
+    }
+    PI_CALLMPI( MPI_Barrier( PI_CommWorld ) )	// buffers are ready before anyone uses them
+
+    for ( i = 0; i < n; i++ ) {
+        PI_CHANNEL *c = thisproc.channels[i];
+        if ( ELIGIBLE(c) && c->consumer == thisproc.rank ) {
+            c->rma = (PI_RING *)( (char *)base + c->rmaDisp );
+            RingsActive = 1;
+        }
+    }
+#undef ELIGIBLE
+}
+
+/*!
+********************************************************************************
+Frees the RMA window, if any.  Called by every process from PI_StopMain, after
+the barrier, so no one is still using it.
+*******************************************************************************/
+static void FreeRma( void )
+{
+    int i;
+
+    if ( RmaWin == MPI_WIN_NULL ) return;
+    for ( i = 0; i < thisproc.allocated_channels; i++ ) {
+        thisproc.channels[i]->rma = NULL;
+        thisproc.channels[i]->rmaDisp = -1;
+        thisproc.channels[i]->rmaHead = thisproc.channels[i]->rmaTail = 0;
+    }
+    MPI_Win_unlock_all( RmaWin );
+    MPI_Win_free( &RmaWin );
+    RingsActive = 0;
+}
+
+/*!
+********************************************************************************
+Reads a counter in an RMA buffer, atomically.
+*******************************************************************************/
+static uint64_t RmaLoad( int rank, MPI_Aint disp )
+{
+    uint64_t value;
+
+    PI_CALLMPI( MPI_Fetch_and_op( NULL, &value, MPI_UINT64_T, rank, disp, MPI_NO_OP, RmaWin ) )
+    PI_CALLMPI( MPI_Win_flush( rank, RmaWin ) )
+    return value;
+}
+
+/*!
+********************************************************************************
+Sets a counter in an RMA buffer, atomically, and waits till it's done.
+*******************************************************************************/
+static void RmaStore( int rank, MPI_Aint disp, uint64_t value )
+{
+    PI_CALLMPI( MPI_Accumulate( &value, 1, MPI_UINT64_T, rank, disp, 1, MPI_UINT64_T,
+                                MPI_REPLACE, RmaWin ) )
+    PI_CALLMPI( MPI_Win_flush( rank, RmaWin ) )
+}
+
+/*!
+********************************************************************************
+Publishes what the producer has put into a channel's RMA buffer by advancing
+its head.  The puts must complete at the target first, since MPI only orders
+accumulates to the same location.  The head must complete there too before
+returning: only a flush guarantees it, and the channel's last write may never
+be followed by another one.
+*******************************************************************************/
+static void RmaPublish( PI_CHANNEL *c )
+{
+    PI_CALLMPI( MPI_Win_flush( c->consumer, RmaWin ) )
+    RmaStore( c->consumer, c->rmaDisp + offsetof(PI_RING, head), c->rmaHead );
+}
+
+/*!
+********************************************************************************
+Puts n bytes into a channel's RMA buffer, waiting for room as needed.  When the
+buffer is full, what's been put so far is published first, so a write bigger
+than the buffer streams through.  The caller publishes the rest.
+*******************************************************************************/
+static void RmaCopyIn( PI_CHANNEL *c, const char *src, size_t n )
+{
+    MPI_Aint data = c->rmaDisp + offsetof(PI_RING, data);
+    int spins = 0, waiting = 0;
+
+    while ( n > 0 ) {
+        size_t room = PI_RING_BYTES - ( c->rmaHead - c->rmaTail );
+        if ( room == 0 ) {
+            if ( !waiting ) {
+                RmaPublish( c );
+                waiting = 1;
+            }
+            else RingWait( &spins );
+            c->rmaTail = RmaLoad( c->consumer, c->rmaDisp + offsetof(PI_RING, tail) );
+            continue;
+        }
+        size_t off = c->rmaHead % PI_RING_BYTES, k = PI_RING_BYTES - off;
+        if ( k > room ) k = room;
+        if ( k > n ) k = n;
+        PI_CALLMPI( MPI_Put( src, k, MPI_BYTE, c->consumer, data + off, k, MPI_BYTE, RmaWin ) )
+        c->rmaHead += k;
+        src += k;
+        n -= k;
+        waiting = 0;
+    }
+}
+
+/*!
+********************************************************************************
+Takes n bytes out of a channel's RMA buffer in this process, waiting for them
+as needed.  The new tail is published before waiting; the caller publishes the
+rest.
+*******************************************************************************/
+static void RmaCopyOut( PI_CHANNEL *c, char *dest, size_t n )
+{
+    int spins = 0;
+
+    while ( n > 0 ) {
+        size_t avail = c->rmaHead - c->rmaTail;
+        if ( avail == 0 ) {
+            if ( spins == 0 )	// the writer may be waiting for room
+                RmaStore( thisproc.rank, c->rmaDisp + offsetof(PI_RING, tail), c->rmaTail );
+            RingWait( &spins );
+            c->rmaHead = RmaLoad( thisproc.rank, c->rmaDisp + offsetof(PI_RING, head) );
+            continue;
+        }
+        PI_CALLMPI( MPI_Win_sync( RmaWin ) )	// the puts are visible to loads
+        size_t off = c->rmaTail % PI_RING_BYTES, k = PI_RING_BYTES - off;
+        if ( k > avail ) k = avail;
+        if ( k > n ) k = n;
+        memcpy( dest, c->rma->data + off, k );
+        c->rmaTail += k;
+        dest += k;
+        n -= k;
+        spins = 0;
+    }
+}
+
+/*!
+********************************************************************************
+Puts one packed write into a channel's RMA buffer, preceded by its length, and
+publishes it.
+*******************************************************************************/
+static void RmaPut( PI_CHANNEL *c, const void *buf, int len )
+{
+    RmaCopyIn( c, (const char *)&len, sizeof(len) );
+    RmaCopyIn( c, buf, len );
+    RmaPublish( c );
+}
+
+/*!
+********************************************************************************
+Takes the next packed write out of a channel's RMA buffer, into the staging
+buffer.  If that can't be enlarged, the write is still taken out, a piece at a
+time, so the next read finds the length that follows it.
+
+\return Its length, or -1 if the staging buffer could not be enlarged.
+*******************************************************************************/
+static int RmaGet( PI_CHANNEL *c )
+{
+    int len;
+
+    RmaCopyOut( c, (char *)&len, sizeof(len) );
+    if ( StageBuffer( len ) == NULL ) {
+        char skip[256];
+        int n;
+        for ( ; len > 0; len -= n ) {
+            n = len < (int)sizeof(skip) ? len : (int)sizeof(skip);
+            RmaCopyOut( c, skip, n );
+        }
+        RmaStore( thisproc.rank, c->rmaDisp + offsetof(PI_RING, tail), c->rmaTail );
+        return -1;
+    }
+    RmaCopyOut( c, StageBuf, len );
+    RmaStore( thisproc.rank, c->rmaDisp + offsetof(PI_RING, tail), c->rmaTail );
+    return len;
+}
+
+/*!
+********************************************************************************
+Finds whether an item written through a ring is large enough to be pulled by
+the reader (see PI_RING).  Both ends decide the same way from the item.
+
+\param count Count of the item's type.
+\param type Item's MPI type.
+\return The item's size in bytes if it should be pulled, else 0, including if
+the type has gaps, so the bytes can't be copied as they are.
+*******************************************************************************/
+static size_t PullBytes( int count, MPI_Datatype type )
+{
+    MPI_Aint lb, extent, trueLb, trueExtent;
+    int size;
+
+    if ( MPI_Type_size( type, &size ) != MPI_SUCCESS ||
+            MPI_Type_get_extent( type, &lb, &extent ) != MPI_SUCCESS ||
+            MPI_Type_get_true_extent( type, &trueLb, &trueExtent ) != MPI_SUCCESS )
+        return 0;
+    if ( lb != 0 || trueLb != 0 || extent != size || trueExtent != size ) return 0;
+
+    size_t bytes = (size_t)count * size;
+    return bytes >= PI_PULL_BYTES ? bytes : 0;
+}
+
+/*!
+********************************************************************************
+Writer's side of a large item in a write through a ring, after the write's
+packed message.  If the item was offered for pulling, waits until the reader
+has dealt with it; if it was not, or the pull failed, copies it into the ring.
+*******************************************************************************/
+static void RingPush( PI_RING *r, int pull, const void *buf, size_t bytes )
+{
+    int spins = 0;
+
+    if ( pull ) {
+        r->pulls++;
+        while ( atomic_load_explicit( &r->pulled, memory_order_acquire ) < r->pulls )
+            RingWait( &spins );
+        if ( !atomic_load_explicit( &r->noPull, memory_order_relaxed ) ) return;
+    }
+    RingCopyIn( r, buf, bytes );
+}
+
+/*!
+********************************************************************************
+Reader's side of RingPush: unpacks the item's descriptor, and pulls the item
+from the writer's memory if it was offered, else takes it from the ring.  Once
+a pull fails (e.g., the OS doesn't permit it), no more are tried on the ring.
+
+\param r Ring.
+\param dest Where the item goes.
+\param packBuf Packed message holding the descriptor.
+\param packedLen Length of the packed message.
+\param packed Position of the descriptor, advanced past it.
+*******************************************************************************/
+static void RingPull( PI_RING *r, void *dest, char *packBuf, int packedLen, int *packed )
+{
+    uint64_t desc[3];		// pid, address, bytes
+    size_t got = 0;
+
+    PI_CALLMPI( MPI_Unpack( packBuf, packedLen, packed, desc, 3, MPI_UINT64_T,
+                            PI_CommWorld ) )
+    if ( desc[1] ) {
+#ifdef __linux__
+        while ( got < desc[2] && !atomic_load_explicit( &r->noPull, memory_order_relaxed ) ) {
+            struct iovec local = { (char *)dest + got, desc[2] - got },
+                         remote = { (char *)(uintptr_t)desc[1] + got, desc[2] - got };
+            ssize_t n = process_vm_readv( (pid_t)desc[0], &local, 1, &remote, 1, 0 );
+            if ( n <= 0 ) break;
+            got += n;
+        }
+#endif
+        if ( got < desc[2] ) atomic_store_explicit( &r->noPull, 1, memory_order_relaxed );
+        atomic_fetch_add_explicit( &r->pulled, 1, memory_order_release );
+        if ( got == desc[2] ) return;
+    }
+    RingCopyOut( r, dest, desc[2] );
+}
+
+/*!
+********************************************************************************
+Takes the next packed write out of a ring, into the staging buffer.  If that
+can't be enlarged, the write is still taken out, a piece at a time, so the ring
+stays in step with its writer.
+
+\return Its length, or -1 if the staging buffer could not be enlarged.
+*******************************************************************************/
+static int RingGet( PI_RING *r )
+{
+    int len;
+
+    RingCopyOut( r, (char *)&len, sizeof(len) );
+    if ( StageBuffer( len ) == NULL ) {
+        char skip[256];
+        int n;
+        for ( ; len > 0; len -= n ) {
+            n = len < (int)sizeof(skip) ? len : (int)sizeof(skip);
+            RingCopyOut( r, skip, n );
+        }
+        return -1;
+    }
+    RingCopyOut( r, StageBuf, len );
+    return len;
+}
+
+/*!
+********************************************************************************
+Makes sure the staging buffer used for packed messages can hold \p size bytes.
+The buffer is reused for every packed message, and only grows.
+
+\param size Number of bytes needed.
+\return Pointer to the staging buffer, or NULL if it could not be enlarged.
+*******************************************************************************/
+static void *StageBuffer( int size )
+{
+    if ( size > StageLen ) {
+        char *p = realloc( StageBuf, size );
+        if ( p == NULL ) return NULL;
+        StageBuf = p;
+        StageLen = size;
+    }
+    return StageBuf;
+}
+
+/*!
+********************************************************************************
+Allocates the array for a ^ or %s read.  A buffer given back by
+PI_ReleaseBuffer is reused if one is big enough, otherwise a new one is
+malloc'd.  Either way it is remembered, so it can be released later.  Since the
+buffer comes from malloc, the user may also just free it.
+
+\param size Number of bytes needed.
+\return Buffer, or NULL if malloc failed.
+*******************************************************************************/
+static void *PoolAlloc( size_t size )
+{
+    int i, best = -1;
+    PI_POOLBUF got;
+
+    /* smallest released buffer that fits */
+    for ( i = 0; i < PoolFreeCount; i++ ) {
+        if ( PoolFree[i].size >= size &&
+                ( best < 0 || PoolFree[i].size < PoolFree[best].size ) )
+            best = i;
+    }
+
+    if ( best >= 0 ) {
+        got = PoolFree[best];
+        PoolFree[best] = PoolFree[--PoolFreeCount];
+    }
+    else {
+        got.size = ( size + 63 ) & ~(size_t)63;	// round up to help reuse
+        got.buf = malloc( got.size );
+        if ( got.buf == NULL ) return NULL;
+    }
+
+    /* remember it for PI_ReleaseBuffer; forget the oldest if need be */
+    PoolLent[PoolLentNext] = got;
+    PoolLentNext = ( PoolLentNext + 1 ) % PI_POOL_LENT;
+    return got.buf;
+}
+
+/*!
+********************************************************************************
+Frees all buffers held in the pool (but not the ones the user still has).
+*******************************************************************************/
+static void FreePool( void )
+{
+    while ( PoolFreeCount > 0 )
+        free( PoolFree[--PoolFreeCount].buf );
+    memset( PoolLent, 0, sizeof(PoolLent) );
+    PoolLentNext = 0;
+}
+
+/*!
+********************************************************************************
+Sets an item to transfer \p n elements of its datatype.  MPI counts are ints,
+so if \p n is larger than INT_MAX (or \p force is set), the elements are
+wrapped into a single element of a derived datatype instead: contiguous for up
+to INT_MAX elements, otherwise a struct of PI_BIG_CHUNK-element chunks followed
+by the remainder.  Either way its extent covers all \p n elements.
+
+The types are remembered in a ring as long as PI_MAX_FORMATLEN, so that no call
+can free a type it is still using, and a repeated big transfer reuses its type.
+MPI keeps a type alive for any pending transfer after it is freed.
+
+\param arg Item whose `type` is set, with `count` not yet set.
+\param n Number of elements.
+\param force Non-zero to wrap even if \p n would fit in an int count.
+*******************************************************************************/
+static void WrapCount( PI_MPI_RTTI *arg, long long n, int force )
+{
+    int i;
+
+    if ( n <= INT_MAX && !force ) {
+        arg->count = n;
+        return;
+    }
+
+    arg->base = arg->type;
+    arg->elements *= n;
+    arg->count = 1;
+
+    for ( i = 0; i < PI_MAX_FORMATLEN; i++ ) {
+        if ( BigTypes[i].n == n && BigTypes[i].base == arg->base ) {
+            arg->type = BigTypes[i].type;
+            return;
+        }
+    }
+
+    if ( n <= INT_MAX ) {
+        PI_CALLMPI( MPI_Type_contiguous( n, arg->base, &arg->type ) )
+    }
+    else {
+        MPI_Aint lb, extent;
+        MPI_Datatype types[2];
+        int blocklens[2] = { 1, 1 };
+        MPI_Aint displs[2] = { 0, 0 };
+        long long chunks = n / PI_BIG_CHUNK;
+
+        PI_CALLMPI( MPI_Type_get_extent( arg->base, &lb, &extent ) )
+        PI_CALLMPI( MPI_Type_vector( chunks, PI_BIG_CHUNK, PI_BIG_CHUNK, arg->base, &types[0] ) )
+        PI_CALLMPI( MPI_Type_contiguous( n % PI_BIG_CHUNK, arg->base, &types[1] ) )
+        displs[1] = chunks * PI_BIG_CHUNK * extent;
+        PI_CALLMPI( MPI_Type_create_struct( 2, blocklens, displs, types, &arg->type ) )
+        PI_CALLMPI( MPI_Type_free( &types[0] ) )
+        PI_CALLMPI( MPI_Type_free( &types[1] ) )
+    }
+    PI_CALLMPI( MPI_Type_commit( &arg->type ) )
+
+    /* replace the oldest type in the ring */
+    if ( BigTypes[BigTypesNext].n > 0 )
+        PI_CALLMPI( MPI_Type_free( &BigTypes[BigTypesNext].type ) )
+    BigTypes[BigTypesNext].base = arg->base;
+    BigTypes[BigTypesNext].type = arg->type;
+    BigTypes[BigTypesNext].n = n;
+    BigTypesNext = ( BigTypesNext + 1 ) % PI_MAX_FORMATLEN;
+}
+
+/*!
+********************************************************************************
+Frees the types built by WrapCount.
+*******************************************************************************/
+static void FreeBigTypes( void )
+{
+    int i;
+
+    for ( i = 0; i < PI_MAX_FORMATLEN; i++ ) {
+        if ( BigTypes[i].n > 0 ) {
+            MPI_Type_free( &BigTypes[i].type );
+            BigTypes[i].n = 0;
+        }
+    }
+    BigTypesNext = 0;
+}
+
+/*!
+********************************************************************************
+Stores an array length received for the ^ flag in the caller's variable, which
+is an int unless the z prefix made it a size_t.
+
+\param arg Length element of the item.
+\param len The length.
+\return 1 if OK, 0 if it doesn't fit in an int (only with PI_OnErrorReturn).
+*******************************************************************************/
+static int StoreLength( const PI_MPI_RTTI *arg, long long len )
+{
+    PI_ON_ERROR_RETURN( 0 )
+
+    if ( arg->length == NULL ) return 1;	// %s: nowhere to store it
+    if ( arg->wideLen ) *(size_t *)arg->length = len;
+    else {
+        PI_ASSERT( , len <= INT_MAX, PI_ARRAY_LENGTH )
+        *(int *)arg->length = len;
+    }
+    return 1;
+}
+
+/*!
+********************************************************************************
+Allocates the handle for a nonblocking operation, with its own copy of the
+bound items.  Values held in the items' data unions (scalars and lengths) are
+moved along with them, off the caller's stack.
+
+\param c Channel being written or read.
+\param reading True for PI_IRead.
+\param mpiArgs Items bound by ParseFormatString.
+\param mpiArgCount Number of elements in mpiArgs.
+\return The handle, or NULL if out of memory.
+*******************************************************************************/
+static PI_REQUEST *NewRequest( PI_CHANNEL *c, int reading, const PI_MPI_RTTI mpiArgs[],
+                               int mpiArgCount )
+{
+    int i;
+    PI_REQUEST *r = malloc( sizeof( PI_REQUEST ) );
+    if ( r == NULL ) return NULL;
+
+    r->chan = c;
+    r->reading = reading;
+    r->nargs = mpiArgCount;
+    r->posted = 0;
+    r->done = 0;
+    r->persistent = 0;
+    r->multi = 0;
+    r->signFirst = r->sig = r->theirs = 0;
+    r->sigtype = MPI_DATATYPE_NULL;
+    r->packed = NULL;
+    r->packedLen = 0;
+    r->format = NULL;
+    r->next = NULL;
+    for ( i = 0; i < mpiArgCount; i++ ) {
+        r->args[i] = mpiArgs[i];
+        if ( mpiArgs[i].buf == &mpiArgs[i].data )
+            r->args[i].buf = &r->args[i].data;
+        r->mpireq[i] = MPI_REQUEST_NULL;
+        r->dups[i] = MPI_DATATYPE_NULL;
+    }
+    r->magic = PI_REQ;
+    return r;
+}
+
+/*!
+********************************************************************************
+Finds the size of the one packed message that -pimsg=c makes of a channel
+write's items (see PI_Write).  Both ends of a channel get the same answer.
+
+\param mpiArgs Bound items.
+\param mpiArgCount Number of elements in mpiArgs.
+\param signFirst Non-0 if the signature goes at the front.
+\return The size, or -1 on error (only with PI_OnErrorReturn).
+*******************************************************************************/
+static int PackedSize( const PI_MPI_RTTI mpiArgs[], int mpiArgCount, int signFirst )
+{
+    PI_ON_ERROR_RETURN( -1 )
+
+    int i, part, size = 0;
+    if ( signFirst ) {
+        PI_CALLMPI( MPI_Pack_size( 1, MPI_INT, PI_CommWorld, &part ) )
+        size += part;
+    }
+    for ( i = 0; i < mpiArgCount; i++ ) {
+        /* a packed message's size is an int, so big items can't be packed */
+        PI_ASSERT( , mpiArgs[i].base == MPI_DATATYPE_NULL, PI_ARRAY_LENGTH )
+        PI_CALLMPI( MPI_Pack_size( mpiArgs[i].count, mpiArgs[i].type,
+                                   PI_CommWorld, &part ) )
+        PI_ASSERT( , part <= INT_MAX - size, PI_ARRAY_LENGTH )
+        size += part;
+    }
+    return size;
+}
+
+/*!
+********************************************************************************
+Binds a channel's write or read to the locations of its variables, for
+PI_BindWrite and PI_BindRead.  The items are parsed, their datatypes are
+built, and persistent MPI requests are set up, all just once.
+
+\param c Channel, which the caller has checked.
+\param reading True for PI_BindRead.
+\param format Format string.
+\param ap Variables (locations).
+\return The binding, or NULL on error (only with PI_OnErrorReturn).
+*******************************************************************************/
+static PI_REQUEST *BindChannel( PI_CHANNEL *c, int reading, const char *format, va_list ap )
+{
+    PI_ON_ERROR_RETURN( NULL )
+    PI_ASSERT( , c->bundle==NULL, PI_BUNDLED_CHANNEL )	// collectives can't be persistent
+
+    int i;
+    int mpiArgCount;
+    PI_MPI_RTTI mpiArgs[ PI_MAX_FORMATLEN ];
+    PI_FORMAT *compiled = c->format;	// typed channel's format, else NULL
+
+    /* a typed channel only carries its own format */
+    if ( compiled )
+        PI_ASSERT( , SameFormat( compiled, format ), PI_FORMAT_MISMATCH )
+
+    mpiArgCount = ParseFormatString( IO_CONTEXT_LOCS, mpiArgs, &compiled, format, ap );
+    if ( mpiArgCount < 0 ) return NULL;	// func. detected error with PI_OnErrorReturn
+
+    /* Only items of fixed shape can be bound: no ^, ~, %s, or reduce ops */
+    for ( i = 0; i < mpiArgCount; i++ ) {
+        PI_ASSERT( , !mpiArgs[i].sendCount && mpiArgs[i].capacity==NULL, PI_FORMAT_INVALID )
+        PI_ASSERT( , mpiArgs[i].op==MPI_OP_NULL, PI_OP_INVALID )
+    }
+
+    int packSize = -1;		// >= 0 means items are packed
+    int signFirst = PI_CheckLevel >= 2 && !( c->format && c->format->sigFixed );
+    if ( thisproc.svc_flag[MSG_COALESCE] && mpiArgCount > 1 ) {
+        packSize = PackedSize( mpiArgs, mpiArgCount, signFirst );
+        if ( packSize < 0 ) return NULL;	// func. detected error with PI_OnErrorReturn
+    }
+
+    PI_REQUEST *r = NewRequest( c, reading, mpiArgs, mpiArgCount );
+    PI_ASSERT( , r, PI_MALLOC_ERROR )
+    r->persistent = 1;
+    r->done = 1;			// not started
+    r->posted = mpiArgCount;
+    r->signFirst = signFirst;
+    if ( signFirst ) r->sig = (int)GetSignature( compiled, mpiArgs, mpiArgCount );
+    r->format = strdup( format );	// if NULL, only logging suffers
+
+    /* hold on to derived datatypes, which may belong to the format cache */
+    for ( i = 0; i < mpiArgCount; i++ ) {
+        int ints, addrs, types, combiner;
+        PI_CALLMPI( MPI_Type_get_envelope( r->args[i].type, &ints, &addrs,
+                                           &types, &combiner ) )
+        if ( combiner != MPI_COMBINER_NAMED ) {
+            PI_CALLMPI( MPI_Type_dup( r->args[i].type, &r->dups[i] ) )
+            r->args[i].type = r->dups[i];
+        }
+    }
+
+    if ( packSize >= 0 ) {
+        r->packed = malloc( packSize );
+        if ( r->packed == NULL ) FreeRequest( &r );
+        PI_ASSERT( , r, PI_MALLOC_ERROR )
+        r->packedLen = packSize;
+        if ( reading ) {
+            PI_CALLMPI( MPI_Recv_init( r->packed, packSize, MPI_PACKED, c->producer,
+                                       c->chan_tag, PI_CommWorld, &r->mpireq[0] ) )
+        }
+        else {	// packing once finds the size, which is the same each time
+            int pos = PackArgs( r );
+            PI_CALLMPI( MPIPSender[ c->sendmode ]( r->packed, pos, MPI_PACKED, c->consumer,
+                                                   c->chan_tag, PI_CommWorld,
+                                                   &r->mpireq[0] ) )
+        }
+        return r;
+    }
+
+    for ( i = 0; i < mpiArgCount; i++ ) {
+        PI_MPI_RTTI *arg = &r->args[i];
+        void *buf = arg->buf;
+        int count = arg->count;
+        MPI_Datatype type = arg->type;
+
+        if ( i == 0 && signFirst ) {	// first message carries signature
+            r->sigtype = SigDatatype( NULL, reading ? &r->theirs : &r->sig, arg );
+            buf = MPI_BOTTOM;
+            count = 1;
+            type = r->sigtype;
+        }
+        if ( reading ) {
+            PI_CALLMPI( MPI_Recv_init( buf, count, type, c->producer, c->chan_tag,
+                                       PI_CommWorld, &r->mpireq[i] ) )
+        }
+        else PI_CALLMPI( MPIPSender[ c->sendmode ]( buf, count, type, c->consumer,
+                                                    c->chan_tag, PI_CommWorld,
+                                                    &r->mpireq[i] ) )
+    }
+
+    return r;
+}
+
+/*!
+********************************************************************************
+Starts the messages of a channel write without waiting for them, for PI_IWrite
+and PI_WriteMulti.
+
+\param c Channel, which the caller has checked.
+\param format Format string.
+\param compiled Its compiled form.
+\param mpiArgs Bound items.
+\param mpiArgCount Number of elements in mpiArgs.
+\param code Code to log each item with, or NULL if the caller logs the call.
+\return The request, or NULL on error (only with PI_OnErrorReturn).
+*******************************************************************************/
+static PI_REQUEST *StartWrite( PI_CHANNEL *c, const char *format, PI_FORMAT *compiled,
+                               PI_MPI_RTTI mpiArgs[], int mpiArgCount, const char *code )
+{
+    PI_ON_ERROR_RETURN( NULL )
+
+    int i;
+
+    /* Check the items before allocating the handle (see PI_Write for the
+     * signature and -pimsg=c packing)
+     */
+    int packSize = -1;		// >= 0 means items will be packed
+    int signFirst = PI_CheckLevel >= 2 && !( c->format && c->format->sigFixed );
+    for ( i = 0; i < mpiArgCount; i++ )
+        PI_ASSERT( , mpiArgs[i].op==MPI_OP_NULL, PI_OP_INVALID )
+
+    if ( thisproc.svc_flag[MSG_COALESCE] && mpiArgCount > 1 ) {
+        packSize = PackedSize( mpiArgs, mpiArgCount, signFirst );
+        if ( packSize < 0 ) return NULL;	// func. detected error with PI_OnErrorReturn
+    }
+
+    PI_REQUEST *r = NewRequest( c, 0, mpiArgs, mpiArgCount );
+    PI_ASSERT( , r, PI_MALLOC_ERROR )
+    r->posted = mpiArgCount;
+    r->signFirst = signFirst;
+    if ( signFirst ) r->sig = (int)GetSignature( compiled, mpiArgs, mpiArgCount );
+
+    /* Log each item */
+    if ( code ) {
+        for ( i = 0; i < mpiArgCount; i++ )
+            LOGCALL( code, c->chan_id, format, i+1, mpiArgCount, &r->args[i] );
+    }
+
+    /* with -pimsg=c, pack into a buffer owned by the handle, and send it */
+    if ( packSize >= 0 ) {
+        r->packed = malloc( packSize );
+        if ( r->packed == NULL ) FreeRequest( &r );
+        PI_ASSERT( , r, PI_MALLOC_ERROR )
+        r->packedLen = packSize;
+        PI_CALLMPI( MPIISender[ c->sendmode ]( r->packed, PackArgs( r ), MPI_PACKED,
+                                               c->consumer, c->chan_tag, PI_CommWorld,
+                                               &r->mpireq[0] ) )
+        return r;
+    }
+
+    for ( i = 0; i < mpiArgCount; i++ ) {
+        PI_MPI_RTTI *arg = &r->args[i];
+
+        if ( arg->sendCount ) {
+            /* no length message: the reader finds it from the data message */
+        }
+        else if ( signFirst ) {		// first message carries signature
+            MPI_Datatype sigtype = SigDatatype( SigCache( compiled ), &r->sig, arg );
+            PI_CALLMPI( MPIISender[ c->sendmode ]( MPI_BOTTOM, 1, sigtype, c->consumer,
+                                                   c->chan_tag, PI_CommWorld,
+                                                   &r->mpireq[i] ) )
+            FreeSigDatatype( SigCache( compiled ), &sigtype );	// freed once the send is done
+            signFirst = 0;
+        }
+        else PI_CALLMPI( MPIISender[ c->sendmode ]( arg->buf, arg->count, arg->type,
+                                                    c->consumer, c->chan_tag, PI_CommWorld,
+                                                    &r->mpireq[i] ) )
+    }
+
+    return r;
+}
+
+
+/*!
+********************************************************************************
+Posts the receives of a channel read without waiting for them, for PI_IRead and
+PI_ReadMulti (see PI_IRead for the items that are deferred).
+
+\param c Channel, which the caller has checked.
+\param format Format string.
+\param compiled Its compiled form.
+\param mpiArgs Bound items.
+\param mpiArgCount Number of elements in mpiArgs.
+\param code Code to log each item with, or NULL if the caller logs the call.
+\return The request, or NULL on error (only with PI_OnErrorReturn).
+*******************************************************************************/
+static PI_REQUEST *StartRead( PI_CHANNEL *c, const char *format, PI_FORMAT *compiled,
+                              PI_MPI_RTTI mpiArgs[], int mpiArgCount, const char *code )
+{
+    PI_ON_ERROR_RETURN( NULL )
+
+    int i, k;
+    int packSize = -1;		// >= 0 means items will arrive packed
+    int signFirst = PI_CheckLevel >= 2 && !( c->format && c->format->sigFixed );
+    for ( i = 0; i < mpiArgCount; i++ )
+        PI_ASSERT( , mpiArgs[i].op==MPI_OP_NULL, PI_OP_INVALID )
+
+    /* Receives are posted for the k items before the first ^ or %s, unless an
+     * earlier read on the channel still has deferred items.  A packed message
+     * is either posted whole or deferred.
+     */
+    for ( k = 0; k < mpiArgCount && !mpiArgs[k].sendCount; k++ ) ;
+    if ( c->deferTail ) k = 0;
+    if ( thisproc.svc_flag[MSG_COALESCE] && mpiArgCount > 1 ) {
+        if ( k < mpiArgCount ) k = 0;
+        else {
+            packSize = PackedSize( mpiArgs, mpiArgCount, signFirst );
+            if ( packSize < 0 ) return NULL;	// func. detected error with PI_OnErrorReturn
+        }
+    }
+
+    PI_REQUEST *r = NewRequest( c, 1, mpiArgs, mpiArgCount );
+    PI_ASSERT( , r, PI_MALLOC_ERROR )
+    r->posted = k;
+    r->signFirst = signFirst && k > 0;	// else ReadArgs checks it
+    if ( r->signFirst ) r->sig = (int)GetSignature( compiled, mpiArgs, mpiArgCount );
+
+    /* Log each item */
+    if ( code ) {
+        for ( i = 0; i < mpiArgCount; i++ )
+            LOGCALL( code, c->chan_id, format, i+1, mpiArgCount, &r->args[i] );
+    }
+
+    if ( packSize >= 0 ) {
+        r->packed = malloc( packSize );
+        if ( r->packed == NULL ) FreeRequest( &r );
+        PI_ASSERT( , r, PI_MALLOC_ERROR )
+        r->packedLen = packSize;
+        PI_CALLMPI( MPI_Irecv( r->packed, packSize, MPI_PACKED, c->producer, c->chan_tag,
+                               PI_CommWorld, &r->mpireq[0] ) )
+        return r;
+    }
+
+    for ( i = 0; i < k; i++ ) {
+        PI_MPI_RTTI *arg = &r->args[i];
+
+        if ( i == 0 && r->signFirst ) {	// first message carries signature
+            MPI_Datatype sigtype = SigDatatype( SigCache( compiled ), &r->theirs, arg );
+            PI_CALLMPI( MPI_Irecv( MPI_BOTTOM, 1, sigtype, c->producer, c->chan_tag,
+                                   PI_CommWorld, &r->mpireq[i] ) )
+            FreeSigDatatype( SigCache( compiled ), &sigtype );
+        }
+        else PI_CALLMPI( MPI_Irecv( arg->buf, arg->count, arg->type, c->producer,
+                                    c->chan_tag, PI_CommWorld, &r->mpireq[i] ) )
+    }
+
+    /* Queue a read with deferred items on the channel, holding on to their
+     * derived datatypes, which belong to the format cache, and the format
+     */
+    if ( k < mpiArgCount ) {
+        for ( i = k; i < mpiArgCount; i++ ) {
+            int ints, addrs, types, combiner;
+            PI_CALLMPI( MPI_Type_get_envelope( r->args[i].type, &ints, &addrs,
+                                               &types, &combiner ) )
+            if ( combiner != MPI_COMBINER_NAMED ) {
+                PI_CALLMPI( MPI_Type_dup( r->args[i].type, &r->dups[i] ) )
+                r->args[i].type = r->dups[i];
+            }
+        }
+        r->format = strdup( format );	// if NULL, only logging suffers
+
+        if ( c->deferTail ) c->deferTail->next = r;
+        else c->deferHead = r;
+        c->deferTail = r;
+    }
+
+    return r;
+}
+
+
+/*!
+********************************************************************************
+Packs a write request's signature (if any) and items into its packed buffer,
+for -pimsg=c.
+
+\param r Request.
+\return Number of bytes packed.
+*******************************************************************************/
+static int PackArgs( PI_REQUEST *r )
+{
+    int i, pos = 0;
+
+    if ( r->signFirst ) {
+        PI_CALLMPI( MPI_Pack( &r->sig, 1, MPI_INT, r->packed, r->packedLen,
+                              &pos, PI_CommWorld ) )
     }
-#endif
+    for ( i = 0; i < r->nargs; i++ ) {
+        PI_CALLMPI( MPI_Pack( r->args[i].buf, r->args[i].count, r->args[i].type,
+                              r->packed, r->packedLen, &pos, PI_CommWorld ) )
+    }
+    return pos;
 }
 
-void PI_Log_( const char *text )
+/*!
+********************************************************************************
+Completes a nonblocking operation, without freeing it.
+
+\param r Request.
+\param block If 0, return instead of waiting.
+\return 1 if complete, else 0 (not ready, or error with PI_OnErrorReturn).
+*******************************************************************************/
+static int CompleteRequest( PI_REQUEST *r, int block )
 {
-    PI_ON_ERROR_RETURN()
-    PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
+    if ( AggPending ) FlushAggregated();	// the other end may be waiting for them
+    if ( r->done ) return 1;		// finished for a later read on its channel
+    if ( r->posted < r->nargs ) return FinishDeferred( r, block );
+
+    if ( !block ) {
+        int flag;
+        PI_CALLMPI( MPI_Testall( r->posted, r->mpireq, &flag, MPI_STATUSES_IGNORE ) )
+        if ( !flag ) return 0;
+    }
+    return r->done = WaitPosted( r );
+}
 
-    /* if logging to file enabled, forward to LogEvent as USER type event */
-    if ( thisproc.svc_flag[OLP_LOGFILE] ) LogEvent( USER, text );
+/*!
+********************************************************************************
+Waits for the messages of a request's posted items.  Each item is logged
+here, as for PI_Write or PI_Read, since this is where the process may block,
+and the deadlock detector needs to see that (PI_WriteMulti and PI_ReadMulti
+log their calls instead).  For a read, the writer's
+signature is then checked, and packed items are unpacked.
+
+\param r Request.
+\return 1 if OK, 0 on error (only with PI_OnErrorReturn).
+*******************************************************************************/
+static int WaitPosted( PI_REQUEST *r )
+{
+    PI_ON_ERROR_RETURN( 0 )
 
-#ifdef PILOT_WITH_MPE
-    if ( thisproc.svc_flag[LOG_MPE] ) {
-        bytebuf_pos = 0;
-        MPE_Log_pack( bytebuf, &bytebuf_pos, 'd', 1, &PI_CallerLine );
-        int textlen = strlen( text );
-        MPE_Log_pack( bytebuf, &bytebuf_pos, 's', MIN(LOG_LOG_SMAX,textlen), text );
-        MPE_Log_event( thisproc.mpe_event[LOG_LOG], 0, bytebuf );       // event bubble for PI_Log
+    int i, pos = 0;
+    for ( i = 0; i < r->posted; i++ ) {
+        if ( !r->multi ) LOGCALL( "Wai", r->chan->chan_id, "", i+1, r->nargs, NULL )
+        PI_CALLMPI( MPI_Wait( &r->mpireq[i], MPI_STATUS_IGNORE ) )
     }
-#endif
+    if ( !r->reading ) return 1;
+
+    if ( r->packed ) {
+        if ( r->signFirst ) {
+            PI_CALLMPI( MPI_Unpack( r->packed, r->packedLen, &pos,
+                                    &r->theirs, 1, MPI_INT, PI_CommWorld ) )
+        }
+        PI_ASSERT( LEVEL(2), !r->signFirst || r->theirs==r->sig, PI_FORMAT_MISMATCH )
+        for ( i = 0; i < r->nargs; i++ ) {
+            PI_CALLMPI( MPI_Unpack( r->packed, r->packedLen, &pos, r->args[i].buf,
+                                    r->args[i].count, r->args[i].type, PI_CommWorld ) )
+        }
+    }
+    else PI_ASSERT( LEVEL(2), !r->signFirst || r->theirs==r->sig, PI_FORMAT_MISMATCH )
+    return 1;
 }
 
-/* This function might be called before Pilot's tables are all set up, so be
-   sure we don't deref. any NULL pointers.  It can be called in any phase of
-   the program by any process.  If MPI is not even running yet, it will call
-   abort() and get out that way.  If Pilot is in the configuration phase (where
-   the same code is running on all nodes), only rank 0 will print, to avoid
-   cluttering the display with many duplicate messages.
-*/
-void PI_Abort( const int errcode, const char *text, const char *file, const int line )
+/*!
+********************************************************************************
+Receives the deferred items of the reads queued on r's channel, oldest first,
+up to and including r, as PI_Read would.  Without block, stops at the first
+read whose posted items are unfinished, or whose deferred data has not begun to
+arrive (once it has, the rest follow from the writer's PI_Write).
+
+\param r Queued read.
+\param block If 0, return instead of waiting.
+\return 1 if r is complete, else 0 (not ready, or error with PI_OnErrorReturn).
+*******************************************************************************/
+static int FinishDeferred( PI_REQUEST *r, int block )
 {
-    if ( thisproc.phase != CONFIG || thisproc.rank == 0 ) {
-        char *procname = "";
-        int procarg = 0;
-        if ( thisproc.processes ) {
-            procname = thisproc.processes[thisproc.rank].name;
-            procarg = thisproc.processes[thisproc.rank].argument;
+    PI_CHANNEL *c = r->chan;
+    while ( !r->done ) {
+        PI_REQUEST *q = c->deferHead;
+
+        if ( !block ) {
+            int flag;
+            PI_CALLMPI( MPI_Testall( q->posted, q->mpireq, &flag, MPI_STATUSES_IGNORE ) )
+            if ( flag ) {
+                PI_CALLMPI( MPI_Iprobe( c->producer, c->chan_tag, PI_CommWorld,
+                                        &flag, MPI_STATUS_IGNORE ) )
+            }
+            if ( !flag ) return 0;
         }
-        fprintf( stderr, "\n" PI_BORDER
-                 "*** PI_Abort *** Called from MPI process #%d = Pilot process:\n"
-                 PI_BORDER "***   %s(%d) @ %s:%d:\n"
-                 PI_BORDER "***   %s%s\n" PI_BORDER
-                 "The above should pinpoint the problem.\n" PI_BORDER
-                 "Subsequent messages from MPI can likely be disregarded.\n",
-                 thisproc.rank, procname, procarg, file, line,
-                 ( errcode >= PI_MIN_ERROR && errcode <= PI_MAX_ERROR ) ?
-                 ErrorText[errcode] : "",
-                 text ? text : "" );
-    }
 
-    /* TODO: Shut down MPE logging gracefully so file isn't lost or
-       corrupted (MPI errors are intercepted and end up here, too).
-       Unfortunately, we only have control over one process -- this one --
-       indeed, others could be exited or deadlocked, so we can't arrange for
-       them to call MPE functions.  We know that MPI_Abort, at least with
-       OpenMPI, sends SIGTERM to all processes, and we *can* trap that, but
-       MPE calls in the handler don't seem to work or even return, probably
-       because they in turn use MPI and MPI is shutting down.  So we have
-       to give up on this :-(
-       Another approach would be to find a Pilot way to stop all the processes
-       without calling MPI_Abort (at least not till everything is tidied up). */
+        c->deferHead = q->next;
+        if ( c->deferHead == NULL ) c->deferTail = NULL;
+        q->next = NULL;
 
-    /* MPI should shut down the application and may call exit/abort(errcode) */
-    int MPI_up;
-    MPI_Initialized( &MPI_up );
-    if ( MPI_up )
-        MPI_Abort( MPI_COMM_WORLD, errcode );	// kill everyone, not just PI_CommWorld subset
-    else
-        abort();
-    /******** does not return *********/
+        if ( !WaitPosted( q ) ) return 0;
+        ReadArgs( c, q->format ? q->format : "", NULL, q->args, q->nargs, q->posted );
+        q->done = 1;
+    }
+    return 1;
 }
 
-void PI_StopMain_( int status )
+/*!
+********************************************************************************
+Frees a nonblocking request or binding and clears the caller's handle.  A read
+that is still queued on its channel is taken off the queue.
+
+\param req Caller's handle.
+*******************************************************************************/
+static void FreeRequest( PI_REQUEST **req )
 {
     int i;
+    PI_REQUEST *r = *req, *q, *prev = NULL;
+    PI_CHANNEL *c = r->chan;
+
+    for ( q = c->deferHead; q; prev = q, q = q->next ) {
+        if ( q == r ) {
+            if ( prev ) prev->next = r->next;
+            else c->deferHead = r->next;
+            if ( c->deferTail == r ) c->deferTail = prev;
+            break;
+        }
+    }
 
-    PI_ON_ERROR_RETURN()
-    PI_ASSERT( , thisproc.phase==RUNNING, PI_WRONG_PHASE )
+    for ( i = 0; i < r->nargs; i++ ) {
+        if ( r->mpireq[i] != MPI_REQUEST_NULL ) PI_CALLMPI( MPI_Request_free( &r->mpireq[i] ) )
+        if ( r->dups[i] != MPI_DATATYPE_NULL ) PI_CALLMPI( MPI_Type_free( &r->dups[i] ) )
+    }
+    if ( r->sigtype != MPI_DATATYPE_NULL ) PI_CALLMPI( MPI_Type_free( &r->sigtype ) )
+    free( r->packed );
+    free( r->format );
+    r->magic = 0;		// in case caller keeps a stale copy
+    free( r );
+    *req = NULL;
+}
 
-    /* First job is to shutdown Pilot process logging, if it's active. */
-    if ( thisproc.svc_flag[OLP_RANK] == 1 ) {
+/*!
+********************************************************************************
+Reduces one item to rank 0 of the communicator.  MPI's predefined operators
+only work on predefined datatypes, so an item wrapped by WrapCount is reduced
+in chunks of PI_BIG_CHUNK elements.
+
+\param sendbuf Our contribution.
+\param recvbuf Result buffer if we are rank 0, else NULL.
+\param arg Item to reduce.
+\param comm Communicator of the writers.
+*******************************************************************************/
+static void ReduceItem( void *sendbuf, void *recvbuf, const PI_MPI_RTTI *arg, MPI_Comm comm )
+{
+    MPI_Aint lb, extent, offset;
+    long long done;
+    int chunk;
+
+    if ( arg->base == MPI_DATATYPE_NULL ) {
+        PI_CALLMPI( MPI_Reduce( sendbuf, recvbuf, arg->count, arg->type,
+                                arg->op, 0, comm ) )
+        return;
+    }
 
-        /* Notify log that this process is finished (unless this *is* the log
-           process on rank 1) */
-        if ( thisproc.rank != 1 ) {
-            char buff[PI_MAX_LOGLEN];
-            sprintf( buff, "FIN" PI_LOGSEP "%d", status );
-            LogEvent( PILOT, buff );
-        }
+    PI_CALLMPI( MPI_Type_get_extent( arg->base, &lb, &extent ) )
+    for ( done = 0; done < arg->elements; done += chunk ) {
+        chunk = arg->elements - done < PI_BIG_CHUNK ? arg->elements - done : PI_BIG_CHUNK;
+        offset = done * extent;
+        PI_CALLMPI( MPI_Reduce( (char *)sendbuf + offset,
+                                recvbuf ? (char *)recvbuf + offset : NULL,
+                                chunk, arg->base, arg->op, 0, comm ) )
     }
+}
 
-    /*MPE Shutdown Calls*/
-#ifdef PILOT_WITH_MPE
-    if ( thisproc.svc_flag[LOG_MPE] ) {
-        bytebuf_pos = 0;
-        MPE_Log_event( thisproc.mpe_eventse[LOG_COMPUTE][1], 0, NULL ); // end of execution phase (Compute state)
-        MPE_Log_sync_clocks();
-        MPE_Finish_log( LogFilename );
+/*!
+********************************************************************************
+Builds a datatype for a format signature followed by one read/write item, so
+that the signature can ride along with the item's message instead of being
+sent separately.  Addresses are absolute, so the datatype is used with
+MPI_BOTTOM, and the caller must release it with FreeSigDatatype after starting
+the transfer.
+
+The datatype is kept in \p cache, and reused as long as the signature and the
+item stay where they are, as they do when a loop repeats a transfer.  An item
+whose datatype is the caller's or a wrapped count's is not cached, since its
+handle may be freed and reused for another type.
+
+\param cache Where to keep the datatype, or NULL to build one for the caller.
+\param sig Location of the signature.
+\param arg Item to be sent or received after the signature.
+\return Committed datatype.
+*******************************************************************************/
+static PI_SIGTYPE ItemsSigItem = { MPI_DATATYPE_NULL };	// for formats not compiled
+
+static MPI_Datatype SigDatatype( PI_SIGTYPE *cache, int *sig, const PI_MPI_RTTI *arg )
+{
+    int blocklens[2] = { 1, arg->count };
+    MPI_Aint displs[2];
+    MPI_Datatype types[2] = { MPI_INT, arg->type }, sigtype;
+
+    if ( cache && ( arg->cType == CTYPE_USER_DEFINED || arg->base != MPI_DATATYPE_NULL ) )
+        cache = NULL;
+    if ( cache && cache->type != MPI_DATATYPE_NULL && cache->sig == sig
+            && cache->buf == arg->buf && cache->count == arg->count && cache->item == arg->type )
+        return cache->type;
+
+    PI_CALLMPI( MPI_Get_address( sig, &displs[0] ) )
+    PI_CALLMPI( MPI_Get_address( arg->buf, &displs[1] ) )
+    PI_CALLMPI( MPI_Type_create_struct( 2, blocklens, displs, types, &sigtype ) )
+    PI_CALLMPI( MPI_Type_commit( &sigtype ) )
+
+    if ( cache ) {		// MPI keeps the old one for any pending transfer
+        if ( cache->type != MPI_DATATYPE_NULL ) PI_CALLMPI( MPI_Type_free( &cache->type ) )
+        cache->type = sigtype;
+        cache->sig = sig;
+        cache->buf = arg->buf;
+        cache->count = arg->count;
+        cache->item = arg->type;
+    }
+    return sigtype;
+}
+
+/*!
+********************************************************************************
+Releases a datatype from SigDatatype: frees it unless it is kept in \p cache.
+
+\param cache Cache given to SigDatatype.
+\param type Datatype to release.
+*******************************************************************************/
+static void FreeSigDatatype( PI_SIGTYPE *cache, MPI_Datatype *type )
+{
+    if ( cache == NULL || *type != cache->type ) PI_CALLMPI( MPI_Type_free( type ) )
+}
+
+/*!
+********************************************************************************
+Finds where to keep the signed item's datatype for a transfer (see PI_SIGTYPE).
+
+\param f Compiled format, or NULL if the items were not given by a format.
+\return The format's cache, or the one shared by PI_WriteItems/PI_ReadItems.
+*******************************************************************************/
+static PI_SIGTYPE *SigCache( PI_FORMAT *f )
+{
+    return f ? &f->sigItem : &ItemsSigItem;
+}
+
+/*!
+********************************************************************************
+Matches the next message on a point-to-point channel, to be received with
+RecvNext: the one PI_SelectRead already matched, if any, else the next to
+arrive.  Without MPI-3 the message is only probed.
+
+\param c Channel, read end.
+\param msg Set to the matched message.
+\param status Set to its status.
+*******************************************************************************/
+static void MatchNext( PI_CHANNEL *c, PI_PROBED *msg, MPI_Status *status )
+{
+    if ( c->matched ) {
+        *msg = c->probed;
+        *status = c->probedStatus;
+        c->matched = 0;
+        return;
     }
+#if MPI_VERSION >= 3
+    PI_CALLMPI( MPI_Mprobe( c->producer, c->chan_tag, PI_CommWorld, msg, status ) )
+#else
+    PI_CALLMPI( MPI_Probe( c->producer, c->chan_tag, PI_CommWorld, status ) )
 #endif
+}
 
-    MPI_Barrier( PI_CommWorld );	/* synchronize all processes */
+/*!
+********************************************************************************
+Receives a message matched by MatchNext.
 
-    /* If user pre-initialized MPI, then leave it initialized.  This is to
-       allow Pilot to be re-configured and used again in this program, which is
-       needed for running benchmarks, but not in ordinary use.  In this case,
-       since MPI_Finalize is not being called, we take the trouble to free up
-       the communicators created for non-selector bundles, because MPI is liable
-       to run out of that resource given enough repetitions.
-    */
-    if ( MPIPreInit ) {
-        thisproc.phase = PREINIT;
-        if ( thisproc.bundles != NULL )
-            for ( i = 0; i < thisproc.allocated_bundles; i++ ) {
-                if ( thisproc.bundles[i]->usage != PI_SELECT &&
-                        thisproc.bundles[i]->comm != MPI_COMM_NULL )
-                    MPI_Comm_free( &(thisproc.bundles[i]->comm) );
-            }
+\param c Channel, read end.
+\param buf Where to receive it.
+\param count Number of elements of \p type.
+\param type Datatype of the elements.
+\param msg Message from MatchNext.
+*******************************************************************************/
+static void RecvNext( PI_CHANNEL *c, void *buf, int count, MPI_Datatype type, PI_PROBED *msg )
+{
+    MPI_Status status;
+
+#if MPI_VERSION >= 3
+    PI_CALLMPI( MPI_Mrecv( buf, count, type, msg, &status ) )
+#else
+    PI_CALLMPI( MPI_Recv( buf, count, type, c->producer, c->chan_tag, PI_CommWorld, &status ) )
+#endif
+}
+
+/*!
+********************************************************************************
+Receives an item that carries the writer's format signature (see SigDatatype)
+and compares the signature to ours.  The message size is checked first, so a
+mismatched item is never received into the caller's buffer.
+
+\param cache Where SigDatatype keeps the datatype.
+\param arg Item to receive.
+\param sig Our own signature.
+\param c Channel to receive from, if point-to-point.
+\param b Broadcaster bundle to receive from, or NULL for point-to-point.
+\return 1 if the signatures match, 0 if not (only with PI_OnErrorReturn).
+*******************************************************************************/
+static int RecvSignedItem( PI_SIGTYPE *cache, PI_MPI_RTTI *arg, int sig, PI_CHANNEL *c,
+                           PI_BUNDLE *b )
+{
+    PI_ON_ERROR_RETURN( 0 )
+
+    int theirs;
+    MPI_Datatype sigtype;
+
+    if ( b==NULL ) {
+        MPI_Status status;
+        PI_PROBED msg;
+        int bytes, size;
+
+        MatchNext( c, &msg, &status );
+        PI_CALLMPI( MPI_Get_count( &status, MPI_BYTE, &bytes ) )
+        PI_CALLMPI( MPI_Type_size( arg->type, &size ) )
+        PI_ASSERT( LEVEL(2), bytes==(int)sizeof(int)+arg->count*size, PI_FORMAT_MISMATCH )
+
+        sigtype = SigDatatype( cache, &theirs, arg );
+        RecvNext( c, MPI_BOTTOM, 1, sigtype, &msg );
     }
     else {
-        thisproc.phase = POSTRUN;
-        MPI_Finalize( );
+        sigtype = SigDatatype( cache, &theirs, arg );
+        PI_CALLMPI( MPI_Bcast( MPI_BOTTOM, 1, sigtype, 0, b->comm ) )
     }
+    FreeSigDatatype( cache, &sigtype );
 
-    /* deallocate memory */
+    PI_ASSERT( LEVEL(2), theirs==sig, PI_FORMAT_MISMATCH )
+    return 1;
+}
 
-    for ( i = 0; i < thisproc.allocated_channels; i++ )
-        free( thisproc.channels[i] );
+/*!
+********************************************************************************
+Starts broadcasting a format signature from the root (rank 0) of a bundle's
+communicator.  It is nonblocking where MPI allows, so that the root can overlap
+it with the collective(s) carrying the data.  The rest of the bundle completes
+it with MPI_Wait before any data collective, and compares, so that mismatched
+data is never received.
+
+\param sig Signature to send (at root) or location to receive it.
+\param comm Bundle's communicator.
+\param req Returns request to wait on.
+*******************************************************************************/
+static void StartSigBcast( int *sig, MPI_Comm comm, MPI_Request *req )
+{
+#if MPI_VERSION >= 3
+    PI_CALLMPI( MPI_Ibcast( sig, 1, MPI_INT, 0, comm, req ) )
+#else
+    PI_CALLMPI( MPI_Bcast( sig, 1, MPI_INT, 0, comm ) )
+    *req = MPI_REQUEST_NULL;
+#endif
+}
 
-    if ( thisproc.channels != NULL )
-        free( thisproc.channels );
+/*!
+********************************************************************************
+Finds the length of a variable-length item (^ flag or %s) from its data message
+on a channel, so that the writer does not have to send the length in a message
+of its own.  The message is matched here, and must be received by RecvProbed.
+
+\param c Channel being read.
+\param arg Data element of the item.
+\param signFirst Non-0 if the message also carries the writer's signature.
+\param msg Returns the matched message for RecvProbed.
+\return Number of elements in the message (which may exceed INT_MAX), or -1
+if it doesn't fit the item (only with PI_OnErrorReturn).
+*******************************************************************************/
+static long long ProbeArrayLen( PI_CHANNEL *c, const PI_MPI_RTTI *arg, int signFirst, PI_PROBED *msg )
+{
+    PI_ON_ERROR_RETURN( -1 )
 
-    if ( thisproc.processes != NULL )
-        free( thisproc.processes );
+    MPI_Status status;
 
-    if ( thisproc.bundles != NULL ) {
-        for( i = 0; i < thisproc.allocated_bundles; i++ ) {
-            if ( thisproc.bundles[i]->channels != NULL )
-                free( thisproc.bundles[i]->channels );
-        }
-        free( thisproc.bundles );
+#if MPI_VERSION >= 3
+    /* the message may hold more than INT_MAX elements, so count its bytes */
+    MPI_Count len, size;
+
+    MatchNext( c, msg, &status );
+    PI_CALLMPI( MPI_Get_elements_x( &status, MPI_BYTE, &len ) )
+    PI_CALLMPI( MPI_Type_size_x( arg->type, &size ) )
+    if ( signFirst ) {		// length is what follows the signature
+        len -= sizeof(int);
+        PI_ASSERT( LEVEL(2), size > 0 && len > 0 && len % size == 0, PI_FORMAT_MISMATCH )
     }
+    else PI_ASSERT( , size > 0 && len % size == 0, PI_FORMAT_MISMATCH )
+    return len / size;
+#else
+    int len, size;
 
-    if ( LogFilename ) free( LogFilename );
+    MatchNext( c, msg, &status );
 
-    /* The main process always returns, but other processes normally exit
-       here because otherwise they would return from PI_StartAll and (re)execute
-       main's code.  However, if Pilot is in "bench mode", we do return so
-       that another Pilot application can be configured and executed.
-    */
-    if ( thisproc.rank!=0 && !MPIPreInit ) exit( 0 );
+    if ( signFirst ) {		// length is what follows the signature
+        PI_CALLMPI( MPI_Get_count( &status, MPI_BYTE, &len ) )
+        PI_CALLMPI( MPI_Type_size( arg->type, &size ) )
+        len -= sizeof(int);
+        PI_ASSERT( LEVEL(2), len > 0 && len % size == 0, PI_FORMAT_MISMATCH )
+        len /= size;
+    }
+    else {
+        PI_CALLMPI( MPI_Get_count( &status, arg->type, &len ) )
+        PI_ASSERT( , len != MPI_UNDEFINED, PI_FORMAT_MISMATCH )
+    }
+    return len;
+#endif
 }
 
-
-/*** Internal Functions ***/
-
 /*!
 ********************************************************************************
-Called by MPI to handle error in library function.
-Handle the error reported from MPI by printing message and aborting.
-Could be due to Pilot's misuse of MPI, or MPI detecting a user error (like
-mismatched read/write data types or lengths).
-
-\param comm MPI communicator where error occurred (we don't use this).
-\param code MPI error code
-\param ... additional implementation-specific args (ignore)
+Receives a message matched by ProbeArrayLen into the caller's array.  If the
+message also carries the writer's signature, it is compared to ours.
+
+\param c Channel being read.
+\param arg Data element of the item.
+\param buf Array to receive into.
+\param count Number of elements, as found by ProbeArrayLen.
+\param sig Our own signature, or NULL if the message doesn't carry one.
+\param cache Where SigDatatype keeps the datatype, if \p sig.
+\param msg Message matched by ProbeArrayLen.
+\return 1 if OK, 0 if the signatures don't match (only with PI_OnErrorReturn).
 *******************************************************************************/
-static void HandleMPIErrors( MPI_Comm *comm, int *code, ... )
+static int RecvProbed( PI_CHANNEL *c, const PI_MPI_RTTI *arg, void *buf, int count,
+                       const int *sig, PI_SIGTYPE *cache, PI_PROBED *msg )
 {
-    char buff[MPI_MAX_ERROR_STRING], text[MPI_MAX_ERROR_STRING+80];
-    int len;
+    PI_ON_ERROR_RETURN( 0 )
 
-    MPI_Error_string( *code, buff, &len );	// obtain text for error code
+    int theirs;
+    MPI_Status status;
+    MPI_Datatype type = arg->type;
+
+    if ( sig ) {		// receive via signature + array datatype
+        PI_MPI_RTTI item = *arg;
+        item.buf = buf;
+        item.count = count;
+        type = SigDatatype( cache, &theirs, &item );
+        buf = MPI_BOTTOM;
+        count = 1;
+    }
 
-    snprintf( text, sizeof(text), " at " __FILE__ ":%d; MPI error code %d:\n%s",
-              MPICallLine, *code, buff );
+#if MPI_VERSION >= 3
+    PI_CALLMPI( MPI_Mrecv( buf, count, type, msg, &status ) )
+#else
+    PI_CALLMPI( MPI_Recv( buf, count, type, c->producer, c->chan_tag, PI_CommWorld, &status ) )
+#endif
 
-    PI_Abort( PI_MPI_ERROR, text, PI_CallerFile, PI_CallerLine );
-    /***** does not return *****/
+    if ( sig ) {
+        FreeSigDatatype( cache, &type );
+        PI_ASSERT( LEVEL(2), theirs==*sig, PI_FORMAT_MISMATCH )
+    }
+    return 1;
 }
 
 /*!
@@ -2186,6 +5857,8 @@ static char *ParseArgs( int *argc, char ***argv )
     memset( Option, 0, OPT_END );	// clear all option flags
     LogFilename = NULL;			// assume no log needed
     OnlineProcess = OLP_NONE;		// assume no online process needed
+    WaitParams[0] = PI_WAIT_SPIN;	// default backoff unless -piwait
+    WaitParams[1] = PI_WAIT_SLEEP;
 
     /* scan args, shuffling non-Pilot args up in *argv array */
     for ( i=0; i<*argc; i++ ) {
@@ -2220,6 +5893,34 @@ static char *ParseArgs( int *argc, char ***argv )
                 }
             }
 
+            /* '-pimsg=...' message transport options */
+            else if ( 0==strncmp( (*argv)[i]+3, "msg=", 4 ) ) {
+                for ( j=7; (*argv)[i][j]; j++ ) {
+                    switch ( toupper( (*argv)[i][j] ) ) {
+                    case 'C':
+                        Option[OPT_COALESCE] = 1;
+                        break;
+                    default:
+                        unrec = 1;
+                    }
+                }
+            }
+
+            /* '-piwait=spin[,sleep]' polled waits (microseconds) */
+            else if ( 0==strncmp( (*argv)[i]+3, "wait=", 5 ) ) {
+                char *end;
+                long spin = strtol( (*argv)[i]+8, &end, 10 ), sleep = PI_WAIT_SLEEP;
+                if ( end == (*argv)[i]+8 ) unrec = 1;	// no spin given
+                else if ( *end == ',' ) sleep = strtol( end+1, &end, 10 );
+                if ( unrec || *end || spin < 0 || sleep < 0 || spin > INT_MAX || sleep > INT_MAX )
+                    unrec = 1;
+                else {
+                    Option[OPT_WAIT] = 1;
+                    WaitParams[0] = spin;
+                    WaitParams[1] = sleep;
+                }
+            }
+
             /* '-pilog=filename' */
             else if ( 0==strncmp( (*argv)[i]+3, "log=", 4 ) ) {
                 int len = strlen( (*argv)[i] );
@@ -2412,13 +6113,13 @@ static const char *interpArg( char *dest, int maxlen, const char *code, const PI
 
     // use code to decide whether this is an input or output call
 
-    const char *iocodes = "Rea" "Gat" "Rdu" "Wri" "Sca" "Bro";
+    const char *iocodes = "Rea" "Gat" "Rdu" "IRe" "ReM" "WrM" "Wri" "Sca" "Bro" "IWr";
     char *which = strstr( iocodes, code );
     if ( which==NULL ) return dest;	// nothing to print
 
     int func = (which - iocodes) / 3;	// convert to function number
 
-    if ( func < 3 ) {		// input type function, print address
+    if ( func < 6 ) {		// input type function, or args are locations, print address
         snprintf( dest+strlen(dest), maxlen, PI_LOGSEP "[%d] %p", arg->count, arg->data.address);
         return dest;
     }
@@ -2459,6 +6160,7 @@ static const char *interpArg( char *dest, int maxlen, const char *code, const PI
         case CTYPE_LONG_LONG:           PRVAL("%lld",lld)
         case CTYPE_UNSIGNED_LONG_LONG:  PRVAL("%llu",llu)
         case CTYPE_USER_DEFINED:        PRVAL("%p",address)
+        case CTYPE_STRUCT:              PRVAL("%p",address)
 
         // don't try to handle these types yet
         case CTYPE_FORTRAN:             PRFAIL()
@@ -2494,6 +6196,7 @@ static const char *interpArg( char *dest, int maxlen, const char *code, const PI
     // don't try to handle these types
     case CTYPE_FORTRAN:         PRFAIL()
     case CTYPE_USER_DEFINED:    PRFAIL()
+    case CTYPE_STRUCT:          PRFAIL()
     default:
         break;
     }
@@ -2592,13 +6295,13 @@ static int32_t OpToInt( int len, const char *bytes )
 
 /*!
 ********************************************************************************
-Fills in \c rtti->type and \c rtti->cType given a conversion specification.
+Fills in \c term->type and \c term->cType given a conversion specification.
 
 \return The number of characters that have been successfully processed.
 \retval 0 indicates failure since conversion specifiers are at least one
 char long.
 *******************************************************************************/
-static int LookupConversionSpec( const char *key, PI_MPI_RTTI *rtti )
+static int LookupConversionSpec( const char *key, PI_FORMAT_TERM *term )
 {
     CTYPE cType = CTYPE_INVALID;
     MPI_Datatype mpiType = MPI_DATATYPE_NULL;
@@ -2809,9 +6512,9 @@ static int LookupConversionSpec( const char *key, PI_MPI_RTTI *rtti )
         return 0;
     }
 
-    if ( rtti ) {
-        rtti->cType = cType;
-        rtti->type = mpiType;
+    if ( term ) {
+        term->cType = cType;
+        term->type = mpiType;
     }
 
     return skip;
@@ -2819,7 +6522,7 @@ static int LookupConversionSpec( const char *key, PI_MPI_RTTI *rtti )
 
 /*!
 ********************************************************************************
-Fills in \c rtti->op given a reduce operator in the first \p len bytes of \p key.
+Fills in \c term->op given a reduce operator in the first \p len bytes of \p key.
 If op is MPI_OP_NULL but the return value is non-0, then the caller should obtain
 a user-defined operator.
 
@@ -2827,7 +6530,7 @@ a user-defined operator.
 \retval 0 indicates failure since reduce operators are at least one
 char long.
 *******************************************************************************/
-static int LookupReduceOp( int len, const char *key, PI_MPI_RTTI *rtti )
+static int LookupReduceOp( int len, const char *key, PI_FORMAT_TERM *term )
 {
     MPI_Op mpiOp = MPI_OP_NULL;
     int skip = 0;
@@ -2895,8 +6598,8 @@ static int LookupReduceOp( int len, const char *key, PI_MPI_RTTI *rtti )
         return 0;
     }
 
-    if ( rtti ) {
-        rtti->op = mpiOp;
+    if ( term ) {
+        term->op = mpiOp;
     }
 
     return skip;
@@ -3021,7 +6724,7 @@ static uint32_t FormatSignature( PI_MPI_RTTI meta[], int items )
 
         // general case
         else {
-            length = meta[i].count;
+            length = (int)( meta[i].count * meta[i].elements );
 
             /* A reduce op is represented by a field of type MPI_Op. This is an
              * opaque datatype, meaning that it is almost surely implemented as a
@@ -3066,24 +6769,596 @@ static uint32_t FormatSignature( PI_MPI_RTTI meta[], int items )
                         | redopflag << 5
                         | (type & 0x1f);
 
-        // combine with earlier sig by shifting it 3 bits and XORing
-        sig = (sig << 3) ^ item;
+        // combine with earlier sig by shifting it 3 bits and XORing, along
+        // with the fields of a %{...} record
+        sig = (sig << 3) ^ item ^ meta[i].layout;
     }
 
     return sig;
 }
 
 
+/*!
+********************************************************************************
+Returns the signature of a bound format, using the value cached in the compiled
+format whenever the signature does not depend on the args (which it does for
+'*' array lengths and user-defined reduce operators).
+
+\param f  Compiled format returned by ParseFormatString(), or NULL if none.
+\param meta  The array of parsed arguments filled in by ParseFormatString().
+\param items  Number of format elements in the meta array.
+\return  The signature of the format, see FormatSignature().
+*******************************************************************************/
+static uint32_t GetSignature( PI_FORMAT *f, PI_MPI_RTTI meta[], int items )
+{
+    if ( f == NULL ) return FormatSignature( meta, items );
+    if ( f->sigValid ) return f->sig;
+
+    uint32_t sig = FormatSignature( meta, items );
+    if ( f->sigFixed ) {
+        f->sig = sig;
+        f->sigValid = 1;
+    }
+    return sig;
+}
+
+
+static PI_RECORD *Records;	// records built so far
+static int RecordCount;
+
+/* Alignment of a C type, found without relying on C11 _Alignof */
+#define ALIGNOF(T) offsetof( struct { char c; T x; }, x )
+
+/*!
+********************************************************************************
+Compiles a record layout, e.g., "{d 3lf 16c}", into the MPI struct datatype
+stored in \p t.  Each field is an optional array size and a C conversion spec
+(not %s, %m, or Fortran), and fields are separated by whitespace.  The offsets
+are those of a C struct with the same members: each field is aligned for its
+type, and the record's extent is padded to a multiple of the largest alignment,
+so that arrays of records work.  Datatypes are kept in a list (see PI_RECORD)
+for the rest of the run and shared by all formats with the same fields.
+
+\param s  Format text at the opening brace.
+\param t  Term to fill in.
+\return Number of chars up to and including the closing brace, or 0 if the
+layout is malformed (with \c t->error set if not PI_FORMAT_INVALID).
+*******************************************************************************/
+static int CompileRecord( const char *s, PI_FORMAT_TERM *t )
+{
+    const char *start = s++;		// skip '{'
+    PI_RECORD r;
+    PI_FORMAT_TERM field;
+    MPI_Datatype types[PI_MAX_FORMATLEN];
+    int i, skip;
+
+    r.fields = 0;
+    r.layout = 0;
+    while ( 1 ) {
+        while ( isspace(*s) ) s++;
+        if ( *s == '}' ) break;
+        if ( r.fields == PI_MAX_FORMATLEN ) return 0;
+
+        /* optional array size, which has the same rules as in a term */
+        const char *digits = s;
+        int count = 0;
+        while ( isdigit(*s) ) {
+            if ( count > INT_MAX / 10 ) {
+                t->error = PI_ARRAY_LENGTH;
+                return 0;
+            }
+            count = count * 10 + ( *s++ ) - '0';
+        }
+        if ( s > digits && count <= 1 ) {
+            t->error = PI_ARRAY_LENGTH;
+            return 0;
+        }
+        if ( s == digits ) count = 1;
+
+        if ( *s == 's' ) return 0;	// %s would be taken as %c
+        skip = LookupConversionSpec( s, &field );
+        if ( skip == 0 || field.cType == CTYPE_FORTRAN || field.cType == CTYPE_USER_DEFINED )
+            return 0;
+        s += skip;
+        if ( !isspace(*s) && *s != '}' ) return 0;
+
+        r.cType[r.fields] = field.cType;
+        r.count[r.fields] = count;
+        types[r.fields] = field.type;
+        r.fields++;
+        r.layout = ( r.layout << 3 ) ^ ( (uint32_t)(count & 0x1ffffff) << 7 | (field.cType & 0x1f) );
+    }
+    if ( r.fields == 0 ) return 0;
+    r.layout |= 1;			// nonzero even if the XORs cancel out
+
+    t->cType = CTYPE_STRUCT;
+    t->layout = r.layout;
+
+    /* already built? */
+    for ( i = 0; i < RecordCount; i++ ) {
+        if ( Records[i].layout == r.layout && Records[i].fields == r.fields &&
+                memcmp( Records[i].cType, r.cType, r.fields * sizeof(CTYPE) ) == 0 &&
+                memcmp( Records[i].count, r.count, r.fields * sizeof(int) ) == 0 ) {
+            t->type = Records[i].type;
+            return s + 1 - start;
+        }
+    }
+
+    /* lay out the fields as the C compiler would */
+    MPI_Datatype record;
+    MPI_Aint displs[PI_MAX_FORMATLEN], lb, extent, offset = 0;
+    int align, maxAlign = 1;
+
+    for ( i = 0; i < r.fields; i++ ) {
+        switch ( r.cType[i] ) {
+        case CTYPE_CHAR:                align = ALIGNOF( char ); break;
+        case CTYPE_SHORT:               align = ALIGNOF( short ); break;
+        case CTYPE_INT:                 align = ALIGNOF( int ); break;
+        case CTYPE_LONG:                align = ALIGNOF( long ); break;
+        case CTYPE_UNSIGNED_CHAR:       align = ALIGNOF( unsigned char ); break;
+        case CTYPE_UNSIGNED_SHORT:      align = ALIGNOF( unsigned short ); break;
+        case CTYPE_UNSIGNED_LONG:       align = ALIGNOF( unsigned long ); break;
+        case CTYPE_UNSIGNED:            align = ALIGNOF( unsigned ); break;
+        case CTYPE_FLOAT:               align = ALIGNOF( float ); break;
+        case CTYPE_DOUBLE:              align = ALIGNOF( double ); break;
+        case CTYPE_LONG_DOUBLE:         align = ALIGNOF( long double ); break;
+        case CTYPE_LONG_LONG:           align = ALIGNOF( long long ); break;
+        case CTYPE_UNSIGNED_LONG_LONG:  align = ALIGNOF( unsigned long long ); break;
+        default:                        align = 1; break;	// byte
+        }
+        offset = ( offset + align - 1 ) / align * align;
+        displs[i] = offset;
+        if ( align > maxAlign ) maxAlign = align;
+        PI_CALLMPI( MPI_Type_get_extent( types[i], &lb, &extent ) )
+        offset += extent * r.count[i];
+    }
+    extent = ( offset + maxAlign - 1 ) / maxAlign * maxAlign;
+
+    PI_CALLMPI( MPI_Type_create_struct( r.fields, r.count, displs, types, &record ) )
+    PI_CALLMPI( MPI_Type_create_resized( record, 0, extent, &r.type ) )
+    PI_CALLMPI( MPI_Type_free( &record ) )
+    PI_CALLMPI( MPI_Type_commit( &r.type ) )
+
+    PI_RECORD *grown = realloc( Records, ( RecordCount + 1 ) * sizeof(PI_RECORD) );
+    if ( grown == NULL ) {
+        MPI_Type_free( &r.type );
+        t->error = PI_MALLOC_ERROR;
+        return 0;
+    }
+    Records = grown;
+    Records[RecordCount++] = r;
+    t->type = r.type;
+    return s + 1 - start;
+}
+
+/*!
+********************************************************************************
+Frees the datatypes of all the records built by CompileRecord.
+*******************************************************************************/
+static void FreeRecords( void )
+{
+    while ( RecordCount > 0 )
+        MPI_Type_free( &Records[--RecordCount].type );
+    free( Records );
+    Records = NULL;
+}
+
+
+/*!
+********************************************************************************
+Compiles one conversion specification starting at \p *ps into \p t, and advances
+\p *ps past it.  Nothing here depends on the caller's arg list.  If the term is
+malformed, the error code is stored in \c t->error, leaving in place whatever
+fields were parsed before the error was found, so that ParseFormatString will consume
+the same args before reporting it as the former one-pass parser did.
+
+\param ps  Pointer into format text, at start of term (after whitespace).
+\param t  Term to fill in.
+\param msgs  Number of messages generated by the preceding terms.
+\return Number of messages (1 or 2) the term generates, or 0 if in error.
+*******************************************************************************/
+static int CompileTerm( const char **ps, PI_FORMAT_TERM *t, int msgs )
+{
+    const char *s = *ps;
+    int stride = 0, block = 0, strided = 0;	// for strided array
+
+    t->cType = CTYPE_INVALID;
+    t->type = MPI_DATATYPE_NULL;
+    t->op = MPI_OP_NULL;
+    t->opArg = 0;
+    t->countKind = COUNT_NONE;
+    t->count = 0;
+    t->wideLen = 0;
+    t->strided = 0;
+    t->elements = 1;
+    t->layout = 0;
+    t->callerBuf = 0;
+    t->error = PI_NO_ERROR;
+
+    /* The next char must mark the start of a conversion specification. */
+    if ( *s++ != '%' || *s == '\0' ) {
+        t->error = PI_FORMAT_INVALID;
+        return 0;
+    }
+
+    /* Parse optional reduce operation.  Only look for the slash within this
+       term, or else "%d %+/d" would take "d %+" as the operator. */
+    const char *slash = s;
+    while ( *slash && *slash != '/' && *slash != '%' && !isspace( *slash ) )
+        slash++;
+    if ( *slash == '/' ) {
+        int oplen = slash - s;		// op should be 1-3 chars
+        if ( oplen < 1 || oplen > 3 || LookupReduceOp( oplen, s, t ) == 0 ) {
+            t->error = PI_FORMAT_INVALID;
+            return 0;
+        }
+        t->opArg = ( t->op == MPI_OP_NULL );	// user-defined op is in next arg
+        s = slash+1;
+    }
+
+    /* Parse optional array size */
+    if ( isdigit(*s) ) {
+        long long count = 0;
+        do {
+            if ( count > LLONG_MAX / 10 ) {
+                t->error = PI_ARRAY_LENGTH;
+                return 0;
+            }
+            count = count * 10 + ( *s++ ) - '0';
+        } while ( isdigit(*s) );
+
+        /* Digits must be followed by a type */
+        if ( *s == '\0' ) {
+            t->error = PI_FORMAT_INVALID;
+            return 0;
+        }
+
+        /* Disallow "%1" since 1 (one) looks too similar to l (ell).
+           Also disallow "%0" as it has no meaning. */
+        if ( count <= 1 ) {
+            t->error = PI_ARRAY_LENGTH;
+            return 0;
+        }
+        t->countKind = COUNT_FIXED;
+        t->count = count;
+
+        /* Parse optional stride and block length, "%N:S:B", which selects N
+           blocks of B elements (default 1) spaced S elements apart */
+        if ( *s == ':' ) {
+            if ( !isdigit(*++s) ) {
+                t->error = PI_FORMAT_INVALID;
+                return 0;
+            }
+            while ( isdigit(*s) ) stride = stride * 10 + ( *s++ ) - '0';
+
+            if ( *s == ':' ) {
+                if ( !isdigit(*++s) ) {
+                    t->error = PI_FORMAT_INVALID;
+                    return 0;
+                }
+                while ( isdigit(*s) ) block = block * 10 + ( *s++ ) - '0';
+            }
+            else block = 1;
+
+            if ( block < 1 || stride < block || count > INT_MAX ) {
+                t->error = PI_ARRAY_LENGTH;
+                return 0;
+            }
+            strided = 1;	// term owns the vector type only once it's built
+        }
+    }
+
+    /* 'z' prefix before '*', '^', or '~' says the length args are size_t */
+    if ( *s == 'z' && ( s[1] == '*' || s[1] == '^' || s[1] == '~' ) ) {
+        t->wideLen = 1;
+        s++;
+    }
+
+    /* '*' specifies array size supplied in int (or size_t) arg */
+    if ( *s == '*' ) {
+        /* Make sure the count has not already been specified */
+        if ( t->countKind != COUNT_NONE ) {
+            t->error = PI_ARRAY_LENGTH;
+            return 0;
+        }
+        t->countKind = COUNT_ARG;
+        if ( *++s == '\0' ) {
+            t->error = PI_FORMAT_INVALID;
+            return 0;
+        }
+    }
+
+    /* Handle '^' flag and 's' string datatype, which generate an extra
+       array length element (see ParseFormatString).  The '~' flag works like
+       '^' (or plain 's' in "%~s"), except the reader supplies the buffer. */
+    if ( *s == '^' || *s == '~' || *s == 's' ) {
+        /* Make sure we're not into a reduction; ^ would not make sense */
+        if ( t->op != MPI_OP_NULL || t->opArg ) {
+            t->error = PI_FORMAT_INVALID;
+            return 0;
+        }
+        /* Make sure the count has not been specified */
+        if ( t->countKind != COUNT_NONE ) {
+            t->error = PI_ARRAY_LENGTH;
+            return 0;
+        }
+        char flag = *s;
+        t->callerBuf = ( flag == '~' );
+
+        /* advance ^ parsing to type code (for 's' case we let it scan the 's') */
+        if ( flag != 's' && *++s == '\0' ) {
+            t->error = PI_FORMAT_INVALID;
+            return 0;
+        }
+        t->countKind = ( flag == '^' || *s != 's' ) ? COUNT_VAR : COUNT_STRLEN;
+        if ( msgs+1 >= PI_MAX_FORMATLEN ) {
+            t->error = PI_FORMAT_INVALID;
+            return 0;
+        }
+    }
+
+    /* Figure out which MPI type to use, or build one for a record */
+    int skip = *s == '{' ? CompileRecord( s, t ) : LookupConversionSpec( s, t );
+    if ( skip == 0 ) {
+        if ( t->error == PI_NO_ERROR ) t->error = PI_FORMAT_INVALID;
+        return 0;
+    }
+    if ( t->cType == CTYPE_STRUCT && ( t->op != MPI_OP_NULL || t->opArg ) ) {
+        t->error = PI_FORMAT_INVALID;	// MPI can't reduce a struct with a builtin op
+        return 0;
+    }
+
+    /* A strided array is sent as one item of a vector type, built here once
+       and kept with the compiled format.  Its extent is resized to one block,
+       so that in PI_Gather/PI_Scatter, successive channels' blocks are placed
+       side by side (e.g., each gets its own columns of a matrix).  Neither
+       reductions nor %m (type known only at bind time) can be strided. */
+    if ( strided ) {
+        MPI_Datatype vector;
+        MPI_Aint lb, extent;
+
+        if ( t->op != MPI_OP_NULL || t->opArg || t->type == MPI_DATATYPE_NULL ) {
+            t->error = PI_FORMAT_INVALID;
+            return 0;
+        }
+        PI_CALLMPI( MPI_Type_get_extent( t->type, &lb, &extent ) )
+        PI_CALLMPI( MPI_Type_vector( t->count, block, stride, t->type, &vector ) )
+        PI_CALLMPI( MPI_Type_create_resized( vector, 0, block * extent, &t->type ) )
+        PI_CALLMPI( MPI_Type_free( &vector ) )
+        PI_CALLMPI( MPI_Type_commit( &t->type ) )
+        t->strided = 1;
+        t->elements = t->count * block;
+        t->count = 1;
+    }
+
+    /* Here we may want to verify that a reduce operation is compatible
+       with the MPI type, but let's see if/how MPI detects problems. */
+
+    *ps = s + skip;
+    return ( t->countKind == COUNT_VAR || t->countKind == COUNT_STRLEN ) ? 2 : 1;
+}
+
+
+/*!
+********************************************************************************
+Compiles a format string into \p f.  Compilation stops at the first malformed
+term; the error is recorded (see CompileTerm) and reported later by
+ParseFormatString.
+
+\param fmt  Printf like format to be compiled (not NULL).
+\param f  Compiled format to fill in.  Its key and text are not set here.
+*******************************************************************************/
+static void CompileFormat( const char *fmt, PI_FORMAT *f )
+{
+    const char *s = fmt;
+    int msgs = 0, n;
+
+    f->terms = 0;
+    f->error = PI_NO_ERROR;
+    f->sigFixed = 1;
+    f->sigValid = 0;
+    f->sigItem.type = MPI_DATATYPE_NULL;
+
+    /* Each term normally generates one message, but formats that send an
+       extra message with count info (^ flag and %s type) generate two. */
+    while ( 1 ) {
+        /* Skip whitespace in fmt */
+        while ( isspace(*s) ) s++;
+
+        if ( *s == '\0' ) break;
+
+        PI_FORMAT_TERM *t = &f->term[ f->terms++ ];
+        n = CompileTerm( &s, t, msgs );
+
+        /* The signature includes '*' lengths and user-defined operators */
+        if ( t->countKind == COUNT_ARG || t->opArg ) f->sigFixed = 0;
+
+        if ( n == 0 ) break;		// error recorded in term
+
+        /* The format string contains too many arguments. */
+        msgs += n;
+        if ( msgs >= PI_MAX_FORMATLEN ) {
+            f->error = PI_FORMAT_ARGS;
+            break;
+        }
+    }
+
+    /* The format string is nothing but whitespace. */
+    if ( f->terms == 0 ) f->error = PI_FORMAT_INVALID;
+
+    f->messages = msgs;
+}
+
+
+/*!
+********************************************************************************
+Finds the compiled form of a format string, compiling it if necessary.
+
+Compiled formats are kept in a small direct-mapped cache indexed by the
+format's address, since most formats are string literals.  A hit is verified
+by comparing the text as well, because the same buffer may be reused for
+different formats (e.g., by the Fortran API).  Malformed formats are not cached;
+they are compiled into a scratch area that is overwritten by the next one.
+A compiled format owns the vector datatypes of its strided terms, and the
+datatype of its signed item (see SigDatatype), so these follow it into the
+cache and are freed when it is replaced.
+
+\param fmt  Printf like format to be looked up (not NULL).
+\return Pointer to the compiled format (never NULL).
+*******************************************************************************/
+static PI_FORMAT *FormatCache[ PI_FORMAT_CACHE ];
+static PI_FORMAT FormatScratch = { .sigItem={ MPI_DATATYPE_NULL } };
+
+static void FreeTermTypes( PI_FORMAT *f )
+{
+    int i;
+
+    for ( i = 0; i < f->terms; i++ )
+        if ( f->term[i].strided )
+            MPI_Type_free( &f->term[i].type );
+    f->terms = 0;
+    if ( f->sigItem.type != MPI_DATATYPE_NULL )
+        MPI_Type_free( &f->sigItem.type );
+}
+
+static PI_FORMAT *LookupFormat( const char *fmt )
+{
+    unsigned slot = (unsigned)( ( (uintptr_t)fmt * 2654435761u ) >> 8 )
+                    % PI_FORMAT_CACHE;
+    PI_FORMAT *f = FormatCache[ slot ];
+
+    if ( f && f->key == fmt && strcmp( f->text, fmt ) == 0 )
+        return f;			// cache hit
+
+    FreeTermTypes( &FormatScratch );	// left from a malformed format
+    CompileFormat( fmt, &FormatScratch );
+    if ( FormatScratch.error != PI_NO_ERROR ||
+            FormatScratch.term[ FormatScratch.terms-1 ].error != PI_NO_ERROR )
+        return &FormatScratch;
+
+    /* Replace any previous occupant of the slot; if memory is short, just
+       carry on using the scratch copy. */
+    if ( f == NULL ) f = malloc( sizeof( PI_FORMAT ) );
+    else {
+        FreeTermTypes( f );
+        free( f->text );
+    }
+    if ( f == NULL ) return &FormatScratch;
+
+    *f = FormatScratch;
+    f->key = fmt;
+    f->text = strdup( fmt );
+    if ( f->text == NULL ) {
+        free( f );
+        FormatCache[ slot ] = NULL;
+        return &FormatScratch;
+    }
+    FormatScratch.terms = 0;		// its types now belong to the cache
+    FormatScratch.sigItem.type = MPI_DATATYPE_NULL;
+    FormatCache[ slot ] = f;
+    return f;
+}
+
+
+/*!
+********************************************************************************
+Frees all the compiled formats in the cache, including their MPI datatypes, and
+the signed item datatype kept for PI_WriteItems/PI_ReadItems.
+*******************************************************************************/
+static void FreeFormatCache( void )
+{
+    int i;
+
+    FreeTermTypes( &FormatScratch );
+    if ( ItemsSigItem.type != MPI_DATATYPE_NULL )
+        MPI_Type_free( &ItemsSigItem.type );
+    for ( i = 0; i < PI_FORMAT_CACHE; i++ ) {
+        if ( FormatCache[i] ) {
+            FreeTermTypes( FormatCache[i] );
+            free( FormatCache[i]->text );
+            free( FormatCache[i] );
+            FormatCache[i] = NULL;
+        }
+    }
+}
+
+
+/*!
+********************************************************************************
+Tells whether a format given to a read or write of a typed channel is the
+channel's own: the same pointer, as usual, or the same text at another address.
+
+\param f The channel's compiled format.
+\param format Format given by the caller.
+\return 1 if they match, else 0.
+*******************************************************************************/
+static int SameFormat( const PI_FORMAT *f, const char *format )
+{
+    return format == f->key || strcmp( format, f->text ) == 0;
+}
+
+/*!
+********************************************************************************
+Frees a channel's format set by PI_SetChannelFormat, if any, including its MPI
+datatypes.
+*******************************************************************************/
+static void FreeChannelFormat( PI_CHANNEL *c )
+{
+    if ( c->format == NULL ) return;
+
+    FreeTermTypes( c->format );
+    free( c->format->text );
+    free( c->format );
+    c->format = NULL;
+}
+
+
+/*!
+********************************************************************************
+Confirms that every process set the same formats on the same channels.  This
+is collective over PI_CommWorld: each process hashes the channel IDs and format
+texts, and the smallest and largest hashes must agree.
+
+\return 1 if all processes agree, else 0.
+*******************************************************************************/
+static int CheckChannelFormats( void )
+{
+    uint32_t hash = 2166136261u;	// FNV-1a
+    int i, minmax[2];
+    const char *t;
+
+    for ( i = 0; i < thisproc.allocated_channels; i++ ) {
+        const PI_CHANNEL *c = thisproc.channels[i];
+        if ( c->format == NULL ) continue;
+        hash = ( hash ^ (uint32_t)c->chan_id ) * 16777619u;
+        for ( t = c->format->text; *t; t++ )
+            hash = ( hash ^ (unsigned char)*t ) * 16777619u;
+    }
+
+    /* min of -hash is -max */
+    minmax[0] = hash & INT_MAX;
+    minmax[1] = -minmax[0];
+    MPI_Allreduce( MPI_IN_PLACE, minmax, 2, MPI_INT, MPI_MIN, PI_CommWorld );
+    return minmax[0] == -minmax[1];
+}
+
+
 /*!
 ********************************************************************************
 Parse a printf like format string into data which describes MPI data. This function
 aborts upon encountering a format error, unless PI_OnErrorReturn is set.
 
+The format text is only scanned the first time it is seen (see LookupFormat);
+after that, this function just binds the caller's args to the compiled terms.
+
 \param valsOrLocs  Whether the va_list should be interpreted as a list of
 values (e.g., PI_Write) or locations (e.g., PI_Read). Locations are demanded for
 certain collective output functions that draw from arrays (PI_Scatter). If values
 are allowed, locations can still be distinguished by coding a length.
 \param meta  An array of size PI_MAX_FORMATLEN to hold the parsed arguments.
+\param compiled  If not NULL, receives a pointer to the compiled format, which
+stays valid until the next call.  If it already points to a compiled format
+(a typed channel's), that is bound instead of looking up fmt.
 \param fmt  Printf like format to be parsed.
 \param ap  The va_list to read the arguments from. It is expected that the first
 argument is an integer giving the number of remaining args in the va_list.
@@ -3096,10 +7371,9 @@ parsed, but can be greater if the ^ flag or %s datatype is used) or -1 when
 an invalid format string is encountered.
 *******************************************************************************/
 static int ParseFormatString( IO_CONTEXT valsOrLocs, PI_MPI_RTTI meta[],
-                              const char *fmt, va_list ap )
+                              PI_FORMAT **compiled, const char *fmt, va_list ap )
 {
-    const char *s = fmt;
-    int metaIndex, nargs;
+    int metaIndex, nargs, termIndex;
 
     PI_ON_ERROR_RETURN( -1 );
     PI_ASSERT( , fmt != NULL, PI_NULL_FORMAT );
@@ -3111,75 +7385,41 @@ static int ParseFormatString( IO_CONTEXT valsOrLocs, PI_MPI_RTTI meta[],
      */
     nargs = va_arg( ap, int );
 
-    /* This loop runs until the format string has been fully parsed.
-     * It normally generates one meta element per format type code.
-     * However, formats that send an extra message with count info (^ flag
-     * and %s type) generate two elements. In that case, the loop index
-     * will be incremented inside the loop. In the end, there will be one
+    PI_FORMAT *f = compiled && *compiled ? *compiled : LookupFormat( fmt );
+    if ( compiled ) *compiled = f;
+
+    /* This loop runs through the compiled terms, normally generating one meta
+     * element per term.  However, formats that send an extra message with count
+     * info (^ flag and %s type) generate two elements. In that case, the meta
+     * index will be incremented inside the loop. In the end, there will be one
      * meta element per message that needs to be sent or received.
      */
-    for ( metaIndex = 0; metaIndex < PI_MAX_FORMATLEN; metaIndex++ ) {
+    for ( termIndex = metaIndex = 0; termIndex < f->terms; termIndex++, metaIndex++ ) {
+        const PI_FORMAT_TERM *t = &f->term[ termIndex ];
         PI_MPI_RTTI *rtti = &meta[ metaIndex ];
         rtti->sendCount = 0;		// assume no need to send count (=array size)
-        rtti->op = MPI_OP_NULL;		// assume no reduce op
-        int count = -1;			// -1 = haven't found count specified (yet)
-
-        /* Skip whitespace in fmt */
-        while ( isspace(*s) ) s++;
-
-        if ( *s == '\0' )
-            break;
-
-        /* The next char must mark the start of a conversion specification. */
-        PI_ASSERT( , *s == '%', PI_FORMAT_INVALID );
-
-        s++;
-        PI_ASSERT( , *s != '\0', PI_FORMAT_INVALID );
-
-        /* Parse optional reduce operation */
-        char *slash = strchr( s , '/' );	// look for slash
-        if ( slash ) {
-            int oplen = slash - s;		// op should be 1-3 chars
-            PI_ASSERT( , oplen>=1 || oplen<=3, PI_FORMAT_INVALID );
-
-            /* Figure out which MPI op to use */
-            int skip = LookupReduceOp( oplen, s, rtti );
-            PI_ASSERT( , skip > 0, PI_FORMAT_INVALID );
+        rtti->capacity = NULL;
+        rtti->length = NULL;
+        rtti->wideLen = t->wideLen;
+        rtti->elements = 1;
+        rtti->base = MPI_DATATYPE_NULL;
+        rtti->layout = 0;
+        rtti->resize = NULL;
+        rtti->op = t->op;
+        long long count = t->countKind == COUNT_FIXED ? t->count : -1;
+                                        // -1 = no count specified
+
+        /* Obtain user-defined operator from next arg */
+        if ( t->opArg ) {
+            PI_ASSERT( LEVEL(1), nargs-- > 0, PI_FORMAT_ARGS );
+            rtti->op = va_arg( ap, MPI_Op );
+        }
 
-            /* Obtain user-defined operator from next arg */
-            if ( rtti->op == MPI_OP_NULL ) {
-                PI_ASSERT( LEVEL(1), nargs-- > 0, PI_FORMAT_ARGS );
-                rtti->op = va_arg( ap, MPI_Op );
-            }
-            s = slash+1;
-        }
-
-        /* Parse optional array size */
-        if ( isdigit(*s) ) {
-            /* This should be the 1st digit seen */
-            PI_ASSERT( , count == -1, PI_FORMAT_INVALID );
-            count = 0;
-            do {
-                count = count * 10 + ( *s++ ) - '0';
-            } while ( isdigit(*s) );
-            /* Digits must be followed by a type */
-            PI_ASSERT( , *s != '\0', PI_FORMAT_INVALID );
-
-            /* Disallow "%1" since 1 (one) looks too similar to l (ell).
-               Also disallow "%0" as it has no meaning. */
-            PI_ASSERT( , count > 1, PI_ARRAY_LENGTH );
-        }
-
-        /* '*' specifies array size supplied in int arg */
-        if ( *s == '*' ) {
-            /* Make sure the count has not already been specified */
-            PI_ASSERT( , count == -1, PI_ARRAY_LENGTH );
-            /* Grab next arg for size */
+        /* '*' specifies array size supplied in int (or size_t) arg */
+        if ( t->countKind == COUNT_ARG ) {
             PI_ASSERT( LEVEL(1), nargs-- > 0, PI_FORMAT_ARGS );
-            count = va_arg( ap, int );
+            count = t->wideLen ? (long long)va_arg( ap, size_t ) : va_arg( ap, int );
             PI_ASSERT( , count > 0, PI_ARRAY_LENGTH );
-            s++;
-            PI_ASSERT( , *s != '\0', PI_FORMAT_INVALID );
         }
 
         /* Handle '^' flag and 's' string datatype:
@@ -3187,36 +7427,29 @@ static int ParseFormatString( IO_CONTEXT valsOrLocs, PI_MPI_RTTI meta[],
          * array length message. The difference is that 's' calculates the length on
          * writing, and does not store it in an arg on reading.
          */
-        if ( *s == '^' || *s == 's' ) {
-            /* Make sure we're not into a reduction; ^ would not make sense */
-            PI_ASSERT( , rtti->op == MPI_OP_NULL, PI_FORMAT_INVALID );
-            /* Make sure the count has not been specified */
-            PI_ASSERT( , count == -1, PI_ARRAY_LENGTH );
-            rtti->count = 1;	// refers to length of array size msg (1 x int)
-            rtti->type = MPI_INT;
-            rtti->cType = CTYPE_INT;
-            rtti->sendCount = 1;	// flag that count has to be sent from writer            }
+        if ( t->countKind == COUNT_VAR || t->countKind == COUNT_STRLEN ) {
+            rtti->count = 1;	// refers to length of array size msg (1 x long long)
+            rtti->type = MPI_LONG_LONG;
+            rtti->cType = CTYPE_LONG_LONG;
+            rtti->sendCount = 1;	// flag that count has to be sent from writer
+            rtti->buf = &rtti->data.lld;	// length travels in the parse element
 
             /* Reading: 1st element inputs integer array size */
             if ( valsOrLocs == IO_CONTEXT_LOCS ) {
-                /* general case: Grab next arg as location to store array size */
-                if ( *s == '^' ) {
+                /* general case: Grab next arg as location to store array size,
+                   which PI_Read fills in from the parse element (see StoreLength) */
+                if ( t->countKind == COUNT_VAR ) {
                     PI_ASSERT( LEVEL(1), nargs-- > 0, PI_FORMAT_ARGS );
-                    rtti->data.address = va_arg( ap, void* );
-                    rtti->buf = rtti->data.address;
-                }
-                /* 's' case: Store the length in the parse element itself */
-                else {
-                    rtti->buf = &rtti->data.d;
+                    rtti->length = va_arg( ap, void* );
                 }
             }
 
             /* Writing: 1st element sends integer array size from supplied variable */
             else {
                 /* general case: Grab next arg as the array size */
-                if ( *s == '^' ) {
+                if ( t->countKind == COUNT_VAR ) {
                     PI_ASSERT( LEVEL(1), nargs-- > 0, PI_FORMAT_ARGS );
-                    count = va_arg( ap, int );
+                    count = t->wideLen ? (long long)va_arg( ap, size_t ) : va_arg( ap, int );
                     PI_ASSERT( , count > 0, PI_ARRAY_LENGTH );
                 }
                 /* 's' case: Peek at next arg's strlen */
@@ -3228,49 +7461,56 @@ static int ParseFormatString( IO_CONTEXT valsOrLocs, PI_MPI_RTTI meta[],
                     count = 1 + strlen( (char *)va_arg( temp, char* ) ); // +1 for NUL term
                     va_end( temp );
                 }
-                rtti->data.d = count;
-                rtti->buf = &rtti->data.d;
-            }
-
-            /* advance ^ parsing to type code (for 's' case we let it scan the 's') */
-            if ( *s == '^' ) {
-                s++;
-                PI_ASSERT( , *s != '\0', PI_FORMAT_INVALID );
+                rtti->data.lld = count;
             }
 
             /* then start another element */
             metaIndex++;
-            PI_ASSERT( , metaIndex < PI_MAX_FORMATLEN, PI_FORMAT_INVALID );
             rtti = &meta[ metaIndex ];
             rtti->sendCount = 0;
+            rtti->capacity = NULL;
+            rtti->length = NULL;
+            rtti->wideLen = t->wideLen;
+            rtti->elements = 1;
+            rtti->base = MPI_DATATYPE_NULL;
+            rtti->layout = 0;
+            rtti->resize = NULL;
             rtti->op = MPI_OP_NULL;
         }
 
-        /* Figure out which MPI type to use */
-        int skip = LookupConversionSpec( s, rtti );
-        PI_ASSERT( , skip > 0, PI_FORMAT_INVALID );
+        /* Now report any error in the term found by CompileTerm */
+        PI_ASSERT( , t->error == PI_NO_ERROR, t->error );
 
-        /* Here we may want to verify that a reduce operation is compatible
-           with the MPI type, but let's see if/how MPI detects problems. */
+        rtti->cType = t->cType;
+        rtti->type = t->type;
+        rtti->elements = t->elements;
+        rtti->layout = t->layout;
 
         /* Set `rtti->buf` to point to the appropriate data. */
         if ( valsOrLocs == IO_CONTEXT_LOCS || count >= 1 ) {
-            if ( count <= 0 ) {
-                // This is a Read into a Scalar.
-                rtti->count = 1;
-            }
-            else rtti->count = count;
-
             /* For user defined types, collect the datatype from the user */
             if ( rtti->cType == CTYPE_USER_DEFINED ) {
                 PI_ASSERT( LEVEL(1), nargs-- > 0, PI_FORMAT_ARGS );
                 rtti->type = va_arg( ap, MPI_Datatype );
             }
 
+            if ( count <= 0 ) {
+                // This is a Read into a Scalar.
+                rtti->count = 1;
+            }
+            else WrapCount( rtti, count, 0 );
+
             PI_ASSERT( LEVEL(1), nargs-- > 0, PI_FORMAT_ARGS );
             rtti->data.address = va_arg( ap, void* );
             rtti->buf = rtti->data.address;
             PI_ASSERT( LEVEL(3), CheckPointer( rtti->buf ) > 1, PI_BOGUS_POINTER_ARG );
+
+            /* Reading with '~' flag: next arg is capacity of caller's buffer */
+            if ( t->callerBuf && valsOrLocs == IO_CONTEXT_LOCS ) {
+                PI_ASSERT( LEVEL(1), nargs-- > 0, PI_FORMAT_ARGS );
+                rtti->capacity = va_arg( ap, void* );
+                PI_ASSERT( LEVEL(3), CheckPointer( rtti->capacity ) > 1, PI_BOGUS_POINTER_ARG );
+            }
         }
         else if ( valsOrLocs == IO_CONTEXT_VALS ) {
             /* Writing a single scalar => copy it into a buffer.
@@ -3352,6 +7592,11 @@ static int ParseFormatString( IO_CONTEXT valsOrLocs, PI_MPI_RTTI meta[],
                 rtti->buf = rtti->data.address;
                 PI_ASSERT( LEVEL(3), CheckPointer( rtti->buf ) > 1, PI_BOGUS_POINTER_ARG );
                 break;
+            case CTYPE_STRUCT:		// a record is always passed by address
+                rtti->data.address = va_arg( ap, void* );
+                rtti->buf = rtti->data.address;
+                PI_ASSERT( LEVEL(3), CheckPointer( rtti->buf ) > 1, PI_BOGUS_POINTER_ARG );
+                break;
             default:
                 PI_ASSERT( , 0, PI_SYSTEM_ERROR );
             }
@@ -3359,15 +7604,10 @@ static int ParseFormatString( IO_CONTEXT valsOrLocs, PI_MPI_RTTI meta[],
         else {
             PI_ASSERT( , 0, PI_SYSTEM_ERROR );
         }
-
-        /* Move onto the next conversion specifier. */
-        s += skip;
     }
 
-    /* The format string is nothing but whitespace. */
-    PI_ASSERT( , metaIndex != 0, PI_FORMAT_INVALID );
-    /* The format string contains too many arguments. */
-    PI_ASSERT( , metaIndex != PI_MAX_FORMATLEN, PI_FORMAT_ARGS );
+    /* Report any error found after the last term (empty or too long format) */
+    PI_ASSERT( , f->error == PI_NO_ERROR, f->error );
 
     /* End of format string -- there should now be no more args */
     PI_ASSERT( LEVEL(1), nargs == 0, PI_FORMAT_ARGS )
@@ -3389,3 +7629,116 @@ static int ParseFormatString( IO_CONTEXT valsOrLocs, PI_MPI_RTTI meta[],
 
     return metaIndex;
 }
+
+
+/*!
+********************************************************************************
+Looks up the conversion spec equivalent to a PI_ITEMTYPE.
+
+\param type Item type.
+\param t Filled in with the spec's details.
+\return 1 if OK, or 0 if the type is invalid.
+*******************************************************************************/
+static int ItemSpec( PI_ITEMTYPE type, PI_FORMAT_TERM *t )
+{
+    /* conversion spec for each PI_ITEMTYPE, in the same order */
+    static const char *spec[] = {
+        "c", "hd", "d", "ld", "lld", "hhu", "hu", "u", "lu", "llu", "f", "lf", "Lf", "b"
+    };
+
+    if ( type < 0 || type >= (int)(sizeof(spec)/sizeof(spec[0])) ) return 0;
+    LookupConversionSpec( spec[type], t );
+    return 1;
+}
+
+/*!
+********************************************************************************
+Binds the items of PI_WriteItems or PI_ReadItems to MPI message elements, just
+as ParseFormatString binds a format's args, but without any parsing.  Each item
+gives the same elements as its equivalent format term ("%d", "%Nd", or "%z^d"
+if variable length), so either end of a channel may use a format instead.
+
+\param valsOrLocs Whether the items are being written or read.
+\param meta The array to fill in.
+\param items Caller's items.
+\param n Number of items.
+
+\return The number of meta elements filled, or -1 if an item is invalid.
+*******************************************************************************/
+static int BindItems( IO_CONTEXT valsOrLocs, PI_MPI_RTTI meta[], const PI_ITEM items[], int n )
+{
+    int i, metaIndex;
+    PI_FORMAT_TERM t;
+
+    PI_ON_ERROR_RETURN( -1 )
+    PI_ASSERT( , items != NULL && n > 0, PI_FORMAT_ARGS )
+
+    for ( i = metaIndex = 0; i < n; i++, metaIndex++ ) {
+        const PI_ITEM *item = &items[i];
+        PI_MPI_RTTI *rtti = &meta[ metaIndex ];
+
+        PI_ASSERT( , ItemSpec( item->type, &t ), PI_FORMAT_INVALID )
+        PI_ASSERT( , metaIndex + (item->varLen ? 2 : 1) <= PI_MAX_FORMATLEN, PI_FORMAT_INVALID )
+
+        rtti->sendCount = 0;
+        rtti->capacity = NULL;
+        rtti->length = NULL;
+        rtti->wideLen = 1;		// lengths are always size_t
+        rtti->elements = 1;
+        rtti->base = MPI_DATATYPE_NULL;
+        rtti->layout = 0;
+        rtti->resize = NULL;
+        rtti->op = MPI_OP_NULL;
+
+        /* variable length: the length travels in its own element, as for ^ */
+        if ( item->varLen ) {
+            rtti->count = 1;
+            rtti->type = MPI_LONG_LONG;
+            rtti->cType = CTYPE_LONG_LONG;
+            rtti->sendCount = 1;
+            rtti->buf = &rtti->data.lld;
+            if ( valsOrLocs == IO_CONTEXT_VALS ) {
+                PI_ASSERT( , item->count > 0 && item->count <= LLONG_MAX, PI_ARRAY_LENGTH )
+                rtti->data.lld = item->count;
+            }
+
+            /* then start another element, like this one but without the flag */
+            metaIndex++;
+            rtti = &meta[ metaIndex ];
+            *rtti = meta[ metaIndex-1 ];
+            rtti->sendCount = 0;
+            memset( &rtti->data, 0, sizeof( rtti->data ) );	// no longer the length
+        }
+
+        rtti->cType = t.cType;
+        rtti->type = t.type;
+
+        /* reading variable length: the callback will supply the array */
+        if ( item->varLen && valsOrLocs == IO_CONTEXT_LOCS ) {
+            PI_ASSERT( , item->resize != NULL, PI_FORMAT_ARGS )
+            rtti->resize = item->resize;
+            rtti->resizeCtx = item->ctx;
+            rtti->count = 1;
+            rtti->data.address = NULL;
+            rtti->buf = &rtti->data.address;
+        }
+        else {
+            PI_ASSERT( , item->count > 0 && item->count <= LLONG_MAX, PI_ARRAY_LENGTH )
+            PI_ASSERT( LEVEL(3), CheckPointer( item->buf ) > 1, PI_BOGUS_POINTER_ARG );
+            WrapCount( rtti, item->count, 0 );
+
+            /* As ParseFormatString does, for the call log: a scalar being
+               written is copied into the element, anything else is logged by
+               its address. */
+            if ( valsOrLocs == IO_CONTEXT_VALS && item->count == 1 && !item->varLen ) {
+                int size;
+                PI_CALLMPI( MPI_Type_size( rtti->type, &size ) )
+                memcpy( &rtti->data, item->buf, size );
+                rtti->buf = &rtti->data;
+            }
+            else rtti->buf = rtti->data.address = item->buf;
+        }
+    }
+
+    return metaIndex;
+}
@@ -37,6 +37,7 @@ typedef int(*PI_WORK_FUNC)(int,void*);
 typedef struct OPAQUE PI_PROCESS;
 typedef struct OPAQUE PI_CHANNEL;
 typedef struct OPAQUE PI_BUNDLE;
+typedef struct OPAQUE PI_REQUEST;
 #endif
 
 #include "pilot_limits.h"
@@ -44,6 +45,10 @@ typedef struct OPAQUE PI_BUNDLE;
 // define NULL
 #include <stddef.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 
 /*** Pilot global variables ***/
 
@@ -65,7 +70,7 @@ by means of command line option -picheck.  If set to N, additional checks up to
 and including level N will be done at the expense of performance degradation.
 
 After all Pilot-using code has been exercised, it should not be necessary to
-keep using levels 2 and 3 (which have high overhead).
+keep using level 3 (which has high overhead).
 
 Level 0:
  - Validates many function preconditions (detects user errors)
@@ -78,7 +83,9 @@ Level 1: DEFAULT
 
 Level 2:
  - Checks that reader formats match types and lengths of writer formats =>
-   PI_FORMAT_MISMATCH error (increases message traffic up to double)
+   PI_FORMAT_MISMATCH error (the format signature rides along with the first
+   item's message, or goes in a small broadcast ahead of a collective, so
+   added traffic is small)
 
 Level 3:
  - Checks that reader pointer arguments (&var) and writer pointer arguments
@@ -195,6 +202,13 @@ Optional command line arguments (all start with "-pi"):
   - c: make log of API calls
   - d: perform deadlock detection (uses one additional MPI process)
 
+- -pimsg=\<message options\>
+  - c: coalesce the items of each channel read/write into a single message
+
+- -piwait=\<spin\>[,\<sleep\>]
+  - poll in blocking reads and selects: spin for \<spin\> usec., then back off
+    to sleeps of at most \<sleep\> usec. (default 1000)
+
 - -pilog=\<filename\>
 
 \c -picheck overrides any programmer setting of the PI_CheckLevel global variable
@@ -204,6 +218,21 @@ made prior to calling \c PI_Configure(). Level N includes all levels below it.
 is needed to analyze and print/visualize the results. Other services are planned
 for future versions.
 
+\c -pimsg=c packs all the items of a PI_Write on an ordinary channel (i.e., not
+part of a collective bundle) into one MPI message, which PI_Read unpacks.  This
+trades a memory copy at each end for fewer messages, which pays off for formats
+with several short items, like "%d %lf %100f".  A packed message is limited
+to 2 GB, so larger writes fail with PI_ARRAY_LENGTH under this option.
+
+\c -piwait keeps a process blocked in PI_Read (on an ordinary channel),
+PI_Select, PI_SelectRead, or PI_SelectAll from spinning in MPI's progress
+engine, which matters when processes outnumber cores.  It polls instead, at
+first without pause, then yielding the CPU and sleeping 1, 2, 4, ... usec., up
+to the maximum; a maximum of 0 only yields.  The numbers also set the
+backoff of PI_ReadTimeout and PI_SelectTimeout, which otherwise spin for 50
+usec. and sleep at most 1000.  Writes and collective operations still block in
+MPI.
+
 \c -pilog allows the name of the log file to be changed from the default "pilot.log"
 
 \note Only specifying -pilog=fname does not by itself create a log. Some
@@ -370,6 +399,173 @@ void PI_SetName_( void *object, const char *name );
 	(PI_CallerFile = __FILE__, PI_CallerLine = __LINE__ , \
 	PI_SetName_( object, name ))
 
+/*!
+********************************************************************************
+Binds a format to a channel for its whole lifetime, making it a typed channel.
+
+The format is compiled once here (a malformed one is reported now), and its
+derived datatypes (strided arrays, records) are built now.  PI_Write and
+PI_Read on the channel must then give the same format (by pointer or by
+text, else PI_FORMAT_MISMATCH), and they bind the args to the compiled
+format without looking it up.  At level 2, PI_StartAll confirms once that all
+processes set the same formats, so a typed point-to-point channel sends no
+format signature with its data, unless the signature depends on the args
+("*" lengths or "mop" operators).  PI_WriteItems and PI_ReadItems cannot be
+used on a typed channel.  A channel of a selector given a format by
+PI_SetSelectFormat already has that format, and fails with PI_BUNDLE_USAGE.
+
+\param c Channel to type.
+\param format Format string for every read and write on the channel, or
+NULL to make the channel untyped again.
+
+\pre Channel has been created, and PI_StartAll has not been called.
+*******************************************************************************/
+void PI_SetChannelFormat_( PI_CHANNEL *c, const char *format );
+#define PI_SetChannelFormat( c, format ) \
+	(PI_CallerFile = __FILE__, PI_CallerLine = __LINE__ , \
+	PI_SetChannelFormat_( c, format ))
+
+/*!
+********************************************************************************
+How writes on a channel are sent, set by PI_SetChannelMode.
+\see PI_SetChannelMode
+*******************************************************************************/
+enum PI_SENDMODE { PI_SEND_STANDARD, PI_SEND_SYNC, PI_SEND_READY, PI_SEND_BUFFERED,
+                   PI_SEND_AGGREGATE, PI_SEND_SHARED, PI_SEND_RMA };
+
+/*!
+********************************************************************************
+Which of several ready channels PI_Select and PI_TrySelect choose, set by
+PI_SetSelectPolicy.
+\see PI_SetSelectPolicy
+*******************************************************************************/
+enum PI_SELECTPOLICY { PI_SELECT_ANY, PI_SELECT_ROUND_ROBIN, PI_SELECT_LEAST_RECENT };
+
+/*!
+********************************************************************************
+Selects how writes on a channel are sent.
+
+By default a channel is PI_SEND_STANDARD: PI_Write uses MPI_Send, which may
+return before the reader gets the data or may wait for it, at MPI's choice.
+The other modes are:
+
+ - PI_SEND_SYNC: every write waits until the reader has started to receive it
+   (MPI_Ssend), e.g., to pace a producer to its consumer.
+ - PI_SEND_READY: writes assume the reader has already started the read with
+   PI_IRead or a started PI_BindRead, and skip the handshake (MPI_Rsend).  If
+   it hasn't, the outcome is undefined.  With PI_IRead, this applies to the
+   items before any "^" or "%s".
+ - PI_SEND_BUFFERED: PI_Write copies the data and returns without waiting
+   (write-behind), so fire-and-forget traffic such as telemetry never waits for
+   the reader.  The copies come from a bounded pool per process; when it is
+   full, PI_Write waits for the oldest to be sent.  PI_StopMain waits for all
+   of them.
+ - PI_SEND_AGGREGATE: for many small writes, PI_Write packs each one onto the
+   end of a buffer kept by the channel, which is sent as one message once it
+   holds a few KB, or when PI_Flush is called, or before the writing process
+   next waits for anything in Pilot (any read, select, PI_ChannelHasData,
+   collective, PI_Wait/PI_Test, write on another channel, or PI_StopMain).
+   PI_Read unpacks the writes one at a time, in order, and PI_Select and
+   PI_ChannelHasData see those still waiting to be read.  PI_IWrite, PI_IRead,
+   PI_BindWrite, and PI_BindRead fail with PI_SEND_MODE on such a channel.
+ - PI_SEND_SHARED: if PI_StartAll finds both ends on the same node, writes
+   bypass MPI and go through a ring buffer in shared memory, which the reader
+   polls.  PI_Write only waits when the ring is full, and PI_Read, PI_Select,
+   and PI_ChannelHasData see the ring.  On Linux, PI_Read copies an item of a
+   megabyte or more straight from the writer's memory, while PI_Write waits,
+   unless the OS forbids it (e.g., ptrace restrictions) or the two processes
+   are in different PID namespaces, in which case the item goes through the
+   ring.  If the ends are on different nodes, the channel
+   acts as PI_SEND_STANDARD.  As with PI_SEND_AGGREGATE, the nonblocking calls
+   and bindings fail with PI_SEND_MODE.
+ - PI_SEND_RMA: a streaming channel.  PI_StartAll gives it a ring buffer in an
+   MPI window held by the reader, wherever the ends are.  PI_Write puts each
+   write into it with one-sided MPI calls and then advances a counter, and
+   PI_Read takes writes out of it, with no message matching on either side.
+   Each PI_Write is synchronous with the buffer, but not with the reader: it
+   waits for its data to land there before advancing the counter, and for the
+   counter to land too (two round trips), and waits for room when the buffer
+   is full.  PI_Select and
+   PI_ChannelHasData see the buffer.  The nonblocking calls and bindings fail
+   with PI_SEND_MODE.
+
+PI_IWrite and PI_BindWrite follow the mode too, except that they make no copy
+in buffered mode.  Collective operations are not affected.  With deadlock
+detection (-pisvc=d), every channel acts as PI_SEND_SYNC, an aggregating
+channel sends each write at once, and no rings or RMA buffers are used.
+
+\param c Channel whose writes are affected.
+\param mode One of enum PI_SENDMODE; any other value fails with PI_SEND_MODE.
+
+\pre Channel has been created, and PI_StartAll has not been called.
+*******************************************************************************/
+void PI_SetChannelMode_( PI_CHANNEL *c, enum PI_SENDMODE mode );
+#define PI_SetChannelMode( c, mode ) \
+	(PI_CallerFile = __FILE__, PI_CallerLine = __LINE__ , \
+	PI_SetChannelMode_( c, mode ))
+
+/*!
+********************************************************************************
+Selects which channel of a selector bundle PI_Select and PI_TrySelect return
+when more than one has data.
+
+By default a bundle is PI_SELECT_ANY: the channel is whichever one MPI's probe
+of the whole bundle finds, which is quick, but under heavy load may keep
+finding the same few writers and starve the rest.  The other policies look at
+the channels one by one, which costs a probe per channel looked at:
+
+ - PI_SELECT_ROUND_ROBIN: starts looking at the channel after the one last
+   chosen, so each writer with data gets a turn.
+ - PI_SELECT_LEAST_RECENT: looks at the channels in the order they were last
+   chosen, least recent first, so a writer that has waited longest is served
+   first.
+
+\param b Selector bundle.
+\param policy One of enum PI_SELECTPOLICY; any other value fails with
+PI_INVALID_ARG.
+
+\pre Bundle has been created, and PI_StartAll has not been called.
+*******************************************************************************/
+void PI_SetSelectPolicy_( PI_BUNDLE *b, enum PI_SELECTPOLICY policy );
+#define PI_SetSelectPolicy( b, policy ) \
+	(PI_CallerFile = __FILE__, PI_CallerLine = __LINE__ , \
+	PI_SetSelectPolicy_( b, policy ))
+
+/*!
+********************************************************************************
+Gives every channel of a selector bundle the same fixed-size format, and has
+the reader keep a receive posted for each of them.
+
+PI_StartAll posts an MPI_Irecv for each channel into a buffer big enough for
+one write, and each PI_Write on a channel sends its values as one packed
+message, which lands there without waiting to be matched.  PI_Select and
+PI_TrySelect then wait on or test the posted receives together
+(MPI_Waitany/MPI_Testany) instead of probing, and PI_Read unpacks the landed
+message and posts the channel's receive again.  With many writers sending
+small messages, this spares the reader the unexpected-message queue; it also
+makes PI_SEND_READY safe on the channels.  When several channels' messages
+have landed, PI_Select and PI_TrySelect take them round-robin, whatever the
+bundle's select policy.
+
+The format must fix the size of every write: no ^ or %s, no * or %m lengths,
+and no reduce operators.  Reads and writes must use it, as with
+PI_SetChannelFormat.  The channels cannot be put in PI_SEND_AGGREGATE,
+PI_SEND_SHARED, or PI_SEND_RMA mode, and the nonblocking calls, bindings,
+streams, and PI_ReadMulti/PI_WriteMulti fail with PI_SEND_MODE on them.
+
+\param b Selector bundle.
+\param format Format string for the bundle's channels.
+
+\pre Bundle has been created, its channels are not in PI_SEND_AGGREGATE,
+PI_SEND_SHARED, or PI_SEND_RMA mode, and PI_StartAll has not been called.
+\post The bundle's channels are typed with \p format; PI_SetChannelFormat
+fails with PI_BUNDLE_USAGE on them.
+*******************************************************************************/
+void PI_SetSelectFormat_( PI_BUNDLE *b, const char *format );
+#define PI_SetSelectFormat( b, format ) \
+	(PI_CallerFile = __FILE__, PI_CallerLine = __LINE__ , \
+	PI_SetSelectFormat_( b, format ))
+
 /*!
 ********************************************************************************
 Kicks off parallel processing.
@@ -446,6 +642,46 @@ next argument, e.g., ("%*d", 25, intarray).  If the size is specified as "^":
   then a right-sized array is allocated and its pointer is stored in the
   following argument, e.g., ("%^d", &len, &arrayptr) where "int len, *arrayptr;".
 
+Arrays may have more than INT_MAX elements; Pilot transfers them in one
+message of a derived datatype (or in chunks, for reduce operations).  Since
+the "*" and "^" length args are ints, for such arrays insert the "z" prefix
+to make the length args (and the capacity for "~") size_t instead, e.g.,
+("%z*lf", n, bigarray) where "size_t n;".  Reading a length over INT_MAX into
+an int fails with PI_ARRAY_LENGTH.  A fixed size like "%3000000000lf" needs no
+prefix.
+
+Arrays allocated by reading with "^" or "%s" may be freed with free(), or given
+back with PI_ReleaseBuffer so that later reads can reuse them without calling
+malloc.  Alternatively, the "~" flag lets the reader supply the buffer: it is
+written like "^" (or "%~s" like "%s"), but on reading it takes the address of
+the length (not for "%~s"), of the array pointer, and of the array's capacity
+in elements, e.g., ("%~d", &len, &arrayptr, &cap) where "int len, *arrayptr=NULL,
+cap=0;".  The array is only reallocated when the data would not fit, in which
+case the new capacity is stored.  Writer and reader may use "^" and "~"
+interchangeably.
+
+A fixed size array may also be strided, selecting elements that are spaced apart
+in memory, by writing "%N:S:Bt": N blocks of B elements each, whose starts are S
+elements apart (":B" may be omitted for single elements).  For example, with
+"double a[4][4];", ("%4:4lf", &a[0][1]) is column 1 of the matrix, and
+("%4:4:2lf", &a[0][2]) is its right-hand 4x2 tile.  Only the selected elements
+are transferred, so a strided array matches a plain one of N*B elements, e.g.,
+a column written with "%4:4lf" can be read as "%4lf".  In PI_Scatter and
+PI_Gather, each channel's part starts B elements after the previous one's, so
+successive channels get successive columns (or tiles).  Strided arrays cannot
+be used with reduce operations or %m.
+
+A C struct is sent with "%{fields}", listing the types of its members in order,
+separated by spaces, each with an optional array size (but not s, m, or Fortran
+types).  E.g., with "struct { int id; double xyz[3]; char name[8]; } rec, recs[100];",
+("%{d 3lf 8c}", &rec) sends one record (always by address, even on writing),
+and ("%100{d 3lf 8c}", recs) sends the array as one message.  The record
+may also have the "*", "^", "~", and strided sizes, but no reduce operation.
+Pilot computes the offsets that a C compiler gives the members (each aligned
+for its type, with padding at the end for arrays), builds an MPI struct
+datatype once, and shares it among all formats with the same fields.  Level 2
+checking compares the fields as well.
+
 Variable length arrays ("^" flag and "%s" format) are not supported for collective
 operations except for PI_Broadcast.
 
@@ -494,6 +730,436 @@ void PI_Read_( PI_CHANNEL *c, const char *format, ... );
 	(PI_CallerFile = __FILE__, PI_CallerLine = __LINE__ , \
 	PI_Read_( c, format, PP_NARG(__VA_ARGS__), __VA_ARGS__ ))
 
+/*!
+********************************************************************************
+Reads a number of values from the specified channel, unless nothing arrives
+within a time limit.
+
+As PI_Read, but polls for the write instead of blocking: it spins briefly,
+then yields the CPU and sleeps for longer and longer (see -piwait under
+PI_Configure), and gives up once \p timeout seconds have passed.  A call that
+times out is not logged, and no variables are changed.
+
+\param c Channel to read from; not part of a collective bundle.
+\param timeout Seconds to wait at most; 0 just checks, and a negative value
+waits as long as it takes, as PI_Read does (logged and polled the same way).
+\param format Format string specifying the type of each variable.
+\retval 1 if the values were read.
+\retval 0 if the time ran out (or on error, with PI_OnErrorReturn).
+
+\pre Channel has been created.
+*******************************************************************************/
+int PI_ReadTimeout_( PI_CHANNEL *c, double timeout, const char *format, ... );
+#define PI_ReadTimeout( c, timeout, format, ... ) \
+	(PI_CallerFile = __FILE__, PI_CallerLine = __LINE__ , \
+	PI_ReadTimeout_( c, timeout, format, PP_NARG(__VA_ARGS__), __VA_ARGS__ ))
+
+/*!
+********************************************************************************
+\brief Element types of a PI_ITEM.
+
+Each is the type of one of the conversion specs of PI_Write, in order: %c %hd
+%d %ld %lld %hhu %hu %u %lu %llu %f %lf %Lf %b.
+*******************************************************************************/
+typedef enum {
+    PI_ITEM_CHAR, PI_ITEM_SHORT, PI_ITEM_INT, PI_ITEM_LONG, PI_ITEM_LONG_LONG,
+    PI_ITEM_UNSIGNED_CHAR, PI_ITEM_UNSIGNED_SHORT, PI_ITEM_UNSIGNED,
+    PI_ITEM_UNSIGNED_LONG, PI_ITEM_UNSIGNED_LONG_LONG,
+    PI_ITEM_FLOAT, PI_ITEM_DOUBLE, PI_ITEM_LONG_DOUBLE, PI_ITEM_BYTE
+} PI_ITEMTYPE;
+
+/*!
+********************************************************************************
+\brief One item of a PI_WriteItems or PI_ReadItems call.
+
+A fixed length item is a scalar or array at `buf` of `count` elements, like
+%d or %Nd.  A variable length item is like %z^d: on writing, `buf` and `count`
+are sent, and on reading, once the writer's count is known, `resize` is called
+with `ctx` and the count, and must return the buffer to receive into (or NULL
+if it cannot, which fails with PI_MALLOC_ERROR).
+*******************************************************************************/
+typedef struct {
+    PI_ITEMTYPE type;	/*!< Type of each element. */
+    int varLen;		/*!< True if the length is sent with the data. */
+    void *buf;		/*!< Data, except when reading a variable length item. */
+    size_t count;	/*!< Elements at buf, except when reading a variable length item. */
+    void *(*resize)( void *ctx, size_t count ); /*!< Reading variable length: buffer supplier. */
+    void *ctx;		/*!< First arg to resize. */
+} PI_ITEM;
+
+/*!
+********************************************************************************
+Writes items that are already described by PI_ITEMs, so no format is parsed.
+
+This is the entry point used by the C++ binding (pilot.hpp), where the items
+are worked out from the argument types at compile time.  Each item is sent
+exactly as its equivalent format term would be, so the reader may use PI_Read
+with that format, e.g., "%d %100lf %z^c" for an int, double[100], and a
+variable length char array.  Reduce operations, strided arrays, records, and
+%m are not available; use PI_Write for those.
+
+\param c Channel to write to.
+\param items Array of items to send.
+\param n Number of items.
+
+\pre Channel has been created.
+\post Data values have been sent to process at read end of channel.
+*******************************************************************************/
+void PI_WriteItems_( PI_CHANNEL *c, const PI_ITEM items[], int n );
+#define PI_WriteItems( c, items, n ) \
+	(PI_CallerFile = __FILE__, PI_CallerLine = __LINE__ , \
+	PI_WriteItems_( c, items, n ))
+
+/*!
+********************************************************************************
+Reads items that are already described by PI_ITEMs, so no format is parsed.
+
+See PI_WriteItems.  The writer may use PI_Write with the equivalent format,
+where "^", "~", and "%s" (with its NUL) match a variable length item.
+
+\param c Channel to read from.
+\param items Array of items to receive.
+\param n Number of items.
+
+\pre Channel has been created.
+\post Items have been filled with data from process at write end of channel.
+*******************************************************************************/
+void PI_ReadItems_( PI_CHANNEL *c, const PI_ITEM items[], int n );
+#define PI_ReadItems( c, items, n ) \
+	(PI_CallerFile = __FILE__, PI_CallerLine = __LINE__ , \
+	PI_ReadItems_( c, items, n ))
+
+/*!
+********************************************************************************
+\brief Function called by PI_ReadStream as each segment arrives.
+
+\param ctx The ctx given to PI_ReadStream.
+\param segment The segment's elements.
+\param first Index in the whole array of the segment's first element.
+\param count Elements in the segment.
+*******************************************************************************/
+typedef void (*PI_STREAM_FUNC)( void *ctx, const void *segment, size_t first, size_t count );
+
+/*!
+********************************************************************************
+Writes a large array as a stream of segments, so that the reader can work on
+each one as it arrives, instead of waiting for the whole array.
+
+Several segments are in flight at once, so the transfer of each overlaps the
+reader's work on those before it.  The reader must use PI_ReadStream.  The
+segments are sent in the channel's mode.  Returns once the whole array has been
+sent, so it may then be modified.
+
+\param c Channel to write to, which may not be in a bundle.
+\param type Type of each element.
+\param buf The array.
+\param count Elements in the array, which may be 0.
+\param segment Elements in each segment, or 0 for about a megabyte's worth.
+
+\pre Channel has been created, has no format set by PI_SetChannelFormat, and
+is not in PI_SEND_READY, PI_SEND_AGGREGATE, PI_SEND_SHARED, or PI_SEND_RMA mode.
+\post The array has been sent to process at read end of channel.
+*******************************************************************************/
+void PI_WriteStream_( PI_CHANNEL *c, PI_ITEMTYPE type, const void *buf, size_t count,
+                      size_t segment );
+#define PI_WriteStream( c, type, buf, count, segment ) \
+	(PI_CallerFile = __FILE__, PI_CallerLine = __LINE__ , \
+	PI_WriteStream_( c, type, buf, count, segment ))
+
+/*!
+********************************************************************************
+Reads an array written by PI_WriteStream, segment by segment.
+
+If buf is given, each segment is received in its place in buf, and consume, if
+given, is called as each one arrives, in order.  If buf is NULL, the segments
+are received into a few buffers that are reused, so the whole array is never
+stored, and consume must deal with each segment before it returns.
+
+\param c Channel to read from.
+\param type Type of each element, which must match the writer's.
+\param buf Array to receive the elements, or NULL.
+\param capacity Elements that buf can hold (ignored if buf is NULL).
+\param consume Function to call for each segment, or NULL if buf is given.
+\param ctx First arg to consume.
+\return Elements received.
+
+\pre Channel has been created, has no format set by PI_SetChannelFormat, and
+is not in PI_SEND_READY, PI_SEND_AGGREGATE, PI_SEND_SHARED, or PI_SEND_RMA mode.
+\post All the segments have been received, and passed to consume.
+*******************************************************************************/
+size_t PI_ReadStream_( PI_CHANNEL *c, PI_ITEMTYPE type, void *buf, size_t capacity,
+                       PI_STREAM_FUNC consume, void *ctx );
+#define PI_ReadStream( c, type, buf, capacity, consume, ctx ) \
+	(PI_CallerFile = __FILE__, PI_CallerLine = __LINE__ , \
+	PI_ReadStream_( c, type, buf, capacity, consume, ctx ))
+
+/*!
+********************************************************************************
+Writes to each of several channels at once.
+
+Like PI_Scatter, but for channels that are not bundled, e.g., from a master to
+each of its workers.  Each arg is the location of an array holding the items
+for every channel, in the order of the channels, so "%100d" takes an array of
+100*n ints, and channel i gets elements [100*i, 100*i+100).  The writes are all
+started before waiting for any, so a slow reader doesn't hold up the others.
+The readers use PI_Read as usual.  Only items of fixed size can be written
+this way, so "^", "~", and "%s" are rejected as PI_FORMAT_INVALID.
+
+\param c Array of channels to write to.
+\param n Number of channels, which may be 0.
+\param format Format string, and locations of the arrays.
+
+\pre The channels have been created, are not in a bundle, and are not in
+PI_SEND_AGGREGATE, PI_SEND_SHARED, or PI_SEND_RMA mode.  With deadlock
+detection, they lead to different processes.
+\post Every channel's items have been sent.
+*******************************************************************************/
+void PI_WriteMulti_( PI_CHANNEL *const c[], int n, const char *format, ... );
+#define PI_WriteMulti( c, n, format, ... ) \
+	(PI_CallerFile = __FILE__, PI_CallerLine = __LINE__ , \
+	PI_WriteMulti_( c, n, format, PP_NARG(__VA_ARGS__), __VA_ARGS__ ))
+
+/*!
+********************************************************************************
+Reads from each of several channels at once.
+
+Like PI_Gather, but for channels that are not bundled.  Each arg is the
+location of an array that receives the items from every channel, in the order
+of the channels (see PI_WriteMulti).  The reads are all posted before waiting
+for any, and each channel's read is completed as soon as its data arrives, so
+if order is given, it tells the order in which the channels' data came in.  The
+writers use PI_Write as usual.
+
+\param c Array of channels to read from.
+\param n Number of channels, which may be 0.
+\param order If not NULL, filled in with the n channel indices, in the order
+their reads completed.
+\param format Format string, and locations of the arrays.
+
+\pre The channels have been created, are not in a bundle, and are not in
+PI_SEND_AGGREGATE, PI_SEND_SHARED, or PI_SEND_RMA mode.  With deadlock
+detection, they lead from different processes.
+\post Every channel's items have been received.
+*******************************************************************************/
+void PI_ReadMulti_( PI_CHANNEL *const c[], int n, int order[], const char *format, ... );
+#define PI_ReadMulti( c, n, order, format, ... ) \
+	(PI_CallerFile = __FILE__, PI_CallerLine = __LINE__ , \
+	PI_ReadMulti_( c, n, order, format, PP_NARG(__VA_ARGS__), __VA_ARGS__ ))
+
+/*!
+********************************************************************************
+Sends the writes a PI_SEND_AGGREGATE channel has accumulated, without waiting
+for more to fill its buffer.
+
+Use this when the reader should see the writes so far, but the writer has no
+reason to wait for anything itself.  Does nothing on a channel in another mode.
+
+\param c Channel to flush, or NULL for all of this process's channels.
+
+\pre If not NULL, this process is the channel's writer.
+\see PI_SetChannelMode
+*******************************************************************************/
+void PI_Flush_( PI_CHANNEL *c );
+#define PI_Flush( c ) \
+	(PI_CallerFile = __FILE__, PI_CallerLine = __LINE__ , \
+	PI_Flush_( c ))
+
+/*!
+********************************************************************************
+Starts writing values to the specified channel, and returns without waiting
+for them to be sent.
+
+The format string and variables are as for PI_Write, and the reader uses
+PI_Read as usual.  Scalar values are copied when the write starts, but arrays
+are sent from the caller's storage, so they must not be modified (or freed)
+until the write completes, as found by PI_Wait, PI_WaitAll, or PI_Test.
+Several writes may be outstanding at once, on the same or different channels;
+those on the same channel are received in the order they were started.
+
+\param c Channel to write to, which may not be in a bundle.
+\param format Format string specifying the type of each variable.
+\return Handle for the write, to be given to PI_Wait/PI_Test.
+
+\pre Channel has been created.
+\post Data values are being sent to process at read end of channel.
+
+\note Every handle must be completed, or its storage is never freed.
+*******************************************************************************/
+PI_REQUEST *PI_IWrite_( PI_CHANNEL *c, const char *format, ... );
+#define PI_IWrite( c, format, ... ) \
+	(PI_CallerFile = __FILE__, PI_CallerLine = __LINE__ , \
+	PI_IWrite_( c, format, PP_NARG(__VA_ARGS__), __VA_ARGS__ ))
+
+/*!
+********************************************************************************
+Starts reading values from the specified channel, and returns without waiting
+for them to arrive.
+
+The format string and variables are as for PI_Read, and the writer uses
+PI_Write or PI_IWrite as usual.  The variables must stay valid, and must not be
+used, until the read completes, as found by PI_Wait, PI_WaitAll, or PI_Test.
+Several reads may be outstanding at once; those on the same channel receive
+successive writes in the order they were started.
+
+Receives can only be started for the items before the first "^" item or %s,
+since the size of that one is not known until it arrives.  The rest are
+received when the read is completed, and PI_Test only reports completion
+once they have begun to arrive.
+
+\param c Channel to read from, which may not be in a bundle.
+\param format Format string specifying the type of each variable.
+\return Handle for the read, to be given to PI_Wait/PI_Test.
+
+\pre Channel has been created.
+\post Variables are being filled with data from process at write end of channel.
+
+\note Every handle must be completed, or its storage is never freed.
+\note PI_Read on the channel first completes any such partly started reads,
+but PI_Select and PI_ChannelHasData do not know about outstanding reads.
+*******************************************************************************/
+PI_REQUEST *PI_IRead_( PI_CHANNEL *c, const char *format, ... );
+#define PI_IRead( c, format, ... ) \
+	(PI_CallerFile = __FILE__, PI_CallerLine = __LINE__ , \
+	PI_IRead_( c, format, PP_NARG(__VA_ARGS__), __VA_ARGS__ ))
+
+/*!
+********************************************************************************
+Waits for a nonblocking operation to complete, then frees its handle.
+
+For a binding (see PI_BindWrite), waits for the transfer begun by PI_Start,
+and keeps the handle for the next PI_Start.  If it was not started, this
+returns immediately.
+
+\param req Address of the handle, which is set to NULL.  If the handle
+is already NULL, this returns immediately.
+
+\pre Handle was returned by PI_IWrite, PI_IRead, PI_BindWrite, or PI_BindRead.
+\post Operation is complete, and its variables may be reused.
+*******************************************************************************/
+void PI_Wait_( PI_REQUEST **req );
+#define PI_Wait( req ) \
+	(PI_CallerFile = __FILE__, PI_CallerLine = __LINE__ , \
+	PI_Wait_( req ))
+
+/*!
+********************************************************************************
+Checks whether a nonblocking operation has completed, without waiting.
+
+\param req Address of the handle.  If the operation has completed, the handle
+is freed and set to NULL (but not that of a binding).  A NULL handle counts as
+completed.
+\return 1 if completed, otherwise 0.
+*******************************************************************************/
+int PI_Test_( PI_REQUEST **req );
+#define PI_Test( req ) \
+	(PI_CallerFile = __FILE__, PI_CallerLine = __LINE__ , \
+	PI_Test_( req ))
+
+/*!
+********************************************************************************
+Waits for all of an array of nonblocking operations (see PI_Wait).
+
+\param reqs Array of handles, each of which is set to NULL.  NULL handles are
+skipped.
+\param n Number of handles.
+*******************************************************************************/
+void PI_WaitAll_( PI_REQUEST *reqs[], int n );
+#define PI_WaitAll( reqs, n ) \
+	(PI_CallerFile = __FILE__, PI_CallerLine = __LINE__ , \
+	PI_WaitAll_( reqs, n ))
+
+/*!
+********************************************************************************
+Binds a write on the specified channel to the locations of its variables, to be
+repeated by PI_Start and PI_Wait.
+
+For a loop that writes the same variables on the same channel every time,
+this does the work of PI_Write that doesn't change from one time to the next
+(parsing the format, building datatypes, and setting up MPI) just once.  Each
+PI_Start then sends the variables' current contents.  The reader may use
+PI_Read, PI_IRead, or PI_BindRead with the same format.
+
+The format is as for PI_Write, but the variables are given by location, as
+for PI_Read (e.g., "%d %100lf" with &n, arr), and each must have a fixed size:
+"*" lengths are taken now, and "^", "~", %s, and reduce operators are not
+allowed.
+
+\param c Channel to write to, which may not be in a bundle.
+\param format Format string specifying the type of each variable.
+\return Binding, to be given to PI_Start, PI_Wait/PI_Test, and PI_Unbind.
+
+\pre Channel has been created.
+\post Nothing is sent until PI_Start.
+*******************************************************************************/
+PI_REQUEST *PI_BindWrite_( PI_CHANNEL *c, const char *format, ... );
+#define PI_BindWrite( c, format, ... ) \
+	(PI_CallerFile = __FILE__, PI_CallerLine = __LINE__ , \
+	PI_BindWrite_( c, format, PP_NARG(__VA_ARGS__), __VA_ARGS__ ))
+
+/*!
+********************************************************************************
+Binds a read on the specified channel to the locations of its variables, to be
+repeated by PI_Start and PI_Wait.
+
+See PI_BindWrite.  The writer may use PI_Write, PI_IWrite, or PI_BindWrite
+with the same format.
+
+\param c Channel to read from, which may not be in a bundle.
+\param format Format string specifying the type of each variable.
+\return Binding, to be given to PI_Start, PI_Wait/PI_Test, and PI_Unbind.
+
+\pre Channel has been created.
+\post Nothing is received until PI_Start.
+*******************************************************************************/
+PI_REQUEST *PI_BindRead_( PI_CHANNEL *c, const char *format, ... );
+#define PI_BindRead( c, format, ... ) \
+	(PI_CallerFile = __FILE__, PI_CallerLine = __LINE__ , \
+	PI_BindRead_( c, format, PP_NARG(__VA_ARGS__), __VA_ARGS__ ))
+
+/*!
+********************************************************************************
+Starts the write or read of a binding, which then completes like PI_IWrite or
+PI_IRead: with PI_Wait, PI_WaitAll, or PI_Test.  The variables must not be
+changed (or, for a read, used) until then.
+
+\param r Binding from PI_BindWrite or PI_BindRead, which is not already
+started.
+*******************************************************************************/
+void PI_Start_( PI_REQUEST *r );
+#define PI_Start( r ) \
+	(PI_CallerFile = __FILE__, PI_CallerLine = __LINE__ , \
+	PI_Start_( r ))
+
+/*!
+********************************************************************************
+Frees a binding, after waiting for it if it was started.
+
+\param req Address of the binding, which is set to NULL.  If it is already
+NULL, this returns immediately.
+*******************************************************************************/
+void PI_Unbind_( PI_REQUEST **req );
+#define PI_Unbind( req ) \
+	(PI_CallerFile = __FILE__, PI_CallerLine = __LINE__ , \
+	PI_Unbind_( req ))
+
+/*!
+********************************************************************************
+Gives back an array that was allocated by reading with the "^" flag or "%s".
+
+The array is kept by Pilot and reused for a later read of the same or smaller
+size, so that steady streams of variable-length data need not call malloc.
+Calling free() on such an array is still allowed.
+
+\param buf Array from a ^ or %s read (NULL is ignored).
+
+\pre buf has not been freed or released already.
+\post buf must not be used by the caller any more.
+*******************************************************************************/
+void PI_ReleaseBuffer_( void *buf );
+#define PI_ReleaseBuffer( buf ) \
+	(PI_CallerFile = __FILE__, PI_CallerLine = __LINE__ , \
+	PI_ReleaseBuffer_( buf ))
+
 /*!
 ********************************************************************************
 Returns the index of a channel in the bundle that has data to read.
@@ -544,6 +1210,113 @@ int PI_TrySelect_( PI_BUNDLE *b );
 	(PI_CallerFile = __FILE__, PI_CallerLine = __LINE__ , \
 	PI_TrySelect_( b ))
 
+/*!
+********************************************************************************
+Waits a limited time for any of the Selector's channels to be ready to read.
+
+Between PI_Select and PI_TrySelect: polls the bundle as PI_TrySelect does,
+spinning briefly, then yielding the CPU and sleeping for longer and longer
+(see -piwait under PI_Configure), until a channel has data or \p timeout
+seconds have passed.
+
+\param b Selector bundle to wait on.
+\param timeout Seconds to wait at most; 0 acts as PI_TrySelect, and a negative
+value acts as PI_Select.
+\return Index of Channel to be read, or -1 if the time ran out.
+
+\pre Selector \p b has been created.
+*******************************************************************************/
+int PI_SelectTimeout_( PI_BUNDLE *b, double timeout );
+#define PI_SelectTimeout( b, timeout ) \
+	(PI_CallerFile = __FILE__, PI_CallerLine = __LINE__ , \
+	PI_SelectTimeout_( b, timeout ))
+
+/*!
+********************************************************************************
+Selects a channel of a Selector that has data, and reads it.
+
+Same as PI_Select followed by PI_Read of the channel selected, but the message
+that PI_Select would find is the one received, without MPI having to find it
+again for the read.  Nor can another thread's receive take the message between
+the two.  This applies to messages through MPI with no select policy (see
+PI_SetSelectPolicy); otherwise the channel is selected and read as usual.
+
+\param b Selector bundle.
+\param format Format string, as for PI_Read.
+\param ... Args for \p format, as for PI_Read.
+\return Index of the channel read.
+
+\pre Selector \p b has been created.
+\see PI_Select, PI_Read
+*******************************************************************************/
+int PI_SelectRead_( PI_BUNDLE *b, const char *format, ... );
+#define PI_SelectRead( b, format, ... ) \
+	(PI_CallerFile = __FILE__, PI_CallerLine = __LINE__ , \
+	PI_SelectRead_( b, format, PP_NARG(__VA_ARGS__), __VA_ARGS__ ))
+
+/*!
+********************************************************************************
+Lists every channel of a Selector that has data to read.
+
+Like PI_Select, waits until at least one channel has data, but then reports
+all of them at once, so a process with many writers can go through the lot
+(e.g., with PI_ReadReady) instead of selecting each in turn.  The bundle's
+select policy (see PI_SetSelectPolicy) does not apply.
+
+\param b Selector bundle.
+\param ready Array, with room for every channel in the bundle, that is set to
+the indices of the channels with data, in ascending order.
+\return Number of channels listed in \p ready, at least 1.
+
+\pre Selector \p b has been created.
+\see PI_TrySelectAll, PI_ReadReady
+*******************************************************************************/
+int PI_SelectAll_( PI_BUNDLE *b, int ready[] );
+#define PI_SelectAll( b, ready ) \
+	(PI_CallerFile = __FILE__, PI_CallerLine = __LINE__ , \
+	PI_SelectAll_( b, ready ))
+
+/*!
+********************************************************************************
+Same as PI_SelectAll, except that if none of the Selector's channels has data,
+this function returns 0 instead of waiting.
+
+\param b Selector bundle.
+\param ready Array, with room for every channel in the bundle, that is set to
+the indices of the channels with data, in ascending order.
+\return Number of channels listed in \p ready.
+
+\pre Selector \p b has been created.
+*******************************************************************************/
+int PI_TrySelectAll_( PI_BUNDLE *b, int ready[] );
+#define PI_TrySelectAll( b, ready ) \
+	(PI_CallerFile = __FILE__, PI_CallerLine = __LINE__ , \
+	PI_TrySelectAll_( b, ready ))
+
+/*!
+********************************************************************************
+Reads one message from each of a list of a Selector's channels.
+
+Meant for the list from PI_SelectAll or PI_TrySelectAll: the first \p n
+channels listed are read in turn, which won't wait for any of them.  The
+format is parsed just once, and as for PI_ReadMulti, each arg is an array
+holding every channel's items in turn, in the order listed.  Only fixed-size
+items are allowed.
+
+\param b Selector bundle.
+\param ready Indices of the channels to read.
+\param n Number of channels to read; 0 does nothing.
+\param format Format string for one channel's items, as for PI_Read.
+\param ... One array for each item in \p format.
+
+\pre Selector \p b has been created.
+\see PI_SelectAll, PI_TrySelectAll
+*******************************************************************************/
+void PI_ReadReady_( PI_BUNDLE *b, const int ready[], int n, const char *format, ... );
+#define PI_ReadReady( b, ready, n, format, ... ) \
+	(PI_CallerFile = __FILE__, PI_CallerLine = __LINE__ , \
+	PI_ReadReady_( b, ready, n, format, PP_NARG(__VA_ARGS__), __VA_ARGS__ ))
+
 /*!
 ********************************************************************************
 Returns the specified channel from a bundle.
@@ -740,4 +1513,8 @@ void PI_StopMain_( int status );
 	(PI_CallerFile = __FILE__, PI_CallerLine = __LINE__ , \
 	PI_StopMain_( status ))
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
@@ -0,0 +1,265 @@
+/***************************************************************************
+ * Copyright (c) 2008-2017 University of Guelph.
+ *                         All rights reserved.
+ *
+ * This file is part of the Pilot software package.  For license
+ * information, see the LICENSE file in the top level directory of the
+ * Pilot source distribution.
+ **************************************************************************/
+
+/*!
+********************************************************************************
+\file pilot.hpp
+\brief C++17 binding for Pilot channel reads and writes
+
+Lets C++ programs write and read channels without format strings:
+
+    pilot::write( chan, n, xyz, samples, name );   // int, double[3],
+    pilot::read( chan, n, xyz, samples, name );    // std::vector<float>, std::string
+
+Each argument's type picks its MPI datatype at compile time, and arguments
+are passed straight to PI_WriteItems/PI_ReadItems, so nothing is parsed at
+run time and an unsupported type is a compile error rather than
+PI_FORMAT_MISMATCH.  Data is sent from and received into the arguments'
+own storage, never copied.  Supported arguments, with their equivalent
+PI_Write format (shown for int), so that the other end may use C:
+
+ - arithmetic scalar: %d
+ - C array, including multidimensional, or std::array: %Nd (N = all elements)
+ - std::span (if the library has it): %*d, its size is fixed by the caller
+ - std::vector: %z^d, reading resizes the vector to the writer's length
+ - std::string: %s, reading resizes the string (its NUL is dropped)
+
+Element types are those of the PI_Write conversion specs, plus signed char
+and std::byte (%c and %b); bool is not supported.  Writing an empty vector
+or span fails with PI_ARRAY_LENGTH, as for ^ and *.  Collective operations
+still use the C API.
+
+For diagnostics, the caller's file and line are recorded as with the C macros
+(with GCC or Clang; otherwise this file's name is shown).
+*******************************************************************************/
+
+#ifndef PILOT_HPP
+#define PILOT_HPP
+
+#include "pilot.h"
+
+#include <array>
+#include <cstddef>
+#include <string>
+#include <type_traits>
+#include <vector>
+#if __has_include(<span>)
+#include <span>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define PI_HPP_FILE __builtin_FILE()
+#define PI_HPP_LINE __builtin_LINE()
+#else
+#define PI_HPP_FILE __FILE__
+#define PI_HPP_LINE __LINE__
+#endif
+
+namespace pilot {
+
+namespace detail {
+
+/* Element type code of each supported C++ type */
+template<typename T> struct Elem { static constexpr bool ok = false; };
+
+#define PI_HPP_ELEM( T, code ) \
+    template<> struct Elem<T> { \
+        static constexpr bool ok = true; \
+        static constexpr PI_ITEMTYPE type = code; \
+    };
+
+PI_HPP_ELEM( char, PI_ITEM_CHAR )
+PI_HPP_ELEM( signed char, PI_ITEM_CHAR )
+PI_HPP_ELEM( short, PI_ITEM_SHORT )
+PI_HPP_ELEM( int, PI_ITEM_INT )
+PI_HPP_ELEM( long, PI_ITEM_LONG )
+PI_HPP_ELEM( long long, PI_ITEM_LONG_LONG )
+PI_HPP_ELEM( unsigned char, PI_ITEM_UNSIGNED_CHAR )
+PI_HPP_ELEM( unsigned short, PI_ITEM_UNSIGNED_SHORT )
+PI_HPP_ELEM( unsigned, PI_ITEM_UNSIGNED )
+PI_HPP_ELEM( unsigned long, PI_ITEM_UNSIGNED_LONG )
+PI_HPP_ELEM( unsigned long long, PI_ITEM_UNSIGNED_LONG_LONG )
+PI_HPP_ELEM( float, PI_ITEM_FLOAT )
+PI_HPP_ELEM( double, PI_ITEM_DOUBLE )
+PI_HPP_ELEM( long double, PI_ITEM_LONG_DOUBLE )
+PI_HPP_ELEM( std::byte, PI_ITEM_BYTE )
+
+#undef PI_HPP_ELEM
+
+template<typename T> constexpr PI_ITEMTYPE ElemType()
+{
+    static_assert( Elem<T>::ok, "pilot: no MPI datatype for this element type" );
+    return Elem<T>::type;
+}
+
+inline PI_ITEM Fixed( PI_ITEMTYPE type, const void *buf, std::size_t count )
+{
+    return PI_ITEM{ type, 0, const_cast<void *>( buf ), count, nullptr, nullptr };
+}
+
+/* Resize callback for reading a variable length item into container C */
+template<typename C> void *Resize( void *ctx, std::size_t count )
+{
+    try {
+        C *cont = static_cast<C *>( ctx );
+        cont->resize( count );
+        return cont->data();
+    }
+    catch ( ... ) {		// mustn't unwind through C
+        return nullptr;
+    }
+}
+
+/*
+ * How each kind of argument is bound: `slots` is the number of message
+ * elements it needs (2 if variable length), `out` and `in` describe it for
+ * writing and reading, and `done` tidies up after reading.  `view` is true
+ * if reading through a temporary (e.g. a span) is meaningful.
+ */
+template<typename T> struct Binding {		// scalar
+    static constexpr int slots = 1;
+    static constexpr bool view = false;
+    static PI_ITEM out( const T &x ) { return Fixed( ElemType<T>(), &x, 1 ); }
+    static PI_ITEM in( T &x ) { return Fixed( ElemType<T>(), &x, 1 ); }
+    static void done( T & ) {}
+};
+
+template<typename T, std::size_t N> struct Binding<T[N]> {	// C array, flattened
+    using E = std::remove_all_extents_t<T>;
+    static constexpr std::size_t count = sizeof(T[N]) / sizeof(E);
+    static constexpr int slots = 1;
+    static constexpr bool view = false;
+    static PI_ITEM out( const T (&x)[N] ) { return Fixed( ElemType<E>(), x, count ); }
+    static PI_ITEM in( T (&x)[N] ) { return Fixed( ElemType<E>(), x, count ); }
+    static void done( T (&)[N] ) {}
+};
+
+template<typename T, std::size_t N> struct Binding<std::array<T, N>> {
+    static constexpr int slots = 1;
+    static constexpr bool view = false;
+    static PI_ITEM out( const std::array<T, N> &x ) { return Fixed( ElemType<T>(), x.data(), N ); }
+    static PI_ITEM in( std::array<T, N> &x ) { return Fixed( ElemType<T>(), x.data(), N ); }
+    static void done( std::array<T, N> & ) {}
+};
+
+template<typename T, typename A> struct Binding<std::vector<T, A>> {
+    using V = std::vector<T, A>;
+    static constexpr int slots = 2;
+    static constexpr bool view = false;
+    static PI_ITEM out( const V &x )
+    {
+        return PI_ITEM{ ElemType<T>(), 1, const_cast<T *>( x.data() ), x.size(), nullptr, nullptr };
+    }
+    static PI_ITEM in( V &x )
+    {
+        return PI_ITEM{ ElemType<T>(), 1, nullptr, 0, Resize<V>, &x };
+    }
+    static void done( V & ) {}
+};
+
+template<typename Tr, typename A> struct Binding<std::basic_string<char, Tr, A>> {
+    using S = std::basic_string<char, Tr, A>;
+    static constexpr int slots = 2;
+    static constexpr bool view = false;
+    static PI_ITEM out( const S &x )	// like %s, the NUL goes too
+    {
+        return PI_ITEM{ PI_ITEM_CHAR, 1, const_cast<char *>( x.c_str() ), x.size() + 1,
+                        nullptr, nullptr };
+    }
+    static PI_ITEM in( S &x )
+    {
+        return PI_ITEM{ PI_ITEM_CHAR, 1, nullptr, 0, Resize<S>, &x };
+    }
+    static void done( S &x ) { if ( !x.empty() && x.back() == '\0' ) x.pop_back(); }
+};
+
+#ifdef __cpp_lib_span
+template<typename T, std::size_t X> struct Binding<std::span<T, X>> {
+    using E = std::remove_cv_t<T>;
+    static constexpr int slots = 1;
+    static constexpr bool view = true;
+    static PI_ITEM out( const std::span<T, X> &x ) { return Fixed( ElemType<E>(), x.data(), x.size() ); }
+    static PI_ITEM in( const std::span<T, X> &x )
+    {
+        static_assert( !std::is_const_v<T>, "pilot: cannot read into a span of const" );
+        return Fixed( ElemType<E>(), x.data(), x.size() );
+    }
+    static void done( const std::span<T, X> & ) {}
+};
+#endif
+
+template<typename T> using Bind = Binding<std::remove_cv_t<std::remove_reference_t<T>>>;
+
+template<typename... Args> constexpr int Slots()
+{
+    return ( 0 + ... + Bind<Args>::slots );
+}
+
+} // namespace detail
+
+
+/*!
+********************************************************************************
+Writes its arguments to channel c, like PI_Write with the equivalent format.
+
+Used as a function: pilot::write( c, args... );
+*******************************************************************************/
+template<typename... Args> struct write {
+    write( PI_CHANNEL *c, const Args &... args,
+           const char *file = PI_HPP_FILE, int line = PI_HPP_LINE )
+    {
+        static_assert( sizeof...(Args) > 0, "pilot: nothing to write" );
+        static_assert( detail::Slots<Args...>() <= PI_MAX_FORMATLEN,
+                       "pilot: too many items for one write (see PI_MAX_FORMATLEN)" );
+
+        const PI_ITEM items[] = { detail::Bind<Args>::out( args )... };
+        PI_CallerFile = file;
+        PI_CallerLine = line;
+        PI_WriteItems_( c, items, sizeof...(Args) );
+    }
+};
+
+template<typename... Args> write( PI_CHANNEL *, const Args &... ) -> write<Args...>;
+
+/*!
+********************************************************************************
+Reads into its arguments from channel c, like PI_Read with the equivalent
+format.  Arguments must be variables, except for spans.
+
+Used as a function: pilot::read( c, args... );
+*******************************************************************************/
+template<typename... Args> struct read {
+    read( PI_CHANNEL *c, Args &&... args,
+          const char *file = PI_HPP_FILE, int line = PI_HPP_LINE )
+    {
+        static_assert( sizeof...(Args) > 0, "pilot: nothing to read" );
+        static_assert( detail::Slots<Args...>() <= PI_MAX_FORMATLEN,
+                       "pilot: too many items for one read (see PI_MAX_FORMATLEN)" );
+        static_assert( ( ... && ( std::is_lvalue_reference_v<Args> || detail::Bind<Args>::view ) ),
+                       "pilot: can only read into variables" );
+        static_assert( ( ... && ( detail::Bind<Args>::view ||
+                                  !std::is_const_v<std::remove_reference_t<Args>> ) ),
+                       "pilot: cannot read into a const variable" );
+
+        const PI_ITEM items[] = { detail::Bind<Args>::in( args )... };
+        PI_CallerFile = file;
+        PI_CallerLine = line;
+        PI_ReadItems_( c, items, sizeof...(Args) );
+        ( detail::Bind<Args>::done( args ), ... );
+    }
+};
+
+template<typename... Args> read( PI_CHANNEL *, Args &&... ) -> read<Args...>;
+
+} // namespace pilot
+
+#undef PI_HPP_FILE
+#undef PI_HPP_LINE
+
+#endif
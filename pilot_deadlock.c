@@ -27,6 +27,11 @@ Uses PI_OLP_ASSERT to check for malloc failures.
 	Added a "key" explaining notation on deadlock traceback. V2.0 (BG)
 [17-Sep-16] Fixed blocked message, source:line was in wrong place, wasn't
         printing format arg.
+[17-Oct-26] Added PI_IWrite, PI_IRead, and PI_Wait events; the dependency is made
+        when the operation is waited for. V3.3 (JC)
+[17-Oct-26] Added PI_WriteMulti and PI_ReadMulti events, one per item per channel;
+        each item's are handled together once all have arrived, as for a
+        collective. V3.3 (JC)
 *******************************************************************************/
 
 #include "pilot_deadlock.h"
@@ -125,6 +130,7 @@ stored in a single string.  Order of codes matches switch cases in handle().
 static char eventCodes[] = {
 	// CALLS events
 	"CWri" "CRea" "CSel" "CHas" "CTry" "CBro" "CGat" "CSca" "CRdu"
+	"CIWr" "CWai" "CIRe" "CWrM" "CReM"
 	// PILOT events
 	"PFIN" };
 
@@ -197,6 +203,19 @@ for( ep=EQhead->next; ep; ep=ep->next)
 printf( "}\n" );
 }
 
+/*!
+********************************************************************************
+Return true if no earlier event of this event's process is queued
+*******************************************************************************/
+static int EQfirst( const EQevent *ev )
+{
+    const EQevent *ep;
+
+    for ( ep = EQhead->next; ep != ev; ep = ep->next )
+	if ( ep->proc == ev->proc ) return 0;
+    return 1;
+}
+
 /*!
 ********************************************************************************
 Delete handled events, return number remaining in queue
@@ -255,6 +274,11 @@ static struct {
 	{ "Gat", "PI_Gather", 'B', 'F' },
 	{ "Sca", "PI_Scatter", 'B', 'F' },
 	{ "Rdu", "PI_Reduce", 'B', 'F' },
+	{ "IWr", "PI_IWrite", 'C', 'F' },
+	{ "Wai", "PI_Wait", 'C', '-' },
+	{ "IRe", "PI_IRead", 'C', 'F' },
+	{ "WrM", "PI_WriteMulti", 'C', 'F' },
+	{ "ReM", "PI_ReadMulti", 'C', 'F' },
 	{ "ZZZ", "sentinel", '-', '-'} };	// <-- must end with Z!
 
 /*!
@@ -753,7 +777,32 @@ printf( "$DL$ * handling %d '%4s'\n", ev->proc, ev->ecode );
 		makeDepend( ev, bundchan[i]->producer, bundchan[i]->chan_id, -1 );
 	    break;
 
-	case 9: // process exited
+	case 9: // PI_IWrite
+	case 11: // PI_IRead; neither blocks until its PI_Wait
+	    break;
+
+	case 10: // PI_Wait; blocks like PI_Write or PI_Read, depending on the end
+	    if ( ev->proc == olpe->channels[object-1]->producer ) {
+		q = olpe->channels[object-1]->consumer;
+		makeDepend( ev, q, olpe->channels[object-1]->chan_id, +1 );
+	    }
+	    else {
+		q = olpe->channels[object-1]->producer;
+		makeDepend( ev, q, olpe->channels[object-1]->chan_id, -1 );
+	    }
+	    break;
+
+	case 12: // PI_WriteMulti; one channel's write dependency, as for PI_Write
+	    q = olpe->channels[object-1]->consumer;
+	    makeDepend( ev, q, olpe->channels[object-1]->chan_id, +1 );
+	    break;
+
+	case 13: // PI_ReadMulti; one channel's read dependency, as for PI_Read
+	    q = olpe->channels[object-1]->producer;
+	    makeDepend( ev, q, olpe->channels[object-1]->chan_id, -1 );
+	    break;
+
+	case 14: // process exited
 	    removeDepends( ev->proc );
 	    break;
 
@@ -769,6 +818,57 @@ printf( "$DL$ * handling %d '%4s'\n", ev->proc, ev->ecode );
 }
 
 
+/*!
+********************************************************************************
+Return the number of channels in the PI_WriteMulti or PI_ReadMulti item whose
+first part is event, or 1 if it's any other event.  The parts are logged
+together, as "(part i/n)", so they follow each other in the queue.
+*******************************************************************************/
+static int multiParts( const EQevent *ev )
+{
+    const char *part;
+
+    if ( strcmp( ev->ecode, "CWrM" ) != 0 && strcmp( ev->ecode, "CReM" ) != 0 ) return 1;
+    part = strstr( ev->saveEvent, " (part 1/" );	// added by LOGCALL
+    return part ? atoi( part+9 ) : 1;
+}
+
+/*!
+********************************************************************************
+Handle all the parts of a PI_WriteMulti or PI_ReadMulti item at once, as for a
+collective, if they have all arrived.  Parts that complete an operation already
+waiting at the other end are handled first, so that the rest can't appear to
+make a cycle through them.  Returns true if the parts were handled.
+*******************************************************************************/
+static int handleMulti( EQevent *first )
+{
+    int i, n = multiParts( first ), count = 0, pass;
+    EQevent *ep, **parts = malloc( n * sizeof(EQevent *) );
+    PI_OLP_ASSERT( parts, PI_MALLOC_ERROR );
+
+    for ( ep = first; ep && count < n; ep = ep->next )
+	if ( ep->proc == first->proc ) parts[count++] = ep;
+    if ( count < n ) {		// rest not here yet
+	free( parts );
+	return 0;
+    }
+
+    for ( pass = 0; pass < 2; pass++ ) {
+	for ( i = 0; i < n; i++ ) {
+	    if ( parts[i]->proc < 0 ) continue;		// handled already
+
+	    // peek at the channel, which handle() will parse
+	    PI_CHANNEL *c = olpe->channels[ atoi( parts[i]->strtokLast ) - 1 ];
+	    int p = parts[i]->proc;
+	    int q = ( p == c->producer ) ? c->consumer : c->producer;
+	    if ( pass == 0 && !( DEPENDS(q,p) != 0 && chanproc[c->chan_id] == q ) ) continue;
+	    handle( parts[i] );
+	}
+    }
+    free( parts );
+    return 1;
+}
+
 /*!
 ********************************************************************************
 Start the deadlock detector.
@@ -827,7 +927,8 @@ printf( "$DL$ Recd & queued: [%s]\n", event );
        now empty.  There can be multiple queued events from the same blocked
        process, because PI_Write may return as soon as data leaves user's
        buffer, allowing caller to go on and make other Pilot calls.  This is
-       why we start a fresh scan anytime an event was handled.
+       why we start a fresh scan anytime an event was handled.  The parts of
+       a PI_WriteMulti or PI_ReadMulti item stay queued until all have come.
     */
     int foundWork;
     EQevent *ev;
@@ -836,11 +937,16 @@ printf( "$DL$ Recd & queued: [%s]\n", event );
 	foundWork = 0;		// assume no work to do (all events blocked)
 	EQreset();
 	while( (ev = EQnext()) ) {	// scan till end of queue
-	    if ( process[ev->proc].state == RUN ) {
+	    if ( process[ev->proc].state != RUN || !EQfirst( ev ) ) continue;
+	    if ( multiParts( ev ) == 1 ) {
 		handle( ev );
 		foundWork = 1;
 		break;		// break out to do/while loop condition
 	    }
+	    if ( handleMulti( ev ) ) {
+		foundWork = 1;
+		break;		// break out to do/while loop condition
+	    }
 	}
     } while( foundWork && EQcompact()>0 );
 }
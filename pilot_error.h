@@ -62,14 +62,17 @@ PI_FORMAT_INVALID,
 PI_ARRAY_LENGTH,	// 30
 PI_MPI_ERROR,
 PI_FORMAT_MISMATCH,
-PI_BOGUS_POINTER_ARG
+PI_BOGUS_POINTER_ARG,
+PI_SEND_MODE,
+
+PI_INVALID_ARG		// 35
 };
 
 /*! First defined error code. */
 #define PI_MIN_ERROR 1
 
 /*! Last defined error code. */
-#define PI_MAX_ERROR PI_BOGUS_POINTER_ARG
+#define PI_MAX_ERROR PI_INVALID_ARG
 
 /*!
 ********************************************************************************
@@ -118,7 +121,10 @@ static char *ErrorText[] = {
     "Array length invalid",
     "MPI reported an error",
     "Read format does not match write format in type, length, or reduce operator",
-    "An argument that should be a location (pointer) looks like a data value"
+    "An argument that should be a location (pointer) looks like a data value",
+    "Send mode is invalid, or operation not allowed in the channel's send mode",
+
+    "Argument value is out of range"
 };
 #endif
 
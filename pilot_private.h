@@ -23,7 +23,7 @@ are only used in Pilot internal code. Hence, the PI_ prefix is optional.
 #define PILOT_PRIVATE_H
 
 /*! Change this for a new version. */
-#define PI_VERSION "3.2"
+#define PI_VERSION "3.3"
 
 /*! Printed on welcome banner. */
 #define PI_HELLO "Pilot " PI_VERSION " for MPI - University of Guelph"
@@ -52,6 +52,8 @@ extern char etext,	// end of program text segment
 #include "pilot_limits.h"
 #include "pilot_log_colors.h"
 #include <mpi.h>
+#include <stdint.h>
+#include <stdatomic.h>
 
 /*!
 ********************************************************************************
@@ -68,12 +70,56 @@ typedef int(*PI_WORK_FTN)(int*,void**);	// Fortran func (call by ref)
 /*! Character (in double quotes) used to separate fields on a log line. */
 #define PI_LOGSEP "\t"
 
+/*! Number of compiled format strings cached by each process (power of 2). */
+#define PI_FORMAT_CACHE 64
+
+/*! Items per chunk when a transfer of more than INT_MAX items is split up. */
+#define PI_BIG_CHUNK (1<<30)
+
+/*! Number of released ^ and %s read buffers kept for reuse by each process. */
+#define PI_POOL_FREE 16
+
+/*! Number of most recent ^ and %s read buffers remembered for PI_ReleaseBuffer. */
+#define PI_POOL_LENT 64
+
+/*! Number of PI_SEND_BUFFERED writes that may be in flight from each process. */
+#define PI_WB_MESSAGES 64
+
+/*! Bytes of PI_SEND_BUFFERED writes that may be in flight from each process. */
+#define PI_WB_BYTES (1<<20)
+
+/*! Bytes of writes an aggregating channel accumulates before sending them. */
+#define PI_AGG_BYTES 8192
+
+/*! Bytes of data in the shared-memory ring of each co-located PI_SEND_SHARED channel. */
+#define PI_RING_BYTES (1<<16)
+
+/*! Microseconds a polled wait spins before it starts to yield and sleep. */
+#define PI_WAIT_SPIN 50
+
+/*! Longest sleep, in microseconds, that a polled wait backs off to. */
+#define PI_WAIT_SLEEP 1000
+
+/*! Items of at least this many bytes written through a ring are pulled by the
+    reader straight from the writer's memory, where the OS allows it. */
+#define PI_PULL_BYTES (1<<20)
+
+/*! Default bytes in each segment of PI_WriteStream. */
+#define PI_STREAM_BYTES (1<<20)
+
+/*! Segments of a stream in flight at once, at each end. */
+#define PI_STREAM_DEPTH 4
+
+/*! Number of values of enum PI_SENDMODE. */
+#define PI_SEND_MODES 7
+
 
 /*** Magic Numbers used to validate data structures with ISVALID ***/
 
 #define PI_PROC 899503453
 #define PI_CHAN 937927385
 #define PI_BUND 152536731
+#define PI_REQ 604837291
 
 /*** Pilot macros for error checking ***
  These are for use by API functions and those called by them, chiefly to
@@ -146,9 +192,23 @@ effects.
         LogEvent( CALLS, interpArg( buff, sizeof(buff)-strlen(buff)-1, (code), (arg) ) ); \
     }
 
+/*!
+********************************************************************************
+\brief A message matched by a probe, to be received afterwards.
+
+With MPI-3 this is a matched message handle (MPI_Mprobe/MPI_Mrecv).  Older MPIs
+receive by source and tag instead, so the handle is not used.
+*******************************************************************************/
+#if MPI_VERSION >= 3
+typedef MPI_Message PI_PROBED;
+#else
+typedef int PI_PROBED;
+#endif
+
 typedef struct PI_PROCESS PI_PROCESS;		// forward declarations
 typedef struct PI_CHANNEL PI_CHANNEL;
 typedef struct PI_BUNDLE PI_BUNDLE;
+typedef struct PI_REQUEST PI_REQUEST;
 
 /*!
 ********************************************************************************
@@ -167,6 +227,23 @@ struct PI_CHANNEL
 
     int chan_tag;	/*!< MPI tag of the channel, starts as chan_id, may be changed if part of Selector bundle */
     PI_BUNDLE *bundle;	/*!< Associated collective bundle, or NULL */
+    struct PI_FORMAT *format;	/*!< Format set by PI_SetChannelFormat, or NULL */
+    struct PI_REQUEST *deferHead;	/*!< Oldest PI_IRead with deferred items, or NULL */
+    struct PI_REQUEST *deferTail;	/*!< Newest PI_IRead with deferred items */
+    int sendmode;	/*!< How writes are sent (see enum PI_SENDMODE). */
+    char *aggBuf;	/*!< PI_SEND_AGGREGATE: writes not yet sent, or batch being read */
+    int aggSize;	/*!< Allocated size of aggBuf */
+    int aggPos;		/*!< Writer: bytes in aggBuf; reader: next byte to unpack */
+    int aggLen;		/*!< Reader: bytes in the batch */
+    struct PI_RING *ring;	/*!< PI_SEND_SHARED and co-located: ring in shared memory, else NULL */
+    struct PI_RING *rma;	/*!< PI_SEND_RMA consumer: its buffer in the RMA window, else NULL */
+    MPI_Aint rmaDisp;	/*!< PI_SEND_RMA: buffer's displacement in the consumer's part of the window, or -1 */
+    uint64_t rmaHead;	/*!< PI_SEND_RMA: bytes put (producer), or last count read (consumer) */
+    uint64_t rmaTail;	/*!< PI_SEND_RMA: bytes taken (consumer), or last count read (producer) */
+    PI_BUNDLE *postSel;	/*!< Selector whose reads are pre-posted (PI_SetSelectFormat), else NULL */
+    int matched;	/*!< Reader: PI_SelectRead matched the next message, held in probed */
+    PI_PROBED probed;	/*!< Reader: message matched by PI_SelectRead, if matched */
+    MPI_Status probedStatus;	/*!< Reader: its status */
 
     int magic;		/*!< Fill in with PI_CHAN */
 };
@@ -208,6 +285,15 @@ struct PI_BUNDLE
     int size;		/*!< Number of channels in this bundle. */
     PI_CHANNEL **channels;	/*!< Array of channels. */
     MPI_Comm comm;   	/*!< Communicator associated with this bundle */
+    int *index;		/*!< Selector: index of each MPI rank's channel, or -1, by rank */
+    int policy;		/*!< Selector: which ready channel is chosen (see enum PI_SELECTPOLICY) */
+    int next;		/*!< Selector, PI_SELECT_ROUND_ROBIN: index to look at first */
+    int *order;		/*!< Selector, PI_SELECT_LEAST_RECENT: indices, least recently selected first */
+    int postSize;	/*!< Selector with PI_SetSelectFormat: bytes of one packed message, else 0 */
+    char *postBuf;	/*!< Reader, pre-posted: each channel's receive buffer, postSize bytes apart */
+    MPI_Request *postReqs;	/*!< Reader, pre-posted: each channel's receive, MPI_REQUEST_NULL once landed */
+    int *postLen;	/*!< Reader, pre-posted: bytes landed in each channel's buffer, or -1 */
+    int landed;		/*!< Reader, pre-posted: channels with a message landed but not read */
 
     int magic;		/*!< Fill in with PI_BUND */
 };
@@ -222,6 +308,7 @@ Each process maintains its own environment, stored as a static variable.
 *******************************************************************************/
 enum {LOGGING=0, LOG_TABLES, LOG_CALLS, LOG_STATS, LOG_MPE,
 	OLP_LOGFILE, OLP_DEADLOCK, OLP_RANK,
+	MSG_COALESCE, WAIT_POLL,
 	SVC_END}; /*!< Flag indexes for use with svc_flag array */
 typedef unsigned char Flag_t;
 
@@ -291,7 +378,8 @@ typedef enum {
     CTYPE_LONG_LONG,
     CTYPE_UNSIGNED_LONG_LONG,
     CTYPE_FORTRAN,
-    CTYPE_USER_DEFINED
+    CTYPE_USER_DEFINED,
+    CTYPE_STRUCT
 } CTYPE;
 
 /*!
@@ -318,7 +406,17 @@ typedef struct {
     void* buf;  /*!< Pointer to user data = MPI's "buf" argument. */
     int count;  /*!< Number of elements to send = MPI's "count" argument. */
     int sendCount; /*!< True if count will be sent in a separate message. */
+    void *capacity; /*!< Reading with ~ flag: caller's buffer capacity, else NULL. */
+    void *length;  /*!< Reading with ^ flag: caller's array length, else NULL. */
+    int wideLen;   /*!< True if z prefix: `length` and `capacity` are size_t, else int. */
+    long long elements;  /*!< Basic elements in each `type` item (>1 if strided or wrapped). */
     MPI_Datatype type;  /*!< The MPI datatype that `buf` points to = MPI's "datatype" argument. */
+    MPI_Datatype base;  /*!< If `type` wraps too many items for an int count, their
+                             datatype (see WrapCount), else MPI_DATATYPE_NULL. */
+    uint32_t layout;	/*!< Signature of a %{...} record's fields, else 0. */
+    void *(*resize)( void *, size_t );	/*!< PI_ReadItems: returns the buffer for a
+                             variable length item, else NULL (see PI_ITEM). */
+    void *resizeCtx;	/*!< First arg to `resize`. */
     MPI_Op op;	/*!< The reduce operation, if any, else MPI_OP_NULL. */
 
 /* private: */
@@ -342,4 +440,193 @@ typedef struct {
     } data;
 } PI_MPI_RTTI;
 
+/*!
+********************************************************************************
+\struct PI_FORMAT_TERM
+\brief One term of a compiled format string.
+
+Holds everything about a format term that can be learned from the text alone.
+Whatever depends on the caller's arg list (values, locations, '*' counts,
+user-defined operators and datatypes) is filled in later when the term is
+bound to a PI_MPI_RTTI.
+*******************************************************************************/
+typedef struct {
+    CTYPE cType;	/*!< C datatype of the term. */
+    MPI_Datatype type;	/*!< MPI datatype, or MPI_DATATYPE_NULL for %m. */
+    MPI_Op op;		/*!< Builtin reduce operation, else MPI_OP_NULL. */
+    int opArg;		/*!< True if user-defined operator (mop) is in arg list. */
+    enum { COUNT_NONE, COUNT_FIXED, COUNT_ARG, COUNT_VAR, COUNT_STRLEN }
+        countKind;	/*!< Scalar, %N, %*, ^ flag, or %s. */
+    long long count;	/*!< Array length if COUNT_FIXED (1 if strided). */
+    int wideLen;	/*!< True if z prefix: length args are size_t. */
+    int strided;	/*!< True if %N:S:B, where type is a vector owned by the term. */
+    int elements;	/*!< Basic elements in type (N*B if strided, else 1). */
+    uint32_t layout;	/*!< Signature of a %{...} record's fields, else 0. */
+    int callerBuf;	/*!< True if ~ flag: read into caller's buffer. */
+    int error;		/*!< Error code if term is malformed, else PI_NO_ERROR. */
+} PI_FORMAT_TERM;
+
+/*!
+********************************************************************************
+\brief A buffer allocated for a ^ or %s read, and its size in bytes.
+*******************************************************************************/
+typedef struct {
+    void *buf;
+    size_t size;
+} PI_POOLBUF;
+
+/*!
+********************************************************************************
+\brief Single-producer/single-consumer ring for a channel whose ends share a node.
+
+It lives in the consumer's part of an MPI shared-memory window.  Each write is
+a packed message (as with -pimsg=c) preceded by its length in bytes, and may
+wrap around, or be bigger than the ring, in which case it is copied in as room
+is made.  head and tail only grow, and are kept on separate cache lines.
+
+An item of PI_PULL_BYTES or more is packed as a descriptor instead: the
+writer's pid, the item's address (0 if it can't be pulled), and its size.  The
+reader pulls it with process_vm_readv and counts it in pulled, while the writer
+waits.  If it is not pulled, it is copied through the ring after the message.
+
+A PI_SEND_RMA channel's buffer has the same layout, but lives in the consumer's
+part of an ordinary MPI window.  The producer puts into it and updates head with
+RMA operations, and the consumer reads and updates its own head and tail with
+RMA operations too, so the atomics are not used, nor are the pull fields.
+*******************************************************************************/
+typedef struct PI_RING {
+    _Atomic uint64_t head;	/*!< Bytes ever written; only the producer stores it */
+    uint64_t pulls;		/*!< Items offered for pulling; only the producer uses it */
+    char pad1[64 - 2 * sizeof(uint64_t)];
+    _Atomic uint64_t tail;	/*!< Bytes ever read; only the consumer stores it */
+    _Atomic uint64_t pulled;	/*!< Items offered and dealt with; only the consumer stores it */
+    _Atomic int noPull;		/*!< Set by the consumer once a pull fails, or if the
+				     ends' PID namespaces differ */
+    char pad2[64 - 2 * sizeof(uint64_t) - sizeof(int)];
+    char data[PI_RING_BYTES];
+} PI_RING;
+
+/*!
+********************************************************************************
+\brief State of a polled wait: how long it has waited, and how long it may.
+
+Polled waits serve PI_SelectTimeout and PI_ReadTimeout, and with -piwait the
+blocking reads and selects too.  They spin for the first -piwait interval, then
+yield the CPU and sleep for longer and longer, up to the -piwait maximum.
+*******************************************************************************/
+typedef struct {
+    double start;	/*!< MPI_Wtime when the wait began */
+    double deadline;	/*!< MPI_Wtime to give up at, or negative to wait for ever */
+    int sleep;		/*!< Next sleep in microseconds, or 0 to yield instead */
+    int spins;		/*!< Polls so far (see RingWait) */
+} PI_WAITER;
+
+/*!
+********************************************************************************
+\brief A PI_SEND_BUFFERED write in flight: its send, and the copy being sent.
+*******************************************************************************/
+typedef struct {
+    MPI_Request req;
+    void *buf;
+    int size;
+} PI_WBMSG;
+
+/*!
+********************************************************************************
+\brief MPI struct datatype built for a %{...} record layout.
+
+Kept in a per-process list for the whole run, so that every format describing
+the same fields shares one committed datatype.
+*******************************************************************************/
+typedef struct {
+    uint32_t layout;	/*!< Signature of the fields (lookup key). */
+    int fields;		/*!< Number of fields. */
+    CTYPE cType[PI_MAX_FORMATLEN];	/*!< Type of each field. */
+    int count[PI_MAX_FORMATLEN];	/*!< Array length of each field (1 if scalar). */
+    MPI_Datatype type;	/*!< Committed datatype, with the C struct's extent. */
+} PI_RECORD;
+
+/*!
+********************************************************************************
+\brief Datatype for a format signature followed by one item (see SigDatatype).
+
+Kept with a compiled format, so that repeating a transfer of the same item
+from the same place reuses it instead of building a new one.
+*******************************************************************************/
+typedef struct {
+    MPI_Datatype type;	/*!< Committed datatype, or MPI_DATATYPE_NULL. */
+    const void *sig;	/*!< Signature location it was built for (lookup key), */
+    const void *buf;	/*!< item location, */
+    int count;		/*!< item count, */
+    MPI_Datatype item;	/*!< and item datatype. */
+} PI_SIGTYPE;
+
+/*!
+********************************************************************************
+\struct PI_FORMAT
+\brief Compiled form of a read/write format string.
+
+Produced once per distinct format string by CompileFormat and kept in a small
+per-process cache, so that repeated calls with the same format only have to
+bind their arguments.  A malformed format is compiled up to the term in error,
+so that errors are still reported in the same order as the args are consumed.
+A channel's format set by PI_SetChannelFormat is compiled the same way, but
+belongs to the channel instead of the cache.
+*******************************************************************************/
+typedef struct PI_FORMAT {
+    const char *key;	/*!< Caller's format pointer (cache key). */
+    char *text;		/*!< Copy of format text, to verify cache hits. */
+    int terms;		/*!< Number of terms in term[]. */
+    int messages;	/*!< Number of PI_MPI_RTTI elements generated by binding. */
+    int error;		/*!< Error found after last term, else PI_NO_ERROR. */
+    int sigFixed;	/*!< True if signature doesn't depend on arg values. */
+    int sigValid;	/*!< True if sig has been calculated. */
+    uint32_t sig;	/*!< Cached format signature, if sigFixed. */
+    PI_SIGTYPE sigItem;	/*!< Datatype for the item that carries the signature. */
+    PI_FORMAT_TERM term[PI_MAX_FORMATLEN];
+} PI_FORMAT;
+
+/*!
+********************************************************************************
+\brief Handle for a nonblocking channel operation (PI_IWrite or PI_IRead), or
+a persistent binding (PI_BindWrite or PI_BindRead).
+
+Holds its own copy of the bound items, so that scalar values written by value
+(which live in each item's data union) and the format signatures stay valid
+until the MPI requests complete, after the caller's stack frame is gone.
+
+A read can only post receives for the items before its first "^" or "%s"
+item, since the length of that item's data is not known until its message
+arrives.  The rest are received by PI_Wait (or PI_Test) as by PI_Read, and
+meanwhile the request is queued on its channel, so that reads with deferred
+items complete in the order they were started.
+
+A binding's items are the caller's locations, and its mpireq[] are persistent,
+restarted by each PI_Start.
+*******************************************************************************/
+struct PI_REQUEST
+{
+    PI_CHANNEL *chan;	/*!< Channel being written or read. */
+    int reading;	/*!< True for PI_IRead or PI_BindRead. */
+    int persistent;	/*!< True for a binding, which PI_Wait doesn't free. */
+    int nargs;		/*!< Number of items in args[]. */
+    int posted;		/*!< Items [0,posted) were started, the rest are deferred. */
+    int done;		/*!< True once complete (a binding, until started). */
+    int multi;		/*!< True if part of PI_WriteMulti or PI_ReadMulti, which log for it. */
+    MPI_Request mpireq[PI_MAX_FORMATLEN];	/*!< Per item, or MPI_REQUEST_NULL if no message. */
+    PI_MPI_RTTI args[PI_MAX_FORMATLEN];	/*!< Copy of the bound items. */
+    MPI_Datatype dups[PI_MAX_FORMATLEN];	/*!< Deferred items' derived types, held
+                                                 in case the format cache drops them. */
+    int signFirst;	/*!< True if a signature goes with the first message. */
+    int sig;		/*!< Our format signature. */
+    int theirs;		/*!< Writer's signature, received by a read. */
+    MPI_Datatype sigtype;	/*!< Binding's datatype for the signed first message. */
+    void *packed;	/*!< Buffer of items packed by -pimsg=c, else NULL. */
+    int packedLen;	/*!< Size of packed. */
+    char *format;	/*!< Copy of the format, for logging deferred items. */
+    PI_REQUEST *next;	/*!< Next read queued on the channel. */
+
+    int magic;		/*!< Fill in with PI_REQ */
+};
+
 #endif
@@ -0,0 +1,157 @@
+/*
+Tests for reading variable-length arrays into reused buffers: the "~" flag,
+where the reader supplies the buffer and its capacity, and PI_ReleaseBuffer,
+which gives a "^" or "%s" array back to Pilot for reuse.  Also covers the "z"
+prefix for size_t lengths.
+*/
+#include "unittests.h"
+
+static PI_PROCESS *echo_proc;
+static PI_CHANNEL *to_echo, *from_echo;
+
+static int echo_func(int q, void *p)
+{
+    int i, len, cap = 0, *arr = NULL;
+    char *str = NULL;
+    int scap = 0;
+    size_t zlen, zcap = 0;
+
+    // grows the caller's buffer as needed, echoing each array
+    for (i = 0; i < 3; i++) {
+        PI_Read(to_echo, "%~d", &len, &arr, &cap);
+        PI_Write(from_echo, "%d %^d", cap, len, arr);
+    }
+    free(arr);
+
+    PI_Read(to_echo, "%~s", &str, &scap);
+    PI_Write(from_echo, "%d %s", scap, str);
+    free(str);
+
+    // a released array is reused by the next read that fits
+    for (i = 0; i < 2; i++) {
+        PI_Read(to_echo, "%^d", &len, &arr);
+        PI_Write(from_echo, "%^d", len, arr);
+        PI_ReleaseBuffer(arr);
+    }
+
+    // size_t length and capacity
+    arr = NULL;
+    PI_Read(to_echo, "%z~d", &zlen, &arr, &zcap);
+    PI_Write(from_echo, "%z*d", zlen, arr);
+    free(arr);
+    return 0;
+}
+
+static void caller_buffer(void)
+{
+    int i, len, cap, *back;
+    int a[10] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+    char *s;
+
+    PI_Errno = 0;
+    PI_Write(to_echo, "%^d", 5, a);
+    PI_Read(from_echo, "%d %^d", &cap, &len, &back);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+    CU_ASSERT_EQUAL(len, 5);
+    CU_ASSERT_EQUAL(cap, 5);
+    for (i = 0; i < 5; i++)
+        CU_ASSERT_EQUAL(back[i], i);
+    free(back);
+
+    // shorter array keeps the buffer
+    PI_Write(to_echo, "%^d", 3, a+7);
+    PI_Read(from_echo, "%d %^d", &cap, &len, &back);
+    CU_ASSERT_EQUAL(len, 3);
+    CU_ASSERT_EQUAL(cap, 5);
+    CU_ASSERT(back[0] == 7 && back[2] == 9);
+    free(back);
+
+    // longer array grows it
+    PI_Write(to_echo, "%^d", 10, a);
+    PI_Read(from_echo, "%d %^d", &cap, &len, &back);
+    CU_ASSERT_EQUAL(len, 10);
+    CU_ASSERT_EQUAL(cap, 10);
+    CU_ASSERT(back[0] == 0 && back[9] == 9);
+    free(back);
+
+    PI_Write(to_echo, "%s", "reused");
+    PI_Read(from_echo, "%d %s", &cap, &s);
+    CU_ASSERT_EQUAL(cap, 7);
+    CU_ASSERT_NSTRING_EQUAL(s, "reused", 7);
+    free(s);
+}
+
+static void release_buffer(void)
+{
+    int i, len, *back, *first;
+    int a[4] = {4, 3, 2, 1};
+
+    PI_Errno = 0;
+    PI_Write(to_echo, "%^d", 4, a);
+    PI_Read(from_echo, "%^d", &len, &back);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+    CU_ASSERT_EQUAL(len, 4);
+    first = back;
+    PI_ReleaseBuffer(back);
+
+    PI_Write(to_echo, "%^d", 2, a);
+    PI_Read(from_echo, "%^d", &len, &back);
+    CU_ASSERT_EQUAL(len, 2);
+    CU_ASSERT_PTR_EQUAL(back, first);
+    for (i = 0; i < 2; i++)
+        CU_ASSERT_EQUAL(back[i], a[i]);
+    PI_ReleaseBuffer(back);
+
+    PI_ReleaseBuffer(NULL);	// no-op
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+}
+
+static void size_t_lengths(void)
+{
+    int i, back[6];
+    int a[6] = {6, 5, 4, 3, 2, 1};
+
+    PI_Errno = 0;
+    PI_Write(to_echo, "%z^d", (size_t)6, a);
+    PI_Read(from_echo, "%z*d", (size_t)6, back);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+    for (i = 0; i < 6; i++)
+        CU_ASSERT_EQUAL(back[i], a[i]);
+}
+
+static int init(void)
+{
+    int argc = default_argc;
+    char** argv = default_argv;
+    PI_QuietMode = 1;
+    PI_OnErrorReturn = 1;
+
+    PI_Configure(&argc, &argv);
+
+    echo_proc = CreateAliasedProcess(echo_func, "echo", 0, NULL);
+    to_echo = PI_CreateChannel(PI_MAIN, echo_proc);
+    from_echo = PI_CreateChannel(echo_proc, PI_MAIN);
+
+    PI_StartAll();
+    return 0;
+}
+
+static int cleanup(void)
+{
+    if (my_rank == 0)
+        PI_StopMain(0);
+    return 0;
+}
+
+CU_ErrorCode AddBufferSuite(void)
+{
+    CU_pSuite suite = CU_add_suite("Read Buffer Tests", init, cleanup);
+    if (suite == NULL)
+        return CU_get_error();
+
+    AddTest(suite, "~ flag reads into caller's buffer", caller_buffer);
+    AddTest(suite, "PI_ReleaseBuffer gives array back for reuse", release_buffer);
+    AddTest(suite, "z prefix takes size_t lengths", size_t_lengths);
+
+    return CUE_SUCCESS;
+}
@@ -0,0 +1,134 @@
+/*
+Tests for typed channels, whose format is bound once by PI_SetChannelFormat
+during configuration, so that reads and writes skip parsing and the per-call
+signature check.
+*/
+#include "unittests.h"
+#include <string.h>
+
+#define ECHO_FORMAT "%d %3lf %^d"
+#define STAR_FORMAT "%*d"
+
+static PI_PROCESS *echo_proc;
+static PI_CHANNEL *to_echo, *from_echo, *to_echo_star, *from_echo_star;
+static int config_errno, bad_format_errno;
+
+static int echo_func(int q, void *p)
+{
+    int d, len, *var, star[4];
+    double arr[3];
+    char fmt[] = ECHO_FORMAT;	// same text at another address
+
+    PI_Read(to_echo, ECHO_FORMAT, &d, arr, &len, &var);
+    PI_Write(from_echo, fmt, d, arr, len, var);
+    free(var);
+
+    PI_Read(to_echo_star, STAR_FORMAT, 4, star);
+    PI_Write(from_echo_star, STAR_FORMAT, 4, star);
+    return 0;
+}
+
+static void typed_echo(void)
+{
+    int i, d, len, *var, star[4], back_star[4];
+    int v[5] = {5, 4, 3, 2, 1};
+    double arr[3] = {1.0, 2.0, 3.0}, back[3];
+    char fmt[] = ECHO_FORMAT;	// same text at another address
+
+    CU_ASSERT_EQUAL(config_errno, 0);
+
+    PI_Errno = 0;
+    PI_Write(to_echo, ECHO_FORMAT, 17, arr, 5, v);
+    PI_Read(from_echo, fmt, &d, back, &len, &var);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+    CU_ASSERT_EQUAL(d, 17);
+    for (i = 0; i < 3; i++)
+        CU_ASSERT_EQUAL(back[i], arr[i]);
+    CU_ASSERT_EQUAL(len, 5);
+    for (i = 0; i < 5; i++)
+        CU_ASSERT_EQUAL(var[i], v[i]);
+    free(var);
+
+    // a '*' length still gets its signature checked per call
+    for (i = 0; i < 4; i++)
+        star[i] = i * i;
+    PI_Write(to_echo_star, STAR_FORMAT, 4, star);
+    PI_Read(from_echo_star, STAR_FORMAT, 4, back_star);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+    for (i = 0; i < 4; i++)
+        CU_ASSERT_EQUAL(back_star[i], star[i]);
+}
+
+static void typed_errors(void)
+{
+    int d = 1;
+    PI_ITEM item = { PI_ITEM_INT, 0, &d, 1, NULL, NULL };
+
+    // malformed format was reported at configuration
+    CU_ASSERT_EQUAL(bad_format_errno, PI_FORMAT_INVALID);
+
+    // any other format, or items, are refused without sending anything
+    PI_Errno = 0;
+    PI_Write(to_echo, "%d", d);
+    CU_ASSERT_EQUAL(PI_Errno, PI_FORMAT_MISMATCH);
+
+    PI_Errno = 0;
+    PI_WriteItems(to_echo, &item, 1);
+    CU_ASSERT_EQUAL(PI_Errno, PI_FORMAT_MISMATCH);
+
+    PI_Errno = 0;
+    PI_SetChannelFormat(to_echo, "%d");
+    CU_ASSERT_EQUAL(PI_Errno, PI_WRONG_PHASE);
+}
+
+static int init(void)
+{
+    int argc = default_argc;
+    char** argv = default_argv;
+    PI_CHANNEL *spare;
+    PI_QuietMode = 1;
+    PI_OnErrorReturn = 1;
+
+    PI_Configure(&argc, &argv);
+
+    echo_proc = CreateAliasedProcess(echo_func, "echo", 0, NULL);
+    to_echo = PI_CreateChannel(PI_MAIN, echo_proc);
+    from_echo = PI_CreateChannel(echo_proc, PI_MAIN);
+    to_echo_star = PI_CreateChannel(PI_MAIN, echo_proc);
+    from_echo_star = PI_CreateChannel(echo_proc, PI_MAIN);
+    spare = PI_CreateChannel(PI_MAIN, echo_proc);
+
+    PI_Errno = 0;
+    PI_SetChannelFormat(to_echo, ECHO_FORMAT);
+    PI_SetChannelFormat(from_echo, ECHO_FORMAT);
+    PI_SetChannelFormat(to_echo_star, STAR_FORMAT);
+    PI_SetChannelFormat(from_echo_star, STAR_FORMAT);
+    config_errno = PI_Errno;
+
+    PI_Errno = 0;
+    PI_SetChannelFormat(spare, "%q");
+    bad_format_errno = PI_Errno;
+    PI_Errno = 0;
+
+    PI_StartAll();
+    return 0;
+}
+
+static int cleanup(void)
+{
+    if (my_rank == 0)
+        PI_StopMain(0);
+    return 0;
+}
+
+CU_ErrorCode AddChannelFormatSuite(void)
+{
+    CU_pSuite suite = CU_add_suite("Typed Channel Tests", init, cleanup);
+    if (suite == NULL)
+        return CU_get_error();
+
+    AddTest(suite, "typed channels echo with their formats", typed_echo);
+    AddTest(suite, "typed channels refuse other formats", typed_errors);
+
+    return CUE_SUCCESS;
+}
@@ -0,0 +1,111 @@
+/*
+Tests for the C++ binding in pilot.hpp: pilot::write and pilot::read pick each
+argument's datatype at compile time, and must interoperate with PI_Read and
+PI_Write using the equivalent formats, so the echo process uses C formats.
+*/
+#include "unittests.h"
+#include <pilot.hpp>
+#include <cstdlib>
+#include <cstring>
+
+static PI_PROCESS *echo_proc;
+static PI_CHANNEL *to_echo, *from_echo;
+
+static int echo_func(int q, void *p)
+{
+    int d, arr[4], grid[6];
+    double xyz[3];
+    size_t len;
+    float *samples;
+    char *name;
+
+    // int, double[3], std::vector<float>, std::string, std::array<int,4>, int[2][3]
+    PI_Read(to_echo, "%d %3lf %z^f %s %4d %6d", &d, xyz, &len, &samples, &name, arr, grid);
+    PI_Write(from_echo, "%d %3lf %z^f %s %4d %6d", d, xyz, len, samples, name, arr, grid);
+    free(samples);
+    free(name);
+
+#ifdef __cpp_lib_span
+    PI_Read(to_echo, "%5d", arr);
+    PI_Write(from_echo, "%5d", arr);
+#endif
+    return 0;
+}
+
+static void cpp_echo(void)
+{
+    int d = 42, back_d = 0;
+    double xyz[3] = {1.5, -2.5, 3.25}, back_xyz[3] = {0};
+    std::vector<float> samples = {0.5f, 1.5f, 2.5f, 3.5f, 4.5f};
+    std::vector<float> back_samples(20, -1.0f);		// shrinks to fit
+    std::string name = "pilot", back_name = "x";	// grows to fit
+    std::array<int, 4> arr = {{1, 2, 3, 4}}, back_arr = {{0, 0, 0, 0}};
+    int grid[2][3] = {{1, 2, 3}, {4, 5, 6}}, back_grid[2][3] = {{0}};
+    int i;
+
+    PI_Errno = 0;
+    pilot::write(to_echo, d, xyz, samples, name, arr, grid);
+    pilot::read(from_echo, back_d, back_xyz, back_samples, back_name, back_arr, back_grid);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+
+    CU_ASSERT_EQUAL(back_d, 42);
+    for (i = 0; i < 3; i++)
+        CU_ASSERT_EQUAL(back_xyz[i], xyz[i]);
+    CU_ASSERT(back_samples == samples);
+    CU_ASSERT(back_name == name);	// without the NUL that %s sends
+    CU_ASSERT(back_arr == arr);
+    CU_ASSERT_EQUAL(std::memcmp(back_grid, grid, sizeof(grid)), 0);
+}
+
+#ifdef __cpp_lib_span
+static void cpp_span(void)
+{
+    int buf[7] = {0, 10, 20, 30, 40, 50, 0}, back[7] = {0};
+
+    PI_Errno = 0;
+    pilot::write(to_echo, std::span<const int>(buf + 1, 5));
+    pilot::read(from_echo, std::span<int>(back + 1, 5));	// a temporary is fine
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+    CU_ASSERT_EQUAL(back[0], 0);
+    CU_ASSERT_EQUAL(std::memcmp(back + 1, buf + 1, 5 * sizeof(int)), 0);
+    CU_ASSERT_EQUAL(back[6], 0);
+}
+#endif
+
+static int init(void)
+{
+    int argc = default_argc;
+    char** argv = default_argv;
+    PI_QuietMode = 1;
+    PI_OnErrorReturn = 1;
+
+    PI_Configure(&argc, &argv);
+
+    echo_proc = CreateAliasedProcess(echo_func, "echo", 0, NULL);
+    to_echo = PI_CreateChannel(PI_MAIN, echo_proc);
+    from_echo = PI_CreateChannel(echo_proc, PI_MAIN);
+
+    PI_StartAll();
+    return 0;
+}
+
+static int cleanup(void)
+{
+    if (my_rank == 0)
+        PI_StopMain(0);
+    return 0;
+}
+
+CU_ErrorCode AddCppBindingSuite(void)
+{
+    CU_pSuite suite = CU_add_suite("C++ Binding Tests", init, cleanup);
+    if (suite == NULL)
+        return CU_get_error();
+
+    AddTest(suite, "pilot::write/read echo", cpp_echo);
+#ifdef __cpp_lib_span
+    AddTest(suite, "pilot::write/read span", cpp_span);
+#endif
+
+    return CUE_SUCCESS;
+}
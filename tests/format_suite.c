@@ -125,6 +125,14 @@ static void ShouldFailOnInvalidSizeArray( void )
     // Only one length can be specified
     PI_Errno = 0;
     PI_Write( dummy_chan, "%3*d", 1, a );
+    CU_ASSERT_EQUAL( PI_Errno, PI_ARRAY_LENGTH );
+    PI_Errno = 0;
+    PI_Write( dummy_chan, "%3z*d", (size_t)1, a );
+    CU_ASSERT_EQUAL( PI_Errno, PI_ARRAY_LENGTH );
+
+    // Lengths may exceed INT_MAX, but not long long
+    PI_Errno = 0;
+    PI_Write( dummy_chan, "%99999999999999999999d", a );
     CU_ASSERT_EQUAL( PI_Errno, PI_ARRAY_LENGTH );
 
 	// Negative sign should be invalid format
@@ -277,6 +285,34 @@ static void ShouldDetectBogusPointers( void )
     free(heap);
 }
 
+static void ShouldRecompileReusedFormatBuffer( void )
+{
+    char fmt[20];
+    int a[5] = {0};
+
+    // Same buffer (hence same cache key) with different contents each time
+    strcpy( fmt, "%d %BAD" );
+    PI_Errno = 0;
+    PI_Write( dummy_chan, fmt, 1 );
+    CU_ASSERT_EQUAL( PI_Errno, PI_FORMAT_INVALID );
+
+    strcpy( fmt, "%*d" );
+    PI_Errno = 0;
+    PI_Write( dummy_chan, fmt, 0, a );
+    CU_ASSERT_EQUAL( PI_Errno, PI_ARRAY_LENGTH );
+
+    strcpy( fmt, "%+/d" );
+    PI_Errno = 0;
+    PI_Write( dummy_chan, fmt, 1 );
+    CU_ASSERT_EQUAL( PI_Errno, PI_OP_INVALID );
+
+    // Reduce op in a later term must not be taken as part of the 1st term
+    // (which would give PI_FORMAT_INVALID)
+    PI_Errno = 0;
+    PI_Write( dummy_chan, "%*d %+/d", 0, a, 2 );
+    CU_ASSERT_EQUAL( PI_Errno, PI_ARRAY_LENGTH );
+}
+
 static int init(void)
 {
     int argc = default_argc;
@@ -325,6 +361,7 @@ CU_ErrorCode AddFormatSuite(void)
     AddTest( suite, "Should only accept reduce operators with reducer bundle", ReduceOpsWithBundle );
     AddTest( suite, "Should detect too few/many arguments for formats", ShouldDetectWrongNumArgs );
     AddTest( suite, "Should detect a variety of bogus pointers for reading/writing", ShouldDetectBogusPointers );
+    AddTest( suite, "Should recompile a reused format buffer", ShouldRecompileReusedFormatBuffer );
 
     return CUE_SUCCESS;
 }
@@ -0,0 +1,132 @@
+/*
+Tests for PI_WriteItems and PI_ReadItems, the pre-parsed entry points used by
+pilot.hpp, which must interoperate with PI_Read and PI_Write using the
+equivalent formats.  Call logging is on, since it prints the items' values.
+*/
+#include "unittests.h"
+#include <string.h>
+
+static PI_PROCESS *echo_proc;
+static PI_CHANNEL *to_echo, *from_echo;
+
+static int echo_func(int q, void *p)
+{
+    int d;
+    double arr[5];
+    size_t len;
+    char *var;
+
+    PI_Read(to_echo, "%d %5lf %z^c", &d, arr, &len, &var);
+    PI_Write(from_echo, "%d %5lf %z^c", d, arr, len, var);
+    free(var);
+    return 0;
+}
+
+/* resize callback that hands out a fixed buffer */
+static char var_buf[16];
+static size_t var_len;
+
+static void *GetVarBuf(void *ctx, size_t count)
+{
+    var_len = count;
+    return count <= sizeof(var_buf) ? ctx : NULL;
+}
+
+static void items_echo(void)
+{
+    int i, d = 42, back_d = 0;
+    double arr[5] = {0.5, 1.5, 2.5, 3.5, 4.5}, back_arr[5];
+    const char *text = "items";
+
+    PI_ITEM out[3] = {
+        { PI_ITEM_INT, 0, &d, 1, NULL, NULL },
+        { PI_ITEM_DOUBLE, 0, arr, 5, NULL, NULL },
+        { PI_ITEM_CHAR, 1, (void *)text, 6, NULL, NULL }
+    };
+    PI_ITEM in[3] = {
+        { PI_ITEM_INT, 0, &back_d, 1, NULL, NULL },
+        { PI_ITEM_DOUBLE, 0, back_arr, 5, NULL, NULL },
+        { PI_ITEM_CHAR, 1, NULL, 0, GetVarBuf, var_buf }
+    };
+
+    PI_Errno = 0;
+    PI_WriteItems(to_echo, out, 3);
+    PI_ReadItems(from_echo, in, 3);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+    CU_ASSERT_EQUAL(back_d, 42);
+    for (i = 0; i < 5; i++)
+        CU_ASSERT_EQUAL(back_arr[i], arr[i]);
+    CU_ASSERT_EQUAL(var_len, 6);
+    CU_ASSERT_STRING_EQUAL(var_buf, "items");
+}
+
+static void items_errors(void)
+{
+    int d = 1;
+    PI_ITEM bad_type = { (PI_ITEMTYPE)99, 0, &d, 1, NULL, NULL };
+    PI_ITEM no_count = { PI_ITEM_INT, 0, &d, 0, NULL, NULL };
+    PI_ITEM no_resize = { PI_ITEM_INT, 1, NULL, 0, NULL, NULL };
+
+    PI_Errno = 0;
+    PI_WriteItems(to_echo, &bad_type, 1);
+    CU_ASSERT_EQUAL(PI_Errno, PI_FORMAT_INVALID);
+
+    PI_Errno = 0;
+    PI_WriteItems(to_echo, &no_count, 1);
+    CU_ASSERT_EQUAL(PI_Errno, PI_ARRAY_LENGTH);
+
+    PI_Errno = 0;
+    PI_WriteItems(to_echo, &no_count, 0);
+    CU_ASSERT_EQUAL(PI_Errno, PI_FORMAT_ARGS);
+
+    PI_Errno = 0;
+    PI_ReadItems(from_echo, &no_resize, 1);
+    CU_ASSERT_EQUAL(PI_Errno, PI_FORMAT_ARGS);
+
+    PI_Errno = 0;
+    PI_ReadItems(to_echo, &no_count, 1);
+    CU_ASSERT_EQUAL(PI_Errno, PI_ENDPOINT_READER);
+}
+
+static int init(void)
+{
+    int i, argc = default_argc + 2;
+    char *argv_[argc + 1];
+    char **argv = argv_;
+    PI_QuietMode = 1;
+    PI_OnErrorReturn = 1;
+
+    // use the defaults plus call logging, which needs the online process
+    for (i = 0; i < default_argc; i++) argv_[i] = default_argv[i];
+    argv_[default_argc] = "-pisvc=c";
+    argv_[default_argc + 1] = "-pilog=items_suite";
+    argv_[argc] = NULL;
+
+    PI_Configure(&argc, &argv);
+
+    echo_proc = CreateAliasedProcess(echo_func, "echo", 0, NULL);
+    to_echo = PI_CreateChannel(PI_MAIN, echo_proc);
+    from_echo = PI_CreateChannel(echo_proc, PI_MAIN);
+
+    PI_StartAll();
+    return 0;
+}
+
+static int cleanup(void)
+{
+    if (my_rank == 0)
+        PI_StopMain(0);
+    return 0;
+}
+
+CU_ErrorCode AddItemsSuite(void)
+{
+    CU_pSuite suite = CU_add_suite("Pre-parsed Item Tests", init, cleanup);
+    if (suite == NULL)
+        return CU_get_error();
+
+    AddTest(suite, "items echoed through equivalent formats", items_echo);
+    AddTest(suite, "invalid items", items_errors);
+
+    return CUE_SUCCESS;
+}
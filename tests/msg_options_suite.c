@@ -0,0 +1,128 @@
+/*
+Tests for the -pimsg message transport options. This suite configures Pilot with
+its own extra command-line args, then checks that reads and writes of mixed
+items, including variable length ones, still deliver the right data.
+
+For V3.3, -pimsg=c coalesces the items of a read/write into one message.
+*/
+#include "unittests.h"
+#include <string.h>
+
+static PI_PROCESS *echo_proc, *sel_procs[2];
+static PI_CHANNEL *to_echo, *from_echo, *sel_chans[2];
+static PI_BUNDLE *selector;
+
+static int echo_func(int q, void *p)
+{
+    int a, n, *var;
+    double d;
+    float arr[5];
+    char *str;
+
+    PI_Read(to_echo, "%d %lf %5f %^d %s", &a, &d, arr, &n, &var, &str);
+    PI_Write(from_echo, "%d %lf %5f %^d %s", a, d, arr, n, var, str);
+    free(var);
+    free(str);
+
+    // a single item is not coalesced
+    PI_Read(to_echo, "%d", &a);
+    PI_Write(from_echo, "%d", a);
+    return 0;
+}
+
+static int sel_func(int q, void *p)
+{
+    int x[3] = {q, q+1, q+2};
+    PI_Write(sel_chans[q], "%d %c %3d", q, 'A'+q, x);
+    return 0;
+}
+
+static void echo_mixed(void)
+{
+    int a, n, *var, v[3] = {4, 5, 6};
+    double d;
+    float arr[5] = {1.5, 2.5, 3.5, 4.5, 5.5}, arr_[5];
+    char *str;
+
+    PI_Errno = 0;
+    PI_Write(to_echo, "%d %lf %5f %^d %s", 42, 3.25, arr, 3, v, "coalesced");
+    PI_Read(from_echo, "%d %lf %5f %^d %s", &a, &d, arr_, &n, &var, &str);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+
+    CU_ASSERT_EQUAL(a, 42);
+    CU_ASSERT_DOUBLE_EQUAL(d, 3.25, 0.0);
+    CU_ASSERT(0 == memcmp(arr, arr_, sizeof(arr)));
+    CU_ASSERT_EQUAL(n, 3);
+    CU_ASSERT(n == 3 && var[0] == 4 && var[2] == 6);
+    CU_ASSERT_NSTRING_EQUAL(str, "coalesced", 10);
+    free(var);
+    free(str);
+
+    PI_Write(to_echo, "%d", 99);
+    PI_Read(from_echo, "%d", &a);
+    CU_ASSERT_EQUAL(a, 99);
+}
+
+static void select_mixed(void)
+{
+    int i, s, q, x[3], seen = 0;
+    char c;
+
+    for (i = 0; i < 2; i++) {
+        s = PI_Select(selector);
+        PI_Read(PI_GetBundleChannel(selector, s), "%d %c %3d", &q, &c, x);
+        CU_ASSERT_EQUAL(q, s);
+        CU_ASSERT_EQUAL(c, 'A'+s);
+        CU_ASSERT(x[0] == s && x[2] == s+2);
+        seen |= 1 << s;
+    }
+    CU_ASSERT_EQUAL(seen, 3);
+}
+
+static int init(void)
+{
+    int i, argc = default_argc + 1;
+    char *argv_[argc + 1];
+    char **argv = argv_;
+    PI_QuietMode = 1;
+    PI_OnErrorReturn = 1;
+
+    // use the defaults plus the message options being tested
+    for (i = 0; i < default_argc; i++) argv_[i] = default_argv[i];
+    argv_[default_argc] = "-pimsg=c";
+    argv_[argc] = NULL;
+
+    PI_Configure(&argc, &argv);
+
+    echo_proc = CreateAliasedProcess(echo_func, "echo", 0, NULL);
+    to_echo = PI_CreateChannel(PI_MAIN, echo_proc);
+    from_echo = PI_CreateChannel(echo_proc, PI_MAIN);
+
+    for (i = 0; i < 2; i++) {
+        sel_procs[i] = CreateAliasedProcess(sel_func, "sel", i, NULL);
+        sel_chans[i] = PI_CreateChannel(sel_procs[i], PI_MAIN);
+    }
+    selector = PI_CreateBundle(PI_SELECT, sel_chans, 2);
+
+    PI_StartAll();
+    return 0;
+}
+
+static int cleanup(void)
+{
+    if (my_rank == 0)
+        PI_StopMain(0);
+    return 0;
+}
+
+CU_ErrorCode AddMsgOptionsSuite(void)
+{
+    CU_pSuite suite = CU_add_suite("Message Option Tests", init, cleanup);
+    if (suite == NULL)
+        return CU_get_error();
+
+    AddTest(suite, "Coalesced read/write of mixed items", echo_mixed);
+    AddTest(suite, "Coalesced read/write via selector", select_mixed);
+
+    return CUE_SUCCESS;
+}
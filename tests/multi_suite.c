@@ -0,0 +1,117 @@
+/*
+Tests for PI_WriteMulti and PI_ReadMulti: a master writing to each of its
+workers over separate channels, and reading their replies in arrival order.
+*/
+#include "unittests.h"
+#include <unistd.h>
+
+#define N_WORKERS 4
+#define N_VALS 3
+#define SLOW 0		// this worker replies late
+
+static PI_PROCESS *workers[N_WORKERS];
+static PI_CHANNEL *to_worker[N_WORKERS], *from_worker[N_WORKERS];
+
+static int worker_func(int q, void *p)
+{
+    int d, pair[2];
+    double vals[N_VALS];
+
+    PI_Read(to_worker[q], "%d %3lf", &d, vals);
+    pair[0] = vals[0];
+    pair[1] = vals[N_VALS-1];
+    if (q == SLOW)
+        usleep(200000);
+    PI_Write(from_worker[q], "%d %2d", d * 10, pair);
+    return 0;
+}
+
+static void multi_write_and_read(void)
+{
+    int i, d[N_WORKERS], replies[N_WORKERS], pairs[N_WORKERS][2], order[N_WORKERS];
+    double vals[N_WORKERS][N_VALS];
+    int seen = 0;
+
+    for (i = 0; i < N_WORKERS; i++) {
+        d[i] = i + 1;
+        vals[i][0] = 100 * i;
+        vals[i][1] = -1;
+        vals[i][N_VALS-1] = 100 * i + 2;
+    }
+
+    PI_Errno = 0;
+    PI_WriteMulti(to_worker, N_WORKERS, "%d %3lf", d, vals);
+    PI_ReadMulti(from_worker, N_WORKERS, order, "%d %2d", replies, pairs);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+    for (i = 0; i < N_WORKERS; i++) {
+        CU_ASSERT_EQUAL(replies[i], (i + 1) * 10);
+        CU_ASSERT_EQUAL(pairs[i][0], 100 * i);
+        CU_ASSERT_EQUAL(pairs[i][1], 100 * i + 2);
+        seen |= 1 << order[i];
+    }
+    CU_ASSERT_EQUAL(seen, (1 << N_WORKERS) - 1);	// each channel once
+    CU_ASSERT_EQUAL(order[N_WORKERS-1], SLOW);
+}
+
+static void multi_errors(void)
+{
+    int d[N_WORKERS], *arr = NULL;
+
+    PI_Errno = 0;
+    PI_WriteMulti(from_worker, N_WORKERS, "%d", d);
+    CU_ASSERT_EQUAL(PI_Errno, PI_ENDPOINT_WRITER);
+
+    PI_Errno = 0;
+    PI_ReadMulti(to_worker, N_WORKERS, NULL, "%d", d);
+    CU_ASSERT_EQUAL(PI_Errno, PI_ENDPOINT_READER);
+
+    // each channel's share must be fixed
+    PI_Errno = 0;
+    PI_ReadMulti(from_worker, N_WORKERS, NULL, "%^d", d, &arr);
+    CU_ASSERT_EQUAL(PI_Errno, PI_FORMAT_INVALID);
+
+    // nothing to do
+    PI_Errno = 0;
+    PI_WriteMulti(to_worker, 0, "%d", d);
+    PI_ReadMulti(from_worker, 0, NULL, "%d", d);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+}
+
+static int init(void)
+{
+    int i;
+    int argc = default_argc;
+    char** argv = default_argv;
+    PI_QuietMode = 1;
+    PI_OnErrorReturn = 1;
+
+    PI_Configure(&argc, &argv);
+
+    for (i = 0; i < N_WORKERS; i++) {
+        workers[i] = CreateAliasedProcess(worker_func, "worker", i, NULL);
+        to_worker[i] = PI_CreateChannel(PI_MAIN, workers[i]);
+        from_worker[i] = PI_CreateChannel(workers[i], PI_MAIN);
+    }
+
+    PI_StartAll();
+    return 0;
+}
+
+static int cleanup(void)
+{
+    if (my_rank == 0)
+        PI_StopMain(0);
+    return 0;
+}
+
+CU_ErrorCode AddMultiSuite(void)
+{
+    CU_pSuite suite = CU_add_suite("Multi-Channel Tests", init, cleanup);
+    if (suite == NULL)
+        return CU_get_error();
+
+    AddTest(suite, "write to and read from each worker", multi_write_and_read);
+    AddTest(suite, "multi-channel errors", multi_errors);
+
+    return CUE_SUCCESS;
+}
@@ -0,0 +1,350 @@
+/*
+Tests for nonblocking channel operations: PI_IWrite and PI_IRead, and bindings
+repeated by PI_Start, with PI_Wait, PI_Test, and PI_WaitAll to complete them.
+*/
+#include "unittests.h"
+
+#define ECHO_FORMAT "%d %lf %5d"
+#define N_ECHOES 13
+#define VAR_FORMAT "%d %^d %lf"
+#define N_VARS 6
+
+static PI_PROCESS *echo_proc, *var_proc;
+static PI_CHANNEL *to_echo, *from_echo, *to_var, *from_var;
+
+static int echo_func(int q, void *p)
+{
+    int i, d, arr[5];
+    double f;
+
+    for (i = 0; i < N_ECHOES; i++) {
+        PI_Read(to_echo, ECHO_FORMAT, &d, &f, arr);
+        PI_Write(from_echo, ECHO_FORMAT, d, f, arr);
+    }
+    return 0;
+}
+
+/* Sends back each array it gets, after its length, and then half its length */
+static int var_func(int q, void *p)
+{
+    int i, len, *arr;
+
+    for (i = 0; i < N_VARS; i++) {
+        PI_Read(to_var, "%^d", &len, &arr);
+        PI_Write(from_var, VAR_FORMAT, len, len, arr, len / 2.0);
+        free(arr);
+    }
+    return 0;
+}
+
+/* Reads one echo and checks it against what was written */
+static void check_echo(int d, double f, const int arr[5])
+{
+    int i, back_d, back_arr[5];
+    double back_f;
+
+    PI_Read(from_echo, ECHO_FORMAT, &back_d, &back_f, back_arr);
+    CU_ASSERT_EQUAL(back_d, d);
+    CU_ASSERT_EQUAL(back_f, f);
+    for (i = 0; i < 5; i++)
+        CU_ASSERT_EQUAL(back_arr[i], arr[i]);
+}
+
+static const int fixed_arr[5] = {9, 8, 7, 6, 5};
+
+/* Scalars are passed by value, so they must outlive this frame */
+static PI_REQUEST *start_write(int d, double f)
+{
+    return PI_IWrite(to_echo, ECHO_FORMAT, d, f, fixed_arr);
+}
+
+static void iwrite_wait(void)
+{
+    PI_Errno = 0;
+    PI_REQUEST *req = start_write(42, 2.5);
+    CU_ASSERT(req != NULL);
+    PI_Wait(&req);
+    CU_ASSERT(req == NULL);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+    check_echo(42, 2.5, fixed_arr);
+
+    PI_Wait(&req);		// already completed
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+}
+
+static void iwrite_waitall(void)
+{
+    int i, j;
+    int arrs[3][5], back_d[3], back_arrs[3][5];
+    double back_f[3];
+    PI_REQUEST *reqs[7];
+
+    // each echo is waited for before the next write, since the echo can't
+    // take that write until its reply is read (writes are synchronous under
+    // deadlock detection)
+    PI_Errno = 0;
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < 5; j++)
+            arrs[i][j] = 10 * i + j;
+        reqs[2 * i] = PI_IWrite(to_echo, ECHO_FORMAT, i, i / 2.0, arrs[i]);
+        reqs[2 * i + 1] = PI_IRead(from_echo, ECHO_FORMAT,
+                                   &back_d[i], &back_f[i], back_arrs[i]);
+    }
+    reqs[6] = NULL;		// skipped
+    PI_WaitAll(reqs, 7);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+    for (i = 0; i < 7; i++)
+        CU_ASSERT(reqs[i] == NULL);
+
+    // writes on one channel arrive in the order they were started
+    for (i = 0; i < 3; i++) {
+        CU_ASSERT_EQUAL(back_d[i], i);
+        CU_ASSERT_EQUAL(back_f[i], i / 2.0);
+        for (j = 0; j < 5; j++)
+            CU_ASSERT_EQUAL(back_arrs[i][j], arrs[i][j]);
+    }
+}
+
+static void iwrite_test(void)
+{
+    PI_REQUEST *req;
+
+    PI_Errno = 0;
+    req = PI_IWrite(to_echo, ECHO_FORMAT, -1, -1.0, fixed_arr);
+    while (!PI_Test(&req))
+        ;
+    CU_ASSERT(req == NULL);
+    CU_ASSERT_EQUAL(PI_Test(&req), 1);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+    check_echo(-1, -1.0, fixed_arr);
+}
+
+static void iread_wait(void)
+{
+    int i, d, arr[5], back[5] = {0};
+    double f;
+    PI_REQUEST *req;
+
+    for (i = 0; i < 5; i++)
+        arr[i] = i * i;
+
+    // the read is posted before the echo is even asked for
+    PI_Errno = 0;
+    req = PI_IRead(from_echo, ECHO_FORMAT, &d, &f, back);
+    CU_ASSERT(req != NULL);
+    PI_Write(to_echo, ECHO_FORMAT, 3, 0.25, arr);
+    PI_Wait(&req);
+    CU_ASSERT(req == NULL);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+    CU_ASSERT_EQUAL(d, 3);
+    CU_ASSERT_EQUAL(f, 0.25);
+    for (i = 0; i < 5; i++)
+        CU_ASSERT_EQUAL(back[i], arr[i]);
+
+    // both ends nonblocking; the write is finished first, as the echo needs it
+    req = PI_IRead(from_echo, ECHO_FORMAT, &d, &f, back);
+    PI_REQUEST *wreq = PI_IWrite(to_echo, ECHO_FORMAT, 4, 0.5, arr);
+    while (!PI_Test(&wreq))
+        ;
+    PI_Wait(&req);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+    CU_ASSERT_EQUAL(d, 4);
+    CU_ASSERT_EQUAL(f, 0.5);
+}
+
+/* Checks one reply from var_func to an array of len elements, 0..len-1 */
+static void check_var(int d, int len, const int *arr, double f)
+{
+    int i;
+
+    CU_ASSERT_EQUAL(d, len);
+    CU_ASSERT_EQUAL(f, len / 2.0);
+    for (i = 0; i < len; i++)
+        CU_ASSERT_EQUAL(arr[i], i);
+}
+
+static void iread_deferred(void)
+{
+    int i, out[30], d[3], len[3], *arr[3];
+    double f[3];
+    PI_REQUEST *reqs[3];
+
+    for (i = 0; i < 30; i++)
+        out[i] = i;
+
+    // the ^ items of all three are deferred while they are outstanding
+    // together; each reply is waited for before the next write, since var
+    // can't take that write until its reply is read (writes are synchronous
+    // under deadlock detection)
+    PI_Errno = 0;
+    for (i = 0; i < 3; i++)
+        reqs[i] = PI_IRead(from_var, VAR_FORMAT, &d[i], &len[i], &arr[i], &f[i]);
+    for (i = 0; i < 3; i++) {
+        PI_Write(to_var, "%^d", 10 * (i + 1), out);
+        PI_Wait(&reqs[i]);
+        CU_ASSERT(reqs[i] == NULL);
+    }
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+    for (i = 0; i < 3; i++) {
+        check_var(d[i], len[i], arr[i], f[i]);
+        PI_ReleaseBuffer(arr[i]);
+    }
+
+    // PI_Test completes it once the data is on its way
+    reqs[0] = PI_IRead(from_var, VAR_FORMAT, &d[0], &len[0], &arr[0], &f[0]);
+    PI_Write(to_var, "%^d", 7, out);
+    while (!PI_Test(&reqs[0]))
+        ;
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+    check_var(d[0], len[0], arr[0], f[0]);
+    PI_ReleaseBuffer(arr[0]);
+
+    // a blocking read on the same channel gets the reply after the
+    // nonblocking one's
+    reqs[0] = PI_IRead(from_var, VAR_FORMAT, &d[0], &len[0], &arr[0], &f[0]);
+    PI_Write(to_var, "%^d", 5, out);
+    PI_Wait(&reqs[0]);
+    PI_Write(to_var, "%^d", 6, out);
+    PI_Read(from_var, VAR_FORMAT, &d[1], &len[1], &arr[1], &f[1]);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+    CU_ASSERT_EQUAL(len[0], 5);
+    CU_ASSERT_EQUAL(len[1], 6);
+    check_var(d[0], len[0], arr[0], f[0]);
+    check_var(d[1], len[1], arr[1], f[1]);
+    PI_ReleaseBuffer(arr[0]);
+    PI_ReleaseBuffer(arr[1]);
+}
+
+static void bind_repeat(void)
+{
+    int i, j, d, arr[5], back_d, back[5];
+    double f, back_f;
+    PI_REQUEST *reqs[2];
+
+    PI_Errno = 0;
+    reqs[0] = PI_BindWrite(to_echo, ECHO_FORMAT, &d, &f, arr);
+    reqs[1] = PI_BindRead(from_echo, ECHO_FORMAT, &back_d, &back_f, back);
+    CU_ASSERT(reqs[0] != NULL && reqs[1] != NULL);
+
+    PI_Wait(&reqs[0]);		// not started, so nothing to wait for
+    CU_ASSERT(reqs[0] != NULL);
+
+    // each start sends the variables' current values
+    for (i = 0; i < 3; i++) {
+        d = i + 100;
+        f = i * 1.5;
+        for (j = 0; j < 5; j++)
+            arr[j] = i * j;
+        PI_Start(reqs[1]);
+        PI_Start(reqs[0]);
+        PI_WaitAll(reqs, 2);
+        CU_ASSERT(reqs[0] != NULL && reqs[1] != NULL);
+        CU_ASSERT_EQUAL(PI_Errno, 0);
+        CU_ASSERT_EQUAL(back_d, d);
+        CU_ASSERT_EQUAL(back_f, f);
+        for (j = 0; j < 5; j++)
+            CU_ASSERT_EQUAL(back[j], arr[j]);
+    }
+
+    // a binding interworks with the other calls
+    d = -7;
+    PI_Start(reqs[0]);
+    while (!PI_Test(&reqs[0]))
+        ;
+    CU_ASSERT(reqs[0] != NULL);
+    check_echo(d, f, arr);
+
+    PI_Unbind(&reqs[0]);
+    PI_Unbind(&reqs[1]);
+    CU_ASSERT(reqs[0] == NULL && reqs[1] == NULL);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+}
+
+static void nonblocking_errors(void)
+{
+    int d, *arr_ptr, arr[5];
+    double f;
+
+    PI_Errno = 0;
+    CU_ASSERT(PI_IWrite(from_echo, "%d", 1) == NULL);
+    CU_ASSERT_EQUAL(PI_Errno, PI_ENDPOINT_WRITER);
+
+    PI_Errno = 0;
+    CU_ASSERT(PI_IRead(to_echo, "%d", &d) == NULL);
+    CU_ASSERT_EQUAL(PI_Errno, PI_ENDPOINT_READER);
+
+    // only fixed-size items can be bound
+    PI_Errno = 0;
+    CU_ASSERT(PI_BindWrite(to_echo, "%^d", &d, &arr_ptr) == NULL);
+    CU_ASSERT_EQUAL(PI_Errno, PI_FORMAT_INVALID);
+
+    // not a binding, and already started
+    PI_REQUEST *req = PI_BindRead(from_echo, ECHO_FORMAT, &d, &f, arr);
+    PI_Errno = 0;
+    PI_Start(req);
+    PI_Start(req);
+    CU_ASSERT_EQUAL(PI_Errno, PI_INVALID_OBJ);
+    PI_Write(to_echo, ECHO_FORMAT, 1, 1.0, fixed_arr);
+    PI_Unbind(&req);		// waits for the echo
+    CU_ASSERT(req == NULL);
+    CU_ASSERT_EQUAL(d, 1);
+    CU_ASSERT_EQUAL(f, 1.0);
+
+    PI_Errno = 0;
+    req = PI_IWrite(to_echo, ECHO_FORMAT, 2, 2.0, fixed_arr);
+    PI_Start(req);
+    CU_ASSERT_EQUAL(PI_Errno, PI_INVALID_OBJ);
+    PI_Errno = 0;
+    PI_Unbind(&req);
+    CU_ASSERT_EQUAL(PI_Errno, PI_INVALID_OBJ);
+    PI_Wait(&req);
+    check_echo(2, 2.0, fixed_arr);
+
+    PI_Errno = 0;
+    PI_Wait(NULL);
+    CU_ASSERT_EQUAL(PI_Errno, PI_INVALID_OBJ);
+}
+
+static int init(void)
+{
+    int argc = default_argc;
+    char** argv = default_argv;
+    PI_QuietMode = 1;
+    PI_OnErrorReturn = 1;
+
+    PI_Configure(&argc, &argv);
+
+    echo_proc = CreateAliasedProcess(echo_func, "echo", 0, NULL);
+    to_echo = PI_CreateChannel(PI_MAIN, echo_proc);
+    from_echo = PI_CreateChannel(echo_proc, PI_MAIN);
+    var_proc = CreateAliasedProcess(var_func, "var", 0, NULL);
+    to_var = PI_CreateChannel(PI_MAIN, var_proc);
+    from_var = PI_CreateChannel(var_proc, PI_MAIN);
+
+    PI_StartAll();
+    return 0;
+}
+
+static int cleanup(void)
+{
+    if (my_rank == 0)
+        PI_StopMain(0);
+    return 0;
+}
+
+CU_ErrorCode AddNonblockingSuite(void)
+{
+    CU_pSuite suite = CU_add_suite("Nonblocking Tests", init, cleanup);
+    if (suite == NULL)
+        return CU_get_error();
+
+    AddTest(suite, "PI_IWrite completed by PI_Wait", iwrite_wait);
+    AddTest(suite, "PI_IWrite completed by PI_WaitAll", iwrite_waitall);
+    AddTest(suite, "PI_IWrite completed by PI_Test", iwrite_test);
+    AddTest(suite, "PI_IRead completed by PI_Wait and PI_Test", iread_wait);
+    AddTest(suite, "PI_IRead with deferred ^ items", iread_deferred);
+    AddTest(suite, "PI_BindWrite/PI_BindRead repeated by PI_Start", bind_repeat);
+    AddTest(suite, "nonblocking and binding errors", nonblocking_errors);
+
+    return CUE_SUCCESS;
+}
@@ -0,0 +1,133 @@
+/*
+Tests for the "%{...}" record specifier, which sends C structs (and arrays of
+them) as one message of an MPI struct datatype built from the field list.
+*/
+#include "unittests.h"
+#include <stdio.h>
+#include <string.h>
+
+typedef struct {
+    int id;
+    double value;
+    char tag[6];
+    short flags;
+} Record;
+
+#define RECORD "{d lf 6c hd}"
+
+static PI_PROCESS *echo_proc;
+static PI_CHANNEL *to_echo, *from_echo;
+
+static int echo_func(int q, void *p)
+{
+    Record one, four[4], *var;
+    int len;
+
+    PI_Read(to_echo, "%" RECORD, &one);
+    PI_Write(from_echo, "%" RECORD, &one);
+
+    PI_Read(to_echo, "%4" RECORD, four);
+    PI_Write(from_echo, "%4" RECORD, four);
+
+    PI_Read(to_echo, "%^" RECORD, &len, &var);
+    PI_Write(from_echo, "%^" RECORD, len, var);
+    free(var);
+    return 0;
+}
+
+static void SetRecord(Record *r, int i)
+{
+    r->id = i;
+    r->value = i * 0.5;
+    snprintf(r->tag, sizeof(r->tag), "r%d", i);
+    r->flags = -i;
+}
+
+static int SameRecord(const Record *a, const Record *b)
+{
+    return a->id == b->id && a->value == b->value &&
+           strcmp(a->tag, b->tag) == 0 && a->flags == b->flags;
+}
+
+static void record_echo(void)
+{
+    Record out[6], back[6], *var;
+    int i, len;
+
+    for (i = 0; i < 6; i++)
+        SetRecord(&out[i], i);
+
+    PI_Errno = 0;
+    PI_Write(to_echo, "%" RECORD, &out[1]);
+    PI_Read(from_echo, "%" RECORD, &back[0]);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+    CU_ASSERT(SameRecord(&back[0], &out[1]));
+
+    // every 2nd record, read back as a plain array
+    PI_Write(to_echo, "%4:2" RECORD, out);
+    PI_Read(from_echo, "%4" RECORD, back);
+    for (i = 0; i < 3; i++)
+        CU_ASSERT(SameRecord(&back[i], &out[2*i]));
+
+    PI_Write(to_echo, "%^" RECORD, 5, out);
+    PI_Read(from_echo, "%^" RECORD, &len, &var);
+    CU_ASSERT_EQUAL(len, 5);
+    for (i = 0; i < 5; i++)
+        CU_ASSERT(SameRecord(&var[i], &out[i]));
+    free(var);
+}
+
+static void record_errors(void)
+{
+    Record r;
+
+    // no reduce operations, %s, %m, empty or unterminated records
+    const char* fmts[] = { "%+/{d}", "%{d s}", "%{d m}", "%{}", "%{d lf", NULL };
+    int i;
+
+    for (i = 0; fmts[i] != NULL; i++) {
+        PI_Errno = 0;
+        PI_Write(to_echo, fmts[i], &r);
+        CU_ASSERT_EQUAL(PI_Errno, PI_FORMAT_INVALID);
+    }
+
+    PI_Errno = 0;
+    PI_Write(to_echo, "%{d 1lf}", &r);
+    CU_ASSERT_EQUAL(PI_Errno, PI_ARRAY_LENGTH);
+}
+
+static int init(void)
+{
+    int argc = default_argc;
+    char** argv = default_argv;
+    PI_QuietMode = 1;
+    PI_OnErrorReturn = 1;
+
+    PI_Configure(&argc, &argv);
+
+    echo_proc = CreateAliasedProcess(echo_func, "echo", 0, NULL);
+    to_echo = PI_CreateChannel(PI_MAIN, echo_proc);
+    from_echo = PI_CreateChannel(echo_proc, PI_MAIN);
+
+    PI_StartAll();
+    return 0;
+}
+
+static int cleanup(void)
+{
+    if (my_rank == 0)
+        PI_StopMain(0);
+    return 0;
+}
+
+CU_ErrorCode AddRecordSuite(void)
+{
+    CU_pSuite suite = CU_add_suite("Record Tests", init, cleanup);
+    if (suite == NULL)
+        return CU_get_error();
+
+    AddTest(suite, "record scalar, strided, and variable length echo", record_echo);
+    AddTest(suite, "malformed records", record_errors);
+
+    return CUE_SUCCESS;
+}
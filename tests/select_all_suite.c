@@ -0,0 +1,114 @@
+/*
+Tests for PI_SelectAll, PI_TrySelectAll and PI_ReadReady: listing every channel
+of a selector with data, and reading them all in one call.
+*/
+#include "unittests.h"
+#include <unistd.h>
+
+#define N_WORKERS 4
+#define K 3		// messages from each worker
+
+static PI_PROCESS *workers[N_WORKERS];
+static PI_CHANNEL *from_worker[N_WORKERS];
+static PI_BUNDLE *selector;
+
+static int worker_func(int q, void *p)
+{
+    int i, pair[2];
+
+    for (i = 0; i < K; i++) {
+        pair[0] = q;
+        pair[1] = i;
+        PI_Write(from_worker[q], "%d %2d", 100 * q + i, pair);
+    }
+    return 0;
+}
+
+static void select_and_read_all(void)
+{
+    int i, j, n, ready[N_WORKERS], vals[N_WORKERS], pairs[N_WORKERS][2];
+
+    PI_Errno = 0;
+    for (j = 0; j < K; j++) {
+        // every worker's next message is in before looking
+        for (i = 0; i < N_WORKERS; i++)
+            while (!PI_ChannelHasData(from_worker[i]))
+                usleep(1000);
+
+        n = (j % 2) ? PI_TrySelectAll(selector, ready) : PI_SelectAll(selector, ready);
+        CU_ASSERT_EQUAL(n, N_WORKERS);
+        for (i = 0; i < n; i++)
+            CU_ASSERT_EQUAL(ready[i], i);
+
+        PI_ReadReady(selector, ready, n, "%d %2d", vals, pairs);
+        for (i = 0; i < n; i++) {
+            CU_ASSERT_EQUAL(vals[i], 100 * ready[i] + j);
+            CU_ASSERT_EQUAL(pairs[i][0], ready[i]);
+            CU_ASSERT_EQUAL(pairs[i][1], j);
+        }
+    }
+    CU_ASSERT_EQUAL(PI_TrySelectAll(selector, ready), 0);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+}
+
+static void select_all_errors(void)
+{
+    int ready[N_WORKERS] = { 0, N_WORKERS }, vals[N_WORKERS], *arr = NULL;
+
+    PI_Errno = 0;
+    PI_SelectAll(NULL, ready);
+    CU_ASSERT_EQUAL(PI_Errno, PI_NULL_BUNDLE);
+
+    PI_Errno = 0;
+    PI_ReadReady(selector, ready, 2, "%d", vals);
+    CU_ASSERT_EQUAL(PI_Errno, PI_BUNDLE_INDEX);
+
+    // each channel's share must be fixed
+    PI_Errno = 0;
+    PI_ReadReady(selector, ready, 1, "%^d", vals, &arr);
+    CU_ASSERT_EQUAL(PI_Errno, PI_FORMAT_INVALID);
+
+    // nothing to do
+    PI_Errno = 0;
+    PI_ReadReady(selector, ready, 0, "%d", vals);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+}
+
+static int init(void)
+{
+    int i;
+    int argc = default_argc;
+    char** argv = default_argv;
+    PI_QuietMode = 1;
+    PI_OnErrorReturn = 1;
+
+    PI_Configure(&argc, &argv);
+
+    for (i = 0; i < N_WORKERS; i++) {
+        workers[i] = CreateAliasedProcess(worker_func, "worker", i, NULL);
+        from_worker[i] = PI_CreateChannel(workers[i], PI_MAIN);
+    }
+    selector = PI_CreateBundle(PI_SELECT, from_worker, N_WORKERS);
+
+    PI_StartAll();
+    return 0;
+}
+
+static int cleanup(void)
+{
+    if (my_rank == 0)
+        PI_StopMain(0);
+    return 0;
+}
+
+CU_ErrorCode AddSelectAllSuite(void)
+{
+    CU_pSuite suite = CU_add_suite("Select All Tests", init, cleanup);
+    if (suite == NULL)
+        return CU_get_error();
+
+    AddTest(suite, "select and read every ready channel", select_and_read_all);
+    AddTest(suite, "select all errors", select_all_errors);
+
+    return CUE_SUCCESS;
+}
@@ -0,0 +1,140 @@
+/*
+Tests for PI_SetSelectPolicy: which of several ready channels PI_Select and
+PI_TrySelect choose under the round-robin and least recently selected policies.
+*/
+#include "unittests.h"
+#include <unistd.h>
+
+#define N_WORKERS 3
+#define K 3		// messages from each worker on each bundle
+#define EARLY 1		// this worker's first least-recent message comes early
+
+static PI_PROCESS *workers[N_WORKERS];
+static PI_CHANNEL *rr_chan[N_WORKERS], *lrs_chan[N_WORKERS], *go[N_WORKERS];
+static PI_BUNDLE *rr_bundle, *lrs_bundle;
+static int config_errno;	// from PI_SetSelectPolicy with a bad policy
+
+static int worker_func(int q, void *p)
+{
+    int i, signal;
+
+    for (i = 0; i < K; i++)
+        PI_Write(rr_chan[q], "%d", i);
+
+    i = 0;
+    if (q == EARLY)
+        PI_Write(lrs_chan[q], "%d", i++);
+    PI_Read(go[q], "%d", &signal);
+    for (; i < K; i++)
+        PI_Write(lrs_chan[q], "%d", i);
+    return 0;
+}
+
+// returns when every channel has data, so all are ready at the next select
+static void wait_for_all(PI_CHANNEL *chans[])
+{
+    int i;
+
+    for (i = 0; i < N_WORKERS; i++)
+        while (!PI_ChannelHasData(chans[i]))
+            usleep(1000);
+}
+
+static void round_robin(void)
+{
+    int j, s, v;
+
+    wait_for_all(rr_chan);
+    PI_Errno = 0;
+    for (j = 0; j < N_WORKERS * K; j++) {
+        s = (j % 2) ? PI_TrySelect(rr_bundle) : PI_Select(rr_bundle);
+        CU_ASSERT_EQUAL(s, j % N_WORKERS);
+        if (s < 0)
+            break;
+        PI_Read(PI_GetBundleChannel(rr_bundle, s), "%d", &v);
+        CU_ASSERT_EQUAL(v, j / N_WORKERS);
+    }
+    CU_ASSERT_EQUAL(PI_TrySelect(rr_bundle), -1);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+}
+
+static void least_recent(void)
+{
+    static const int after_early[N_WORKERS] = { 0, 2, 1 };
+    int j, s, v;
+
+    PI_Errno = 0;
+    s = PI_Select(lrs_bundle);		// only EARLY has data yet
+    CU_ASSERT_EQUAL(s, EARLY);
+    PI_Read(PI_GetBundleChannel(lrs_bundle, s), "%d", &v);
+
+    for (j = 0; j < N_WORKERS; j++)
+        PI_Write(go[j], "%d", 0);
+    wait_for_all(lrs_chan);	// now all have, and EARLY was selected most recently
+    for (j = 0; j < N_WORKERS * K - 1; j++) {
+        s = PI_Select(lrs_bundle);
+        CU_ASSERT_EQUAL(s, after_early[j % N_WORKERS]);
+        PI_Read(PI_GetBundleChannel(lrs_bundle, s), "%d", &v);
+    }
+    CU_ASSERT_EQUAL(PI_TrySelect(lrs_bundle), -1);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+}
+
+static void policy_errors(void)
+{
+    CU_ASSERT_EQUAL(config_errno, PI_INVALID_ARG);
+
+    PI_Errno = 0;
+    PI_SetSelectPolicy(rr_bundle, PI_SELECT_ANY);
+    CU_ASSERT_EQUAL(PI_Errno, PI_WRONG_PHASE);
+}
+
+static int init(void)
+{
+    int i;
+    int argc = default_argc;
+    char** argv = default_argv;
+    PI_QuietMode = 1;
+    PI_OnErrorReturn = 1;
+
+    PI_Configure(&argc, &argv);
+
+    for (i = 0; i < N_WORKERS; i++) {
+        workers[i] = CreateAliasedProcess(worker_func, "worker", i, NULL);
+        rr_chan[i] = PI_CreateChannel(workers[i], PI_MAIN);
+        lrs_chan[i] = PI_CreateChannel(workers[i], PI_MAIN);
+        go[i] = PI_CreateChannel(PI_MAIN, workers[i]);
+    }
+    rr_bundle = PI_CreateBundle(PI_SELECT, rr_chan, N_WORKERS);
+    lrs_bundle = PI_CreateBundle(PI_SELECT, lrs_chan, N_WORKERS);
+    PI_SetSelectPolicy(rr_bundle, PI_SELECT_ROUND_ROBIN);
+    PI_SetSelectPolicy(lrs_bundle, PI_SELECT_LEAST_RECENT);
+
+    PI_Errno = 0;
+    PI_SetSelectPolicy(rr_bundle, PI_SELECT_LEAST_RECENT + 1);
+    config_errno = PI_Errno;
+    PI_Errno = 0;
+
+    PI_StartAll();
+    return 0;
+}
+
+static int cleanup(void)
+{
+    if (my_rank == 0)
+        PI_StopMain(0);
+    return 0;
+}
+
+CU_ErrorCode AddSelectPolicySuite(void)
+{
+    CU_pSuite suite = CU_add_suite("Select Policy Tests", init, cleanup);
+    if (suite == NULL)
+        return CU_get_error();
+
+    AddTest(suite, "round-robin selection", round_robin);
+    AddTest(suite, "least recently selected", least_recent);
+    AddTest(suite, "select policy errors", policy_errors);
+
+    return CUE_SUCCESS;
+}
@@ -0,0 +1,161 @@
+/*
+Tests for PI_SetSelectFormat: a selector whose reader keeps a receive posted
+for each channel, read with PI_Select/PI_Read, PI_SelectRead and PI_TrySelect,
+which take the channels with landed messages in turn.
+*/
+#include "unittests.h"
+
+#define N_WORKERS 3
+#define K 6		// messages from each worker
+
+static PI_PROCESS *workers[N_WORKERS];
+static PI_CHANNEL *from_worker[N_WORKERS], *other_from[N_WORKERS];
+static PI_BUNDLE *posted_sel, *other_sel;
+static int format_error, mode_error, retype_error;	// PI_Errno from the config phase
+
+static int worker_func(int q, void *p)
+{
+    int i;
+    double vals[3];
+
+    for (i = 0; i < K; i++) {
+        vals[0] = q;
+        vals[1] = i;
+        vals[2] = -1;
+        PI_Write(from_worker[q], "%d %3lf", 10 * q + i, vals);
+    }
+    return 0;
+}
+
+static void check(int s, int d, const double vals[], int next[])
+{
+    CU_ASSERT_EQUAL(d, 10 * s + next[s]);
+    CU_ASSERT_EQUAL(vals[0], s);
+    CU_ASSERT_EQUAL(vals[1], next[s]);
+    CU_ASSERT_EQUAL(vals[2], -1);
+    next[s]++;
+}
+
+static void posted_config_errors(void)
+{
+    // only fixed-size formats fit a posted receive
+    CU_ASSERT_EQUAL(format_error, PI_FORMAT_INVALID);
+    // nor can a posted channel aggregate its writes
+    CU_ASSERT_EQUAL(mode_error, PI_SEND_MODE);
+    // or take a format of its own
+    CU_ASSERT_EQUAL(retype_error, PI_BUNDLE_USAGE);
+}
+
+static void posted_select_and_read(void)
+{
+    int i, j, s, d, next[N_WORKERS] = { 0 }, turn = N_WORKERS - 1;
+    double vals[3];
+
+    PI_Errno = 0;
+    for (j = 0; j < N_WORKERS * K; j++) {
+        // once every worker with more to send has a message in, the next turn
+        // after the last channel selected is taken, low index or not
+        for (i = 0; i < N_WORKERS; i++)
+            while (next[i] < K && !PI_ChannelHasData(from_worker[i]))
+                ;
+        do
+            turn = (turn + 1) % N_WORKERS;
+        while (next[turn] == K);
+
+        if (j % 2 == 0) {
+            s = PI_Select(posted_sel);
+            CU_ASSERT(s >= 0 && s < N_WORKERS);
+            if (s < 0 || s >= N_WORKERS)
+                break;
+            CU_ASSERT_EQUAL(s, turn);
+            CU_ASSERT(PI_ChannelHasData(from_worker[s]));
+            PI_Read(from_worker[s], "%d %3lf", &d, vals);
+        }
+        else {
+            s = PI_SelectRead(posted_sel, "%d %3lf", &d, vals);
+            CU_ASSERT_EQUAL(s, turn);
+            CU_ASSERT(s >= 0 && s < N_WORKERS);
+            if (s < 0 || s >= N_WORKERS)
+                break;
+        }
+        check(s, d, vals, next);
+    }
+    for (s = 0; s < N_WORKERS; s++)
+        CU_ASSERT_EQUAL(next[s], K);
+    CU_ASSERT_EQUAL(PI_TrySelect(posted_sel), -1);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+}
+
+static void posted_errors(void)
+{
+    int d;
+    double vals[3];
+    PI_REQUEST *req;
+
+    // the posted receive is the only way in
+    PI_Errno = 0;
+    req = PI_IRead(from_worker[0], "%d %3lf", &d, vals);
+    CU_ASSERT_PTR_EQUAL(req, NULL);
+    CU_ASSERT_EQUAL(PI_Errno, PI_SEND_MODE);
+
+    PI_Errno = 0;
+    PI_Read(from_worker[0], "%d", &d);
+    CU_ASSERT_EQUAL(PI_Errno, PI_FORMAT_MISMATCH);
+}
+
+static int init(void)
+{
+    int i;
+    int argc = default_argc;
+    char** argv = default_argv;
+    PI_QuietMode = 1;
+    PI_OnErrorReturn = 1;
+
+    PI_Configure(&argc, &argv);
+
+    for (i = 0; i < N_WORKERS; i++) {
+        workers[i] = CreateAliasedProcess(worker_func, "worker", i, NULL);
+        from_worker[i] = PI_CreateChannel(workers[i], PI_MAIN);
+        other_from[i] = PI_CreateChannel(workers[i], PI_MAIN);
+    }
+    posted_sel = PI_CreateBundle(PI_SELECT, from_worker, N_WORKERS);
+    other_sel = PI_CreateBundle(PI_SELECT, other_from, N_WORKERS);
+
+    PI_SetSelectFormat(posted_sel, "%d %3lf");
+
+    PI_Errno = 0;
+    PI_SetSelectFormat(other_sel, "%d %^d");
+    format_error = PI_Errno;
+
+    PI_Errno = 0;
+    PI_SetChannelMode(from_worker[0], PI_SEND_AGGREGATE);
+    mode_error = PI_Errno;
+
+    PI_Errno = 0;
+    PI_SetChannelFormat(from_worker[1], "%d");
+    retype_error = PI_Errno;
+    PI_Errno = 0;
+
+    PI_StartAll();
+    return 0;
+}
+
+static int cleanup(void)
+{
+    if (my_rank == 0)
+        PI_StopMain(0);
+    return 0;
+}
+
+CU_ErrorCode AddSelectPostedSuite(void)
+{
+    CU_pSuite suite = CU_add_suite("Pre-posted Select Tests", init, cleanup);
+    if (suite == NULL)
+        return CU_get_error();
+
+    AddTest(suite, "pre-posted config errors", posted_config_errors);
+    AddTest(suite, "pre-posted select and read", posted_select_and_read);
+    AddTest(suite, "pre-posted errors", posted_errors);
+
+    return CUE_SUCCESS;
+}
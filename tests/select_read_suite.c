@@ -0,0 +1,127 @@
+/*
+Tests for PI_SelectRead: selecting a channel of a selector and reading the
+message found, for plain items and for variable-length arrays.
+*/
+#include "unittests.h"
+
+#define N_WORKERS 3
+#define K 4		// messages from each worker of each kind
+
+static PI_PROCESS *workers[N_WORKERS];
+static PI_CHANNEL *items_from[N_WORKERS], *arrays_from[N_WORKERS];
+static PI_BUNDLE *items_sel, *arrays_sel;
+
+static int worker_func(int q, void *p)
+{
+    int i, j, arr[K+1];
+    double vals[3];
+
+    for (i = 0; i < K; i++) {
+        vals[0] = q;
+        vals[1] = i;
+        vals[2] = -1;
+        PI_Write(items_from[q], "%d %3lf", 10 * q + i, vals);
+    }
+    for (i = 0; i < K; i++) {
+        for (j = 0; j <= i; j++)
+            arr[j] = 100 * q + j;
+        PI_Write(arrays_from[q], "%d %^d", i, i + 1, arr);
+    }
+    return 0;
+}
+
+static void select_read_errors(void)
+{
+    int d;
+
+    // a bad format is caught before any message is taken
+    PI_Errno = 0;
+    CU_ASSERT_EQUAL(PI_SelectRead(items_sel, "%q", &d), -1);
+    CU_ASSERT_EQUAL(PI_Errno, PI_FORMAT_INVALID);
+
+    PI_Errno = 0;
+    PI_SelectRead(NULL, "%d", &d);
+    CU_ASSERT_EQUAL(PI_Errno, PI_NULL_BUNDLE);
+}
+
+static void select_read_items(void)
+{
+    int j, s, d, next[N_WORKERS] = { 0 };
+    double vals[3];
+
+    PI_Errno = 0;
+    for (j = 0; j < N_WORKERS * K; j++) {
+        s = PI_SelectRead(items_sel, "%d %3lf", &d, vals);
+        CU_ASSERT(s >= 0 && s < N_WORKERS);
+        if (s < 0 || s >= N_WORKERS)
+            break;
+        CU_ASSERT_EQUAL(d, 10 * s + next[s]);
+        CU_ASSERT_EQUAL(vals[0], s);
+        CU_ASSERT_EQUAL(vals[1], next[s]);
+        next[s]++;
+    }
+    CU_ASSERT_EQUAL(PI_TrySelect(items_sel), -1);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+}
+
+static void select_read_arrays(void)
+{
+    int j, k, s, d, len, *arr, next[N_WORKERS] = { 0 };
+
+    PI_Errno = 0;
+    for (j = 0; j < N_WORKERS * K; j++) {
+        s = PI_SelectRead(arrays_sel, "%d %^d", &d, &len, &arr);
+        CU_ASSERT(s >= 0 && s < N_WORKERS);
+        if (s < 0 || s >= N_WORKERS)
+            break;
+        CU_ASSERT_EQUAL(d, next[s]);
+        CU_ASSERT_EQUAL(len, next[s] + 1);
+        for (k = 0; k < len; k++)
+            CU_ASSERT_EQUAL(arr[k], 100 * s + k);
+        next[s]++;
+    }
+    CU_ASSERT_EQUAL(PI_TrySelect(arrays_sel), -1);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+}
+
+static int init(void)
+{
+    int i;
+    int argc = default_argc;
+    char** argv = default_argv;
+    PI_QuietMode = 1;
+    PI_OnErrorReturn = 1;
+
+    PI_Configure(&argc, &argv);
+
+    for (i = 0; i < N_WORKERS; i++) {
+        workers[i] = CreateAliasedProcess(worker_func, "worker", i, NULL);
+        items_from[i] = PI_CreateChannel(workers[i], PI_MAIN);
+        arrays_from[i] = PI_CreateChannel(workers[i], PI_MAIN);
+    }
+    items_sel = PI_CreateBundle(PI_SELECT, items_from, N_WORKERS);
+    arrays_sel = PI_CreateBundle(PI_SELECT, arrays_from, N_WORKERS);
+
+    PI_StartAll();
+    return 0;
+}
+
+static int cleanup(void)
+{
+    if (my_rank == 0)
+        PI_StopMain(0);
+    return 0;
+}
+
+CU_ErrorCode AddSelectReadSuite(void)
+{
+    CU_pSuite suite = CU_add_suite("Select and Read Tests", init, cleanup);
+    if (suite == NULL)
+        return CU_get_error();
+
+    AddTest(suite, "select and read errors", select_read_errors);
+    AddTest(suite, "select and read items", select_read_items);
+    AddTest(suite, "select and read arrays", select_read_arrays);
+
+    return CUE_SUCCESS;
+}
@@ -0,0 +1,301 @@
+/*
+Tests for per-channel send modes set by PI_SetChannelMode: write-behind on a
+buffered channel, ready sends to a posted read, synchronous sends, small
+writes aggregated into batches, and writes through a shared-memory ring or an
+RMA buffer.
+*/
+#include "unittests.h"
+
+#define BIG_LEN 5000	// too big to be sent eagerly
+#define N_BEHIND 16	// 2 messages each, fits in the write-behind pool (see pilot_private.h)
+#define N_MORE 200	// overflows it, so writes wait for the oldest
+#define READY_LEN 100
+#define N_AGG 1000	// several batches' worth
+#define N_SHARED 500
+#define HUGE_LEN 50000	// bigger than a ring (see pilot_private.h)
+#define PULL_LEN 300000	// big enough for the reader to pull it
+
+static PI_PROCESS *sink_proc;
+static PI_CHANNEL *buffered, *go, *ready, *sync_chan, *aggregated, *shared, *rma, *reply;
+static PI_BUNDLE *agg_select, *shared_select, *rma_select;
+static int config_errno, bad_mode_errno;
+
+/* Reads what write_stream wrote, through a bundle of that channel alone, and
+   returns the count of good values */
+static int read_stream(PI_CHANNEL *chan, PI_BUNDLE *sel_bundle)
+{
+    int i, j, d, len, *arr, good = 0;
+    static int pulled[PULL_LEN];
+
+    for (i = 0; i < N_SHARED; i++) {
+        int sel = PI_Select(sel_bundle);
+        int has = PI_ChannelHasData(chan);
+        PI_Read(chan, "%d %^d", &d, &len, &arr);
+        int ok = sel == 0 && has && d == i && len == 1 + i % 11;
+        for (j = 0; ok && j < len; j++)
+            ok = arr[j] == i + j;
+        good += ok;
+        free(arr);
+    }
+    PI_Read(chan, "%^d", &len, &arr);
+    for (j = 0; j < len; j++)
+        good += arr[j] == j;
+    free(arr);
+    PI_Read(chan, "%d %*d", &d, PULL_LEN, pulled);
+    for (j = 0; j < PULL_LEN; j++)
+        good += pulled[j] == d + j;
+    return good;
+}
+
+static int sink_func(int q, void *p)
+{
+    int i, j, d, len, *arr, good = 0, big[READY_LEN];
+    PI_REQUEST *req;
+
+    // nothing is read until all the first writes have been made
+    PI_Read(go, "%d", &d);
+    for (i = 0; i < N_BEHIND + N_MORE; i++) {
+        PI_Read(buffered, "%d %^d", &d, &len, &arr);
+        int ok = d == i && len == (i < N_BEHIND ? BIG_LEN : 1 + i % 7);
+        for (j = 0; ok && j < len; j++)
+            ok = arr[j] == i + j;
+        good += ok;
+        free(arr);
+    }
+    PI_Write(reply, "%d", good);
+
+    // the read is posted before the writer is told to go ahead
+    req = PI_IRead(ready, "%d %100d", &d, big);
+    PI_Write(reply, "%d", 0);
+    PI_Wait(&req);
+    PI_Write(reply, "%d %100d", d, big);
+
+    PI_Read(sync_chan, "%d", &d);
+    PI_Write(reply, "%d", d);
+
+    // writes left in a batch are seen by PI_Select and PI_ChannelHasData
+    good = 0;
+    for (i = 0; i < N_AGG; i++) {
+        int sel = PI_Select(agg_select);
+        int has = PI_ChannelHasData(aggregated);
+        PI_Read(aggregated, "%d %^d", &d, &len, &arr);
+        int ok = sel == 0 && has && d == i && len == 1 + i % 3;
+        for (j = 0; ok && j < len; j++)
+            ok = arr[j] == i + j;
+        good += ok;
+        free(arr);
+    }
+    PI_Write(reply, "%d", good);
+
+    PI_Read(aggregated, "%d", &d);
+    PI_Read(aggregated, "%d", &len);
+    PI_Write(reply, "%d", d + len);
+
+    // shared and RMA channels look like any other
+    PI_Write(reply, "%d", read_stream(shared, shared_select));
+    PI_Write(reply, "%d", read_stream(rma, rma_select));
+    return 0;
+}
+
+/* Fills arr with n values from base */
+static void fill(int *arr, int n, int base)
+{
+    int j;
+
+    for (j = 0; j < n; j++)
+        arr[j] = base + j;
+}
+
+static void buffered_write_behind(void)
+{
+    int i, good, arr[BIG_LEN];
+
+    CU_ASSERT_EQUAL(config_errno, 0);
+
+    // with standard sends, the first write would wait for a reader that is
+    // waiting for "go"
+    PI_Errno = 0;
+    for (i = 0; i < N_BEHIND; i++) {
+        fill(arr, BIG_LEN, i);
+        PI_Write(buffered, "%d %^d", i, BIG_LEN, arr);
+        arr[0] = -1;		// the copy has already been taken
+    }
+    PI_Write(go, "%d", 1);
+
+    for (; i < N_BEHIND + N_MORE; i++) {
+        fill(arr, 1 + i % 7, i);
+        PI_Write(buffered, "%d %^d", i, 1 + i % 7, arr);
+    }
+    PI_Read(reply, "%d", &good);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+    CU_ASSERT_EQUAL(good, N_BEHIND + N_MORE);
+}
+
+static void ready_and_sync(void)
+{
+    int i, d, arr[READY_LEN], back[READY_LEN];
+
+    PI_Errno = 0;
+    PI_Read(reply, "%d", &d);	// read is posted
+    fill(arr, READY_LEN, 3);
+    PI_Write(ready, "%d %100d", 42, arr);
+    PI_Read(reply, "%d %100d", &d, back);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+    CU_ASSERT_EQUAL(d, 42);
+    for (i = 0; i < READY_LEN; i++)
+        CU_ASSERT_EQUAL(back[i], arr[i]);
+
+    PI_Write(sync_chan, "%d", 7);
+    PI_Read(reply, "%d", &d);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+    CU_ASSERT_EQUAL(d, 7);
+}
+
+static void aggregated_writes(void)
+{
+    int i, sum, arr[3];
+
+    // the read sends them
+    PI_Errno = 0;
+    for (i = 0; i < N_AGG; i++) {
+        fill(arr, 1 + i % 3, i);
+        PI_Write(aggregated, "%d %^d", i, 1 + i % 3, arr);
+    }
+    PI_Read(reply, "%d", &sum);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+    CU_ASSERT_EQUAL(sum, N_AGG);
+
+    PI_Write(aggregated, "%d", 20);
+    PI_Write(aggregated, "%d", 22);
+    PI_Flush(aggregated);
+    PI_Read(reply, "%d", &sum);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+    CU_ASSERT_EQUAL(sum, 42);
+}
+
+/* Writes small arrays, then ones bigger than a ring or RMA buffer, and checks
+   read_stream's count */
+static void write_stream(PI_CHANNEL *chan)
+{
+    static int arr[HUGE_LEN];	// level 3 checks won't take a big malloc'd block
+    static int big[PULL_LEN];
+    int i, good;
+
+    PI_Errno = 0;
+    for (i = 0; i < N_SHARED; i++) {
+        fill(arr, 1 + i % 11, i);
+        PI_Write(chan, "%d %^d", i, 1 + i % 11, arr);
+    }
+    fill(arr, HUGE_LEN, 0);
+    PI_Write(chan, "%^d", HUGE_LEN, arr);
+    fill(big, PULL_LEN, 9);
+    PI_Write(chan, "%d %*d", 9, PULL_LEN, big);
+    PI_Read(reply, "%d", &good);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+    CU_ASSERT_EQUAL(good, N_SHARED + HUGE_LEN + PULL_LEN);
+}
+
+static void shared_writes(void)
+{
+    write_stream(shared);
+}
+
+static void rma_writes(void)
+{
+    write_stream(rma);
+}
+
+static void send_mode_errors(void)
+{
+    int d;
+
+    CU_ASSERT_EQUAL(bad_mode_errno, PI_SEND_MODE);
+
+    PI_Errno = 0;
+    PI_SetChannelMode(go, PI_SEND_SYNC);
+    CU_ASSERT_EQUAL(PI_Errno, PI_WRONG_PHASE);
+
+    // aggregated writes can't be nonblocking
+    PI_Errno = 0;
+    CU_ASSERT(PI_IWrite(aggregated, "%d", 1) == NULL);
+    CU_ASSERT_EQUAL(PI_Errno, PI_SEND_MODE);
+    PI_Errno = 0;
+    CU_ASSERT(PI_BindWrite(aggregated, "%d", &d) == NULL);
+    CU_ASSERT_EQUAL(PI_Errno, PI_SEND_MODE);
+    PI_Errno = 0;
+    CU_ASSERT(PI_IWrite(shared, "%d", 1) == NULL);
+    CU_ASSERT_EQUAL(PI_Errno, PI_SEND_MODE);
+    PI_Errno = 0;
+    CU_ASSERT(PI_BindWrite(rma, "%d", &d) == NULL);
+    CU_ASSERT_EQUAL(PI_Errno, PI_SEND_MODE);
+
+    PI_Errno = 0;
+    PI_Flush(reply);
+    CU_ASSERT_EQUAL(PI_Errno, PI_ENDPOINT_WRITER);
+    PI_Errno = 0;
+    PI_Flush(NULL);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+}
+
+static int init(void)
+{
+    int argc = default_argc;
+    char** argv = default_argv;
+    PI_QuietMode = 1;
+    PI_OnErrorReturn = 1;
+
+    PI_Configure(&argc, &argv);
+
+    sink_proc = CreateAliasedProcess(sink_func, "sink", 0, NULL);
+    buffered = PI_CreateChannel(PI_MAIN, sink_proc);
+    go = PI_CreateChannel(PI_MAIN, sink_proc);
+    ready = PI_CreateChannel(PI_MAIN, sink_proc);
+    sync_chan = PI_CreateChannel(PI_MAIN, sink_proc);
+    aggregated = PI_CreateChannel(PI_MAIN, sink_proc);
+    agg_select = PI_CreateBundle(PI_SELECT, &aggregated, 1);
+    shared = PI_CreateChannel(PI_MAIN, sink_proc);
+    shared_select = PI_CreateBundle(PI_SELECT, &shared, 1);
+    rma = PI_CreateChannel(PI_MAIN, sink_proc);
+    rma_select = PI_CreateBundle(PI_SELECT, &rma, 1);
+    reply = PI_CreateChannel(sink_proc, PI_MAIN);
+
+    PI_Errno = 0;
+    PI_SetChannelMode(buffered, PI_SEND_BUFFERED);
+    PI_SetChannelMode(ready, PI_SEND_READY);
+    PI_SetChannelMode(sync_chan, PI_SEND_SYNC);
+    PI_SetChannelMode(aggregated, PI_SEND_AGGREGATE);
+    PI_SetChannelMode(shared, PI_SEND_SHARED);
+    PI_SetChannelMode(rma, PI_SEND_RMA);
+    config_errno = PI_Errno;
+
+    PI_Errno = 0;
+    PI_SetChannelMode(go, (enum PI_SENDMODE)99);
+    bad_mode_errno = PI_Errno;
+    PI_Errno = 0;
+
+    PI_StartAll();
+    return 0;
+}
+
+static int cleanup(void)
+{
+    if (my_rank == 0)
+        PI_StopMain(0);
+    return 0;
+}
+
+CU_ErrorCode AddSendModeSuite(void)
+{
+    CU_pSuite suite = CU_add_suite("Send Mode Tests", init, cleanup);
+    if (suite == NULL)
+        return CU_get_error();
+
+    AddTest(suite, "buffered channel writes behind", buffered_write_behind);
+    AddTest(suite, "ready and synchronous channels", ready_and_sync);
+    AddTest(suite, "aggregating channel batches small writes", aggregated_writes);
+    AddTest(suite, "shared channel writes through a ring", shared_writes);
+    AddTest(suite, "RMA channel writes through the reader's window", rma_writes);
+    AddTest(suite, "send mode errors", send_mode_errors);
+
+    return CUE_SUCCESS;
+}
@@ -0,0 +1,190 @@
+/*
+Tests for PI_WriteStream and PI_ReadStream: arrays sent as segments, received
+into the caller's array or into reused buffers, with a callback per segment,
+and behind a PI_IRead still waiting for its "^" array.
+*/
+#include "unittests.h"
+
+#define STREAM_LEN 1000003	// not a multiple of the segment length
+#define SEGMENT 65536
+
+static PI_PROCESS *worker_proc;
+static PI_CHANNEL *to_worker, *from_worker;
+static PI_CHANNEL *typed, *ready;	// modes streams can't use
+
+static double sent[STREAM_LEN], back[STREAM_LEN];	// too big for the stack
+
+/* What the callback saw */
+struct tally {
+    size_t next;	// first element expected in the next segment
+    int segments;
+    int good;		// elements with the expected value
+};
+
+static void count_segment(void *ctx, const void *segment, size_t first, size_t count)
+{
+    struct tally *t = ctx;
+    const double *d = segment;
+    size_t i;
+
+    if (first != t->next) return;	// out of order: good stays short
+    for (i = 0; i < count; i++)
+        t->good += d[i] == (double)(first + i);
+    t->next += count;
+    t->segments++;
+}
+
+static int worker_func(int q, void *p)
+{
+    static double arr[STREAM_LEN];
+    struct tally whole = {0, 0, 0}, reused = {0, 0, 0}, queued = {0, 0, 0};
+    size_t got, empty;
+    PI_REQUEST *req;
+    int len, *vals, vals_good = 0, i, typed_errno;
+
+    // into our array, with the callback, then with no array at all
+    got = PI_ReadStream(to_worker, PI_ITEM_DOUBLE, arr, STREAM_LEN, count_segment, &whole);
+    PI_ReadStream(to_worker, PI_ITEM_DOUBLE, NULL, 0, count_segment, &reused);
+    empty = PI_ReadStream(to_worker, PI_ITEM_DOUBLE, NULL, 0, count_segment, &reused);
+    PI_Write(from_worker, "%d %d %d %d %d %d", (int)got, whole.good, whole.segments,
+             reused.good, reused.segments, (int)empty);
+
+    // and back again, in default segments
+    PI_WriteStream(from_worker, PI_ITEM_DOUBLE, arr, STREAM_LEN, 0);
+
+    // the stream follows the deferred array of an outstanding PI_IRead
+    req = PI_IRead(to_worker, "%^d", &len, &vals);
+    PI_ReadStream(to_worker, PI_ITEM_DOUBLE, NULL, 0, count_segment, &queued);
+    PI_Wait(&req);
+    for (i = 0; i < len; i++)
+        vals_good += vals[i] == i;
+    PI_ReleaseBuffer(vals);
+
+    // a typed channel is refused at the read end too
+    PI_Errno = 0;
+    PI_ReadStream(typed, PI_ITEM_DOUBLE, arr, STREAM_LEN, NULL, NULL);
+    typed_errno = PI_Errno;
+    PI_Write(from_worker, "%d %d %d %d", len, vals_good, queued.good, typed_errno);
+    return 0;
+}
+
+static void stream_both_ways(void)
+{
+    int i, got, whole_good, whole_segs, reused_good, reused_segs, empty;
+    size_t back_len;
+
+    for (i = 0; i < STREAM_LEN; i++)
+        sent[i] = i;
+
+    PI_Errno = 0;
+    PI_WriteStream(to_worker, PI_ITEM_DOUBLE, sent, STREAM_LEN, SEGMENT);
+    PI_WriteStream(to_worker, PI_ITEM_DOUBLE, sent, STREAM_LEN, SEGMENT);
+    PI_WriteStream(to_worker, PI_ITEM_DOUBLE, NULL, 0, 0);
+    PI_Read(from_worker, "%d %d %d %d %d %d", &got, &whole_good, &whole_segs,
+            &reused_good, &reused_segs, &empty);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+    CU_ASSERT_EQUAL(got, STREAM_LEN);
+    CU_ASSERT_EQUAL(whole_good, STREAM_LEN);
+    CU_ASSERT_EQUAL(whole_segs, (STREAM_LEN + SEGMENT - 1) / SEGMENT);
+    CU_ASSERT_EQUAL(reused_good, STREAM_LEN);
+    CU_ASSERT_EQUAL(reused_segs, whole_segs);
+    CU_ASSERT_EQUAL(empty, 0);
+
+    back_len = PI_ReadStream(from_worker, PI_ITEM_DOUBLE, back, STREAM_LEN, NULL, NULL);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+    CU_ASSERT_EQUAL(back_len, STREAM_LEN);
+    for (i = 0; i < STREAM_LEN && back[i] == sent[i]; i++)
+        ;
+    CU_ASSERT_EQUAL(i, STREAM_LEN);
+}
+
+static void stream_after_iread(void)
+{
+    int vals[100], len, vals_good, queued_good, typed_errno, i;
+
+    for (i = 0; i < 100; i++)
+        vals[i] = i;
+
+    PI_Errno = 0;
+    PI_Write(to_worker, "%^d", 100, vals);
+    PI_WriteStream(to_worker, PI_ITEM_DOUBLE, sent, STREAM_LEN, SEGMENT);
+    PI_Read(from_worker, "%d %d %d %d", &len, &vals_good, &queued_good, &typed_errno);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+    CU_ASSERT_EQUAL(len, 100);
+    CU_ASSERT_EQUAL(vals_good, 100);
+    CU_ASSERT_EQUAL(queued_good, STREAM_LEN);
+    CU_ASSERT_EQUAL(typed_errno, PI_FORMAT_MISMATCH);
+}
+
+static void stream_errors(void)
+{
+    PI_Errno = 0;
+    PI_WriteStream(from_worker, PI_ITEM_DOUBLE, sent, 1, 0);
+    CU_ASSERT_EQUAL(PI_Errno, PI_ENDPOINT_WRITER);
+
+    PI_Errno = 0;
+    PI_WriteStream(to_worker, PI_ITEM_DOUBLE, NULL, 1, 0);
+    CU_ASSERT_EQUAL(PI_Errno, PI_FORMAT_ARGS);
+
+    PI_Errno = 0;
+    PI_WriteStream(to_worker, (PI_ITEMTYPE)99, sent, 1, 0);
+    CU_ASSERT_EQUAL(PI_Errno, PI_FORMAT_INVALID);
+
+    PI_Errno = 0;
+    PI_ReadStream(to_worker, PI_ITEM_DOUBLE, back, 1, NULL, NULL);
+    CU_ASSERT_EQUAL(PI_Errno, PI_ENDPOINT_READER);
+
+    PI_Errno = 0;
+    PI_WriteStream(typed, PI_ITEM_DOUBLE, sent, 1, 0);
+    CU_ASSERT_EQUAL(PI_Errno, PI_FORMAT_MISMATCH);
+
+    PI_Errno = 0;
+    PI_WriteStream(ready, PI_ITEM_DOUBLE, sent, 1, 0);
+    CU_ASSERT_EQUAL(PI_Errno, PI_SEND_MODE);
+
+    // nowhere for the elements to go
+    PI_Errno = 0;
+    PI_ReadStream(from_worker, PI_ITEM_DOUBLE, NULL, 0, NULL, NULL);
+    CU_ASSERT_EQUAL(PI_Errno, PI_FORMAT_ARGS);
+}
+
+static int init(void)
+{
+    int argc = default_argc;
+    char** argv = default_argv;
+    PI_QuietMode = 1;
+    PI_OnErrorReturn = 1;
+
+    PI_Configure(&argc, &argv);
+
+    worker_proc = CreateAliasedProcess(worker_func, "worker", 0, NULL);
+    to_worker = PI_CreateChannel(PI_MAIN, worker_proc);
+    from_worker = PI_CreateChannel(worker_proc, PI_MAIN);
+    typed = PI_CreateChannel(PI_MAIN, worker_proc);
+    PI_SetChannelFormat(typed, "%d");
+    ready = PI_CreateChannel(PI_MAIN, worker_proc);
+    PI_SetChannelMode(ready, PI_SEND_READY);
+
+    PI_StartAll();
+    return 0;
+}
+
+static int cleanup(void)
+{
+    if (my_rank == 0)
+        PI_StopMain(0);
+    return 0;
+}
+
+CU_ErrorCode AddStreamSuite(void)
+{
+    CU_pSuite suite = CU_add_suite("Stream Tests", init, cleanup);
+    if (suite == NULL)
+        return CU_get_error();
+
+    AddTest(suite, "arrays streamed both ways", stream_both_ways);
+    AddTest(suite, "stream behind a queued PI_IRead", stream_after_iread);
+    AddTest(suite, "stream errors", stream_errors);
+
+    return CUE_SUCCESS;
+}
@@ -0,0 +1,130 @@
+/*
+Tests for strided arrays "%num:stride" and "%num:stride:block": matrix columns
+and tiles echoed by a process that reads and writes them as plain arrays.
+*/
+#include "unittests.h"
+
+#define ROUNDS 3	// echoes done by the worker
+
+PI_PROCESS *strided_proc;
+PI_CHANNEL *to_strided, *from_strided;
+
+static int array_echo(int q,void *p) {
+
+    int temp[20];
+    int i;
+
+    for (i = 0; i < ROUNDS; i++) {
+        PI_Read(to_strided,"%20d",temp);
+        PI_Write(from_strided,"%20d",temp);
+    }
+    return 0;
+}
+
+// echo the 1st column of a 20x3 matrix into its 3rd column
+static void strided_column(void) {
+
+    int m[20][3];
+    int i;
+
+    for (i = 0; i < 20; i++) {
+        m[i][0] = i * 7;
+        m[i][1] = -1;
+        m[i][2] = -1;
+    }
+
+    PI_Write(to_strided,"%20:3d",&m[0][0]);
+    PI_Read(from_strided,"%20:3d",&m[0][2]);
+
+    for (i = 0; i < 20; i++) {
+        CU_ASSERT_EQUAL(m[i][2], m[i][0]);
+        CU_ASSERT_EQUAL(m[i][1], -1);
+    }
+}
+
+// echo a 10x2 tile into the bottom right corner of a 20x3 matrix
+static void strided_tile(void) {
+
+    int m[20][3];
+    int i;
+
+    for (i = 0; i < 20; i++) {
+        m[i][0] = i * 7;
+        m[i][1] = i * 7 + 1;
+        m[i][2] = -1;
+    }
+
+    PI_Write(to_strided,"%10:3:2d",&m[0][0]);
+    PI_Read(from_strided,"%10:3:2d",&m[10][1]);
+
+    for (i = 0; i < 10; i++) {
+        CU_ASSERT_EQUAL(m[10+i][1], m[i][0]);
+        CU_ASSERT_EQUAL(m[10+i][2], m[i][1]);
+    }
+}
+
+static void strided_errors(void) {
+
+    int a[40], back[20];
+    int i, n = 20;
+
+    for (i = 0; i < 40; i++)
+        a[i] = i;
+
+    // block cannot exceed stride, and reductions cannot be strided
+    PI_Errno = 0;
+    PI_Write(to_strided,"%2:3:4d",a);
+    CU_ASSERT_EQUAL(PI_Errno, PI_ARRAY_LENGTH);
+    PI_Errno = 0;
+    PI_Write(to_strided,"%+/2:3d",a);
+    CU_ASSERT_EQUAL(PI_Errno, PI_FORMAT_INVALID);
+
+    // nor can the length be given twice; the rejected format must not leave
+    // anything behind for the next format compiled to trip over
+    PI_Errno = 0;
+    PI_Write(to_strided,"%2:3*d",n,a);
+    CU_ASSERT_EQUAL(PI_Errno, PI_ARRAY_LENGTH);
+    PI_Errno = 0;
+    PI_Write(to_strided,"%20:2d",a);
+    PI_Read(from_strided,"%20d",back);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+    for (i = 0; i < 20; i++)
+        CU_ASSERT_EQUAL(back[i], 2 * i);
+}
+
+static int init(void)
+{
+    int argc = default_argc;
+    char** argv = default_argv;
+    PI_QuietMode = 1;
+    PI_OnErrorReturn = 1;
+
+    PI_Configure(&argc, &argv);
+
+    strided_proc = CreateAliasedProcess(array_echo,"strided",0,NULL);
+    to_strided = PI_CreateChannel(PI_MAIN,strided_proc);
+    from_strided = PI_CreateChannel(strided_proc,PI_MAIN);
+
+    PI_StartAll();
+    return 0;
+}
+
+static int cleanup(void)
+{
+    if (my_rank == 0)
+        PI_StopMain(0);
+    return 0;
+}
+
+CU_ErrorCode AddStridedSuite(void)
+{
+    CU_pSuite suite = CU_add_suite("Strided Array Tests", init, cleanup);
+    if (suite == NULL)
+        return CU_get_error();
+
+    AddTest(suite, "strided column send/echo", strided_column);
+    AddTest(suite, "strided tile send/echo", strided_tile);
+    AddTest(suite, "strided array errors", strided_errors);
+
+    return CUE_SUCCESS;
+}
@@ -0,0 +1,215 @@
+/*
+Tests for PI_ReadTimeout and PI_SelectTimeout: waits that time out while a
+worker holds back, and waits that end when its writes come.  A second suite
+configures with -piwait, so that blocking reads and selects poll, and has the
+workers answer late enough that the waits back off to sleeping.
+*/
+#include "unittests.h"
+#include <unistd.h>
+
+#define N_WORKERS 2
+#define WAIT 0.05	// seconds that waits expected to time out are given
+#define LATE 20000	// usec. that the -piwait workers hold back each answer
+#define LATE_ROUNDS 3	// answers each late worker gives
+
+static PI_PROCESS *workers[N_WORKERS];
+static PI_CHANNEL *to_worker[N_WORKERS], *from_worker[N_WORKERS];
+static PI_BUNDLE *sel;
+
+static int worker_func(int q, void *p)
+{
+    int go;
+
+    PI_Read(to_worker[q], "%d", &go);
+    PI_Write(from_worker[q], "%d", 10 * q + go);
+    return 0;
+}
+
+/* Answers LATE_ROUNDS requests, each after a pause */
+static int late_worker_func(int q, void *p)
+{
+    int i, go;
+
+    for (i = 0; i < LATE_ROUNDS; i++) {
+        PI_Read(to_worker[q], "%d", &go);
+        usleep(LATE);
+        PI_Write(from_worker[q], "%d", 10 * q + go);
+    }
+    return 0;
+}
+
+static void timeout_expires(void)
+{
+    int d = -1;
+    double start;
+
+    PI_Errno = 0;
+    start = MPI_Wtime();
+    CU_ASSERT_EQUAL(PI_ReadTimeout(from_worker[0], WAIT, "%d", &d), 0);
+    CU_ASSERT(MPI_Wtime() - start >= WAIT);
+    CU_ASSERT_EQUAL(d, -1);		// untouched
+
+    start = MPI_Wtime();
+    CU_ASSERT_EQUAL(PI_SelectTimeout(sel, WAIT), -1);
+    CU_ASSERT(MPI_Wtime() - start >= WAIT);
+
+    // no time at all just checks
+    CU_ASSERT_EQUAL(PI_ReadTimeout(from_worker[1], 0.0, "%d", &d), 0);
+    CU_ASSERT_EQUAL(PI_SelectTimeout(sel, 0.0), -1);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+}
+
+static void timeout_satisfied(void)
+{
+    int d = -1, s;
+
+    PI_Errno = 0;
+    PI_Write(to_worker[0], "%d", 1);
+    CU_ASSERT_EQUAL(PI_ReadTimeout(from_worker[0], -1.0, "%d", &d), 1);
+    CU_ASSERT_EQUAL(d, 1);
+
+    PI_Write(to_worker[1], "%d", 2);
+    s = PI_SelectTimeout(sel, 60.0);
+    CU_ASSERT_EQUAL(s, 1);
+    if (s == 1) {
+        PI_Read(from_worker[1], "%d", &d);
+        CU_ASSERT_EQUAL(d, 12);
+    }
+    CU_ASSERT_EQUAL(PI_SelectTimeout(sel, 0.0), -1);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+}
+
+static void timeout_errors(void)
+{
+    int d;
+
+    PI_Errno = 0;
+    PI_ReadTimeout(to_worker[0], 0.0, "%d", &d);
+    CU_ASSERT_EQUAL(PI_Errno, PI_ENDPOINT_READER);
+
+    PI_Errno = 0;
+    CU_ASSERT_EQUAL(PI_SelectTimeout(NULL, 0.0), -1);
+    CU_ASSERT_EQUAL(PI_Errno, PI_NULL_BUNDLE);
+}
+
+/* Each of the blocking waits polls until the late answer comes */
+static void polled_waits(void)
+{
+    int d = -1, s;
+    double start;
+
+    PI_Errno = 0;
+    start = MPI_Wtime();
+    PI_Write(to_worker[0], "%d", 1);
+    PI_Read(from_worker[0], "%d", &d);
+    CU_ASSERT_EQUAL(d, 1);
+    CU_ASSERT(MPI_Wtime() - start >= LATE / 1e6);
+
+    // a negative timeout blocks as PI_Read does
+    PI_Write(to_worker[0], "%d", 2);
+    CU_ASSERT_EQUAL(PI_ReadTimeout(from_worker[0], -1.0, "%d", &d), 1);
+    CU_ASSERT_EQUAL(d, 2);
+
+    // a limited wait polls with the -piwait backoff
+    PI_Write(to_worker[0], "%d", 3);
+    CU_ASSERT_EQUAL(PI_ReadTimeout(from_worker[0], 60.0, "%d", &d), 1);
+    CU_ASSERT_EQUAL(d, 3);
+
+    // and likewise for selects
+    PI_Write(to_worker[1], "%d", 4);
+    s = PI_Select(sel);
+    CU_ASSERT_EQUAL(s, 1);
+    PI_Read(from_worker[1], "%d", &d);
+    CU_ASSERT_EQUAL(d, 14);
+
+    PI_Write(to_worker[1], "%d", 5);
+    s = PI_SelectTimeout(sel, -1.0);
+    CU_ASSERT_EQUAL(s, 1);
+    PI_Read(from_worker[1], "%d", &d);
+    CU_ASSERT_EQUAL(d, 15);
+
+    PI_Write(to_worker[1], "%d", 6);
+    s = PI_SelectTimeout(sel, 60.0);
+    CU_ASSERT_EQUAL(s, 1);
+    PI_Read(from_worker[1], "%d", &d);
+    CU_ASSERT_EQUAL(d, 16);
+    CU_ASSERT_EQUAL(PI_Errno, 0);
+}
+
+static int init(void)
+{
+    int i;
+    int argc = default_argc;
+    char** argv = default_argv;
+    PI_QuietMode = 1;
+    PI_OnErrorReturn = 1;
+
+    PI_Configure(&argc, &argv);
+
+    for (i = 0; i < N_WORKERS; i++) {
+        workers[i] = CreateAliasedProcess(worker_func, "worker", i, NULL);
+        to_worker[i] = PI_CreateChannel(PI_MAIN, workers[i]);
+        from_worker[i] = PI_CreateChannel(workers[i], PI_MAIN);
+    }
+    sel = PI_CreateBundle(PI_SELECT, from_worker, N_WORKERS);
+
+    PI_StartAll();
+    return 0;
+}
+
+static int init_polled(void)
+{
+    int i, argc = default_argc + 1;
+    char *argv_[argc + 1];
+    char **argv = argv_;
+    PI_QuietMode = 1;
+    PI_OnErrorReturn = 1;
+
+    // short spin, so the late answers are waited for by sleeping
+    for (i = 0; i < default_argc; i++) argv_[i] = default_argv[i];
+    argv_[default_argc] = "-piwait=100,500";
+    argv_[argc] = NULL;
+
+    PI_Configure(&argc, &argv);
+
+    for (i = 0; i < N_WORKERS; i++) {
+        workers[i] = CreateAliasedProcess(late_worker_func, "late", i, NULL);
+        to_worker[i] = PI_CreateChannel(PI_MAIN, workers[i]);
+        from_worker[i] = PI_CreateChannel(workers[i], PI_MAIN);
+    }
+    sel = PI_CreateBundle(PI_SELECT, from_worker, N_WORKERS);
+
+    PI_StartAll();
+    return 0;
+}
+
+static int cleanup(void)
+{
+    if (my_rank == 0)
+        PI_StopMain(0);
+    return 0;
+}
+
+CU_ErrorCode AddTimeoutSuite(void)
+{
+    CU_pSuite suite = CU_add_suite("Timeout Tests", init, cleanup);
+    if (suite == NULL)
+        return CU_get_error();
+
+    AddTest(suite, "waits that time out", timeout_expires);
+    AddTest(suite, "waits that are satisfied", timeout_satisfied);
+    AddTest(suite, "timeout errors", timeout_errors);
+
+    return CUE_SUCCESS;
+}
+
+CU_ErrorCode AddPolledWaitSuite(void)
+{
+    CU_pSuite suite = CU_add_suite("Polled Wait Tests", init_polled, cleanup);
+    if (suite == NULL)
+        return CU_get_error();
+
+    AddTest(suite, "blocking waits polled under -piwait", polled_waits);
+
+    return CUE_SUCCESS;
+}
@@ -7,6 +7,10 @@
 #include <stdlib.h>
 #include <mpi.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 typedef CU_ErrorCode (*SuiteRegisterFunc)(void);
 
 /*== Global variables ==*/
@@ -35,6 +39,26 @@ CU_ErrorCode AddReducerSuite(void);
 CU_ErrorCode AddExtraReadWriteSuite(void);
 CU_ErrorCode AddFormatSuite(void);
 CU_ErrorCode AddConfigSuite(void);
+CU_ErrorCode AddMsgOptionsSuite(void);
+CU_ErrorCode AddBufferSuite(void);
+CU_ErrorCode AddRecordSuite(void);
+CU_ErrorCode AddItemsSuite(void);
+CU_ErrorCode AddCppBindingSuite(void);
+CU_ErrorCode AddChannelFormatSuite(void);
+CU_ErrorCode AddNonblockingSuite(void);
+CU_ErrorCode AddSendModeSuite(void);
+CU_ErrorCode AddStreamSuite(void);
+CU_ErrorCode AddMultiSuite(void);
+CU_ErrorCode AddSelectPolicySuite(void);
+CU_ErrorCode AddSelectAllSuite(void);
+CU_ErrorCode AddSelectReadSuite(void);
+CU_ErrorCode AddSelectPostedSuite(void);
+CU_ErrorCode AddTimeoutSuite(void);
+CU_ErrorCode AddPolledWaitSuite(void);
+CU_ErrorCode AddStridedSuite(void);
 
+#ifdef __cplusplus
+}
+#endif
 
 #endif /* UNITTESTS_H */
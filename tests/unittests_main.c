@@ -30,6 +30,23 @@ int my_rank;
 static SuiteRegisterFunc suites[] = {
     AddInitSuite,
     AddSingleRWSuite,
+    AddMsgOptionsSuite,
+    AddBufferSuite,
+    AddRecordSuite,
+    AddItemsSuite,
+    AddCppBindingSuite,
+    AddChannelFormatSuite,
+    AddNonblockingSuite,
+    AddSendModeSuite,
+    AddStreamSuite,
+    AddMultiSuite,
+    AddSelectPolicySuite,
+    AddSelectAllSuite,
+    AddSelectReadSuite,
+    AddSelectPostedSuite,
+    AddTimeoutSuite,
+    AddPolledWaitSuite,
+    AddStridedSuite,
     AddArrayRWSuite,
     AddMixedValueSuite,
     AddSelectorSuite,